@@ -92,6 +92,8 @@ namespace rhi
             uint32		VarBindingPoint;
             uint32		VarCount;
             
+            Attribute() K3D_NOEXCEPT : VarSemantic(ESemantic::ENumSemanics), VarType(EDataType::EUnknown), VarLocation(0), VarBindingPoint(0), VarCount(0) {}
+            
             Attribute(const String& name, ESemantic semantic, EDataType dataType, uint32 location, uint32 bindingPoint, uint32 varCount)
             : VarName(name), VarSemantic(semantic), VarType(dataType), VarLocation(location), VarBindingPoint(bindingPoint), VarCount(varCount)
             {}
@@ -210,13 +212,13 @@ namespace rhi
             
             BindingTable& AddBinding(Binding && binding)
             {
-                this->Bindings.Append(binding);
+                this->Bindings.Append(::k3d::Move(binding));
                 return *this;
             }
             
             BindingTable& AddUniform(Uniform && uniform)
             {
-                this->Uniforms.Append(uniform);
+                this->Uniforms.Append(::k3d::Move(uniform));
                 return *this;
             }
             
@@ -245,7 +247,7 @@ if (!a.Member.empty()) {\
 result.Member.AddAll(a.Member);\
 if (!b.Member.empty())\
 {\
-for (auto ele : b.Member)\
+for (auto const& ele : b.Member)\
 {\
 if (!a.Member.Contains(ele))\
 {\
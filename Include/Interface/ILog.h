@@ -2,6 +2,8 @@
 #ifndef __ILog_h__
 #define __ILog_h__
 
+#include "../Config/PlatformTypes.h"
+
 namespace k3d
 {
 	enum class ELogLevel
@@ -15,11 +17,23 @@ namespace k3d
 		Profile
 	};
 
+	/// Where and when a record was logged
+	struct LogSource
+	{
+		const char *	Thread;
+		/// Wall clock, microseconds since the epoch
+		uint64			Time;
+	};
+
 	class ILogger
 	{
 	public:
 		virtual ~ILogger() {}
 		virtual void Log(ELogLevel const &, const char * tag, const char *) = 0;
+		/// Records formatted on the log thread, logged earlier by source.Thread
+		virtual void Log(ELogLevel const & lv, const char * tag, const char * msg, LogSource const &) { Log(lv, tag, msg); }
+		/// Ends a batch of records
+		virtual void Flush() {}
 	};
 }
 
@@ -49,4 +49,77 @@ K3D_COMMON_NS
 		const char* get_name() const { return "kAllocator"; }
 		void set_name(const char*) {}
 	};
+
+	/// SizeClassStats
+	/// Counters of one size class of the pooled __k3d_malloc__.
+	/// Allocs and Frees are flushed from the thread caches in batches,
+	/// so they lag behind a little.
+	struct SizeClassStats
+	{
+		uint32	ObjectSize;
+		uint64	Allocs;
+		uint64	Frees;
+		uint64	SpanBytes;
+		uint64	DepotObjects;
+	};
+
+	/// PoolAllocator
+	/// Backend of __k3d_malloc__/__k3d_free__. Requests up to MaxSmallSize are
+	/// served from size-class slabs through thread-local caches backed by a
+	/// central depot, larger requests go to the system heap.
+	/// __k3d_free__ trusts a non zero size to find the size class, pass 0
+	/// when the allocation size is not known.
+	class K3D_API PoolAllocator
+	{
+	public:
+		static const size_t MaxSmallSize = 32768;
+
+		static uint32	GetSizeClassCount();
+		static bool		GetStats(uint32 sizeClass, SizeClassStats & stats);
+		static uint64	GetLargeAllocCount();
+		static uint64	GetLargeFreeCount();
+		/// Return the blocks cached by the calling thread to the depot
+		static void		FlushThreadCache();
+	};
+
+	/// FrameArena
+	/// Per-thread linear scratch memory, one buffer per frame in flight.
+	/// Memory handed out during frame N stays valid until frame N+FramesInFlight
+	/// begins, it is never freed individually, the buffer is rewound instead.
+	class K3D_API FrameArena
+	{
+	public:
+		static const uint32 FramesInFlight = 3;
+
+		static void*	Allocate(size_t size, size_t alignment = 16);
+		/// Called once per frame by the main loop, advances the frame index
+		static void		EndFrame();
+		static uint64	FrameIndex();
+		/// Bytes handed out by the calling thread in the current frame
+		static uint64	BytesUsed();
+		/// Bytes reserved by the calling thread over all buffers
+		static uint64	BytesReserved();
+	};
+
+	/// FrameAllocator
+	/// kAllocator compatible allocator for transient containers, deallocate is no-op.
+	/// e.g. DynArray<T, FrameAllocator>, StringBase<char, FrameAllocator>
+	class FrameAllocator
+	{
+	public:
+		FrameAllocator(const char* = nullptr) {}
+		FrameAllocator(const FrameAllocator&) {}
+		FrameAllocator(const FrameAllocator&, const char*) {}
+		FrameAllocator& operator=(const FrameAllocator&) { return *this; }
+		bool operator==(const FrameAllocator&) { return true; }
+		bool operator!=(const FrameAllocator&) { return false; }
+		void* allocate(size_t n, int /*flags = 0*/) { return FrameArena::Allocate(n); }
+		void* allocate(size_t n, size_t alignment, size_t /*alignmentOffset*/, int /*flags = 0*/)
+		{
+			return FrameArena::Allocate(n, alignment);
+		}
+		void deallocate(void*, size_t) {}
+		const char* get_name() const { return "FrameAllocator"; }
+		void set_name(const char*) {}
+	};
 }
@@ -1,50 +1,212 @@
 #pragma once
 #include <Interface/IIODevice.h>
 #include <type_traits>
+#include <string.h>
 
 K3D_COMMON_NS
 {
+    /// Archive
+    /// Serializes fields through an IIODevice. Subclasses may give the
+    /// archive a window of memory (a write buffer, a mapped file), fields
+    /// are copied in and out of it inline and the device is only called
+    /// once the window is exhausted.
     class K3D_API Archive {
     public:
-        Archive() : Handler(nullptr) {}
+        Archive()
+            : Handler(nullptr)
+            , ReadCursor(nullptr), ReadLimit(nullptr)
+            , WriteCursor(nullptr), WriteLimit(nullptr) {}
         virtual ~Archive() {}
-        
+
         void SetIODevice(IIODevice * ioHandler) {
             Handler = ioHandler;
         }
-        
+
         template <typename T>
         Archive & operator >> (T & data) {
-            assert(std::is_pointer<T>::value != true && "cannot be serialize, not a pod class!!");
-            Handler->Read((char*)&data, sizeof(T));
+            static_assert(!std::is_pointer<T>::value, "cannot be serialize, not a pod class!!");
+            ReadBytes(&data, sizeof(T));
             return *this;
         }
-        
+
         template <typename T>
-        Archive & operator << (const T data) {
-            assert(std::is_pointer<T>::value != true && "cannot be serialize, not a pod class!!");
-            Handler->Write((kByte*)&data, sizeof(T));
+        Archive & operator << (T const & data) {
+            static_assert(!std::is_pointer<T>::value, "cannot be serialize, not a pod class!!");
+            WriteBytes(&data, sizeof(T));
             return *this;
         }
-        
+
         template <typename T>
-        void ArrayIn(T *dataArray, size_t elemCount) {
-            assert(std::is_pointer<T>::value != true && "ArrayIn Error: not a pod class");
-            Handler->Write((kByte*)dataArray, elemCount*sizeof(T));
+        void ArrayIn(const T *dataArray, size_t elemCount) {
+            static_assert(!std::is_pointer<T>::value, "ArrayIn Error: not a pod class");
+            WriteBytes(dataArray, elemCount*sizeof(T));
         }
-        
+
         template <typename T>
         void ArrayOut(T *dataArray, size_t elemCount) {
-            assert(std::is_pointer<T>::value != true && "ArrayOut Error: not a pod class");
-            Handler->Read((char*)dataArray, elemCount*sizeof(T));
+            static_assert(!std::is_pointer<T>::value, "ArrayOut Error: not a pod class");
+            ReadBytes(dataArray, elemCount*sizeof(T));
+        }
+
+        /// \return bytes read, short at the end of the data
+        size_t ReadBytes(void * data, size_t size) {
+            if (size && size <= (size_t)(ReadLimit - ReadCursor)) {
+                memcpy(data, ReadCursor, size);
+                ReadCursor += size;
+                return size;
+            }
+            return ReadSlow(data, size);
+        }
+
+        size_t WriteBytes(const void * data, size_t size) {
+            if (size && size <= (size_t)(WriteLimit - WriteCursor)) {
+                memcpy(WriteCursor, data, size);
+                WriteCursor += size;
+                return size;
+            }
+            return WriteSlow(data, size);
         }
-        
+
         virtual void FlushCurrentCache() {
-            Handler->Flush();
+            if (Handler)
+                Handler->Flush();
         }
-        
+
     protected:
-        
+        /// Called when the window cannot take size bytes
+        virtual size_t ReadSlow(void * data, size_t size) {
+            return Handler ? Handler->Read((char*)data, size) : 0;
+        }
+
+        virtual size_t WriteSlow(const void * data, size_t size) {
+            return Handler ? Handler->Write(data, size) : 0;
+        }
+
         IIODevice* Handler;
+        const kByte* ReadCursor;
+        const kByte* ReadLimit;
+        kByte* WriteCursor;
+        kByte* WriteLimit;
+    };
+
+    /// BufferedArchive
+    /// Combines writes into blocks of bufferSize and reads ahead as much,
+    /// serializing a mesh through Os::File costs a few device calls instead
+    /// of one per field. Arrays larger than the buffer go to the device
+    /// directly. Use one archive per direction, the writes reach the device
+    /// on FlushCurrentCache or destruction.
+    class BufferedArchive : public Archive {
+    public:
+        static const size_t DefaultBufferSize = 256 * 1024;
+
+        explicit BufferedArchive(IIODevice * ioHandler = nullptr, size_t bufferSize = DefaultBufferSize)
+            : Buffer(new kByte[bufferSize]), BufferSize(bufferSize) {
+            Handler = ioHandler;
+            WriteCursor = Buffer;
+            WriteLimit = Buffer + BufferSize;
+        }
+
+        ~BufferedArchive() {
+            FlushWrites();
+            delete[] Buffer;
+        }
+
+        void FlushCurrentCache() override {
+            FlushWrites();
+            Archive::FlushCurrentCache();
+        }
+
+        /// Hand the buffered writes to the device
+        /// \return false if the device took less than all of them
+        bool FlushWrites() {
+            size_t size = (size_t)(WriteCursor - Buffer);
+            bool ok = !size || (Handler && Handler->Write(Buffer, size) == size);
+            WriteCursor = Buffer;
+            return ok;
+        }
+
+    protected:
+        size_t ReadSlow(void * data, size_t size) override {
+            kByte * dst = (kByte*)data;
+            size_t buffered = (size_t)(ReadLimit - ReadCursor);
+            if (buffered)
+                memcpy(dst, ReadCursor, buffered);
+            ReadCursor = ReadLimit;
+            size_t left = size - buffered;
+            if (!Handler || !left)
+                return buffered;
+            if (left >= BufferSize)
+                return buffered + Handler->Read((char*)dst + buffered, left);
+            size_t filled = Handler->Read((char*)Buffer, BufferSize);
+            size_t copied = left < filled ? left : filled;
+            memcpy(dst + buffered, Buffer, copied);
+            ReadCursor = Buffer + copied;
+            ReadLimit = Buffer + filled;
+            return buffered + copied;
+        }
+
+        size_t WriteSlow(const void * data, size_t size) override {
+            if (!FlushWrites())
+                return 0;
+            if (size >= BufferSize)
+                return Handler ? Handler->Write(data, size) : 0;
+            memcpy(WriteCursor, data, size);
+            WriteCursor += size;
+            return size;
+        }
+
+    private:
+        BufferedArchive(const BufferedArchive&) = delete;
+        BufferedArchive& operator=(const BufferedArchive&) = delete;
+
+        kByte*  Buffer;
+        size_t  BufferSize;
+    };
+
+    /// ViewArchive
+    /// Reads from memory the caller keeps alive, typically a mapping
+    /// (MemMapFile::FileData) or a bundle chunk. View hands out pointers
+    /// into it where ArrayOut would copy.
+    class ViewArchive : public Archive {
+    public:
+        ViewArchive(const void * data, size_t size) : Begin((const kByte*)data) {
+            ReadCursor = Begin;
+            ReadLimit = Begin + size;
+        }
+
+        /// count elements in place, then skips them
+        /// \return null past the end or if the data is misaligned for T
+        template <typename T>
+        const T * View(size_t count) {
+            static_assert(!std::is_pointer<T>::value, "View Error: not a pod class");
+            if (count > Remaining() / sizeof(T) || (size_t)ReadCursor % alignof(T) != 0)
+                return nullptr;
+            const T * view = (const T*)ReadCursor;
+            ReadCursor += count * sizeof(T);
+            return view;
+        }
+
+        bool Skip(size_t size) {
+            if (size > Remaining())
+                return false;
+            ReadCursor += size;
+            return true;
+        }
+
+        size_t Tell() const { return (size_t)(ReadCursor - Begin); }
+        size_t Remaining() const { return (size_t)(ReadLimit - ReadCursor); }
+
+    protected:
+        size_t ReadSlow(void * data, size_t size) override {
+            size_t left = Remaining();
+            size_t copied = size < left ? size : left;
+            if (copied)
+                memcpy(data, ReadCursor, copied);
+            ReadCursor += copied;
+            return copied;
+        }
+
+    private:
+        const kByte* Begin;
     };
 }
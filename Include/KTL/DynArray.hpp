@@ -5,200 +5,165 @@
 #include "Config/PlatformTypes.h"
 #include "Allocator.hpp"
 #include "Archive.hpp"
+#include "TypeTrait.hpp"
 
-#if (K3DPLATFORM_OS_WIN) || (K3DPLATFORM_OS_ANDROID)
-#include <malloc.h>
-#else
-#include <stdlib.h>
-#endif
-
-
-
-
+#include <new>
 #include <string.h>
-
-#ifdef DYNARRAY_TEST_CASE
-#include <iostream>
-typedef unsigned int uint32;
-typedef size_t uint64;
-#endif
+#include <type_traits>
 
 K3D_COMMON_NS
 {
-    template <
-		class T,
-		bool hasConstructor = (__has_trivial_constructor(T) || __has_nothrow_constructor(T)) && !__is_pod(T)
-	>
-    struct __Initializer
-    {
-        static void DoInit(T* begin, T* end)
-        {
-			for (T* iter = begin; iter != end; iter++)
-			{
-				new (iter) T();
-			}
-        }
-    };
-    
-    template <class T>
-    struct __Initializer<T, false>
-    {
-        static void DoInit(T* begin, T* end)
-        {
-            memset(begin, 0, (end-begin)*sizeof(T));
-        }
-    };
-
-    template <class T, bool isClass = __is_class(T)>
-    struct __Copier
-    {
-        static void DoCopy(T* dest, T* src, size_t n);
-    };
+	/// IsTriviallyRelocatable
+	/// Elements of such types are moved to a new buffer with memcpy when an
+	/// array grows. Specialize it for types that are not trivially copyable
+	/// but never point into themselves (String does, with its inline buffer).
+	template <typename T>
+	struct IsTriviallyRelocatable
+	{
+		static const bool Value = std::is_trivially_copyable<T>::value;
+	};
 
-    template <class T>
-    struct __Copier<T, true>
-    {
-        static void DoCopy(T* dest, T* src, size_t n)
-        {
-            for(T* iter = dest; (iter-dest)!= n; iter++)
-            {
-                *iter = *src ++;
-            }
-        }
-    };
-    
-    template <class T>
-    struct __Copier<T, false>
-    {
-        static void DoCopy(T* dest, T* src, size_t n)
-        {
-            ::memcpy(dest, src, sizeof(T)*n);
-        }
-    };
-    
+	/// DynArray
+	/// Contiguous growable array. Capacity is raw storage, elements are
+	/// constructed only when they are added.
 	template <typename ElementType, typename TAllocator = kAllocator>
 	class DynArray
 	{
 	public:
 
-		DynArray() K3D_NOEXCEPT 
-			: m_ElementIndex(0), m_ElementCount(0), m_Capacity(4), m_pElement(nullptr)
+		DynArray() K3D_NOEXCEPT
+			: m_ElementCount(0), m_Capacity(0), m_InlineCapacity(0), m_pElement(nullptr), m_pInline(nullptr)
 		{
-			m_pElement = (ElementType*)m_Allocator.allocate(m_Capacity*sizeof(ElementType), 0);
-            __Initializer<ElementType>::DoInit(m_pElement, m_pElement+m_Capacity);
 		}
-        
-        DynArray(int size) K3D_NOEXCEPT
-        : m_ElementIndex(0), m_ElementCount(0), m_Capacity(size), m_pElement(nullptr)
-        {
-            m_pElement = (ElementType*)m_Allocator.allocate(m_Capacity*sizeof(ElementType), 0);
-            __Initializer<ElementType>::DoInit(m_pElement, m_pElement+m_Capacity);
-        }
-        
-		DynArray(DynArray && rhs) : m_ElementCount(0), m_ElementIndex(0), m_pElement(nullptr)
+
+		/// Reserves room for size elements, Count() stays 0
+		DynArray(int size) K3D_NOEXCEPT
+			: m_ElementCount(0), m_Capacity(0), m_InlineCapacity(0), m_pElement(nullptr), m_pInline(nullptr)
 		{
-			m_ElementCount = rhs.m_ElementCount;
-			m_Capacity = rhs.m_Capacity;
-			m_pElement = rhs.m_pElement;
-			rhs.m_pElement = nullptr;
-			rhs.m_Capacity = 0;
-			rhs.m_ElementCount = 0;
+			Reserve(size > 0 ? size : 0);
 		}
 
-		DynArray(DynArray && rhs, TAllocator & alloc) : m_ElementCount(0), m_ElementIndex(0), m_pElement(nullptr), m_Allocator(alloc)
+		DynArray(DynArray && rhs) K3D_NOEXCEPT
+			: m_ElementCount(0), m_Capacity(0), m_InlineCapacity(0), m_pElement(nullptr), m_pInline(nullptr)
 		{
-			m_ElementCount = rhs.m_ElementCount;
-			m_Capacity = rhs.m_Capacity;
-			m_pElement = rhs.m_pElement;
+			MoveFrom(rhs);
 		}
 
-		DynArray(DynArray const& rhs) : m_ElementIndex(0), m_ElementCount(0), m_pElement(nullptr)
+		DynArray(DynArray && rhs, TAllocator & alloc) K3D_NOEXCEPT
+			: m_ElementCount(0), m_Capacity(0), m_InlineCapacity(0), m_pElement(nullptr), m_pInline(nullptr), m_Allocator(alloc)
 		{
-			m_ElementCount = rhs.m_ElementCount;
-			m_Capacity = rhs.m_Capacity;
-			m_pElement = (ElementType*)m_Allocator.allocate(m_Capacity*sizeof(ElementType), 0);
-			__Initializer<ElementType>::DoInit(m_pElement, m_pElement + m_Capacity);
-			__Copier<ElementType>::DoCopy(m_pElement, rhs.m_pElement, rhs.m_ElementCount);
+			MoveFrom(rhs);
 		}
 
+		DynArray(DynArray const& rhs)
+			: m_ElementCount(0), m_Capacity(0), m_InlineCapacity(0), m_pElement(nullptr), m_pInline(nullptr)
+		{
+			AddAll(rhs);
+		}
+
+		/// Reinterprets count OtherElementType as ElementType bytes
 		template <typename OtherElementType>
-		DynArray(OtherElementType * data, uint32 count) : m_ElementIndex(0), m_pElement(nullptr)
+		DynArray(OtherElementType * data, uint32 count)
+			: m_ElementCount(0), m_Capacity(0), m_InlineCapacity(0), m_pElement(nullptr), m_pInline(nullptr)
 		{
-			m_Capacity = (uint32)(count * sizeof(OtherElementType) / sizeof(ElementType) * 1.5f);
-			m_ElementCount = count * sizeof(OtherElementType) / sizeof(ElementType);
-			m_pElement = (ElementType*)m_Allocator.allocate(m_Capacity * sizeof(ElementType), 0);
-			memcpy(m_pElement, data, count * sizeof(OtherElementType));
+			static_assert(std::is_trivially_copyable<ElementType>::value, "byte copy needs a trivially copyable element");
+			uint32 elementCount = (uint32)(count * sizeof(OtherElementType) / sizeof(ElementType));
+			Reserve(elementCount);
+			memcpy(m_pElement, data, elementCount * sizeof(ElementType));
+			m_ElementCount = elementCount;
 		}
 
 		~DynArray()
 		{
-			if (m_pElement)
-			{
-				Deconstruct();
-				m_Allocator.deallocate(m_pElement, 0);
-				m_pElement = nullptr;
-			}
+			Destroy(m_pElement, m_ElementCount);
+			Release();
+		}
+
+		DynArray& Append(ElementType const & element)
+		{
+			Emplace(element);
+			return *this;
 		}
 
-		void Deconstruct()
+		DynArray& Append(ElementType && element)
 		{
-			for (uint32 i = 0; i < m_ElementCount; i++)
-			{
-				typedef ElementType ElementTypeType;
-				m_pElement[i].ElementTypeType::~ElementTypeType();
-			}
+			Emplace(Move(element));
+			return *this;
 		}
 
-		DynArray& Append(ElementType const & element)
+		/// Constructs the new element in place, args may refer to an element
+		/// of this array
+		template <typename... Args>
+		ElementType& Emplace(Args&&... args)
 		{
-			m_ElementCount++;
 			if (m_ElementCount == m_Capacity)
 			{
-				ReAdjust(m_Capacity * 2);
+				uint32 newCapacity = GrowCapacity(m_ElementCount + 1);
+				ElementType* pElement = Allocate(newCapacity);
+				new (pElement + m_ElementCount) ElementType(Forward<Args>(args)...);
+				Relocate(pElement, m_pElement, m_ElementCount);
+				Release();
+				m_pElement = pElement;
+				m_Capacity = newCapacity;
 			}
-			m_pElement[m_ElementCount - 1] = element;
-			return *this;
+			else
+			{
+				new (m_pElement + m_ElementCount) ElementType(Forward<Args>(args)...);
+			}
+			return m_pElement[m_ElementCount++];
 		}
 
-		DynArray& AddAll(DynArray<ElementType> const & rhs)
+		template <typename OtherAllocator>
+		DynArray& AddAll(DynArray<ElementType, OtherAllocator> const & rhs)
 		{
-			auto merged = rhs.Count() + m_ElementCount;
-			if (merged >= m_Capacity)
+			uint32 count = rhs.Count();
+			Reserve(m_ElementCount + count);
+			// rhs may be this array, read its data after reserving
+			ElementType const* src = rhs.Data();
+			if (std::is_trivially_copyable<ElementType>::value)
+			{
+				memcpy(m_pElement + m_ElementCount, src, count * sizeof(ElementType));
+			}
+			else
 			{
-				ReAdjust(merged + 1);
+				for (uint32 i = 0; i < count; i++)
+				{
+					new (m_pElement + m_ElementCount + i) ElementType(src[i]);
+				}
 			}
-            __Copier<ElementType>::DoCopy(m_pElement + m_ElementCount, rhs.m_pElement, rhs.m_ElementCount);
-			m_ElementCount = merged;
+			m_ElementCount += count;
 			return *this;
 		}
 
-		DynArray& Append(ElementType && element)
+		DynArray& operator=(DynArray const& rhs)
 		{
-			if (m_ElementCount == m_Capacity)
+			if (this != &rhs)
 			{
-				ReAdjust(m_Capacity * 2);
+				Clear();
+				AddAll(rhs);
 			}
-			m_ElementCount++;
-			m_pElement[m_ElementCount - 1] = element;
 			return *this;
 		}
 
-		DynArray& operator=(DynArray const& rhs)
+		DynArray& operator=(DynArray && rhs)
 		{
-			m_ElementCount = rhs.m_ElementCount;
-			m_Capacity = rhs.m_Capacity;
-			if (m_pElement)
+			if (this != &rhs)
 			{
-				m_Allocator.deallocate(m_pElement, 0);
+				Clear();
+				MoveFrom(rhs);
 			}
-			m_pElement = (ElementType*)m_Allocator.allocate(m_Capacity*sizeof(ElementType), 0);
-			__Initializer<ElementType>::DoInit(m_pElement, m_pElement + m_Capacity);
-            __Copier<ElementType>::DoCopy(m_pElement, rhs.m_pElement, rhs.m_ElementCount);
 			return *this;
 		}
 
 		void Swap(DynArray & rhs)
 		{
+			if (IsInline() || rhs.IsInline())
+			{
+				DynArray tmp(Move(rhs));
+				rhs = Move(*this);
+				*this = Move(tmp);
+				return;
+			}
 			{
 				ElementType *tmp = rhs.m_pElement;
 				rhs.m_pElement = m_pElement;
@@ -221,29 +186,70 @@ K3D_COMMON_NS
 			}
 		}
 
-        void Resize(int NewElementCount)
-        {
-            if(NewElementCount > m_Capacity)
-            {
-                ElementType* pElement = (ElementType*)m_Allocator.allocate(NewElementCount*sizeof(ElementType), 0);
-                __Initializer<ElementType>::DoInit(pElement, pElement + NewElementCount);
-                if(m_ElementCount > 0)
-                {
-                    __Copier<ElementType>::DoCopy(pElement, m_pElement, m_ElementCount);
-                    m_Allocator.deallocate(m_pElement, 0);
-                }
-                m_Capacity = NewElementCount;
-                m_pElement = pElement;
-            }
-			m_ElementCount = NewElementCount;
-        }
-        
+		/// Grows capacity to at least newCapacity, never shrinks
+		void Reserve(uint32 newCapacity)
+		{
+			if (newCapacity > m_Capacity)
+			{
+				Reallocate(newCapacity);
+			}
+		}
+
+		/// Drops unused capacity, moving back to the inline buffer if it fits
+		void Shrink()
+		{
+			if (m_ElementCount == m_Capacity || IsInline())
+				return;
+			if (m_pInline && m_ElementCount <= m_InlineCapacity)
+			{
+				Relocate(m_pInline, m_pElement, m_ElementCount);
+				Release();
+				m_pElement = m_pInline;
+				m_Capacity = m_InlineCapacity;
+			}
+			else if (m_ElementCount == 0)
+			{
+				Release();
+				m_pElement = nullptr;
+				m_Capacity = 0;
+			}
+			else
+			{
+				Reallocate(m_ElementCount);
+			}
+		}
+
+		/// Value-initializes added elements, destroys removed ones
+		void Resize(int NewElementCount)
+		{
+			uint32 newCount = NewElementCount > 0 ? (uint32)NewElementCount : 0;
+			if (newCount > m_ElementCount)
+			{
+				Reserve(newCount);
+				for (uint32 i = m_ElementCount; i < newCount; i++)
+				{
+					new (m_pElement + i) ElementType();
+				}
+			}
+			else
+			{
+				Destroy(m_pElement + newCount, m_ElementCount - newCount);
+			}
+			m_ElementCount = newCount;
+		}
+
+		/// Destroys all elements, keeps the capacity
+		void Clear()
+		{
+			Destroy(m_pElement, m_ElementCount);
+			m_ElementCount = 0;
+		}
+
 		ElementType const& operator[](uint32 index) const
 		{
 			return m_pElement[index];
 		}
 
-
 		ElementType& operator[](uint32 index)
 		{
 			return m_pElement[index];
@@ -264,11 +270,16 @@ K3D_COMMON_NS
 			return m_ElementCount;
 		}
 
+		uint32 Capacity() const
+		{
+			return m_Capacity;
+		}
+
 		bool Contains(ElementType const & item) const
 		{
 			for (auto iter = begin(); iter != end(); ++iter)
 			{
-				if (*iter == item) 
+				if (*iter == item)
 				{
 					return true;
 				}
@@ -305,54 +316,182 @@ K3D_COMMON_NS
 		bool empty() const { return m_ElementCount == 0; }
 #endif
 
+	protected:
+		/// For SmallDynArray, pInline is uninitialized storage owned by the derived class
+		DynArray(ElementType * pInline, uint32 inlineCapacity) K3D_NOEXCEPT
+			: m_ElementCount(0), m_Capacity(inlineCapacity), m_InlineCapacity(inlineCapacity), m_pElement(pInline), m_pInline(pInline)
+		{
+		}
+
 	private:
         template<typename T> friend Archive& operator<<(Archive& ar, DynArray<T> const& rhs);
         template<typename T> friend Archive& operator>>(Archive& ar, DynArray<T> & rhs);
 
-		void ReAdjust(uint32 NewElementCount)
+		bool IsInline() const
+		{
+			return m_pInline && m_pElement == m_pInline;
+		}
+
+		uint32 GrowCapacity(uint32 required) const
+		{
+			uint32 doubled = m_Capacity ? m_Capacity * 2 : 4;
+			return doubled > required ? doubled : required;
+		}
+
+		ElementType* Allocate(uint32 count)
 		{
-			ElementType* pElement = (ElementType*)m_Allocator.allocate(NewElementCount*sizeof(ElementType), 0);
-			__Initializer<ElementType>::DoInit(pElement, pElement + NewElementCount);
-            __Copier<ElementType>::DoCopy(pElement, m_pElement, m_ElementCount);
-			m_Capacity = NewElementCount;
-			m_Allocator.deallocate(m_pElement, 0);
+			return (ElementType*)m_Allocator.allocate(count * sizeof(ElementType), 0);
+		}
+
+		/// Frees the heap buffer, elements must be destroyed or relocated already
+		void Release()
+		{
+			if (m_pElement && !IsInline())
+			{
+				m_Allocator.deallocate(m_pElement, m_Capacity * sizeof(ElementType));
+			}
+		}
+
+		void Reallocate(uint32 newCapacity)
+		{
+			ElementType* pElement = Allocate(newCapacity);
+			Relocate(pElement, m_pElement, m_ElementCount);
+			Release();
 			m_pElement = pElement;
+			m_Capacity = newCapacity;
+		}
 
-#ifdef DYNARRAY_TEST_CASE
-			std::cerr << "Need Reallocate .. capacity=" << m_Capacity << std::endl;
-#endif
+		/// Takes over rhs' elements, this must be empty
+		void MoveFrom(DynArray & rhs)
+		{
+			if (rhs.IsInline())
+			{
+				Reserve(rhs.m_ElementCount);
+				Relocate(m_pElement, rhs.m_pElement, rhs.m_ElementCount);
+				m_ElementCount = rhs.m_ElementCount;
+				rhs.m_ElementCount = 0;
+				return;
+			}
+			Release();
+			m_pElement = rhs.m_pElement;
+			m_ElementCount = rhs.m_ElementCount;
+			m_Capacity = rhs.m_Capacity;
+			rhs.m_pElement = rhs.m_pInline;
+			rhs.m_ElementCount = 0;
+			rhs.m_Capacity = rhs.m_InlineCapacity;
+		}
+
+		static void Relocate(ElementType * dest, ElementType * src, uint32 count)
+		{
+			if (IsTriviallyRelocatable<ElementType>::Value)
+			{
+				if (count)
+				{
+					memcpy((void*)dest, (void*)src, count * sizeof(ElementType));
+				}
+			}
+			else
+			{
+				for (uint32 i = 0; i < count; i++)
+				{
+					new (dest + i) ElementType(Move(src[i]));
+					src[i].~ElementType();
+				}
+			}
+		}
+
+		static void Destroy(ElementType * begin, uint32 count)
+		{
+			if (!std::is_trivially_destructible<ElementType>::value)
+			{
+				for (uint32 i = 0; i < count; i++)
+				{
+					begin[i].~ElementType();
+				}
+			}
 		}
 
-		uint32			m_ElementIndex;
 		uint32			m_ElementCount;
 		uint32			m_Capacity;
+		uint32			m_InlineCapacity;
 		ElementType *	m_pElement;
+		ElementType *	m_pInline;
 		TAllocator		m_Allocator;
 	};
 
+	/// SmallDynArray
+	/// DynArray with room for InlineCount elements inside the object, spills
+	/// to the allocator beyond that. Usable wherever a DynArray& is expected.
+	template <typename ElementType, uint32 InlineCount, typename TAllocator = kAllocator>
+	class SmallDynArray : public DynArray<ElementType, TAllocator>
+	{
+		typedef DynArray<ElementType, TAllocator> Super;
+	public:
+		SmallDynArray() K3D_NOEXCEPT
+			: Super(InlineBuffer(), InlineCount)
+		{
+		}
+
+		SmallDynArray(SmallDynArray const& rhs)
+			: Super(InlineBuffer(), InlineCount)
+		{
+			Super::AddAll(rhs);
+		}
+
+		SmallDynArray(Super const& rhs)
+			: Super(InlineBuffer(), InlineCount)
+		{
+			Super::AddAll(rhs);
+		}
+
+		SmallDynArray(SmallDynArray && rhs) K3D_NOEXCEPT
+			: Super(InlineBuffer(), InlineCount)
+		{
+			Super::operator=(Move(rhs));
+		}
+
+		SmallDynArray& operator=(SmallDynArray const& rhs)
+		{
+			Super::operator=(rhs);
+			return *this;
+		}
+
+		SmallDynArray& operator=(SmallDynArray && rhs)
+		{
+			Super::operator=(Move(rhs));
+			return *this;
+		}
+
+	private:
+		ElementType* InlineBuffer()
+		{
+			return reinterpret_cast<ElementType*>(&m_Inline);
+		}
+
+		typename std::aligned_storage<sizeof(ElementType) * InlineCount, alignof(ElementType)>::type m_Inline;
+	};
+
     template <typename T>
     inline Archive& operator<<(Archive& ar, DynArray<T> const& rhs)
     {
         ar << rhs.m_ElementCount << rhs.m_Capacity;
-        for(auto ele : rhs)
+        for(auto const& ele : rhs)
         {
             ar << ele;
         }
         return ar;
     }
-    
+
     template <typename T>
     inline Archive& operator>>(Archive& ar, DynArray<T> & rhs)
     {
-        ar >> rhs.m_ElementCount >> rhs.m_Capacity;
-        if(rhs.m_pElement)
-        {
-            rhs.m_Allocator.deallocate(rhs.m_pElement, 0);
-        }
-        rhs.m_pElement = (T*)rhs.m_Allocator.allocate(rhs.m_Capacity*sizeof(T), 0);
-        for(uint32 i = 0; i < rhs.m_ElementCount; i++)
+        uint32 count = 0, capacity = 0;
+        ar >> count >> capacity;
+        rhs.Clear();
+        rhs.Reserve(count);
+        for(uint32 i = 0; i < count; i++)
         {
-            ar >> rhs.m_pElement[i];
+            ar >> rhs.Emplace();
         }
         return ar;
     }
@@ -0,0 +1,592 @@
+#pragma once
+#ifndef __HashMap_hpp__
+#define __HashMap_hpp__
+
+#include <Config/Config.h>
+#include "Allocator.hpp"
+#include "String.hpp"
+#include <string>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define K3D_HASHMAP_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+K3D_COMMON_NS
+{
+	/// farmhash Hash64 of the bytes, implemented in Core
+	extern K3D_API uint64 HashBytes(const char * data, size_t len);
+
+	/// Hash
+	/// Integral, enum and pointer keys are mixed with the murmur finalizer,
+	/// string keys go through farmhash. String hashers accept const char*,
+	/// std::string and String alike, so lookups need no temporary key.
+	template <typename K>
+	struct Hash
+	{
+		uint64 operator()(K const & key) const
+		{
+			static_assert(std::is_integral<K>::value || std::is_enum<K>::value || std::is_pointer<K>::value,
+				"no default Hash for this key type");
+			uint64 x = (uint64)key;
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdULL;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+	};
+
+	struct StringHash
+	{
+		uint64 operator()(const char * key) const { return HashBytes(key, strlen(key)); }
+		uint64 operator()(std::string const & key) const { return HashBytes(key.data(), key.size()); }
+		uint64 operator()(String const & key) const { return HashBytes(key.CStr(), key.Length()); }
+	};
+
+	template <> struct Hash<std::string> : StringHash {};
+	template <> struct Hash<String> : StringHash {};
+	template <> struct Hash<const char*> : StringHash {};
+
+	template <typename K>
+	struct EqualTo
+	{
+		template <typename Q>
+		bool operator()(K const & lhs, Q const & rhs) const { return lhs == rhs; }
+	};
+
+	struct StringEqual
+	{
+		static bool Equal(const char * lhs, size_t lhsLen, const char * rhs, size_t rhsLen)
+		{
+			return lhsLen == rhsLen && memcmp(lhs, rhs, lhsLen) == 0;
+		}
+		template <typename S>
+		bool operator()(S const & lhs, const char * rhs) const { return Equal(Data(lhs), Size(lhs), rhs, strlen(rhs)); }
+		template <typename S>
+		bool operator()(S const & lhs, std::string const & rhs) const { return Equal(Data(lhs), Size(lhs), rhs.data(), rhs.size()); }
+		template <typename S>
+		bool operator()(S const & lhs, String const & rhs) const { return Equal(Data(lhs), Size(lhs), rhs.CStr(), rhs.Length()); }
+
+	private:
+		static const char * Data(std::string const & s) { return s.data(); }
+		static size_t Size(std::string const & s) { return s.size(); }
+		static const char * Data(String const & s) { return s.CStr(); }
+		static size_t Size(String const & s) { return s.Length(); }
+		static const char * Data(const char * s) { return s; }
+		static size_t Size(const char * s) { return strlen(s); }
+	};
+
+	template <> struct EqualTo<std::string> : StringEqual {};
+	template <> struct EqualTo<String> : StringEqual {};
+	template <> struct EqualTo<const char*> : StringEqual {};
+
+	namespace HashDetail
+	{
+		const int8 kEmpty = -128;	// 0b10000000
+		const int8 kDeleted = -2;	// 0b11111110
+		// full slots store the low 7 bits of the hash, 0b0xxxxxxx
+
+		inline uint32 CountTrailingZeros(uint64 v)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+#if defined(_WIN64)
+			_BitScanForward64(&index, v);
+#else
+			if (_BitScanForward(&index, (unsigned long)v))
+				return index;
+			_BitScanForward(&index, (unsigned long)(v >> 32));
+			index += 32;
+#endif
+			return index;
+#else
+			return __builtin_ctzll(v);
+#endif
+		}
+
+		/// Bit set of matching slots within a group
+		struct BitMask
+		{
+			uint64 Bits;
+			uint32 Shift;
+
+			explicit operator bool() const { return Bits != 0; }
+			uint32 Lowest() const { return CountTrailingZeros(Bits) >> Shift; }
+			void ClearLowest() { Bits &= Bits - 1; }
+		};
+
+#if K3D_HASHMAP_SSE2
+		/// 16 control bytes matched with one SSE2 compare
+		struct Group
+		{
+			static const uint32 Width = 16;
+
+			explicit Group(const int8 * ctrl) : m_Ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+			BitMask Match(int8 h2) const
+			{
+				return { (uint64)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), m_Ctrl)), 0 };
+			}
+			BitMask MatchEmpty() const
+			{
+				return Match(kEmpty);
+			}
+			BitMask MatchEmptyOrDeleted() const
+			{
+				return { (uint64)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), m_Ctrl)), 0 };
+			}
+
+			__m128i m_Ctrl;
+		};
+#else
+		/// 8 control bytes matched as one 64 bit word
+		struct Group
+		{
+			static const uint32 Width = 8;
+			static const uint64 kLsbs = 0x0101010101010101ULL;
+			static const uint64 kMsbs = 0x8080808080808080ULL;
+
+			explicit Group(const int8 * ctrl) { memcpy(&m_Ctrl, ctrl, sizeof(m_Ctrl)); }
+
+			// may report false positives next to a real match, keys are compared anyway
+			BitMask Match(int8 h2) const
+			{
+				uint64 x = m_Ctrl ^ (kLsbs * (uint8)h2);
+				return { (x - kLsbs) & ~x & kMsbs, 3 };
+			}
+			BitMask MatchEmpty() const
+			{
+				return { m_Ctrl & (~m_Ctrl << 6) & kMsbs, 3 };
+			}
+			BitMask MatchEmptyOrDeleted() const
+			{
+				return { m_Ctrl & (~m_Ctrl << 7) & kMsbs, 3 };
+			}
+
+			uint64 m_Ctrl;
+		};
+#endif
+
+		template <typename K, typename V>
+		struct MapPolicy
+		{
+			typedef std::pair<K, V> Entry;
+			static K const & KeyOf(Entry const & e) { return e.first; }
+		};
+
+		template <typename K>
+		struct SetPolicy
+		{
+			typedef K Entry;
+			static K const & KeyOf(Entry const & e) { return e; }
+		};
+	}
+
+	/// HashTable
+	/// Open addressing table in the SwissTable layout: one control byte per
+	/// slot holds 7 bits of the hash, probing tests a whole group of control
+	/// bytes at once and only touches entries whose bits match.
+	/// Groups are probed quadratically, max load factor is 7/8.
+	/// Insertion and erase invalidate iterators and entry pointers.
+	template <typename TPolicy, typename K, typename THash, typename TEqual, typename TAllocator>
+	class HashTable
+	{
+	public:
+		typedef typename TPolicy::Entry Entry;
+		typedef HashDetail::Group Group;
+
+		template <typename TEntry>
+		class Iterator
+		{
+		public:
+			Iterator() : m_Ctrl(nullptr), m_Entry(nullptr) {}
+			Iterator(const int8 * ctrl, TEntry * entry) : m_Ctrl(ctrl), m_Entry(entry) { SkipFree(); }
+			template <typename U>
+			Iterator(Iterator<U> const & rhs) : m_Ctrl(rhs.m_Ctrl), m_Entry(rhs.m_Entry) {}
+
+			TEntry & operator*() const { return *m_Entry; }
+			TEntry * operator->() const { return m_Entry; }
+			Iterator & operator++() { ++m_Ctrl; ++m_Entry; SkipFree(); return *this; }
+			Iterator operator++(int) { Iterator tmp(*this); ++*this; return tmp; }
+			template <typename U>
+			bool operator==(Iterator<U> const & rhs) const { return m_Entry == rhs.m_Entry; }
+			template <typename U>
+			bool operator!=(Iterator<U> const & rhs) const { return m_Entry != rhs.m_Entry; }
+
+		private:
+			template <typename> friend class Iterator;
+			friend class HashTable;
+
+			// the control array ends with a full sentinel byte
+			void SkipFree()
+			{
+				if (!m_Ctrl)
+					return;
+				while (*m_Ctrl < 0) { ++m_Ctrl; ++m_Entry; }
+			}
+
+			const int8 *	m_Ctrl;
+			TEntry *		m_Entry;
+		};
+
+		typedef Iterator<Entry> iterator;
+		typedef Iterator<const Entry> const_iterator;
+
+		HashTable() : m_Ctrl(nullptr), m_Entries(nullptr), m_Capacity(0), m_Count(0), m_GrowthLeft(0) {}
+
+		explicit HashTable(uint64 reserve) : HashTable() { Reserve(reserve); }
+
+		HashTable(HashTable const & rhs) : HashTable()
+		{
+			Reserve(rhs.m_Count);
+			for (Entry const & e : rhs)
+				InsertUnique(TPolicy::KeyOf(e), e);
+		}
+
+		HashTable(HashTable && rhs) : HashTable() { Swap(rhs); }
+
+		~HashTable()
+		{
+			Clear();
+			Release();
+		}
+
+		HashTable & operator=(HashTable const & rhs)
+		{
+			if (this != &rhs)
+			{
+				HashTable tmp(rhs);
+				Swap(tmp);
+			}
+			return *this;
+		}
+
+		HashTable & operator=(HashTable && rhs)
+		{
+			Swap(rhs);
+			return *this;
+		}
+
+		void Swap(HashTable & rhs)
+		{
+			std::swap(m_Ctrl, rhs.m_Ctrl);
+			std::swap(m_Entries, rhs.m_Entries);
+			std::swap(m_Capacity, rhs.m_Capacity);
+			std::swap(m_Count, rhs.m_Count);
+			std::swap(m_GrowthLeft, rhs.m_GrowthLeft);
+			std::swap(m_Allocator, rhs.m_Allocator);
+		}
+
+		iterator begin() { return m_Capacity ? iterator(m_Ctrl, m_Entries) : iterator(); }
+		iterator end() { return m_Capacity ? iterator(m_Ctrl + m_Capacity, m_Entries + m_Capacity) : iterator(); }
+		const_iterator begin() const { return m_Capacity ? const_iterator(m_Ctrl, m_Entries) : const_iterator(); }
+		const_iterator end() const { return m_Capacity ? const_iterator(m_Ctrl + m_Capacity, m_Entries + m_Capacity) : const_iterator(); }
+
+		uint64 Count() const { return m_Count; }
+		bool IsEmpty() const { return m_Count == 0; }
+		uint64 Capacity() const { return m_Capacity; }
+
+		template <typename Q>
+		iterator Find(Q const & key)
+		{
+			Entry * e = FindEntry(key);
+			return e ? MakeIterator(e) : end();
+		}
+
+		template <typename Q>
+		const_iterator Find(Q const & key) const
+		{
+			Entry * e = const_cast<HashTable*>(this)->FindEntry(key);
+			return e ? const_iterator(m_Ctrl + (e - m_Entries), e) : end();
+		}
+
+		template <typename Q>
+		bool Contains(Q const & key) const
+		{
+			return const_cast<HashTable*>(this)->FindEntry(key) != nullptr;
+		}
+
+		template <typename Q>
+		bool Erase(Q const & key)
+		{
+			Entry * e = FindEntry(key);
+			if (!e)
+				return false;
+			EraseAt(e - m_Entries);
+			return true;
+		}
+
+		void Erase(iterator iter)
+		{
+			EraseAt(iter.m_Entry - m_Entries);
+		}
+
+		/// Destroy all entries, keeps the storage
+		void Clear()
+		{
+			if (!m_Capacity)
+				return;
+			for (uint64 i = 0; i < m_Capacity; i++)
+			{
+				if (m_Ctrl[i] >= 0)
+					m_Entries[i].~Entry();
+			}
+			memset(m_Ctrl, HashDetail::kEmpty, m_Capacity);
+			m_Count = 0;
+			m_GrowthLeft = MaxLoad(m_Capacity);
+		}
+
+		void Reserve(uint64 count)
+		{
+			uint64 capacity = Group::Width;
+			while (MaxLoad(capacity) < count)
+				capacity *= 2;
+			if (capacity > m_Capacity)
+				Rehash(capacity);
+		}
+
+	protected:
+		static uint64 MaxLoad(uint64 capacity) { return capacity - capacity / 8; }
+		static uint64 H1(uint64 hash) { return hash >> 7; }
+		static int8 H2(uint64 hash) { return (int8)(hash & 0x7f); }
+
+		iterator MakeIterator(Entry * e) { return iterator(m_Ctrl + (e - m_Entries), e); }
+
+		template <typename Q>
+		Entry * FindEntry(Q const & key)
+		{
+			if (!m_Capacity)
+				return nullptr;
+			return FindEntry(key, m_Hasher(key));
+		}
+
+		template <typename Q>
+		Entry * FindEntry(Q const & key, uint64 hash)
+		{
+			if (!m_Capacity)
+				return nullptr;
+			int8 h2 = H2(hash);
+			uint64 groupMask = m_Capacity / Group::Width - 1;
+			uint64 group = H1(hash) & groupMask;
+			for (uint64 step = 1; ; step++)
+			{
+				Group g(m_Ctrl + group * Group::Width);
+				for (HashDetail::BitMask m = g.Match(h2); m; m.ClearLowest())
+				{
+					Entry * e = m_Entries + group * Group::Width + m.Lowest();
+					if (m_Equal(TPolicy::KeyOf(*e), key))
+						return e;
+				}
+				if (g.MatchEmpty() || step > groupMask)
+					return nullptr;
+				group = (group + step) & groupMask;
+			}
+		}
+
+		uint64 FindFreeSlot(uint64 hash) const
+		{
+			uint64 groupMask = m_Capacity / Group::Width - 1;
+			uint64 group = H1(hash) & groupMask;
+			for (uint64 step = 1; ; step++)
+			{
+				HashDetail::BitMask m = Group(m_Ctrl + group * Group::Width).MatchEmptyOrDeleted();
+				if (m)
+					return group * Group::Width + m.Lowest();
+				group = (group + step) & groupMask;
+			}
+		}
+
+		/// \return the entry and true if the key was not present yet
+		template <typename Q, typename... Args>
+		std::pair<iterator, bool> InsertUnique(Q const & key, Args&&... args)
+		{
+			uint64 hash = m_Hasher(key);
+			Entry * e = FindEntry(key, hash);
+			if (e)
+				return { MakeIterator(e), false };
+			if (m_GrowthLeft == 0)
+			{
+				if (m_Capacity == 0)
+					Rehash(Group::Width);
+				else // mostly tombstones: rehash at the same size
+					Rehash(m_Count * 2 < MaxLoad(m_Capacity) ? m_Capacity : m_Capacity * 2);
+			}
+			uint64 slot = FindFreeSlot(hash);
+			if (m_Ctrl[slot] == HashDetail::kEmpty)
+				m_GrowthLeft--;
+			new (m_Entries + slot) Entry(std::forward<Args>(args)...);
+			m_Ctrl[slot] = H2(hash);
+			m_Count++;
+			return { MakeIterator(m_Entries + slot), true };
+		}
+
+		void EraseAt(uint64 slot)
+		{
+			m_Entries[slot].~Entry();
+			m_Count--;
+			// a group that still has an empty slot ends every probe passing it,
+			// so the slot can become empty again instead of a tombstone
+			uint64 groupStart = slot & ~(uint64)(Group::Width - 1);
+			if (Group(m_Ctrl + groupStart).MatchEmpty())
+			{
+				m_Ctrl[slot] = HashDetail::kEmpty;
+				m_GrowthLeft++;
+			}
+			else
+			{
+				m_Ctrl[slot] = HashDetail::kDeleted;
+			}
+		}
+
+		void Rehash(uint64 capacity)
+		{
+			int8 * oldCtrl = m_Ctrl;
+			Entry * oldEntries = m_Entries;
+			uint64 oldCapacity = m_Capacity;
+
+			Allocate(capacity);
+			for (uint64 i = 0; i < oldCapacity; i++)
+			{
+				if (oldCtrl[i] < 0)
+					continue;
+				uint64 hash = m_Hasher(TPolicy::KeyOf(oldEntries[i]));
+				uint64 slot = FindFreeSlot(hash);
+				new (m_Entries + slot) Entry(std::move(oldEntries[i]));
+				m_Ctrl[slot] = H2(hash);
+				oldEntries[i].~Entry();
+			}
+			m_GrowthLeft -= m_Count;
+			if (oldCapacity)
+				m_Allocator.deallocate(oldCtrl, StorageSize(oldCapacity));
+		}
+
+		static uint64 CtrlSize(uint64 capacity)
+		{
+			// + sentinel, rounded up so entries stay aligned
+			uint64 align = alignof(Entry) > Group::Width ? alignof(Entry) : Group::Width;
+			return (capacity + 1 + align - 1) & ~(align - 1);
+		}
+
+		static uint64 StorageSize(uint64 capacity)
+		{
+			return CtrlSize(capacity) + capacity * sizeof(Entry);
+		}
+
+		void Allocate(uint64 capacity)
+		{
+			uint64 size = StorageSize(capacity);
+			m_Ctrl = (int8*)m_Allocator.allocate(size, alignof(Entry), 0, 0);
+			m_Entries = (Entry*)(m_Ctrl + CtrlSize(capacity));
+			memset(m_Ctrl, HashDetail::kEmpty, capacity);
+			m_Ctrl[capacity] = 0;
+			m_Capacity = capacity;
+			m_GrowthLeft = MaxLoad(capacity);
+		}
+
+		void Release()
+		{
+			if (m_Capacity)
+				m_Allocator.deallocate(m_Ctrl, StorageSize(m_Capacity));
+			m_Ctrl = nullptr;
+			m_Entries = nullptr;
+			m_Capacity = 0;
+			m_GrowthLeft = 0;
+		}
+
+		int8 *		m_Ctrl;
+		Entry *		m_Entries;
+		uint64		m_Capacity;
+		uint64		m_Count;
+		uint64		m_GrowthLeft;
+		THash		m_Hasher;
+		TEqual		m_Equal;
+		TAllocator	m_Allocator;
+	};
+
+	/// HashMap
+	/// Flat hash map, entries are std::pair<K, V> stored inline.
+	/// Lookups accept any type THash and TEqual understand, e.g. a
+	/// HashMap<std::string, T> can be searched with a const char*.
+	template <typename K, typename V, typename THash = Hash<K>, typename TEqual = EqualTo<K>, typename TAllocator = kAllocator>
+	class HashMap : public HashTable<HashDetail::MapPolicy<K, V>, K, THash, TEqual, TAllocator>
+	{
+		typedef HashTable<HashDetail::MapPolicy<K, V>, K, THash, TEqual, TAllocator> Super;
+	public:
+		typedef typename Super::iterator iterator;
+		typedef typename Super::const_iterator const_iterator;
+
+		HashMap() {}
+		explicit HashMap(uint64 reserve) : Super(reserve) {}
+
+		std::pair<iterator, bool> Insert(K const & key, V const & value)
+		{
+			return this->InsertUnique(key, key, value);
+		}
+
+		std::pair<iterator, bool> Insert(K && key, V && value)
+		{
+			return this->InsertUnique(key, std::move(key), std::move(value));
+		}
+
+		/// Constructs the value in place if the key is missing
+		template <typename Q, typename... Args>
+		std::pair<iterator, bool> Emplace(Q && key, Args&&... args)
+		{
+			return this->InsertUnique(key, std::piecewise_construct,
+				std::forward_as_tuple(std::forward<Q>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+		}
+
+		/// Inserts a default value if missing, K is built from key only then
+		template <typename Q>
+		V & operator[](Q && key)
+		{
+			return Emplace(std::forward<Q>(key)).first->second;
+		}
+
+		/// \return nullptr if not found
+		template <typename Q>
+		V * FindValue(Q const & key)
+		{
+			auto e = this->FindEntry(key);
+			return e ? &e->second : nullptr;
+		}
+
+		template <typename Q>
+		V const * FindValue(Q const & key) const
+		{
+			auto e = const_cast<HashMap*>(this)->FindEntry(key);
+			return e ? &e->second : nullptr;
+		}
+	};
+
+	/// HashSet
+	template <typename K, typename THash = Hash<K>, typename TEqual = EqualTo<K>, typename TAllocator = kAllocator>
+	class HashSet : public HashTable<HashDetail::SetPolicy<K>, K, THash, TEqual, TAllocator>
+	{
+		typedef HashTable<HashDetail::SetPolicy<K>, K, THash, TEqual, TAllocator> Super;
+	public:
+		typedef typename Super::iterator iterator;
+		typedef typename Super::const_iterator const_iterator;
+
+		HashSet() {}
+		explicit HashSet(uint64 reserve) : Super(reserve) {}
+
+		template <typename Q>
+		std::pair<iterator, bool> Insert(Q && key)
+		{
+			return this->InsertUnique(key, std::forward<Q>(key));
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef __Histogram_hpp__
+#define __Histogram_hpp__
+
+#include <Config/Config.h>
+#include <Config/PlatformTypes.h>
+#include <algorithm>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+K3D_COMMON_NS
+{
+	/// HdrHistogram
+	/// Counts values with a fixed relative precision over a wide range:
+	/// values below 2^PrecisionBits land in buckets of their own, larger
+	/// ones in one of 2^(PrecisionBits-1) buckets per power of two. With
+	/// the default 7 bits any percentile is within 1.6% of the exact value.
+	/// Values can be removed again, which keeps a rolling window exact.
+	class HdrHistogram
+	{
+	public:
+		/// \param maxValue larger values are counted as maxValue
+		explicit HdrHistogram(uint64 maxValue = 60000000, uint32 precisionBits = 7)
+			: m_Bits(precisionBits < 2 ? 2 : precisionBits > 16 ? 16 : precisionBits)
+			, m_MaxValue(maxValue)
+			, m_Total(0)
+		{
+			m_Counts.resize(IndexOf(maxValue) + 1, 0);
+		}
+
+		void Record(uint64 value, uint64 count = 1)
+		{
+			m_Counts[IndexOf(value < m_MaxValue ? value : m_MaxValue)] += count;
+			m_Total += count;
+		}
+
+		/// Takes back a value given to Record
+		void Remove(uint64 value, uint64 count = 1)
+		{
+			uint64 & bucket = m_Counts[IndexOf(value < m_MaxValue ? value : m_MaxValue)];
+			count = count < bucket ? count : bucket;
+			bucket -= count;
+			m_Total -= count;
+		}
+
+		void Reset()
+		{
+			std::fill(m_Counts.begin(), m_Counts.end(), 0);
+			m_Total = 0;
+		}
+
+		/// Same range and precision only
+		void Add(HdrHistogram const & other)
+		{
+			if (other.m_Counts.size() != m_Counts.size())
+				return;
+			for (size_t i = 0; i < m_Counts.size(); i++)
+				m_Counts[i] += other.m_Counts[i];
+			m_Total += other.m_Total;
+		}
+
+		uint64 GetCount() const { return m_Total; }
+
+		/// Highest value counted in the same bucket as the value at
+		/// percentile (0-100), a bound that is never below the exact one
+		uint64 ValueAtPercentile(double percentile) const
+		{
+			if (m_Total == 0)
+				return 0;
+			double wanted = percentile / 100.0 * (double)m_Total;
+			uint64 rank = wanted <= 1.0 ? 1 : (uint64)wanted;
+			if ((double)rank < wanted)
+				rank++;
+			if (rank > m_Total)
+				rank = m_Total;
+			uint64 seen = 0;
+			for (size_t i = 0; i < m_Counts.size(); i++)
+			{
+				seen += m_Counts[i];
+				if (seen >= rank)
+				{
+					uint64 upper = HighestInBucket((uint32)i);
+					return upper < m_MaxValue ? upper : m_MaxValue;
+				}
+			}
+			return m_MaxValue;
+		}
+
+		uint64 GetMax() const
+		{
+			for (size_t i = m_Counts.size(); i > 0; i--)
+			{
+				if (m_Counts[i - 1])
+				{
+					uint64 upper = HighestInBucket((uint32)i - 1);
+					return upper < m_MaxValue ? upper : m_MaxValue;
+				}
+			}
+			return 0;
+		}
+
+		/// Calls fn(lowest, highest, count) for every bucket with a count
+		template <typename Fn>
+		void ForEachBucket(Fn && fn) const
+		{
+			for (size_t i = 0; i < m_Counts.size(); i++)
+			{
+				if (m_Counts[i])
+					fn(LowestInBucket((uint32)i), HighestInBucket((uint32)i), m_Counts[i]);
+			}
+		}
+
+	private:
+		static uint32 FloorLog2(uint64 v)
+		{
+#if defined(_MSC_VER) && defined(_M_X64)
+			unsigned long index;
+			_BitScanReverse64(&index, v);
+			return index;
+#elif defined(_MSC_VER)
+			unsigned long index;
+			if (_BitScanReverse(&index, (unsigned long)(v >> 32)))
+				return index + 32;
+			_BitScanReverse(&index, (unsigned long)v);
+			return index;
+#else
+			return 63 - __builtin_clzll(v);
+#endif
+		}
+
+		uint32 IndexOf(uint64 value) const
+		{
+			uint64 linear = uint64(1) << m_Bits;
+			if (value < linear)
+				return (uint32)value;
+			// keep the top m_Bits bits, the leading one included
+			uint32 shift = FloorLog2(value) - m_Bits + 1;
+			uint64 half = linear >> 1;
+			return (uint32)(linear + (shift - 1) * half + ((value >> shift) - half));
+		}
+
+		uint64 LowestInBucket(uint32 index) const
+		{
+			uint64 linear = uint64(1) << m_Bits;
+			if (index < linear)
+				return index;
+			uint64 half = linear >> 1;
+			uint32 shift = (uint32)((index - linear) / half) + 1;
+			uint64 mantissa = half + (index - linear) % half;
+			return mantissa << shift;
+		}
+
+		uint64 HighestInBucket(uint32 index) const
+		{
+			uint64 linear = uint64(1) << m_Bits;
+			if (index < linear)
+				return index;
+			uint32 shift = (uint32)((index - linear) / (linear >> 1)) + 1;
+			return LowestInBucket(index) + (uint64(1) << shift) - 1;
+		}
+
+		uint32				m_Bits;
+		uint64				m_MaxValue;
+		uint64				m_Total;
+		std::vector<uint64>	m_Counts;
+	};
+}
+
+#endif
@@ -0,0 +1,164 @@
+#pragma once
+#ifndef __InplaceFunction_hpp__
+#define __InplaceFunction_hpp__
+
+#include "TypeTrait.hpp"
+
+#include <new>
+#include <cstddef>
+#include <assert.h>
+#include <type_traits>
+
+K3D_COMMON_NS
+{
+	template <typename Signature, size_t Capacity = 48>
+	class InplaceFunction;
+
+	/// InplaceFunction
+	/// std::function replacement that never allocates, the callable is
+	/// stored in Capacity bytes inside the object. Callables that do not
+	/// fit fail to compile. Move-only callables are supported, copying
+	/// such a function asserts.
+	template <typename Ret, typename... Args, size_t Capacity>
+	class InplaceFunction<Ret(Args...), Capacity>
+	{
+	public:
+		InplaceFunction() K3D_NOEXCEPT : m_pOps(nullptr) {}
+		InplaceFunction(std::nullptr_t) K3D_NOEXCEPT : m_pOps(nullptr) {}
+
+		template <typename TFun, typename = typename std::enable_if<
+			!std::is_same<typename std::decay<TFun>::type, InplaceFunction>::value>::type>
+		InplaceFunction(TFun && fun) K3D_NOEXCEPT
+		{
+			typedef typename std::decay<TFun>::type Callable;
+			static_assert(sizeof(Callable) <= Capacity, "callable too large, increase the InplaceFunction capacity");
+			static_assert(alignof(Callable) <= alignof(Storage), "callable over-aligned for InplaceFunction");
+			new (&m_Storage) Callable(Forward<TFun>(fun));
+			m_pOps = &OpsFor<Callable>::Table;
+		}
+
+		InplaceFunction(InplaceFunction const & rhs) : m_pOps(rhs.m_pOps)
+		{
+			if (m_pOps)
+				m_pOps->Copy(&m_Storage, &rhs.m_Storage);
+		}
+
+		InplaceFunction(InplaceFunction && rhs) K3D_NOEXCEPT : m_pOps(rhs.m_pOps)
+		{
+			if (m_pOps)
+			{
+				m_pOps->Move(&m_Storage, &rhs.m_Storage);
+				rhs.m_pOps = nullptr;
+			}
+		}
+
+		~InplaceFunction()
+		{
+			Reset();
+		}
+
+		InplaceFunction& operator=(InplaceFunction const & rhs)
+		{
+			if (this != &rhs)
+			{
+				Reset();
+				if (rhs.m_pOps)
+					rhs.m_pOps->Copy(&m_Storage, &rhs.m_Storage);
+				m_pOps = rhs.m_pOps;
+			}
+			return *this;
+		}
+
+		InplaceFunction& operator=(InplaceFunction && rhs) K3D_NOEXCEPT
+		{
+			if (this != &rhs)
+			{
+				Reset();
+				if (rhs.m_pOps)
+				{
+					rhs.m_pOps->Move(&m_Storage, &rhs.m_Storage);
+					m_pOps = rhs.m_pOps;
+					rhs.m_pOps = nullptr;
+				}
+			}
+			return *this;
+		}
+
+		InplaceFunction& operator=(std::nullptr_t)
+		{
+			Reset();
+			return *this;
+		}
+
+		Ret operator()(Args... args) const
+		{
+			assert(m_pOps && "InplaceFunction: calling an empty function");
+			return m_pOps->Invoke(const_cast<Storage*>(&m_Storage), Forward<Args>(args)...);
+		}
+
+		explicit operator bool() const { return m_pOps != nullptr; }
+
+		void Reset()
+		{
+			if (m_pOps)
+			{
+				m_pOps->Destroy(&m_Storage);
+				m_pOps = nullptr;
+			}
+		}
+
+	private:
+		typedef typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type Storage;
+
+		struct Ops
+		{
+			Ret		(*Invoke)(void * fun, Args&&... args);
+			void	(*Copy)(void * dst, void const * src);
+			void	(*Move)(void * dst, void * src);
+			void	(*Destroy)(void * fun);
+		};
+
+		template <typename Callable>
+		struct OpsFor
+		{
+			static Ret Invoke(void * fun, Args&&... args)
+			{
+				return (*static_cast<Callable*>(fun))(Forward<Args>(args)...);
+			}
+			static void Copy(void * dst, void const * src)
+			{
+				CopyImpl(dst, src, std::is_copy_constructible<Callable>());
+			}
+			static void CopyImpl(void * dst, void const * src, std::true_type)
+			{
+				new (dst) Callable(*static_cast<Callable const*>(src));
+			}
+			static void CopyImpl(void *, void const *, std::false_type)
+			{
+				assert(false && "InplaceFunction: copying a move-only callable");
+			}
+			static void Move(void * dst, void * src)
+			{
+				new (dst) Callable(::k3d::Move(*static_cast<Callable*>(src)));
+				static_cast<Callable*>(src)->~Callable();
+			}
+			static void Destroy(void * fun)
+			{
+				static_cast<Callable*>(fun)->~Callable();
+			}
+			static const Ops Table;
+		};
+
+		Storage			m_Storage;
+		Ops const *		m_pOps;
+	};
+
+	template <typename Ret, typename... Args, size_t Capacity>
+	template <typename Callable>
+	const typename InplaceFunction<Ret(Args...), Capacity>::Ops
+	InplaceFunction<Ret(Args...), Capacity>::OpsFor<Callable>::Table = {
+		&OpsFor<Callable>::Invoke, &OpsFor<Callable>::Copy, &OpsFor<Callable>::Move, &OpsFor<Callable>::Destroy
+	};
+}
+
+#endif
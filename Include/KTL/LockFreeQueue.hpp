@@ -1,114 +1,418 @@
 #pragma once
 
+#include "Allocator.hpp"
+#include "TypeTrait.hpp"
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
 K3D_COMMON_NS
 {
-	
-template <typename T>
-class LockFreeQueue {
+
+static const uint32 kCacheLineSize = 64;
+
+/// QueueWaiter
+/// Parks threads blocked on an empty/full queue, producers only touch the
+/// mutex when somebody is actually sleeping.
+class QueueWaiter
+{
 public:
+	QueueWaiter() : m_Waiters(0) {}
 
-	LockFreeQueue() : m_Size(0), m_Head(new Node()), m_Tail(m_Head) { }
+	template <typename Predicate>
+	void Wait(Predicate ready)
+	{
+		m_Waiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			while (!ready())
+			{
+				m_CV.wait(lock);
+			}
+		}
+		m_Waiters.fetch_sub(1);
+	}
 
-	~LockFreeQueue() {
-		while (DequeueAndDelete());
-		delete m_Head;
+	/// \return false if timed out before ready() turned true
+	template <typename Predicate>
+	bool WaitFor(Predicate ready, uint32 milliseconds)
+	{
+		m_Waiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool isReady = false;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			isReady = m_CV.wait_for(lock, std::chrono::milliseconds(milliseconds), ready);
+		}
+		m_Waiters.fetch_sub(1);
+		return isReady;
 	}
 
-	bool IsEmpty() const {
-		return m_Head->m_Next == nullptr;
+	void NotifyOne()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_Waiters.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_CV.notify_one();
+		}
 	}
 
-	void Enqueue(const T& v) {
-		const Node* const node = new Node(v);
-		while (1) {
-			const Node* const last = m_Tail;
-			const Node* const next = last->m_Next;
-			if (last != m_Tail) { continue; }
-			if (next == nullptr) {
-				if (compare_and_set(&last->m_Next, next, node)) {
-					compare_and_set(&m_Tail, last, node);
-					++m_Size;
-					return;
-				}
-			}
-			else {
-				compare_and_set(&m_Tail, last, next);
-			}
+	void NotifyAll()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_Waiters.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_CV.notify_all();
 		}
 	}
 
-	T Dequeue() { // it returns false if there is nothing to deque.
-		while (1) {
-			const Node* const first = m_Head;
-			const Node* const last = m_Tail;
-			const Node* const next = first->m_Next;
+private:
+	std::atomic<int32>		m_Waiters;
+	std::mutex				m_Mutex;
+	std::condition_variable	m_CV;
+};
 
-			if (first != m_Head) { continue; }
+/// MPMCQueue
+/// Bounded multi-producer multi-consumer ring queue (Vyukov), every slot
+/// carries a sequence number, so no allocation happens after construction.
+/// Capacity is rounded up to power of two.
+template <typename T, typename TAllocator = kAllocator>
+class MPMCQueue
+{
+public:
+	explicit MPMCQueue(uint32 capacity = 1024)
+		: m_Mask(RoundUp(capacity) - 1)
+		, m_Cells(nullptr)
+		, m_EnqueuePos(0)
+		, m_DequeuePos(0)
+	{
+		m_Cells = (Cell*)m_Allocator.allocate(sizeof(Cell) * (m_Mask + 1), 0);
+		for (uint64 i = 0; i <= m_Mask; i++)
+		{
+			new (&m_Cells[i]) Cell;
+			m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+	}
 
-			if (first == last) {
-				if (next == nullptr) {
-					while (m_Head->m_Next == nullptr) {
-						usleep(1);
-					}
-					continue;
-					//return false;
-				}
-				compare_and_set(&m_Tail, last, next);
+	~MPMCQueue()
+	{
+		T value;
+		while (TryDequeue(value));
+		for (uint64 i = 0; i <= m_Mask; i++)
+		{
+			m_Cells[i].~Cell();
+		}
+		m_Allocator.deallocate(m_Cells, sizeof(Cell) * (m_Mask + 1));
+	}
+
+	template <typename U>
+	bool TryEnqueue(U && value)
+	{
+		Cell * cell = nullptr;
+		uint64 pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell = &m_Cells[pos & m_Mask];
+			uint64 seq = cell->Sequence.load(std::memory_order_acquire);
+			int64 diff = (int64)seq - (int64)pos;
+			if (diff == 0)
+			{
+				if (m_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // full
 			}
-			else {
-				T result = next->mValue;
-				if (compare_and_set(&m_Head, first, next)) {
-					delete first;
-					return result;
-				}
+			else
+			{
+				pos = m_EnqueuePos.load(std::memory_order_relaxed);
 			}
 		}
+		new (cell->Value()) T(Forward<U>(value));
+		cell->Sequence.store(pos + 1, std::memory_order_release);
+		m_NotEmpty.NotifyOne();
+		return true;
 	}
 
-	bool DequeueAndDelete() { // it destroys dequed item. but fast.
-		while (1) {
-			const Node* const first = m_Head;
-			const Node* const last = m_Tail;
-			const Node* const next = first->m_Next;
-
-			if (first != m_Head) { continue; }
-
-			if (first == last) {
-				if (next == nullptr) {
-					return false;
-				}
-				compare_and_set(&m_Tail, last, next);
+	bool TryDequeue(T & value)
+	{
+		Cell * cell = nullptr;
+		uint64 pos = m_DequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell = &m_Cells[pos & m_Mask];
+			uint64 seq = cell->Sequence.load(std::memory_order_acquire);
+			int64 diff = (int64)seq - (int64)(pos + 1);
+			if (diff == 0)
+			{
+				if (m_DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // empty
 			}
-			else {
-				if (compare_and_set(&m_Head, first, next)) {
-					delete first;
-					return true;
-				}
+			else
+			{
+				pos = m_DequeuePos.load(std::memory_order_relaxed);
 			}
 		}
+		T * slot = cell->Value();
+		value = Move(*slot);
+		slot->~T();
+		cell->Sequence.store(pos + m_Mask + 1, std::memory_order_release);
+		m_NotFull.NotifyOne();
+		return true;
+	}
+
+	/// Blocks while the queue is full
+	template <typename U>
+	void Enqueue(U && value)
+	{
+		while (!TryEnqueue(Forward<U>(value)))
+		{
+			m_NotFull.Wait([this]() { return !IsFull(); });
+		}
+	}
+
+	/// Blocks until an element is available
+	void Dequeue(T & value)
+	{
+		while (!TryDequeue(value))
+		{
+			m_NotEmpty.Wait([this]() { return !IsEmpty(); });
+		}
+	}
+
+	/// \return false if nothing arrived within timeout
+	bool Dequeue(T & value, uint32 milliseconds)
+	{
+		if (TryDequeue(value))
+			return true;
+		m_NotEmpty.WaitFor([this]() { return !IsEmpty(); }, milliseconds);
+		return TryDequeue(value);
+	}
+
+	/// Wake every blocked consumer, e.g. before shutting a worker down
+	void WakeAll()
+	{
+		m_NotEmpty.NotifyAll();
+		m_NotFull.NotifyAll();
+	}
+
+	bool IsEmpty() const
+	{
+		uint64 pos = m_DequeuePos.load(std::memory_order_acquire);
+		return m_Cells[pos & m_Mask].Sequence.load(std::memory_order_acquire) != pos + 1;
+	}
+
+	bool IsFull() const
+	{
+		uint64 pos = m_EnqueuePos.load(std::memory_order_acquire);
+		return m_Cells[pos & m_Mask].Sequence.load(std::memory_order_acquire) != pos;
+	}
+
+	/// Approximate when used concurrently
+	uint64 Count() const
+	{
+		uint64 enq = m_EnqueuePos.load(std::memory_order_acquire);
+		uint64 deq = m_DequeuePos.load(std::memory_order_acquire);
+		return enq > deq ? enq - deq : 0;
 	}
 
+	uint64 Capacity() const { return m_Mask + 1; }
 
-	LockFreeQueue(const LockFreeQueue&&) = delete;
-	LockFreeQueue(const LockFreeQueue&) = delete;
-	LockFreeQueue & operator=(const LockFreeQueue&) = delete;
+	MPMCQueue(const MPMCQueue&&) = delete;
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue & operator=(const MPMCQueue&) = delete;
 
 private:
+	static uint64 RoundUp(uint32 capacity)
+	{
+		uint64 size = 2;
+		while (size < capacity)
+			size <<= 1;
+		return size;
+	}
 
-	class Node {
-	public:
-		const T m_Value;
-		Node* m_Next;
-		Node(const T& v) : m_Value(v), m_Next(nullptr) {}
-		Node() : m_Value(), m_Next(nullptr) {};
-	private:
-		Node(const Node&) = delete;
-		Node& operator=(const Node&) = delete;
+	struct Cell
+	{
+		std::atomic<uint64>	Sequence;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+		T * Value() { return reinterpret_cast<T*>(&Storage); }
 	};
 
-	volatile int m_Size;
+	const uint64			m_Mask;
+	Cell *					m_Cells;
+	TAllocator				m_Allocator;
+	char					m_Pad0[kCacheLineSize];
+	std::atomic<uint64>		m_EnqueuePos;
+	char					m_Pad1[kCacheLineSize - sizeof(std::atomic<uint64>)];
+	std::atomic<uint64>		m_DequeuePos;
+	char					m_Pad2[kCacheLineSize - sizeof(std::atomic<uint64>)];
+	QueueWaiter				m_NotEmpty;
+	QueueWaiter				m_NotFull;
+};
+
+/// SPSCQueue
+/// Bounded single-producer single-consumer ring, each side caches the
+/// other side's index to avoid touching the shared cache line per call.
+template <typename T, typename TAllocator = kAllocator>
+class SPSCQueue
+{
+public:
+	explicit SPSCQueue(uint32 capacity = 1024)
+		: m_Mask(RoundUp(capacity) - 1)
+		, m_Slots(nullptr)
+		, m_Head(0)
+		, m_CachedTail(0)
+		, m_Tail(0)
+		, m_CachedHead(0)
+	{
+		m_Slots = (T*)m_Allocator.allocate(sizeof(T) * (m_Mask + 1), 0);
+	}
+
+	~SPSCQueue()
+	{
+		T value;
+		while (TryDequeue(value));
+		m_Allocator.deallocate(m_Slots, sizeof(T) * (m_Mask + 1));
+	}
+
+	/// producer side
+	template <typename U>
+	bool TryEnqueue(U && value)
+	{
+		uint64 tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail - m_CachedHead > m_Mask)
+		{
+			m_CachedHead = m_Head.load(std::memory_order_acquire);
+			if (tail - m_CachedHead > m_Mask)
+				return false; // full
+		}
+		new (&m_Slots[tail & m_Mask]) T(Forward<U>(value));
+		m_Tail.store(tail + 1, std::memory_order_release);
+		m_NotEmpty.NotifyOne();
+		return true;
+	}
+
+	/// consumer side
+	bool TryDequeue(T & value)
+	{
+		uint64 head = m_Head.load(std::memory_order_relaxed);
+		if (head == m_CachedTail)
+		{
+			m_CachedTail = m_Tail.load(std::memory_order_acquire);
+			if (head == m_CachedTail)
+				return false; // empty
+		}
+		T * slot = &m_Slots[head & m_Mask];
+		value = Move(*slot);
+		slot->~T();
+		m_Head.store(head + 1, std::memory_order_release);
+		m_NotFull.NotifyOne();
+		return true;
+	}
+
+	/// consumer side, peek without popping, nullptr if empty
+	T * Front()
+	{
+		uint64 head = m_Head.load(std::memory_order_relaxed);
+		if (head == m_CachedTail)
+		{
+			m_CachedTail = m_Tail.load(std::memory_order_acquire);
+			if (head == m_CachedTail)
+				return nullptr;
+		}
+		return &m_Slots[head & m_Mask];
+	}
+
+	template <typename U>
+	void Enqueue(U && value)
+	{
+		while (!TryEnqueue(Forward<U>(value)))
+		{
+			m_NotFull.Wait([this]() { return !IsFull(); });
+		}
+	}
 
-	Node *m_Head, *m_Tail;
+	void Dequeue(T & value)
+	{
+		while (!TryDequeue(value))
+		{
+			m_NotEmpty.Wait([this]() { return !IsEmpty(); });
+		}
+	}
+
+	bool Dequeue(T & value, uint32 milliseconds)
+	{
+		if (TryDequeue(value))
+			return true;
+		m_NotEmpty.WaitFor([this]() { return !IsEmpty(); }, milliseconds);
+		return TryDequeue(value);
+	}
+
+	void WakeAll()
+	{
+		m_NotEmpty.NotifyAll();
+		m_NotFull.NotifyAll();
+	}
+
+	bool IsEmpty() const
+	{
+		return m_Tail.load(std::memory_order_acquire) == m_Head.load(std::memory_order_acquire);
+	}
+
+	bool IsFull() const
+	{
+		return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire) > m_Mask;
+	}
+
+	uint64 Count() const
+	{
+		return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+	}
+
+	uint64 Capacity() const { return m_Mask + 1; }
+
+	SPSCQueue(const SPSCQueue&&) = delete;
+	SPSCQueue(const SPSCQueue&) = delete;
+	SPSCQueue & operator=(const SPSCQueue&) = delete;
+
+private:
+	static uint64 RoundUp(uint32 capacity)
+	{
+		uint64 size = 2;
+		while (size < capacity)
+			size <<= 1;
+		return size;
+	}
+
+	const uint64			m_Mask;
+	T *						m_Slots;
+	TAllocator				m_Allocator;
+	char					m_Pad0[kCacheLineSize];
+	// consumer line
+	std::atomic<uint64>		m_Head;
+	uint64					m_CachedTail;
+	char					m_Pad1[kCacheLineSize - sizeof(std::atomic<uint64>) - sizeof(uint64)];
+	// producer line
+	std::atomic<uint64>		m_Tail;
+	uint64					m_CachedHead;
+	char					m_Pad2[kCacheLineSize - sizeof(std::atomic<uint64>) - sizeof(uint64)];
+	QueueWaiter				m_NotEmpty;
+	QueueWaiter				m_NotFull;
 };
 
-}
\ No newline at end of file
+/// Former unbounded linked queue, kept as name for existing users
+template <typename T>
+using LockFreeQueue = MPMCQueue<T>;
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef __Name_hpp__
+#define __Name_hpp__
+
+#include "HashMap.hpp"
+
+K3D_COMMON_NS
+{
+	/// Name
+	/// Interned string, holds only a 64 bit ID (FNV-1a of the characters).
+	/// The ID of a literal is a compile time constant (K3D_NAME_ID), the
+	/// global name table maps IDs back to their characters for debugging.
+	/// Interned strings are never released.
+	class K3D_API Name
+	{
+	public:
+		typedef uint64 IdType;
+
+		static constexpr IdType HashOf(const char * str)
+		{
+			return HashStep(str, 14695981039346656037ULL);
+		}
+
+		static IdType HashOf(const char * str, size_t length)
+		{
+			IdType hash = 14695981039346656037ULL;
+			for (size_t i = 0; i < length; i++)
+				hash = (hash ^ (uint8)str[i]) * 1099511628211ULL;
+			return hash;
+		}
+
+		constexpr Name() : m_Id(0) {}
+		/// Interns str
+		explicit Name(const char * str);
+		Name(const char * str, size_t length);
+		explicit Name(std::string const & str) : Name(str.data(), str.size()) {}
+		explicit Name(String const & str) : Name(str.CStr(), str.Length()) {}
+
+		/// Wrap an ID without touching the table, e.g. from K3D_NAME_ID
+		static constexpr Name FromId(IdType id) { return Name(id, 0); }
+		/// Look str up without interning it, None if it was never interned
+		static Name Find(const char * str);
+		/// Number of interned names
+		static uint64 Count();
+
+		constexpr IdType GetId() const { return m_Id; }
+		constexpr bool IsNone() const { return m_Id == 0; }
+		/// "None", or "<unknown>" for an ID that was never interned
+		const char * CStr() const;
+
+		constexpr bool operator==(Name const & rhs) const { return m_Id == rhs.m_Id; }
+		constexpr bool operator!=(Name const & rhs) const { return m_Id != rhs.m_Id; }
+		constexpr bool operator<(Name const & rhs) const { return m_Id < rhs.m_Id; }
+
+	private:
+		constexpr Name(IdType id, int) : m_Id(id) {}
+
+		static constexpr IdType HashStep(const char * str, IdType hash)
+		{
+			return *str ? HashStep(str + 1, (hash ^ (uint8)*str) * 1099511628211ULL) : hash;
+		}
+
+		IdType m_Id;
+	};
+
+	template <> struct Hash<Name>
+	{
+		uint64 operator()(Name const & name) const { return Hash<uint64>()(name.GetId()); }
+	};
+}
+
+/// Compile time ID of a string literal, usable in switch cases and templates
+#define K3D_NAME_ID(str) (::k3d::Name::HashOf(str))
+/// Name of a string literal, interned once on first use
+#define K3D_NAME(str) ([]() -> ::k3d::Name const & { static const ::k3d::Name s_Name(str); return s_Name; }())
+
+#endif
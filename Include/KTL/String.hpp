@@ -2,6 +2,7 @@
 
 #include "Allocator.hpp"
 #include "Archive.hpp"
+#include <cstdarg>
 
 K3D_COMMON_NS
 {
@@ -15,6 +16,9 @@ inline uint64 CharLength(const BaseChar* cStr)
 
 extern K3D_API int Vsnprintf(char*, int n, const char* fmt, va_list);
 
+/// StringBase
+/// Strings up to InlineCapacity characters live inside the object, longer
+/// ones on the heap with geometric growth. Data() is never null.
 template <typename BaseChar, typename Allocator>
 class StringBase
 {
@@ -24,84 +28,77 @@ public:
 	typedef StringBase<BaseChar, Allocator> ThisString;
 	typedef uint64							CharPosition;
 
+	/// Characters stored without heap allocation, excluding the terminator
+	static const uint64 InlineCapacity = 24 / sizeof(BaseChar) - 1;
+
 	StringBase() K3D_NOEXCEPT
-		: m_pStringData(nullptr)
-		, m_StringLength(0)
-		, m_Capacity(0)
 	{
+		InitInline();
 	}
 
 	StringBase(const void * pData, size_t szData) K3D_NOEXCEPT
-		: m_pStringData(nullptr)
-		, m_StringLength(0)
-		, m_Capacity(0)
 	{
-		uint64 calLength = szData / sizeof(BaseChar);
-		uint64 remain = szData % sizeof(BaseChar);
-		if (remain == 0)
+		InitInline();
+		if (szData % sizeof(BaseChar) == 0)
 		{
-			m_StringLength = calLength;
-			m_Capacity = m_StringLength + 1;
-			m_pStringData = Allocate(m_Capacity);
-			memcpy(m_pStringData, pData, szData);
-			m_pStringData[m_StringLength] = 0;
+			Append(reinterpret_cast<ConstCharPointer>(pData), szData / sizeof(BaseChar));
 		}
 	}
 
 	StringBase(ConstCharPointer pStr) K3D_NOEXCEPT
-		: m_pStringData(nullptr)
-		, m_StringLength(0)
-		, m_Capacity(0)
 	{
-		m_StringLength = CharLength(pStr);
-		if (m_StringLength)
+		InitInline();
+		if (pStr)
 		{
-			m_Capacity = (uint64)(1.5f * m_StringLength + 0.5f);
-			m_pStringData = Allocate(m_Capacity);
-			memcpy(m_pStringData, pStr, m_StringLength * sizeof(BaseChar));
-			m_pStringData[m_StringLength] = 0;
+			Append(pStr, CharLength(pStr));
 		}
 	}
 
 	StringBase(const ThisString & rhs) K3D_NOEXCEPT
-		: m_pStringData(nullptr)
-		, m_StringLength(0)
-		, m_Capacity(rhs.m_Capacity)
-		, m_StringAllocator(rhs.m_StringAllocator)
+		: m_StringAllocator(rhs.m_StringAllocator)
 	{
-		Assign(rhs);
+		InitInline();
+		Append(rhs.m_pStringData, rhs.m_StringLength);
 	}
 
 	StringBase(ThisString && rhs) K3D_NOEXCEPT
-		: m_pStringData(nullptr)
-		, m_StringLength(0)
 	{
+		InitInline();
 		MoveAssign(Move(rhs));
 	}
 
 	~StringBase()
 	{
-		if (m_pStringData)
+		if (!IsInline())
 		{
 			Deallocate();
 		}
-		m_pStringData = nullptr;
-		m_StringLength = 0;
 	}
 
 	uint64				Length() const { return m_StringLength; }
+	/// Characters that fit without reallocating, excluding the terminator
+	uint64				Capacity() const { return IsInline() ? InlineCapacity : m_HeapCapacity - 1; }
+	bool				IsEmpty() const { return m_StringLength == 0; }
 	ConstCharPointer	Data() const { return m_pStringData; }
 	ConstCharPointer	CStr() const { return m_pStringData; }
 
 	ThisString&			operator=(const ThisString& rhs) { Assign(rhs); return *this; }
 	ThisString&			operator=(ThisString&& rhs) { MoveAssign(Move(rhs)); return *this; }
-	ThisString&         operator+=(const ThisString& rhs);
+	ThisString&         operator+=(const ThisString& rhs) { return Append(rhs.m_pStringData, rhs.m_StringLength); }
+	ThisString&         operator+=(ConstCharPointer rhs) { return Append(rhs, CharLength(rhs)); }
 	ThisString&         operator+=(const BaseChar& rhs);
 	BaseChar			operator[](uint64 id) const;
+	ThisString&			Append(ConstCharPointer pStr, uint64 count);
+	/// Formats straight into the spare capacity, grows and formats again only if it did not fit
 	ThisString&         AppendSprintf(const BaseChar* fmt, ...);
 	void				Swap(ThisString& rhs);
 
-	void				Resize(int newSize);
+	/// Make room for at least newCapacity characters, keeps the content
+	void				Reserve(uint64 newCapacity);
+	/// Same as Reserve, the length is left unchanged
+	void				Resize(int newSize) { Reserve(newSize > 0 ? (uint64)newSize : 0); }
+	/// Empties the string, keeps the capacity
+	void				Clear() { m_StringLength = 0; m_pStringData[0] = 0; }
 	//CharPosition		FindFirstOf(BaseChar _char);
 
 	template <typename T, typename A>
@@ -118,9 +115,24 @@ protected:
 	void				Assign(ThisString const& rhs);
 
 private:
+	bool				IsInline() const { return m_pStringData == m_Inline; }
+	void				InitInline() { m_pStringData = m_Inline; m_StringLength = 0; m_Inline[0] = 0; }
+	/// Reallocate to exactly newCapacity characters plus the terminator
+	void				Reallocate(uint64 newCapacity);
+	/// Grow by at least 1.5x so repeated appends stay amortized O(1)
+	void				GrowFor(uint64 required)
+	{
+		uint64 capacity = Capacity();
+		Reallocate(required > capacity + capacity / 2 ? required : capacity + capacity / 2);
+	}
+
 	CharPointer			m_pStringData;
 	uint64				m_StringLength;
-	uint64              m_Capacity;
+	union
+	{
+		uint64			m_HeapCapacity; // allocated characters, terminator included
+		BaseChar		m_Inline[InlineCapacity + 1];
+	};
 	Allocator			m_StringAllocator;
 };
 
@@ -133,150 +145,159 @@ KFORCE_INLINE BaseChar* StringBase<BaseChar, Allocator>::Allocate(uint64 length)
 template <typename BaseChar, typename Allocator>
 KFORCE_INLINE void StringBase<BaseChar, Allocator>::Deallocate()
 {
-	m_StringAllocator.deallocate(m_pStringData, sizeof(BaseChar)*m_StringLength);
+	m_StringAllocator.deallocate(m_pStringData, sizeof(BaseChar) * m_HeapCapacity);
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE void StringBase<BaseChar, Allocator>::MoveAssign(StringBase<BaseChar, Allocator> && rhs)
+KFORCE_INLINE void StringBase<BaseChar, Allocator>::Reallocate(uint64 newCapacity)
 {
-	m_pStringData = rhs.m_pStringData;
-	m_StringLength = rhs.m_StringLength;
-	m_Capacity = rhs.m_Capacity;
-	m_StringAllocator = Move(rhs.m_StringAllocator);
-	rhs.m_pStringData = nullptr;
-	rhs.m_StringLength = 0;
-	rhs.m_Capacity = 0;
+	CharPointer pNewData = Allocate(newCapacity + 1);
+	memcpy(pNewData, m_pStringData, m_StringLength * sizeof(BaseChar));
+	pNewData[m_StringLength] = 0;
+	if (!IsInline())
+	{
+		Deallocate();
+	}
+	m_pStringData = pNewData;
+	m_HeapCapacity = newCapacity + 1;
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE void StringBase<BaseChar, Allocator>::Assign(StringBase<BaseChar, Allocator> const & rhs)
+KFORCE_INLINE void StringBase<BaseChar, Allocator>::Reserve(uint64 newCapacity)
 {
-	if (m_pStringData != rhs.m_pStringData)
+	if (newCapacity > Capacity())
 	{
-		if (m_pStringData)
-		{
-			Deallocate();
-		}
-		m_Capacity = rhs.m_StringLength + 1;
-		m_pStringData = Allocate(m_Capacity);
-		m_StringLength = rhs.m_StringLength;
-		memcpy(m_pStringData, rhs.m_pStringData, rhs.m_StringLength * sizeof(BaseChar));
-		m_pStringData[m_StringLength] = 0;
+		Reallocate(newCapacity);
 	}
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE StringBase<BaseChar, Allocator>&
-StringBase<BaseChar, Allocator>::AppendSprintf(const BaseChar *fmt, ...)
+KFORCE_INLINE void StringBase<BaseChar, Allocator>::MoveAssign(StringBase<BaseChar, Allocator> && rhs)
 {
-	va_list va;
-	va_start(va, fmt);
-	int length = Vsnprintf(m_pStringData + m_StringLength, m_Capacity - m_StringLength, fmt, va);
-	va_end(va);
-
-	auto newLen = length + m_StringLength;
-	if (newLen >= m_Capacity)
+	if (this == &rhs)
+		return;
+	if (!IsInline())
 	{
-		m_Capacity = (uint64)(1.33f * newLen + 1.0f);
-		BaseChar* newString = Allocate(m_Capacity);
-		memcpy(newString, m_pStringData, m_StringLength * sizeof(BaseChar));
-
-		va_list va;
-		va_start(va, fmt);
-		Vsnprintf(newString + m_StringLength, m_Capacity - m_StringLength, fmt, va);
-		va_end(va);
-
 		Deallocate();
-		m_pStringData = newString;
 	}
-
-	m_StringLength = newLen;
-
-	return *this;
+	m_StringAllocator = Move(rhs.m_StringAllocator);
+	m_StringLength = rhs.m_StringLength;
+	if (rhs.IsInline())
+	{
+		m_pStringData = m_Inline;
+		memcpy(m_Inline, rhs.m_Inline, (m_StringLength + 1) * sizeof(BaseChar));
+	}
+	else
+	{
+		m_pStringData = rhs.m_pStringData;
+		m_HeapCapacity = rhs.m_HeapCapacity;
+	}
+	rhs.InitInline();
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE void StringBase<BaseChar, Allocator>::Swap(StringBase<BaseChar, Allocator> & rhs)
+KFORCE_INLINE void StringBase<BaseChar, Allocator>::Assign(StringBase<BaseChar, Allocator> const & rhs)
 {
-	BaseChar* p = rhs.m_pStringData;
-	rhs.m_pStringData = m_pStringData;
-	m_pStringData = p;
-
-	uint64 l = rhs.m_StringLength;
-	rhs.m_StringLength = m_StringLength;
-	m_StringLength = l;
+	if (this != &rhs)
+	{
+		Clear();
+		Append(rhs.m_pStringData, rhs.m_StringLength);
+	}
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE void StringBase<BaseChar, Allocator>::Resize(int newSize)
+KFORCE_INLINE StringBase<BaseChar, Allocator>&
+StringBase<BaseChar, Allocator>::Append(ConstCharPointer pStr, uint64 count)
 {
-	auto newCapacity = (uint64)(1.1f * newSize + 1.0f);
-	if (newCapacity > m_Capacity)
+	auto newLen = m_StringLength + count;
+	if (newLen > Capacity())
 	{
-		m_Capacity = newCapacity;
-		auto pStringData = Allocate(m_Capacity);
-		if (m_StringLength)
+		// pStr may point into our own buffer
+		if (pStr >= m_pStringData && pStr <= m_pStringData + m_StringLength)
 		{
-			memcpy(pStringData, m_pStringData, sizeof(BaseChar) * m_StringLength);
-			pStringData[m_StringLength] = 0;
-			Deallocate();
+			auto offset = pStr - m_pStringData;
+			GrowFor(newLen);
+			pStr = m_pStringData + offset;
 		}
 		else
 		{
-			memset(pStringData, 0, sizeof(BaseChar) * m_Capacity);
+			GrowFor(newLen);
 		}
-		m_pStringData = pStringData;
 	}
+	memmove(m_pStringData + m_StringLength, pStr, count * sizeof(BaseChar));
+	m_pStringData[newLen] = 0;
+	m_StringLength = newLen;
+	return *this;
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE BaseChar StringBase<BaseChar, Allocator>::operator[](uint64 id) const
+KFORCE_INLINE StringBase<BaseChar, Allocator>&
+StringBase<BaseChar, Allocator>::AppendSprintf(const BaseChar *fmt, ...)
 {
-	return m_pStringData[id];
+	va_list va;
+	va_list retry;
+	va_start(va, fmt);
+	va_copy(retry, va);
+	uint64 spare = Capacity() - m_StringLength;
+	int length = Vsnprintf(m_pStringData + m_StringLength, (int)(spare + 1), fmt, va);
+	va_end(va);
+
+	if (length > 0 && (uint64)length > spare)
+	{
+		GrowFor(m_StringLength + length);
+		Vsnprintf(m_pStringData + m_StringLength, (int)(Capacity() - m_StringLength + 1), fmt, retry);
+	}
+	va_end(retry);
+
+	if (length > 0)
+	{
+		m_StringLength += length;
+	}
+	m_pStringData[m_StringLength] = 0;
+	return *this;
 }
 
 template <typename BaseChar, typename Allocator>
-KFORCE_INLINE StringBase<BaseChar, Allocator>&
-StringBase<BaseChar, Allocator>::operator+=(StringBase<BaseChar, Allocator> const& rhs)
+KFORCE_INLINE void StringBase<BaseChar, Allocator>::Swap(StringBase<BaseChar, Allocator> & rhs)
 {
-	auto rLen = rhs.m_StringLength;
-	auto newLen = m_StringLength + rLen;
-	if (newLen >= m_Capacity)
+	if (this == &rhs)
+		return;
+	if (!IsInline() && !rhs.IsInline())
 	{
-		m_Capacity = uint64(1.5*newLen + 1);
-		auto pNewData = Allocate(m_Capacity);
-		if (m_pStringData)
-		{
-			memcpy(pNewData, m_pStringData, m_StringLength * sizeof(BaseChar));
-			Deallocate();
-		}
-		m_pStringData = pNewData;
+		BaseChar* p = rhs.m_pStringData;
+		rhs.m_pStringData = m_pStringData;
+		m_pStringData = p;
+
+		uint64 l = rhs.m_StringLength;
+		rhs.m_StringLength = m_StringLength;
+		m_StringLength = l;
+
+		uint64 c = rhs.m_HeapCapacity;
+		rhs.m_HeapCapacity = m_HeapCapacity;
+		m_HeapCapacity = c;
+		return;
 	}
-	memcpy(m_pStringData + m_StringLength, rhs.m_pStringData, rLen * sizeof(BaseChar));
-	m_pStringData[newLen] = 0;
-	m_StringLength = newLen;
-	return *this;
+	ThisString tmp(Move(rhs));
+	rhs.MoveAssign(Move(*this));
+	MoveAssign(Move(tmp));
+}
+
+template <typename BaseChar, typename Allocator>
+KFORCE_INLINE BaseChar StringBase<BaseChar, Allocator>::operator[](uint64 id) const
+{
+	return m_pStringData[id];
 }
 
 template <typename BaseChar, typename Allocator>
 KFORCE_INLINE StringBase<BaseChar, Allocator>&
 StringBase<BaseChar, Allocator>::operator+=(BaseChar const& rhs)
 {
-	auto newLen = m_StringLength + 1;
-	if (newLen >= m_Capacity)
+	if (m_StringLength == Capacity())
 	{
-		m_Capacity = uint64(1.5*newLen + 1);
-		auto pNewData = Allocate(m_Capacity);
-		if (m_pStringData)
-		{
-			memcpy(pNewData, m_pStringData, m_StringLength * sizeof(BaseChar));
-			Deallocate();
-		}
-		m_pStringData = pNewData;
+		GrowFor(m_StringLength + 1);
 	}
-	m_pStringData[m_StringLength] = rhs;
-	m_pStringData[newLen] = 0;
-	m_StringLength = newLen;
+	m_pStringData[m_StringLength++] = rhs;
+	m_pStringData[m_StringLength] = 0;
 	return *this;
 }
 
@@ -284,7 +305,9 @@ template <typename BaseChar, typename Allocator>
 KFORCE_INLINE StringBase<BaseChar, Allocator>
 operator+(StringBase<BaseChar, Allocator> const& lhs, StringBase<BaseChar, Allocator> const& rhs)
 {
-	StringBase<BaseChar, Allocator> ret(lhs);
+	StringBase<BaseChar, Allocator> ret;
+	ret.Reserve(lhs.Length() + rhs.Length());
+	ret += lhs;
 	ret += rhs;
 	return ret;
 }
@@ -301,7 +324,9 @@ KFORCE_INLINE bool operator==(StringBase<BaseChar, Allocator> const& lhs, String
 template <typename BaseChar, typename Allocator>
 Archive& operator<<(Archive & ar, StringBase<BaseChar, Allocator> const& str)
 {
-	ar << str.m_Capacity << str.m_StringLength;
+	// the capacity field is kept for format compatibility, readers ignore it
+	uint64 capacity = str.Capacity() + 1;
+	ar << capacity << str.m_StringLength;
 	ar.ArrayIn(str.CStr(), str.Length());
 	return ar;
 }
@@ -309,10 +334,13 @@ Archive& operator<<(Archive & ar, StringBase<BaseChar, Allocator> const& str)
 template <typename BaseChar, typename Allocator>
 Archive& operator >> (Archive & ar, StringBase<BaseChar, Allocator> & str)
 {
-	ar >> str.m_Capacity >> str.m_StringLength;
-	str.m_pStringData = str.Allocate(str.m_Capacity);
-	ar.ArrayOut(str.m_pStringData, str.Length());
-	str.m_pStringData[str.m_StringLength] = 0;
+	uint64 capacity = 0, length = 0;
+	ar >> capacity >> length;
+	str.Clear();
+	str.Reserve(length);
+	ar.ArrayOut(str.m_pStringData, length);
+	str.m_StringLength = length;
+	str.m_pStringData[length] = 0;
 	return ar;
 }
 
@@ -1,13 +1,409 @@
 #include "Kaleido3D.h"
 #include <KTL/Allocator.hpp>
+#include <atomic>
+#include <thread>
+
+#if K3DPLATFORM_OS_WIN
+#include <malloc.h>
+#endif
+
+K3D_COMMON_NS
+{
+	namespace
+	{
+		// classes: 16..128 step 16, then 4 classes per power of two up to MaxSmallSize
+		const uint32 kNumSizeClasses = 8 + 8 * 4;
+		const size_t kSpanShift = 18;
+		const size_t kSpanSize = size_t(1) << kSpanShift;
+
+		// span -> size class map, covers 48 bit address space
+		const uint32 kPageMapBits = 48 - kSpanShift;
+		const uint32 kPageMapLeafBits = kPageMapBits / 2;
+		const uint32 kPageMapRootSize = 1u << (kPageMapBits - kPageMapLeafBits);
+		const uint32 kPageMapLeafSize = 1u << kPageMapLeafBits;
+
+		inline uint32 FloorLog2(size_t v)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanReverse(&index, (unsigned long)v);
+			return index;
+#else
+			return 31 - __builtin_clz((unsigned int)v);
+#endif
+		}
+
+		inline uint32 SizeToClass(size_t size)
+		{
+			if (size <= 128)
+			{
+				return size == 0 ? 0 : (uint32)((size + 15) >> 4) - 1;
+			}
+			size_t v = size - 1;
+			uint32 lg = FloorLog2(v);
+			return 8 + (lg - 7) * 4 + (uint32)((v - (size_t(1) << lg)) >> (lg - 2));
+		}
+
+		inline size_t ClassToSize(uint32 cls)
+		{
+			if (cls < 8)
+			{
+				return (cls + 1) * 16;
+			}
+			size_t base = size_t(128) << ((cls - 8) / 4);
+			return base + (base >> 2) * ((cls - 8) % 4 + 1);
+		}
+
+		inline uint32 ClassBatchSize(uint32 cls)
+		{
+			size_t n = (64 * 1024) / ClassToSize(cls);
+			return n < 2 ? 2 : (n > 64 ? 64 : (uint32)n);
+		}
+
+		class SpinLock
+		{
+		public:
+			void Lock()
+			{
+				while (m_Locked.exchange(true, std::memory_order_acquire))
+				{
+					while (m_Locked.load(std::memory_order_relaxed))
+						std::this_thread::yield();
+				}
+			}
+			void UnLock() { m_Locked.store(false, std::memory_order_release); }
+		private:
+			std::atomic<bool> m_Locked;
+		};
+
+		struct FreeObject
+		{
+			FreeObject * Next;
+		};
+
+		// all members are zero initialized, usable before static constructors run
+		struct Depot
+		{
+			SpinLock				Lock;
+			FreeObject *			Head;
+			uint64					Count;
+			std::atomic<uint64>		Allocs;
+			std::atomic<uint64>		Frees;
+			std::atomic<uint64>		SpanBytes;
+		};
+
+		Depot g_Depots[kNumSizeClasses];
+		std::atomic<uint8*> g_PageMap[kPageMapRootSize];
+		SpinLock g_PageMapLock;
+		std::atomic<uint64> g_LargeAllocs;
+		std::atomic<uint64> g_LargeFrees;
+
+		/// \return size class + 1, 0 if p is not inside a span
+		inline uint32 LookupSpan(void * p)
+		{
+			uintptr_t key = (uintptr_t)p >> kSpanShift;
+			uintptr_t root = key >> kPageMapLeafBits;
+			if (root >= kPageMapRootSize)
+				return 0;
+			uint8 * leaf = g_PageMap[root].load(std::memory_order_acquire);
+			return leaf ? leaf[key & (kPageMapLeafSize - 1)] : 0;
+		}
+
+		bool RegisterSpan(void * span, uint32 cls)
+		{
+			uintptr_t key = (uintptr_t)span >> kSpanShift;
+			uintptr_t root = key >> kPageMapLeafBits;
+			if (root >= kPageMapRootSize)
+				return false;
+			g_PageMapLock.Lock();
+			uint8 * leaf = g_PageMap[root].load(std::memory_order_relaxed);
+			if (!leaf)
+			{
+				leaf = (uint8*)calloc(kPageMapLeafSize, 1);
+				if (!leaf)
+				{
+					g_PageMapLock.UnLock();
+					return false;
+				}
+				g_PageMap[root].store(leaf, std::memory_order_release);
+			}
+			leaf[key & (kPageMapLeafSize - 1)] = (uint8)(cls + 1);
+			g_PageMapLock.UnLock();
+			return true;
+		}
+
+		void * AllocateSpan()
+		{
+#if K3DPLATFORM_OS_WIN
+			return _aligned_malloc(kSpanSize, kSpanSize);
+#else
+			void * span = nullptr;
+			return posix_memalign(&span, kSpanSize, kSpanSize) == 0 ? span : nullptr;
+#endif
+		}
+
+		void FreeSpan(void * span)
+		{
+#if K3DPLATFORM_OS_WIN
+			_aligned_free(span);
+#else
+			free(span);
+#endif
+		}
+
+		/// Carve a new span into the depot, spans are never returned to the system
+		bool GrowDepot(uint32 cls)
+		{
+			void * span = AllocateSpan();
+			if (!span)
+				return false;
+			if (!RegisterSpan(span, cls))
+			{
+				FreeSpan(span);
+				return false;
+			}
+			size_t size = ClassToSize(cls);
+			size_t count = kSpanSize / size;
+			kByte * base = (kByte*)span;
+			for (size_t i = 0; i < count - 1; i++)
+			{
+				((FreeObject*)(base + i * size))->Next = (FreeObject*)(base + (i + 1) * size);
+			}
+			FreeObject * last = (FreeObject*)(base + (count - 1) * size);
+
+			Depot & depot = g_Depots[cls];
+			depot.Lock.Lock();
+			last->Next = depot.Head;
+			depot.Head = (FreeObject*)base;
+			depot.Count += count;
+			depot.Lock.UnLock();
+			depot.SpanBytes.fetch_add(kSpanSize, std::memory_order_relaxed);
+			return true;
+		}
+
+		/// Move up to count objects from the depot onto list
+		uint32 DepotPop(uint32 cls, FreeObject *& list, uint32 count)
+		{
+			Depot & depot = g_Depots[cls];
+			depot.Lock.Lock();
+			uint32 n = 0;
+			while (n < count && depot.Head)
+			{
+				FreeObject * obj = depot.Head;
+				depot.Head = obj->Next;
+				obj->Next = list;
+				list = obj;
+				n++;
+			}
+			depot.Count -= n;
+			depot.Lock.UnLock();
+			return n;
+		}
+
+		void DepotPush(uint32 cls, FreeObject * first, FreeObject * last, uint32 count)
+		{
+			Depot & depot = g_Depots[cls];
+			depot.Lock.Lock();
+			last->Next = depot.Head;
+			depot.Head = first;
+			depot.Count += count;
+			depot.Lock.UnLock();
+		}
+
+		struct FreeList
+		{
+			FreeObject *	Head;
+			uint32			Count;
+			uint32			Allocs;
+			uint32			Frees;
+		};
+
+		// plain data so the cache outlives its reaper, frees issued by
+		// thread_local destructors running later go straight to the depot
+		struct ThreadCache
+		{
+			FreeList	Lists[kNumSizeClasses];
+			bool		Registered;
+			bool		Dead;
+		};
+
+		thread_local ThreadCache t_Cache;
+
+		void FlushCounters(uint32 cls, FreeList & list)
+		{
+			Depot & depot = g_Depots[cls];
+			if (list.Allocs)
+				depot.Allocs.fetch_add(list.Allocs, std::memory_order_relaxed);
+			if (list.Frees)
+				depot.Frees.fetch_add(list.Frees, std::memory_order_relaxed);
+			list.Allocs = 0;
+			list.Frees = 0;
+		}
+
+		void ReleaseList(uint32 cls, FreeList & list, uint32 keep)
+		{
+			if (list.Count <= keep)
+				return;
+			uint32 n = list.Count - keep;
+			FreeObject * first = list.Head;
+			FreeObject * last = first;
+			for (uint32 i = 1; i < n; i++)
+				last = last->Next;
+			list.Head = last->Next;
+			list.Count = keep;
+			DepotPush(cls, first, last, n);
+		}
+
+		void FlushCache(ThreadCache & cache)
+		{
+			for (uint32 cls = 0; cls < kNumSizeClasses; cls++)
+			{
+				ReleaseList(cls, cache.Lists[cls], 0);
+				FlushCounters(cls, cache.Lists[cls]);
+			}
+		}
+
+		struct ThreadCacheReaper
+		{
+			~ThreadCacheReaper()
+			{
+				FlushCache(t_Cache);
+				t_Cache.Dead = true;
+			}
+		};
+
+		thread_local ThreadCacheReaper t_CacheReaper;
+
+		void * AllocateSmall(uint32 cls)
+		{
+			ThreadCache & cache = t_Cache;
+			if (cache.Dead)
+			{
+				FreeObject * obj = nullptr;
+				if (DepotPop(cls, obj, 1) == 0 && (!GrowDepot(cls) || DepotPop(cls, obj, 1) == 0))
+					return nullptr;
+				g_Depots[cls].Allocs.fetch_add(1, std::memory_order_relaxed);
+				return obj;
+			}
+			FreeList & list = cache.Lists[cls];
+			if (!list.Head)
+			{
+				if (!cache.Registered)
+				{
+					// first touch constructs the reaper and hooks the thread exit
+					(void)&t_CacheReaper;
+					cache.Registered = true;
+				}
+				uint32 batch = ClassBatchSize(cls);
+				uint32 n = DepotPop(cls, list.Head, batch);
+				if (n == 0)
+				{
+					if (!GrowDepot(cls))
+						return nullptr;
+					n = DepotPop(cls, list.Head, batch);
+				}
+				list.Count += n;
+				FlushCounters(cls, list);
+				if (!list.Head)
+					return nullptr;
+			}
+			FreeObject * obj = list.Head;
+			list.Head = obj->Next;
+			list.Count--;
+			list.Allocs++;
+			return obj;
+		}
+
+		void FreeSmall(void * p, uint32 cls)
+		{
+			FreeObject * obj = (FreeObject*)p;
+			ThreadCache & cache = t_Cache;
+			if (cache.Dead)
+			{
+				DepotPush(cls, obj, obj, 1);
+				g_Depots[cls].Frees.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			FreeList & list = cache.Lists[cls];
+			obj->Next = list.Head;
+			list.Head = obj;
+			list.Count++;
+			list.Frees++;
+			uint32 batch = ClassBatchSize(cls);
+			if (list.Count > 2 * batch)
+			{
+				ReleaseList(cls, list, batch);
+				FlushCounters(cls, list);
+			}
+		}
+	}
+
+	uint32 PoolAllocator::GetSizeClassCount()
+	{
+		return kNumSizeClasses;
+	}
+
+	bool PoolAllocator::GetStats(uint32 sizeClass, SizeClassStats & stats)
+	{
+		if (sizeClass >= kNumSizeClasses)
+			return false;
+		Depot & depot = g_Depots[sizeClass];
+		stats.ObjectSize = (uint32)ClassToSize(sizeClass);
+		stats.Allocs = depot.Allocs.load(std::memory_order_relaxed);
+		stats.Frees = depot.Frees.load(std::memory_order_relaxed);
+		stats.SpanBytes = depot.SpanBytes.load(std::memory_order_relaxed);
+		depot.Lock.Lock();
+		stats.DepotObjects = depot.Count;
+		depot.Lock.UnLock();
+		return true;
+	}
+
+	uint64 PoolAllocator::GetLargeAllocCount()
+	{
+		return g_LargeAllocs.load(std::memory_order_relaxed);
+	}
+
+	uint64 PoolAllocator::GetLargeFreeCount()
+	{
+		return g_LargeFrees.load(std::memory_order_relaxed);
+	}
+
+	void PoolAllocator::FlushThreadCache()
+	{
+		if (!t_Cache.Dead)
+			FlushCache(t_Cache);
+	}
+}
 
 K3D_API void* __k3d_malloc__(size_t sizeOfObj)
 {
+	if (sizeOfObj <= k3d::PoolAllocator::MaxSmallSize)
+	{
+		return k3d::AllocateSmall(k3d::SizeToClass(sizeOfObj));
+	}
+	k3d::g_LargeAllocs.fetch_add(1, std::memory_order_relaxed);
 	return malloc(sizeOfObj);
 }
 
 K3D_API void __k3d_free__(void *p, size_t sizeOfObj)
 {
+	if (!p)
+		return;
+	if (sizeOfObj == 0)
+	{
+		uint32 span = k3d::LookupSpan(p);
+		if (span)
+		{
+			k3d::FreeSmall(p, span - 1);
+			return;
+		}
+	}
+	else if (sizeOfObj <= k3d::PoolAllocator::MaxSmallSize)
+	{
+		k3d::FreeSmall(p, k3d::SizeToClass(sizeOfObj));
+		return;
+	}
+	k3d::g_LargeFrees.fetch_add(1, std::memory_order_relaxed);
 	free(p);
 }
 
@@ -15,3 +411,150 @@ K3D_API void* operator new[](size_t size, const char* pName)
 {
 	return malloc(size);
 }
+
+K3D_COMMON_NS
+{
+	namespace
+	{
+		const size_t kFrameBlockSize = 1 << 20;
+
+		struct FrameBlock
+		{
+			FrameBlock *	Next;
+			size_t			Size;
+			size_t			Used;
+
+			kByte *			Data() { return reinterpret_cast<kByte*>(this + 1); }
+		};
+
+		struct FrameBuffer
+		{
+			FrameBlock *	Head;
+			FrameBlock *	Tail;
+			FrameBlock *	Current;
+			uint64			Frame;
+			uint64			Used;
+		};
+
+		std::atomic<uint64> g_FrameIndex(0);
+
+		struct ThreadFrameArena
+		{
+			FrameBuffer		Buffers[FrameArena::FramesInFlight];
+			uint64			Reserved;
+
+			ThreadFrameArena() : Reserved(0)
+			{
+				memset(Buffers, 0, sizeof(Buffers));
+			}
+
+			~ThreadFrameArena()
+			{
+				for (FrameBuffer & buffer : Buffers)
+				{
+					FrameBlock * block = buffer.Head;
+					while (block)
+					{
+						FrameBlock * next = block->Next;
+						free(block);
+						block = next;
+					}
+				}
+			}
+
+			FrameBuffer & Acquire()
+			{
+				uint64 frame = g_FrameIndex.load(std::memory_order_relaxed);
+				FrameBuffer & buffer = Buffers[frame % FrameArena::FramesInFlight];
+				if (buffer.Frame != frame)
+				{
+					// rewind, blocks are kept for reuse
+					buffer.Frame = frame;
+					buffer.Used = 0;
+					buffer.Current = buffer.Head;
+					if (buffer.Current)
+						buffer.Current->Used = 0;
+				}
+				return buffer;
+			}
+
+			static size_t AlignedOffset(FrameBlock * block, size_t alignment)
+			{
+				uintptr_t base = (uintptr_t)block->Data();
+				uintptr_t ptr = (base + block->Used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+				return ptr - base;
+			}
+
+			void* Allocate(size_t size, size_t alignment)
+			{
+				FrameBuffer & buffer = Acquire();
+				FrameBlock * block = buffer.Current;
+				while (block)
+				{
+					size_t offset = AlignedOffset(block, alignment);
+					if (offset + size <= block->Size)
+					{
+						block->Used = offset + size;
+						buffer.Used += size;
+						return block->Data() + offset;
+					}
+					block = block->Next;
+					if (block)
+					{
+						block->Used = 0;
+						buffer.Current = block;
+					}
+				}
+
+				size_t blockSize = size + alignment > kFrameBlockSize ? size + alignment : kFrameBlockSize;
+				block = (FrameBlock*)malloc(sizeof(FrameBlock) + blockSize);
+				if (!block)
+					return nullptr;
+				block->Next = nullptr;
+				block->Size = blockSize;
+				block->Used = 0;
+				if (buffer.Tail)
+					buffer.Tail->Next = block;
+				else
+					buffer.Head = block;
+				buffer.Tail = block;
+				buffer.Current = block;
+				Reserved += blockSize;
+
+				size_t offset = AlignedOffset(block, alignment);
+				block->Used = offset + size;
+				buffer.Used += size;
+				return block->Data() + offset;
+			}
+		};
+
+		thread_local ThreadFrameArena t_FrameArena;
+	}
+
+	void* FrameArena::Allocate(size_t size, size_t alignment)
+	{
+		if (alignment < sizeof(void*))
+			alignment = sizeof(void*);
+		return t_FrameArena.Allocate(size, alignment);
+	}
+
+	void FrameArena::EndFrame()
+	{
+		g_FrameIndex.fetch_add(1, std::memory_order_release);
+	}
+
+	uint64 FrameArena::FrameIndex()
+	{
+		return g_FrameIndex.load(std::memory_order_acquire);
+	}
+
+	uint64 FrameArena::BytesUsed()
+	{
+		return t_FrameArena.Acquire().Used;
+	}
+
+	uint64 FrameArena::BytesReserved()
+	{
+		return t_FrameArena.Reserved;
+	}
+}
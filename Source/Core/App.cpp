@@ -2,6 +2,7 @@
 #include "App.h"
 #include "Message.h"
 #include "LogUtil.h"
+#include "FrameStats.h"
 
 namespace k3d
 {
@@ -64,7 +65,13 @@ namespace k3d
 			if (isQuit)
 				break;
 
-			OnUpdate();
+			{
+				K3D_FRAME_PHASE(Update);
+				OnUpdate();
+			}
+			::k3d::FrameArena::EndFrame();
+			K3D_PROFILE_FRAME();
+			FrameStats::EndFrame();
 		}
 		OnDestroy();
 #else
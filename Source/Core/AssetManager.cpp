@@ -2,17 +2,13 @@
 #include "AssetManager.h"
 #include "Os.h"
 #include "Core/LogUtil.h"
+#include "Profiler.h"
 #include "ImageData.h"
 #include "App.h"
 #include "ObjectMesh.h"
-
-#ifdef USE_TBB_MALLOC
-#include <tbb/scalable_allocator.h>
-#endif
-
-#if K3DPLATFORM_OS_ANDROID
-#include <android/asset_manager.h>
-#endif
+#include "CameraData.h"
+#include "Dispatch/Dispatcher.h"
+#include "Utils/StringUtils.h"
 
 #include <fstream>
 #include <algorithm>
@@ -27,10 +23,16 @@ namespace k3d
 	kString AssetManager::s_envAssetPath;
 
 	AssetManager::AssetManager()/* : m_pThreadPool(nullptr) */
+		: m_Streamer(new AssetStreamer(16, &m_VFS))
+		, m_Residency(new AssetResidency(m_Streamer.get()))
+		, m_CooksInFlight(0)
 	{
-		m_IsLoading = false;
-		m_HasPendingObject = false;
-		m_NumPendingObject.store(0, std::memory_order_release);
+		// where "asset://" always pointed
+#if K3DPLATFORM_OS_ANDROID
+		m_VFS.MountAndroidAssets("");
+#else
+		AddSearchPath(KT("../../Data/"));
+#endif
 	}
 
 	void AssetManager::Init()
@@ -46,7 +48,7 @@ namespace k3d
 		if (_len > 0) {
 			KLOG(Info, "AssetManager", "Kaleido3D_Dir Found. ");
 			s_envAssetPath = _path;
-			m_SearchPaths.push_back(_path);
+			AddSearchPath(_path, 1);
 		}
 		else {
 			KLOG(Error, "AssetManager", "Kaleido3D_Dir Not Found.");
@@ -58,6 +60,11 @@ namespace k3d
 	void AssetManager::Shutdown()
 	{
 		KLOG(Info, "AssetManager", "Shutdown.");
+		DisableHotReload();
+		m_Residency->Clear();
+		// cancels what is queued, waits for the reads in flight
+		m_Streamer.reset(new AssetStreamer(16, &m_VFS));
+		m_Residency->SetStreamer(m_Streamer.get());
 	}
 
 	void AssetManager::LoadAssetDescFile(const char *fileName)
@@ -71,52 +78,19 @@ namespace k3d
 		ifs.close();
 	}
 
-	void AssetManager::AddSearchPath(const kchar *path)
+	void AssetManager::AddSearchPath(const kchar *path, int32 priority)
 	{
 		typedef std::vector<kString>::const_iterator VSCIter;
 
 		VSCIter pos = std::find(m_SearchPaths.begin(), m_SearchPaths.end(), kString(path));
 		if (pos == m_SearchPaths.end()) {
 			m_SearchPaths.push_back(kString(path));
+			m_VFS.MountDirectory("", path, priority);
+			if (m_Watcher)
+				m_Watcher->Watch(path);
 		}
 	}
 
-	//void AssetManager::CommitAsynResourceTask(
-	//	const kchar *fileName,
-	//	BytesPackage &bp,
-	//	std::semaphore &sp,
-	//	std::function<void()> callback)
-	//{
-	//	auto result = m_pThreadPool->enqueue(
-	//		[&bp, &sp](const kchar *name, std::function<void()> _callback)
-	//	{
-	//		//    ++m_NumPendingObject;
-	//		MemMapFile file;
-	//		bool opened = file.Open(name, IORead);
-	//		assert(opened == true);
-	//		if (opened)
-	//		{
-	//			int64 bytes_length = file.GetSize();
-	//			bp.Bytes.assign(bytes_length + 1, '\0');
-	//			//bp.Bytes.assign()
-	//			file.Read((char*)&bp.Bytes[0], bytes_length);
-	//			file.Close();
-
-	//			_callback();
-	//		}
-	//		else
-	//		{
-	//			Log::Out(LogLevel::Error, "AssetManager", "CommitAsynResourceTask failed. Cannot find file %s.", name);
-	//		}
-	//		sp.notify();
-
-	//		//    --m_NumPendingObject;
-	//	},
-	//		fileName,
-	//		callback
-	//		);
-	//}
-
 	//auto AssetManager::AsyncLoadObject(const kchar * objPath, ObjectLoadListener* listener)
 	//{
 	//	auto result = m_pThreadPool->enqueue([&listener](const kchar *path) {
@@ -130,57 +104,311 @@ namespace k3d
 	//	return result;
 	//}
 
-	//void AssetManager::CommitAsynResourceTask(const kchar *fileName, BytesPackage &bp, std::semaphore &sp)
-	//{
-	//	auto result = m_pThreadPool->enqueue(
-	//		[&bp, &sp](const kchar *name)
-	//	{
-	//		//    ++m_NumPendingObject;
-	//		MemMapFile file;
-	//		bool opened = file.Open(name, IORead);
-	//		if (opened)
-	//		{
-	//			int bytes_length = (int)file.GetSize();
-	//			bp.Bytes.reserve(bytes_length);
-	//			file.Read((char*)&bp.Bytes[0], bytes_length);
-	//			file.Close();
-	//		}
-	//		else
-	//		{
-	//			Log::Out(LogLevel::Error, "AssetManager", "CommitSynResourceTask failed. Cannot find file %s.", name);
-	//		}
-	//		sp.notify();
-	//		//    --m_NumPendingObject;
-	//	},
-	//		fileName
-	//		);
-	//}
+	namespace
+	{
+		/// VFS paths are UTF-8
+		std::string ToVFSPath(const kchar * path)
+		{
+#if K3DPLATFORM_OS_WIN
+			char buffer[2048] = { 0 };
+			StringUtil::WCharToChar(path, buffer, sizeof(buffer));
+			return buffer;
+#else
+			return path;
+#endif
+		}
+
+		/// Owns the file until its read completed
+		struct AsyncFileRead
+		{
+			Os::File					File;
+			IOReadRequest::Callback		OnComplete;
+		};
+
+		AsyncFileRead * OpenForAsyncRead(const kchar *fileName, BytesPackage &bp, IOReadRequest::Callback && onComplete)
+		{
+			AsyncFileRead * task = new AsyncFileRead;
+			task->OnComplete = Move(onComplete);
+			if (!task->File.Open(fileName, IORead))
+			{
+				KLOG(Error, "AssetManager", "CommitAsynResourceTask failed. Cannot find file %s.", fileName);
+				IOResult result = { 0, EIOStatus::Failed, 0, nullptr };
+				if (task->OnComplete)
+					task->OnComplete(result);
+				delete task;
+				return nullptr;
+			}
+			bp.Bytes.resize((size_t)task->File.GetSize());
+			return task;
+		}
+
+		IOReadRequest MakeAsyncRead(AsyncFileRead * task, BytesPackage &bp, EIOPriority priority)
+		{
+			IOReadRequest request;
+			request.File = &task->File;
+			request.Dest = bp.Bytes.data();
+			request.Size = bp.Bytes.size();
+			request.Priority = priority;
+			request.OnComplete = [task](IOResult const & result)
+			{
+				task->File.Close();
+				if (task->OnComplete)
+					task->OnComplete(result);
+				delete task;
+			};
+			return request;
+		}
+	}
 
 	void AssetManager::CommitAsynResourceTask(const kchar *fileName, BytesPackage &bp, std::atomic<bool> &finished)
 	{
-		//auto result = m_pThreadPool->enqueue(
-		//	[&bp, &finished](const kchar *name)
-		//{
-		//	//    ++m_NumPendingObject;
-		//	MemMapFile file;
-		//	bool opened = file.Open(name, IORead);
-		//	if (opened)
-		//	{
-		//		int bytes_length = (int)file.GetSize();
-		//		bp.Bytes.reserve(bytes_length);
-		//		file.Read((char*)&bp.Bytes[0], bytes_length);
-		//		file.Close();
-		//	}
-		//	else
-		//	{
-		//		Log::Out(LogLevel::Error, "AssetManager", "CommitSynResourceTask failed. Cannot find file %s.", name);
-		//	}
-		//	finished.store(true, std::memory_order_release);
-
-		//	//    --m_NumPendingObject;
-		//},
-		//	fileName
-		//	);
+		CommitAsynResourceTask(fileName, bp, [&finished](IOResult const &)
+		{
+			finished.store(true, std::memory_order_release);
+		});
+	}
+
+	void AssetManager::CommitAsynResourceTask(const kchar *fileName, BytesPackage &bp,
+		IOReadRequest::Callback && onComplete, EIOPriority priority, IOBatch * batch)
+	{
+		AsyncFileRead * task = OpenForAsyncRead(fileName, bp, Move(onComplete));
+		if (!task)
+			return;
+		IOReadRequest request = MakeAsyncRead(task, bp, priority);
+		AsyncIO::Submit(&request, 1, batch);
+	}
+
+	void AssetManager::CommitAsynResourceBatch(const kchar **fileNames, BytesPackage *packages, uint32 count,
+		IOBatch & batch, EIOPriority priority)
+	{
+		std::vector<IOReadRequest> requests;
+		requests.reserve(count);
+		for (uint32 i = 0; i < count; i++)
+		{
+			AsyncFileRead * task = OpenForAsyncRead(fileNames[i], packages[i], nullptr);
+			if (task)
+				requests.push_back(MakeAsyncRead(task, packages[i], priority));
+		}
+		if (!requests.empty())
+			AsyncIO::Submit(requests.data(), (uint32)requests.size(), &batch);
+	}
+
+	void AssetManager::LoadAssetAsync(const kchar *assetRelativePath, BytesPackage &bp,
+		IOReadRequest::Callback && onComplete, EIOPriority priority, IOBatch * batch)
+	{
+		kString rawPath = AssetPath(assetRelativePath);
+		CommitAsynResourceTask(rawPath.c_str(), bp, Move(onComplete), priority, batch);
+	}
+
+	AssetHandle AssetManager::RequestAsset(const kchar *assetRelativePath, EAssetType type,
+		AssetStreamPriority const & priority, AssetHandle const * dependencies, uint32 numDependencies)
+	{
+		// resolved by the streamer, bundle and memory mounts included
+		AssetHandle asset = m_Streamer->Request(assetRelativePath, type, priority, dependencies, numDependencies);
+		if (type == EAssetType::EMesh)
+		{
+			// registered first, main thread callbacks can FindMesh it
+			m_Streamer->OnComplete(asset, [this](AssetStreamRequest & request)
+			{
+				SpMesh const & mesh = request.GetMesh();
+				if (request.GetState() == EAssetState::Loaded && mesh)
+					m_Residency->Insert(mesh->GetNameId(), EAssetType::EMesh, mesh, mesh->GetByteSize(), request.GetPath().c_str());
+			}, EAssetCallbackThread::Worker);
+		}
+		return asset;
+	}
+
+	void AssetManager::OnAssetComplete(AssetHandle const & asset, AssetStreamRequest::Callback && callback, EAssetCallbackThread thread)
+	{
+		m_Streamer->OnComplete(asset, Move(callback), thread);
+	}
+
+	void AssetManager::SetAssetPriority(AssetHandle const & asset, AssetStreamPriority const & priority)
+	{
+		m_Streamer->SetPriority(asset, priority);
+	}
+
+	bool AssetManager::CancelAsset(AssetHandle const & asset)
+	{
+		return m_Streamer->Cancel(asset);
+	}
+
+	uint32 AssetManager::UpdateStreaming()
+	{
+		K3D_PROFILE_FUNCTION();
+		// reloads finished by now are swapped in by Update
+		if (m_Watcher)
+			ReloadChangedFiles();
+		return m_Streamer->Update();
+	}
+
+	uint32 AssetManager::GetPendingAssetCount() const
+	{
+		return m_Streamer->GetPendingCount();
+	}
+
+	bool AssetManager::EnableHotReload(uint32 coalesceMs)
+	{
+		if (m_Watcher)
+			return true;
+		m_Watcher.reset(new FileWatcher(coalesceMs));
+		bool watching = false;
+		for (auto & path : m_SearchPaths)
+			watching |= m_Watcher->Watch(path.c_str());
+		KLOG(Info, "AssetManager", "Hot reload enabled (%s).", m_Watcher->IsPolling() ? "polling" : "inotify");
+		return watching;
+	}
+
+	void AssetManager::DisableHotReload()
+	{
+		m_Watcher.reset();
+		m_CookLock.Lock();
+		while (m_CooksInFlight)
+			m_CooksDone.Wait(&m_CookLock);
+		m_Cooked.clear();
+		m_CookLock.UnLock();
+		m_CookOutputs.clear();
+	}
+
+	void AssetManager::RegisterCooker(const kchar *extension, Cooker && cooker)
+	{
+		m_Cookers.emplace_back(kString(extension), Move(cooker));
+	}
+
+	void AssetManager::AddReloadListener(ReloadListener && listener)
+	{
+		m_ReloadListeners.push_back(Move(listener));
+	}
+
+	void AssetManager::ReloadChangedFiles()
+	{
+		std::vector<kString> paths;
+		// taken before polling, a cook finishing in between is reloaded
+		// next pass and its output dropped from the changes below
+		m_CookLock.Lock();
+		for (auto & cooked : m_Cooked)
+		{
+			paths.push_back(ToAssetPath(cooked.first));
+			m_CookOutputs[paths.back()] = cooked.second;
+		}
+		m_Cooked.clear();
+		m_CookLock.UnLock();
+
+		std::vector<FileChange> changes;
+		m_Watcher->Poll(changes);
+		// a cached hit may be gone or shadowed by a new file
+		if (!changes.empty())
+			m_VFS.InvalidateCache();
+		for (auto & change : changes)
+		{
+			if (change.Kind == EFileChange::Removed)
+				continue;
+			kString path = ToAssetPath(change.Path);
+			// written by a cooker and reloaded from m_Cooked, unless edited since
+			auto output = m_CookOutputs.find(path);
+			if (output != m_CookOutputs.end())
+			{
+				if (Os::LastModified(change.Path.c_str()) == output->second)
+					continue;
+				m_CookOutputs.erase(output);
+			}
+			Cooker * cooker = nullptr;
+			for (auto & entry : m_Cookers)
+			{
+				kString const & extension = entry.first;
+				if (change.Path.size() >= extension.size() &&
+					change.Path.compare(change.Path.size() - extension.size(), extension.size(), extension) == 0)
+				{
+					cooker = &entry.second;
+					break;
+				}
+			}
+			if (cooker)
+				Cook(change.Path, cooker);
+			else
+				paths.push_back(path);
+		}
+		std::sort(paths.begin(), paths.end());
+		paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+		for (auto & path : paths)
+			Reload(path);
+	}
+
+	void AssetManager::Cook(kString const & source, Cooker * cooker)
+	{
+		m_CookLock.Lock();
+		m_CooksInFlight++;
+		m_CookLock.UnLock();
+		Dispatcher::Dispatch(::Dispatch::Bind([this, source, cooker]()
+		{
+			kString cooked = (*cooker)(source);
+			uint64 written = 0;
+			if (cooked.empty())
+			{
+				KLOG(Error, "AssetManager", "Cooking %s failed.", source.c_str());
+			}
+			else
+			{
+				written = Os::LastModified(cooked.c_str());
+			}
+			m_CookLock.Lock();
+			if (!cooked.empty())
+				m_Cooked.emplace_back(cooked, written);
+			if (--m_CooksInFlight == 0)
+				m_CooksDone.NotifyAll();
+			m_CookLock.UnLock();
+		}));
+	}
+
+	void AssetManager::Reload(kString const & path)
+	{
+		std::vector<AssetSource> assets;
+		if (!m_Residency->FindByPath(path.c_str(), assets))
+		{
+			for (auto & listener : m_ReloadListeners)
+				listener(path, Name());
+			return;
+		}
+		for (auto & asset : assets)
+		{
+			if (asset.Type != EAssetType::EMesh && asset.Type != EAssetType::ECamera)
+				continue;
+			AssetHandle request = m_Streamer->Request(path.c_str(), asset.Type);
+			Name name = asset.Asset;
+			// on the main thread, nothing renders from the old asset meanwhile
+			m_Streamer->OnComplete(request, [this, name](AssetStreamRequest & loaded)
+			{
+				if (loaded.GetState() != EAssetState::Loaded)
+				{
+					KLOG(Error, "AssetManager", "Reloading %s failed.", loaded.GetPath().c_str());
+					return;
+				}
+				if (loaded.GetType() == EAssetType::EMesh)
+				{
+					SpMesh const & mesh = loaded.GetMesh();
+					m_Residency->Insert(name, EAssetType::EMesh, mesh, mesh->GetByteSize(), loaded.GetPath().c_str());
+				}
+				else
+				{
+					std::shared_ptr<CameraData> const & camera = loaded.GetCamera();
+					m_Residency->Insert(name, EAssetType::ECamera, camera, sizeof(CameraData), loaded.GetPath().c_str());
+				}
+				for (auto & listener : m_ReloadListeners)
+					listener(loaded.GetPath(), name);
+			}, EAssetCallbackThread::Main);
+		}
+	}
+
+	kString AssetManager::ToAssetPath(kString const & nativePath) const
+	{
+		kString path = StringUtil::NormalizePath(nativePath);
+		for (auto & searchPath : m_SearchPaths)
+		{
+			kString directory = StringUtil::NormalizePath(searchPath) + KT('/');
+			if (path.compare(0, directory.size(), directory) == 0)
+				return path.substr(directory.size());
+		}
+		return nativePath;
 	}
 
 	void AssetManager::CommitSynResourceTask(const kchar *fileName, BytesPackage &bp)
@@ -200,7 +428,12 @@ namespace k3d
 	{
 		KLOG(Info, "AssetManager","Mesh (%s) Appended.", meshPtr->Name());
 		//KLOG(Info, "AssetManager", meshPtr->DumpMeshInfo());
-		m_MeshMap[meshPtr->Name()] = meshPtr;
+		m_Residency->Insert(meshPtr->GetNameId(), EAssetType::EMesh, meshPtr, meshPtr->GetByteSize());
+	}
+
+	void AssetManager::AppendImage(Name imgName, std::shared_ptr<ImageData> image)
+	{
+		m_Residency->Insert(imgName, EAssetType::EImage, image, image->GetByteSize());
 	}
 
 	void AssetManager::Free(char *byte_ptr)
@@ -210,23 +443,37 @@ namespace k3d
 
 	std::shared_ptr<MeshData> AssetManager::FindMesh(const char *meshName)
 	{
-		MapMeshIter iter = m_MeshMap.find(string(meshName));
-		if (iter == m_MeshMap.end())
-			return std::shared_ptr<MeshData>();
-		return (iter->second);
+		// None would match every unnamed entry
+		Name name = Name::Find(meshName);
+		return name.IsNone() ? nullptr : FindMesh(name);
+	}
+
+	std::shared_ptr<MeshData> AssetManager::FindMesh(Name meshName)
+	{
+		return m_Residency->Find<MeshData>(meshName);
 	}
 
 	std::shared_ptr<ImageData> AssetManager::FindImage(const char *imgName)
 	{
-		MapImageIter iter = m_ImageMap.find(string(imgName));
-		if (iter == m_ImageMap.end())
-			return std::shared_ptr<ImageData>();
-		return (iter->second);
+		Name name = Name::Find(imgName);
+		return name.IsNone() ? nullptr : FindImage(name);
+	}
+
+	std::shared_ptr<ImageData> AssetManager::FindImage(Name imgName)
+	{
+		return m_Residency->Find<ImageData>(imgName);
 	}
 
 
 	AssetManager::SpIODevice  AssetManager::OpenAsset(const kchar *assetPath, IOFlag flag, bool fastMode)
 	{
+		if (flag == IORead)
+		{
+			// any mount, bundle and memory files included
+			SpIODevice device = Get().m_VFS.OpenDevice(ToVFSPath(assetPath).c_str(), fastMode);
+			if (device)
+				return device;
+		}
 		kString rawPath = AssetPath(assetPath);
 		SpIODevice fileObj = nullptr;
 		if (fastMode) 
@@ -246,6 +493,9 @@ namespace k3d
 
 	kString AssetManager::AssetPath(const kchar * assetRelativePath)
 	{
+		kString native = Get().m_VFS.NativePath(ToVFSPath(assetRelativePath).c_str());
+		if (!native.empty())
+			return native;
 		if(s_envAssetPath.empty()) {
 			KLOG(Error, "AssetManager", "Kaleido3D_Dir Not Found.");
 			return assetRelativePath;
@@ -253,65 +503,9 @@ namespace k3d
 		return s_envAssetPath + assetRelativePath;
 	}
 
-	class MemmapedAsset : public IAsset
-	{
-	public:
-		MemmapedAsset(const char * path)
-		{
-			m_File = std::make_shared<Os::MemMapFile>();
-			m_File->Open(path, IORead);
-		}
-
-		~MemmapedAsset() override {}
-
-		uint64 GetLength() override
-		{	return m_File->GetSize();	}
-
-		const void * GetBuffer() override
-		{	return m_File->FileData(); }
-
-		uint64 Read(void *data, uint64 size) override { return m_File->Read((char*)data, (size_t)size); }
-		bool Seek(uint64 offset) override { return m_File->Seek((size_t)offset); }
-
-	private:
-		std::shared_ptr<Os::MemMapFile> m_File;
-	};
-
-#if K3DPLATFORM_OS_ANDROID
-	class AndroidAsset : public IAsset
-	{
-	public:
-		AndroidAsset(AAsset * asset) : m_Asset(asset) {}
-		~AndroidAsset() override { if(m_Asset) AAsset_close(m_Asset); }
-
-		uint64 		GetLength() override { return (uint64)AAsset_getLength64(m_Asset); }
-		const void* GetBuffer() override { return AAsset_isAllocated(m_Asset) ? AAsset_getBuffer(m_Asset) : nullptr; }
-
-		uint64 Read(void *data, uint64 size) override { return (uint64)AAsset_read(m_Asset, data, (size_t)size); }
-		bool Seek(uint64 offset) override { return AAsset_seek64(m_Asset, offset, SEEK_SET)!=-1; }
-
-	private:
-		AAsset	* m_Asset;
-	};
-#endif
-
 	IAsset *AssetManager::Open(const char *path)
 	{
-		if(strncmp(path, "asset://", 8)==0) {
-#if K3DPLATFORM_OS_ANDROID
-			AAssetManager* mgr = GetEnv()->GetAssets();
-			std::string relpath(path);
-			relpath = relpath.substr(8, relpath.size() - 8);
-			AAsset * asset = AAssetManager_open(mgr, relpath.c_str(), AASSET_MODE_STREAMING);
-			K3D_ASSERT(asset!= nullptr);
-			return new AndroidAsset(asset);
-#else
-            std::string relpath(path);
-			relpath = "../../Data/" + relpath.substr(8, relpath.size() - 8);
-			return new MemmapedAsset(relpath.c_str());
-#endif
-		}
-		return nullptr;
+		return Get().m_VFS.Open(path);
 	}
 
 }
\ No newline at end of file
@@ -3,12 +3,20 @@
 #pragma once
 
 #include <KTL/Singleton.hpp>
+#include <KTL/HashMap.hpp>
 #include <Interface/IIODevice.h>
 
 #include "MeshData.h"
+#include "AsyncIO.h"
+#include "AssetStream.h"
+#include "AssetResidency.h"
+#include "VirtualFS.h"
+#include "FileWatcher.h"
 
 #include <atomic>
+#include <deque>
 #include <memory>
+#include <map>
 
 namespace k3d
 {
@@ -23,15 +31,6 @@ namespace k3d
 		std::vector<kByte> Bytes;
 	};
 
-	struct IAsset
-	{
-		virtual ~IAsset() {}
-		virtual uint64	GetLength() = 0;
-		virtual const void*	GetBuffer() = 0;
-		virtual uint64 Read(void *data, uint64 size) = 0;
-		virtual bool Seek(uint64 offset) = 0;
-	};
-
 	/// AssetManager
 	/// **Support Asynchronic Reader
 	/// Search Path Supported
@@ -48,28 +47,92 @@ namespace k3d
 		/// \param fileName
 		void LoadAssetDescFile(const char *fileName);
 
-		/// Add Search Path Support
+		/// Mounts path as a directory at the root of the VFS
 		/// \brief AddSearchPath
 		/// \param path
-		void AddSearchPath(const kchar *path);
+		void AddSearchPath(const kchar *path, int32 priority = 0);
 
-		//auto AsyncLoadObject(const kchar * objPath, ObjectLoadListener* listener);
+		/// Every asset path resolves through it
+		VirtualFS & GetVFS() { return m_VFS; }
 
-		/*void CommitAsynResourceTask(const kchar *fileName,
-			BytesPackage & bp,
-			std::semaphore & sp,
-			std::function<void()> callback);
+		//auto AsyncLoadObject(const kchar * objPath, ObjectLoadListener* listener);
 
+		/// Read a whole file into bp.Bytes on the AsyncIO engine,
+		/// finished is set once the bytes are in (or the read failed).
 		void CommitAsynResourceTask(
 			const kchar *fileName,
-			BytesPackage & bp,
-			std::semaphore & sp
-			);*/
+			BytesPackage &bp,
+			std::atomic<bool> &finished);
 
+		/// \param onComplete runs on an I/O thread, result.Dest is bp.Bytes.data()
 		void CommitAsynResourceTask(
 			const kchar *fileName,
 			BytesPackage &bp,
-			std::atomic<bool> &finished);
+			IOReadRequest::Callback && onComplete,
+			EIOPriority priority = EIOPriority::Normal,
+			IOBatch * batch = nullptr);
+
+		/// Queue count files at once, wait on batch for all of them
+		void CommitAsynResourceBatch(
+			const kchar **fileNames,
+			BytesPackage *packages,
+			uint32 count,
+			IOBatch & batch,
+			EIOPriority priority = EIOPriority::Normal);
+
+		/// CommitAsynResourceTask on a path relative to the asset directory
+		void LoadAssetAsync(
+			const kchar *assetRelativePath,
+			BytesPackage &bp,
+			IOReadRequest::Callback && onComplete,
+			EIOPriority priority = EIOPriority::Normal,
+			IOBatch * batch = nullptr);
+
+		/// Streams an asset relative to the asset directory, see AssetStreamer.
+		/// Loaded meshes are added to the residency before any callback runs,
+		/// FindMesh streams them in again once evicted.
+		AssetHandle RequestAsset(
+			const kchar *assetRelativePath,
+			EAssetType type,
+			AssetStreamPriority const & priority = AssetStreamPriority(),
+			AssetHandle const * dependencies = nullptr,
+			uint32 numDependencies = 0);
+
+		void OnAssetComplete(
+			AssetHandle const & asset,
+			AssetStreamRequest::Callback && callback,
+			EAssetCallbackThread thread = EAssetCallbackThread::Main);
+
+		void SetAssetPriority(AssetHandle const & asset, AssetStreamPriority const & priority);
+
+		bool CancelAsset(AssetHandle const & asset);
+
+		/// Delivers finished streaming requests, call once a frame
+		uint32 UpdateStreaming();
+
+		/// Streaming requests not done yet
+		uint32 GetPendingAssetCount() const;
+
+		/// Turns a changed source file into the file the runtime loads, runs
+		/// on a Dispatcher worker
+		/// \return the cooked file, empty if cooking failed
+		typedef InplaceFunction<kString(kString const & source), 32> Cooker;
+		/// \param asset the reloaded asset, empty for files the residency
+		/// does not hold (shaders, bundles), the listener reloads those
+		typedef InplaceFunction<void(kString const & path, Name asset), 32> ReloadListener;
+
+		/// Watches the search paths for changes. A changed file is cooked if
+		/// a cooker handles its extension, then the assets loaded from it
+		/// stream in again and replace the resident ones on UpdateStreaming.
+		bool EnableHotReload(uint32 coalesceMs = 100);
+		/// Waits for the cookers in flight, their output is not reloaded
+		void DisableHotReload();
+
+		/// \param extension with the dot, ".obj"
+		void RegisterCooker(const kchar *extension, Cooker && cooker);
+
+		/// Runs on the main thread once a changed file was reloaded
+		void AddReloadListener(ReloadListener && listener);
 
 		void CommitSynResourceTask(
 			const kchar *fileName,
@@ -78,6 +141,8 @@ namespace k3d
 
 		void AppendMesh(SpMesh meshPtr);
 
+		void AppendImage(Name imgName, std::shared_ptr<ImageData> image);
+
 		//  template <class T>
 		//  void AsynLoadMesh(const char *meshName, void (T::*ptr)(), T*);
 
@@ -90,43 +155,68 @@ namespace k3d
 		/// \param meshName
 		/// \return std::shared_ptr<Mesh>
 		std::shared_ptr<MeshData> FindMesh(const char *meshName);
+		std::shared_ptr<MeshData> FindMesh(Name meshName);
 
 		/// \brief FindImage
 		/// \param imgName
 		/// \return std::shared_ptr<Image>
 		std::shared_ptr<ImageData> FindImage(const char *imgName);
+		std::shared_ptr<ImageData> FindImage(Name imgName);
 
 		using string = std::string;
 
-		typedef std::unordered_map<string, SpMesh> MapMesh;
-		typedef MapMesh::iterator MapMeshIter;
-
-		typedef std::unordered_map<string, std::shared_ptr<ImageData> > MapImage;
-		typedef MapImage::iterator MapImageIter;
+		/// Budgets, pinning and stats of the loaded meshes and images
+		AssetResidency & GetResidency() { return *m_Residency; }
 
 		AssetManager();
 
 	public:
 		typedef std::shared_ptr<IIODevice> SpIODevice;
 
+		/// Blocking, use LoadAssetAsync to keep the calling thread going.
+		/// Reads resolve through every VFS mount, writes and files outside
+		/// it go to the path under Kaleido3D_Dir.
 		static SpIODevice		OpenAsset(const kchar * assetPath, IOFlag openFlag = IORead, bool fast = false);
 
+		/// The file a VFS path resolves to, the path under Kaleido3D_Dir
+		/// if no directory mount has it. Bundle and memory files have none,
+		/// open them with OpenAsset or stream them with RequestAsset.
 		static kString			AssetPath(const kchar * assetRelativePath);
 
-        static IAsset * 		Open(const char* path);
+		/// Resolved through the VFS, "asset://" URIs included
+		static IAsset * 		Open(const char* path);
 	protected:
 		static	kString	 s_envAssetPath;
 
 		std::vector<kString>    m_SearchPaths;
+		VirtualFS               m_VFS;
 		//std::thread_pool*        m_pThreadPool;
 
-		MapMesh                 m_MeshMap;
-		MapImage                m_ImageMap;
-
-		mutable bool            m_IsLoading;
-		mutable bool            m_HasPendingObject;
-
-		std::atomic<int>        m_NumPendingObject;
+		std::unique_ptr<AssetStreamer>	m_Streamer;
+		/// Loaded meshes and images, evicted over budget
+		std::unique_ptr<AssetResidency>	m_Residency;
+
+		/// The VFS path of a file below a search path, unchanged if outside
+		kString	ToAssetPath(kString const & nativePath) const;
+		void	ReloadChangedFiles();
+		void	Cook(kString const & source, Cooker * cooker);
+		void	Reload(kString const & path);
+
+		std::unique_ptr<FileWatcher>	m_Watcher;
+		/// Stable addresses, cooks in flight point into it
+		std::deque<std::pair<kString, Cooker>>	m_Cookers;
+		std::vector<ReloadListener>		m_ReloadListeners;
+		/// Guards m_Cooked and m_CooksInFlight, written by the cooking workers
+		Os::Mutex						m_CookLock;
+		/// Cooked files with the modification time the cook left them at
+		std::vector<std::pair<kString, uint64>>	m_Cooked;
+		uint32							m_CooksInFlight;
+		/// Signalled when the last cook in flight finished
+		Os::ConditionVariable			m_CooksDone;
+		/// Modification times cookers left their outputs at, by VFS path.
+		/// A change reported at that time is the cook's own write, a later
+		/// edit of the file reloads it as usual.
+		std::map<kString, uint64>		m_CookOutputs;
 	};
 }
 
@@ -0,0 +1,416 @@
+#include "Kaleido3D.h"
+#include "AssetResidency.h"
+#include "MeshData.h"
+#include "CameraData.h"
+#include "LogUtil.h"
+
+#include <algorithm>
+
+namespace k3d
+{
+	namespace
+	{
+		struct ResidentAsset
+		{
+			EAssetType					Type;
+			AssetResidency::Resource	Asset;
+			uint64						Bytes = 0;
+			kString						Path;
+			/// Found since the last sweep passed it
+			bool						Referenced = false;
+			bool						Pinned = false;
+			AssetHandle					Reloading;
+		};
+
+		struct ResidencyPool
+		{
+			EAssetType					Type;
+			AssetResidencyStats			Stats;
+			/// Every asset of the type, resident or not
+			std::vector<ResidentAsset*>	Ring;
+			size_t						Hand = 0;
+		};
+
+		bool IsReloadable(EAssetType type)
+		{
+			return type == EAssetType::EMesh || type == EAssetType::ECamera;
+		}
+	}
+
+	class AssetResidencyImpl
+	{
+	public:
+		typedef AssetResidency::Resource Resource;
+
+		explicit AssetResidencyImpl(AssetStreamer * streamer) : Streamer(streamer) {}
+
+		~AssetResidencyImpl()
+		{
+			for (auto & pool : Pools)
+			{
+				for (auto asset : pool.Ring)
+					delete asset;
+			}
+		}
+
+		ResidencyPool & PoolOf(EAssetType type)
+		{
+			for (auto & pool : Pools)
+			{
+				if (pool.Type == type)
+					return pool;
+			}
+			Pools.push_back(ResidencyPool());
+			Pools.back().Type = type;
+			return Pools.back();
+		}
+
+		ResidencyPool const * FindPool(EAssetType type) const
+		{
+			for (auto & pool : Pools)
+			{
+				if (pool.Type == type)
+					return &pool;
+			}
+			return nullptr;
+		}
+
+		void Drop(ResidencyPool & pool, ResidentAsset * asset, std::vector<Resource> & dropped)
+		{
+			pool.Stats.BytesResident -= asset->Bytes;
+			dropped.push_back(Move(asset->Asset));
+			asset->Asset = nullptr;
+			asset->Bytes = 0;
+			asset->Referenced = false;
+		}
+
+		/// Clock sweep, the assets are released by the caller outside Lock
+		uint32 Evict(ResidencyPool & pool, std::vector<Resource> & dropped)
+		{
+			uint64 budget = pool.Stats.Budget;
+			if (!budget)
+				return 0;
+			uint32 evicted = 0;
+			// two turns clear every second chance
+			size_t steps = pool.Ring.size() * 2;
+			while (pool.Stats.BytesResident > budget && steps-- > 0)
+			{
+				if (pool.Hand >= pool.Ring.size())
+					pool.Hand = 0;
+				ResidentAsset * asset = pool.Ring[pool.Hand++];
+				// use_count above one: someone outside still holds it.
+				// Without a path to stream it back from, dropping it loses it.
+				if (!asset->Asset || asset->Pinned || asset->Asset.use_count() > 1
+					|| asset->Path.empty() || !IsReloadable(asset->Type))
+					continue;
+				if (asset->Referenced)
+				{
+					asset->Referenced = false;
+					continue;
+				}
+				Drop(pool, asset, dropped);
+				evicted++;
+			}
+			pool.Stats.Evictions += evicted;
+			if (pool.Stats.BytesResident > budget)
+			{
+				KLOG(Warn, AssetResidency, "%llu bytes resident over a budget of %llu, the rest is pinned, in use or not reloadable.",
+					(unsigned long long)pool.Stats.BytesResident, (unsigned long long)budget);
+			}
+			return evicted;
+		}
+
+		void Unlink(ResidentAsset * asset)
+		{
+			ResidencyPool & pool = PoolOf(asset->Type);
+			auto iter = std::find(pool.Ring.begin(), pool.Ring.end(), asset);
+			if ((size_t)(iter - pool.Ring.begin()) < pool.Hand)
+				pool.Hand--;
+			pool.Ring.erase(iter);
+			pool.Stats.BytesResident -= asset->Bytes;
+		}
+
+		void Insert(Name name, EAssetType type, Resource const & resource, uint64 bytes, const kchar * path)
+		{
+			std::vector<Resource> dropped;
+			Lock.Lock();
+			ResidentAsset ** found = Assets.FindValue(name);
+			ResidentAsset * asset = found ? *found : nullptr;
+			if (asset && asset->Type != type)
+			{
+				Unlink(asset);
+				asset->Bytes = 0;
+				asset->Type = type;
+				PoolOf(type).Ring.push_back(asset);
+			}
+			else if (!asset)
+			{
+				asset = new ResidentAsset;
+				asset->Type = type;
+				Assets.Insert(name, asset);
+				PoolOf(type).Ring.push_back(asset);
+			}
+			ResidencyPool & pool = PoolOf(type);
+			pool.Stats.BytesResident += bytes - asset->Bytes;
+			if (asset->Asset)
+				dropped.push_back(Move(asset->Asset));
+			asset->Asset = resource;
+			asset->Bytes = bytes;
+			asset->Referenced = true;
+			if (path)
+				asset->Path = path;
+			Evict(pool, dropped);
+			Lock.UnLock();
+		}
+
+		void OnReloaded(Name name, AssetStreamRequest & request)
+		{
+			Lock.Lock();
+			auto reload = std::find_if(Reloads.begin(), Reloads.end(), [&request](AssetHandle const & handle)
+			{
+				return handle.get() == &request;
+			});
+			if (reload != Reloads.end())
+				Reloads.erase(reload);
+			ResidentAsset ** found = Assets.FindValue(name);
+			// removed or replaced meanwhile
+			bool current = found && (*found)->Reloading.get() == &request;
+			if (current)
+				(*found)->Reloading = nullptr;
+			Lock.UnLock();
+			if (!current || request.GetState() != EAssetState::Loaded)
+				return;
+
+			if (request.GetMesh())
+				Insert(name, request.GetType(), request.GetMesh(), request.GetMesh()->GetByteSize(), nullptr);
+			else if (request.GetCamera())
+				Insert(name, request.GetType(), request.GetCamera(), sizeof(CameraData), nullptr);
+		}
+
+		/// Cancels and waits for the reloads, their callbacks use this
+		void StopReloads()
+		{
+			Lock.Lock();
+			std::vector<AssetHandle> reloads(Reloads);
+			AssetStreamer * streamer = Streamer;
+			Lock.UnLock();
+			for (auto & reload : reloads)
+			{
+				streamer->Cancel(reload);
+				reload->Wait();
+			}
+		}
+
+		AssetStreamer *						Streamer;
+		/// Reloads in flight, including those of removed assets
+		std::vector<AssetHandle>			Reloads;
+		HashMap<Name, ResidentAsset*>		Assets;
+		std::vector<ResidencyPool>			Pools;
+		mutable Os::Mutex					Lock;
+	};
+
+	AssetResidency::AssetResidency(AssetStreamer * streamer)
+		: d(new AssetResidencyImpl(streamer))
+	{
+	}
+
+	AssetResidency::~AssetResidency()
+	{
+		d->StopReloads();
+		delete d;
+	}
+
+	void AssetResidency::SetStreamer(AssetStreamer * streamer)
+	{
+		d->StopReloads();
+		d->Lock.Lock();
+		d->Streamer = streamer;
+		d->Lock.UnLock();
+	}
+
+	void AssetResidency::SetBudget(EAssetType type, uint64 bytes)
+	{
+		std::vector<Resource> dropped;
+		d->Lock.Lock();
+		ResidencyPool & pool = d->PoolOf(type);
+		pool.Stats.Budget = bytes;
+		d->Evict(pool, dropped);
+		d->Lock.UnLock();
+	}
+
+	uint64 AssetResidency::GetBudget(EAssetType type) const
+	{
+		d->Lock.Lock();
+		ResidencyPool const * pool = d->FindPool(type);
+		uint64 budget = pool ? pool->Stats.Budget : 0;
+		d->Lock.UnLock();
+		return budget;
+	}
+
+	void AssetResidency::Insert(Name name, EAssetType type, Resource const & asset, uint64 bytes, const kchar * path)
+	{
+		d->Insert(name, type, asset, bytes, path);
+	}
+
+	AssetResidency::Resource AssetResidency::Find(Name name)
+	{
+		Resource resource;
+		d->Lock.Lock();
+		ResidentAsset ** found = d->Assets.FindValue(name);
+		if (!found)
+		{
+			d->Lock.UnLock();
+			return resource;
+		}
+		ResidentAsset * asset = *found;
+		ResidencyPool & pool = d->PoolOf(asset->Type);
+		if (asset->Asset)
+		{
+			asset->Referenced = true;
+			pool.Stats.Hits++;
+			resource = asset->Asset;
+		}
+		else
+		{
+			pool.Stats.Misses++;
+		}
+		d->Lock.UnLock();
+		if (!resource)
+			Reload(name);
+		return resource;
+	}
+
+	AssetHandle AssetResidency::Reload(Name name, AssetStreamPriority const & priority)
+	{
+		d->Lock.Lock();
+		ResidentAsset ** found = d->Assets.FindValue(name);
+		ResidentAsset * asset = found ? *found : nullptr;
+		if (!asset || asset->Asset || asset->Path.empty() || !d->Streamer || !IsReloadable(asset->Type))
+		{
+			d->Lock.UnLock();
+			return nullptr;
+		}
+		if (asset->Reloading)
+		{
+			AssetHandle reloading = asset->Reloading;
+			d->Lock.UnLock();
+			d->Streamer->SetPriority(reloading, priority);
+			return reloading;
+		}
+		AssetHandle request = d->Streamer->Request(asset->Path.c_str(), asset->Type, priority);
+		asset->Reloading = request;
+		d->Reloads.push_back(request);
+		d->PoolOf(asset->Type).Stats.Reloads++;
+		d->Lock.UnLock();
+
+		AssetResidencyImpl * impl = d;
+		d->Streamer->OnComplete(request, [impl, name](AssetStreamRequest & loaded)
+		{
+			impl->OnReloaded(name, loaded);
+		}, EAssetCallbackThread::Worker);
+		return request;
+	}
+
+	uint32 AssetResidency::FindByPath(const kchar * path, std::vector<AssetSource> & assets) const
+	{
+		uint32 count = 0;
+		d->Lock.Lock();
+		for (auto & entry : d->Assets)
+		{
+			if (entry.second->Path == path)
+			{
+				assets.push_back(AssetSource{ entry.first, entry.second->Type });
+				count++;
+			}
+		}
+		d->Lock.UnLock();
+		return count;
+	}
+
+	bool AssetResidency::Pin(Name name, bool pinned)
+	{
+		d->Lock.Lock();
+		ResidentAsset ** asset = d->Assets.FindValue(name);
+		if (asset)
+			(*asset)->Pinned = pinned;
+		d->Lock.UnLock();
+		return asset != nullptr;
+	}
+
+	bool AssetResidency::Remove(Name name)
+	{
+		Resource resource;
+		AssetHandle reloading;
+		d->Lock.Lock();
+		ResidentAsset ** found = d->Assets.FindValue(name);
+		if (!found)
+		{
+			d->Lock.UnLock();
+			return false;
+		}
+		ResidentAsset * asset = *found;
+		d->Unlink(asset);
+		d->Assets.Erase(name);
+		resource = Move(asset->Asset);
+		reloading = asset->Reloading;
+		AssetStreamer * streamer = d->Streamer;
+		d->Lock.UnLock();
+		delete asset;
+		if (reloading)
+		{
+			// its completion finds nothing to update
+			streamer->Cancel(reloading);
+		}
+		return true;
+	}
+
+	uint32 AssetResidency::Trim(EAssetType type)
+	{
+		std::vector<Resource> dropped;
+		d->Lock.Lock();
+		uint32 evicted = d->Evict(d->PoolOf(type), dropped);
+		d->Lock.UnLock();
+		return evicted;
+	}
+
+	AssetResidencyStats AssetResidency::GetStats(EAssetType type) const
+	{
+		AssetResidencyStats stats;
+		d->Lock.Lock();
+		ResidencyPool const * pool = d->FindPool(type);
+		if (pool)
+		{
+			stats = pool->Stats;
+			for (auto asset : pool->Ring)
+			{
+				if (asset->Asset)
+				{
+					stats.Resident++;
+					stats.Pinned += asset->Pinned ? 1 : 0;
+				}
+			}
+		}
+		d->Lock.UnLock();
+		return stats;
+	}
+
+	void AssetResidency::Clear()
+	{
+		d->StopReloads();
+		std::vector<ResidentAsset*> assets;
+		d->Lock.Lock();
+		for (auto & pool : d->Pools)
+		{
+			assets.insert(assets.end(), pool.Ring.begin(), pool.Ring.end());
+			pool.Ring.clear();
+			pool.Hand = 0;
+			uint64 budget = pool.Stats.Budget;
+			pool.Stats = AssetResidencyStats();
+			pool.Stats.Budget = budget;
+		}
+		d->Assets.Clear();
+		d->Lock.UnLock();
+		for (auto asset : assets)
+			delete asset;
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef __AssetResidency_h__
+#define __AssetResidency_h__
+#pragma once
+
+#include "AssetStream.h"
+
+#include <memory>
+
+namespace k3d
+{
+	struct AssetResidencyStats
+	{
+		/// Find calls that returned a resident asset
+		uint64	Hits = 0;
+		/// Find calls on an evicted asset
+		uint64	Misses = 0;
+		uint64	Evictions = 0;
+		/// Evicted assets requested again through the streamer
+		uint64	Reloads = 0;
+		uint64	BytesResident = 0;
+		/// 0 is unlimited
+		uint64	Budget = 0;
+		uint32	Resident = 0;
+		uint32	Pinned = 0;
+
+		float	HitRate() const { return Hits + Misses ? (float)Hits / (float)(Hits + Misses) : 0.0f; }
+	};
+
+	struct AssetSource
+	{
+		Name		Asset;
+		EAssetType	Type;
+	};
+
+	/// AssetResidency
+	/// Keeps loaded assets within a byte budget per asset type. Going over
+	/// budget evicts with a clock sweep: an asset found since the last sweep
+	/// gets a second chance, pinned assets and assets still referenced
+	/// outside the cache are skipped. Evicted assets keep their source path,
+	/// finding one again streams it back in. Only meshes and cameras (the
+	/// types AssetStreamer decodes) inserted with a path are evicted, the
+	/// others stay resident over budget.
+	class K3D_API AssetResidency
+	{
+	public:
+		typedef std::shared_ptr<void> Resource;
+
+		explicit AssetResidency(AssetStreamer * streamer = nullptr);
+		/// Cancels the reloads in flight
+		~AssetResidency();
+
+		/// Reloads go through streamer, null disables them
+		void			SetStreamer(AssetStreamer * streamer);
+
+		/// Evicts right away if the new budget is exceeded
+		/// \param bytes 0 is unlimited, the default
+		void			SetBudget(EAssetType type, uint64 bytes);
+		uint64			GetBudget(EAssetType type) const;
+
+		/// Adds or replaces name, then evicts down to the budget
+		/// \param path source to reload from once evicted, may be null
+		void			Insert(Name name, EAssetType type, Resource const & asset, uint64 bytes, const kchar * path = nullptr);
+
+		/// Null if unknown or evicted, an evicted asset starts reloading
+		Resource		Find(Name name);
+
+		template <class T>
+		std::shared_ptr<T> Find(Name name) { return std::static_pointer_cast<T>(Find(name)); }
+
+		/// Streams an evicted asset back in, OnComplete tells when Find has it
+		/// \return null if resident, unknown or not reloadable
+		AssetHandle		Reload(Name name, AssetStreamPriority const & priority = AssetStreamPriority());
+
+		/// Appends the assets inserted with path as their source
+		/// \return assets appended
+		uint32			FindByPath(const kchar * path, std::vector<AssetSource> & assets) const;
+
+		/// Pinned assets are never evicted
+		bool			Pin(Name name, bool pinned = true);
+
+		bool			Remove(Name name);
+
+		/// Evicts down to the budget
+		/// \return assets evicted
+		uint32			Trim(EAssetType type);
+
+		AssetResidencyStats	GetStats(EAssetType type) const;
+
+		void			Clear();
+
+	private:
+		AssetResidency(const AssetResidency&) = delete;
+		AssetResidency& operator=(const AssetResidency&) = delete;
+
+		class AssetResidencyImpl * d;
+	};
+}
+
+#endif
@@ -0,0 +1,564 @@
+#include "Kaleido3D.h"
+#include "AssetStream.h"
+#include "MeshData.h"
+#include "CameraData.h"
+#include "LogUtil.h"
+#include "VirtualFS.h"
+#include "Utils/StringUtils.h"
+#include "Dispatch/Dispatcher.h"
+
+#include <algorithm>
+
+namespace k3d
+{
+	namespace
+	{
+		/// Cooked chunk layout: version, 64 byte class name, archive
+		template <class TAsset, class TVersion>
+		std::shared_ptr<TAsset> DecodeChunk(std::vector<kByte> const & bytes, TVersion expected)
+		{
+			ViewArchive archive(bytes.data(), bytes.size());
+			TVersion version;
+			if (archive.ReadBytes(&version, sizeof(version)) != sizeof(version) || version != expected || !archive.Skip(64))
+				return nullptr;
+			std::shared_ptr<TAsset> asset = std::make_shared<TAsset>();
+			archive >> *asset;
+			return asset;
+		}
+
+		/// a more urgent than b
+		bool IsMoreUrgent(AssetStreamPriority const & a, AssetStreamPriority const & b)
+		{
+			if (a.Visible != b.Visible)
+				return a.Visible;
+			return a.Distance < b.Distance;
+		}
+
+		EIOPriority IOPriorityOf(AssetStreamPriority const & priority)
+		{
+			return priority.Visible ? EIOPriority::High : EIOPriority::Low;
+		}
+
+		bool IsFinal(EAssetState state)
+		{
+			return state == EAssetState::Loaded || state == EAssetState::Failed || state == EAssetState::Cancelled;
+		}
+
+		std::string ToVFSPath(kString const & path)
+		{
+#if K3DPLATFORM_OS_WIN
+			char buffer[2048] = { 0 };
+			StringUtil::WCharToChar(path.c_str(), buffer, sizeof(buffer));
+			return buffer;
+#else
+			return path;
+#endif
+		}
+	}
+
+	AssetStreamRequest::AssetStreamRequest()
+		: m_Type(EAssetType::EChunkEnd)
+		, m_State(EAssetState::Queued)
+		, m_CancelRequested(false)
+		, m_BytesReady(false)
+		, m_DependencyFailed(false)
+		, m_Signaled(false)
+		, m_WaitingDeps(0)
+		, m_Compression(EChunkCompression::None)
+		, m_RawSize(0)
+		, m_IORequest(0)
+		, m_ReadPending(false)
+	{
+	}
+
+	AssetStreamRequest::~AssetStreamRequest()
+	{
+	}
+
+	EAssetState AssetStreamRequest::GetState() const
+	{
+		return m_State.load(std::memory_order_acquire);
+	}
+
+	bool AssetStreamRequest::IsDone() const
+	{
+		return IsFinal(GetState());
+	}
+
+	void AssetStreamRequest::Wait()
+	{
+		m_DoneLock.Lock();
+		while (!m_Signaled)
+		{
+			m_DoneCV.Wait(&m_DoneLock);
+		}
+		m_DoneLock.UnLock();
+	}
+
+	//--------------------------------------------------------------------------------------------
+
+	class AssetStreamerImpl
+	{
+	public:
+		typedef std::pair<AssetHandle, AssetStreamRequest::Callback> MainCallback;
+
+		AssetStreamerImpl(uint32 maxInFlight, VirtualFS * vfs)
+			: VFS(vfs), MaxInFlight(maxInFlight), InFlight(0), Outstanding(0), QueueDirty(false)
+		{
+		}
+
+		/// Takes the most urgent queued requests while slots are free and
+		/// starts them on workers: locating and opening the files must not
+		/// stall the I/O thread, which calls this as reads complete
+		void Pump()
+		{
+			std::vector<AssetHandle> start;
+			Lock.Lock();
+			while (InFlight < MaxInFlight && !Queued.empty())
+			{
+				if (QueueDirty)
+				{
+					// least urgent first, the next read is at the back
+					std::stable_sort(Queued.begin(), Queued.end(), [](AssetHandle const & a, AssetHandle const & b)
+					{
+						return IsMoreUrgent(b->m_Priority, a->m_Priority);
+					});
+					QueueDirty = false;
+				}
+				AssetHandle request = Queued.back();
+				Queued.pop_back();
+				request->m_State.store(EAssetState::Loading, std::memory_order_release);
+				InFlight++;
+				start.push_back(request);
+			}
+			Lock.UnLock();
+			AssetStreamerImpl * self = this;
+			for (auto & request : start)
+			{
+				AssetHandle handle = request;
+				Dispatcher::Dispatch(::Dispatch::Bind([self, handle]()
+				{
+					self->StartRead(handle);
+				}));
+			}
+		}
+
+		/// Worker thread
+		void StartRead(AssetHandle const & request)
+		{
+			VFSLocation location;
+			if (!VFS)
+			{
+				location.NativePath = request->m_Path;
+			}
+			else if (!VFS->Locate(ToVFSPath(request->m_Path).c_str(), location))
+			{
+				ReadAsset(request);
+				return;
+			}
+			if (!request->m_File.Open(location.NativePath.c_str(), IORead))
+			{
+				KLOG(Error, AssetStreamer, "Cannot open %s.", request->m_Name.CStr());
+				OnRead(request, EIOStatus::Failed, 0);
+				return;
+			}
+			int64 size = location.Size >= 0 ? location.Size : request->m_File.GetSize() - (int64)location.Offset;
+			request->m_Bytes.resize(size > 0 ? (size_t)size : 0);
+			request->m_Compression = location.Compression;
+			request->m_RawSize = location.RawSize;
+			AssetStreamerImpl * self = this;
+			AssetHandle handle = request;
+			Lock.Lock();
+			// cancelled before the read went out
+			bool cancelled = request->m_CancelRequested;
+			request->m_ReadPending = !cancelled;
+			Lock.UnLock();
+			if (cancelled)
+			{
+				OnRead(request, EIOStatus::Cancelled, 0);
+				return;
+			}
+			IORequestId id = AsyncIO::Read(request->m_File, request->m_Bytes.data(), location.Offset, request->m_Bytes.size(),
+				[self, handle](IOResult const & result)
+				{
+					self->OnRead(handle, result.Status, result.BytesRead);
+				}, IOPriorityOf(request->m_Priority));
+			Lock.Lock();
+			// the read may have completed already, its id is stale then
+			if (request->m_ReadPending)
+				request->m_IORequest = id;
+			Lock.UnLock();
+		}
+
+		/// Files without a place on disk (memory mounts, Android assets)
+		/// are read through the VFS on a worker
+		void ReadAsset(AssetHandle const & request)
+		{
+			AssetStreamerImpl * self = this;
+			AssetHandle handle = request;
+			Dispatcher::Dispatch(::Dispatch::Bind([self, handle]()
+			{
+				IAsset * asset = self->VFS->Open(ToVFSPath(handle->m_Path).c_str());
+				if (!asset)
+				{
+					KLOG(Error, AssetStreamer, "Cannot open %s.", handle->m_Name.CStr());
+					self->OnRead(handle, EIOStatus::Failed, 0);
+					return;
+				}
+				handle->m_Bytes.resize((size_t)asset->GetLength());
+				uint64 read = asset->Read(handle->m_Bytes.data(), handle->m_Bytes.size());
+				delete asset;
+				self->OnRead(handle, read == handle->m_Bytes.size() ? EIOStatus::Done : EIOStatus::Failed, read);
+			}));
+		}
+
+		/// I/O or worker thread, frees the slot and hands the bytes to a worker
+		void OnRead(AssetHandle const & request, EIOStatus status, uint64 bytesRead)
+		{
+			request->m_File.Close();
+			Lock.Lock();
+			InFlight--;
+			request->m_IORequest = 0;
+			request->m_ReadPending = false;
+			bool cancelled = request->m_CancelRequested || status == EIOStatus::Cancelled;
+			Lock.UnLock();
+			Pump();
+
+			if (cancelled || status != EIOStatus::Done)
+			{
+				Finish(request, cancelled ? EAssetState::Cancelled : EAssetState::Failed);
+				return;
+			}
+			request->m_Bytes.resize((size_t)bytesRead);
+			request->m_State.store(EAssetState::Processing, std::memory_order_release);
+			AssetStreamerImpl * self = this;
+			AssetHandle handle = request;
+			Dispatcher::Dispatch(::Dispatch::Bind([self, handle]()
+			{
+				self->Decode(handle);
+			}));
+		}
+
+		/// Worker thread
+		void Decode(AssetHandle const & request)
+		{
+			if (request->m_Compression != EChunkCompression::None)
+			{
+				std::vector<kByte> raw((size_t)request->m_RawSize);
+				AssetChunkView chunk = { request->m_Type, request->m_Bytes.data(), request->m_Bytes.size(), nullptr,
+					request->m_Compression, request->m_RawSize, 0 };
+				if (!DecompressChunk(chunk, raw.data()))
+				{
+					KLOG(Error, AssetStreamer, "Corrupt chunk %s.", request->m_Name.CStr());
+					Finish(request, EAssetState::Failed);
+					return;
+				}
+				request->m_Bytes.swap(raw);
+			}
+			bool decoded = true;
+			switch (request->m_Type)
+			{
+			case EAssetType::EMesh:
+				request->m_Mesh = DecodeChunk<MeshData>(request->m_Bytes, EMeshVersion::VERSION_1_1);
+				decoded = request->m_Mesh != nullptr;
+				break;
+			case EAssetType::ECamera:
+				request->m_Camera = DecodeChunk<CameraData>(request->m_Bytes, ECamVersion::VERSION_1_0);
+				decoded = request->m_Camera != nullptr;
+				break;
+			default:
+				break;
+			}
+			if (!decoded)
+			{
+				KLOG(Error, AssetStreamer, "Cannot decode %s.", request->m_Name.CStr());
+				Finish(request, EAssetState::Failed);
+				return;
+			}
+			Lock.Lock();
+			request->m_BytesReady = true;
+			Lock.UnLock();
+			TryComplete(request);
+		}
+
+		/// Completes once the bytes are decoded and the dependencies are done
+		void TryComplete(AssetHandle const & request)
+		{
+			Lock.Lock();
+			bool ready = request->m_BytesReady && (request->m_WaitingDeps == 0 || request->m_CancelRequested)
+				&& !IsFinal(request->GetState());
+			EAssetState state = request->m_CancelRequested ? EAssetState::Cancelled
+				: request->m_DependencyFailed ? EAssetState::Failed : EAssetState::Loaded;
+			Lock.UnLock();
+			if (ready)
+				Finish(request, state);
+		}
+
+		void Finish(AssetHandle const & request, EAssetState state)
+		{
+			std::vector<AssetStreamRequest::PendingCallback> callbacks;
+			std::vector<AssetHandle> dependents;
+			std::vector<AssetHandle> failedDependents;
+			Lock.Lock();
+			if (IsFinal(request->GetState()))
+			{
+				Lock.UnLock();
+				return;
+			}
+			AssetHandle * active = Active.FindValue(request->m_Name);
+			if (active && *active == request)
+				Active.Erase(request->m_Name);
+			callbacks.swap(request->m_Callbacks);
+			dependents.swap(request->m_Dependents);
+			for (auto & callback : callbacks)
+			{
+				if (callback.Thread == EAssetCallbackThread::Main)
+					MainCallbacks.emplace_back(request, Move(callback.Fun));
+			}
+			for (auto & dependent : dependents)
+			{
+				dependent->m_WaitingDeps--;
+				if (state != EAssetState::Loaded)
+				{
+					dependent->m_DependencyFailed = true;
+					// no point loading it any more
+					auto queued = std::find(Queued.begin(), Queued.end(), dependent);
+					if (queued != Queued.end())
+					{
+						Queued.erase(queued);
+						failedDependents.push_back(dependent);
+					}
+				}
+			}
+			request->m_State.store(state, std::memory_order_release);
+			// after its Main callbacks, queued above
+			Delivered.push_back(request);
+			Lock.UnLock();
+
+			for (auto & callback : callbacks)
+			{
+				if (callback.Thread == EAssetCallbackThread::Worker)
+					callback.Fun(*request);
+			}
+			for (auto & dependent : failedDependents)
+				Finish(dependent, EAssetState::Failed);
+			for (auto & dependent : dependents)
+				TryComplete(dependent);
+
+			Lock.Lock();
+			Outstanding--;
+			IdleCV.NotifyAll();
+			Lock.UnLock();
+
+			// the streamer may be gone from here on
+			request->m_DoneLock.Lock();
+			request->m_Signaled = true;
+			request->m_DoneCV.NotifyAll();
+			request->m_DoneLock.UnLock();
+		}
+
+		/// Under Lock, true if dependency already waits on request, so
+		/// request waiting on it would never complete
+		bool WaitsOn(AssetHandle const & dependency, AssetHandle const & request)
+		{
+			std::vector<AssetStreamRequest*> stack(1, request.get());
+			std::vector<AssetStreamRequest*> visited;
+			while (!stack.empty())
+			{
+				AssetStreamRequest * waiting = stack.back();
+				stack.pop_back();
+				if (waiting == dependency.get())
+					return true;
+				if (std::find(visited.begin(), visited.end(), waiting) != visited.end())
+					continue;
+				visited.push_back(waiting);
+				for (auto & dependent : waiting->m_Dependents)
+					stack.push_back(dependent.get());
+			}
+			return false;
+		}
+
+		VirtualFS *							VFS;
+		uint32								MaxInFlight;
+		uint32								InFlight;
+		/// Requests whose Finish has not returned yet
+		uint32								Outstanding;
+		bool								QueueDirty;
+		/// In flight requests by normalized path, for merging
+		HashMap<Name, AssetHandle>			Active;
+		std::vector<AssetHandle>			Queued;
+		std::vector<MainCallback>			MainCallbacks;
+		/// Done, the decoded asset is released on the next Update
+		std::vector<AssetHandle>			Delivered;
+		mutable Os::Mutex					Lock;
+		Os::ConditionVariable				IdleCV;
+	};
+
+	AssetStreamer::AssetStreamer(uint32 maxInFlight, VirtualFS * vfs)
+		: d(new AssetStreamerImpl(maxInFlight, vfs))
+	{
+	}
+
+	AssetStreamer::~AssetStreamer()
+	{
+		d->Lock.Lock();
+		std::vector<AssetHandle> queued;
+		queued.swap(d->Queued);
+		d->Lock.UnLock();
+		for (auto & request : queued)
+			d->Finish(request, EAssetState::Cancelled);
+
+		d->Lock.Lock();
+		while (d->Outstanding > 0)
+		{
+			d->IdleCV.Wait(&d->Lock);
+		}
+		d->Lock.UnLock();
+		delete d;
+	}
+
+	AssetHandle AssetStreamer::Request(const kchar * path, EAssetType type, AssetStreamPriority const & priority,
+		AssetHandle const * dependencies, uint32 numDependencies)
+	{
+		kString fullPath = StringUtil::NormalizePath(kString(path));
+		// merge key, the characters of the normalized path
+		Name name((const char*)fullPath.c_str(), fullPath.size() * sizeof(kchar));
+
+		d->Lock.Lock();
+		AssetHandle request;
+		AssetHandle * active = d->Active.FindValue(name);
+		if (active)
+		{
+			request = *active;
+			if (IsMoreUrgent(priority, request->m_Priority))
+			{
+				request->m_Priority = priority;
+				d->QueueDirty = true;
+			}
+		}
+		else
+		{
+			request = AssetHandle(new AssetStreamRequest);
+			request->m_Name = name;
+			request->m_Path = fullPath;
+			request->m_Type = type;
+			request->m_Priority = priority;
+			d->Active.Insert(name, request);
+			d->Queued.push_back(request);
+			d->QueueDirty = true;
+			d->Outstanding++;
+		}
+		for (uint32 i = 0; i < numDependencies; i++)
+		{
+			AssetHandle const & dependency = dependencies[i];
+			if (!dependency || dependency == request)
+				continue;
+			EAssetState state = dependency->GetState();
+			if (!IsFinal(state) && d->WaitsOn(dependency, request))
+			{
+				KLOG(Error, AssetStreamer, "%s would wait on itself through its dependencies.", request->m_Name.CStr());
+				request->m_DependencyFailed = true;
+			}
+			else if (!IsFinal(state))
+			{
+				dependency->m_Dependents.push_back(request);
+				request->m_WaitingDeps++;
+			}
+			else if (state != EAssetState::Loaded)
+			{
+				request->m_DependencyFailed = true;
+			}
+		}
+		d->Lock.UnLock();
+
+		d->Pump();
+		return request;
+	}
+
+	void AssetStreamer::OnComplete(AssetHandle const & request, AssetStreamRequest::Callback && callback, EAssetCallbackThread thread)
+	{
+		d->Lock.Lock();
+		if (!request->IsDone())
+		{
+			request->m_Callbacks.push_back(AssetStreamRequest::PendingCallback{ Move(callback), thread });
+			d->Lock.UnLock();
+			return;
+		}
+		if (thread == EAssetCallbackThread::Main)
+		{
+			d->MainCallbacks.emplace_back(request, Move(callback));
+			d->Lock.UnLock();
+			return;
+		}
+		d->Lock.UnLock();
+		callback(*request);
+	}
+
+	void AssetStreamer::SetPriority(AssetHandle const & request, AssetStreamPriority const & priority)
+	{
+		d->Lock.Lock();
+		request->m_Priority = priority;
+		d->QueueDirty = true;
+		d->Lock.UnLock();
+	}
+
+	void AssetStreamer::SetMaxInFlight(uint32 maxInFlight)
+	{
+		d->Lock.Lock();
+		d->MaxInFlight = maxInFlight;
+		d->Lock.UnLock();
+		d->Pump();
+	}
+
+	bool AssetStreamer::Cancel(AssetHandle const & request)
+	{
+		d->Lock.Lock();
+		if (request->IsDone() || request->m_CancelRequested)
+		{
+			d->Lock.UnLock();
+			return false;
+		}
+		request->m_CancelRequested = true;
+		auto queued = std::find(d->Queued.begin(), d->Queued.end(), request);
+		bool wasQueued = queued != d->Queued.end();
+		if (wasQueued)
+			d->Queued.erase(queued);
+		IORequestId io = request->m_IORequest;
+		d->Lock.UnLock();
+
+		if (wasQueued)
+			d->Finish(request, EAssetState::Cancelled);
+		else if (io)
+			AsyncIO::Cancel(io); // the read completes as cancelled
+		else
+			d->TryComplete(request);
+		return true;
+	}
+
+	uint32 AssetStreamer::Update()
+	{
+		std::vector<AssetStreamerImpl::MainCallback> callbacks;
+		std::vector<AssetHandle> delivered;
+		d->Lock.Lock();
+		callbacks.swap(d->MainCallbacks);
+		delivered.swap(d->Delivered);
+		d->Lock.UnLock();
+		for (auto & callback : callbacks)
+			callback.second(*callback.first);
+		// the residency or the callbacks own the assets from here on
+		for (auto & request : delivered)
+		{
+			request->m_Mesh = nullptr;
+			request->m_Camera = nullptr;
+		}
+		return (uint32)callbacks.size();
+	}
+
+	uint32 AssetStreamer::GetPendingCount() const
+	{
+		d->Lock.Lock();
+		uint32 count = d->Outstanding;
+		d->Lock.UnLock();
+		return count;
+	}
+}
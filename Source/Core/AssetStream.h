@@ -0,0 +1,174 @@
+#ifndef __AssetStream_h__
+#define __AssetStream_h__
+#pragma once
+
+#include "AsyncIO.h"
+#include "Bundle.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace k3d
+{
+	class MeshData;
+	class CameraData;
+	class VirtualFS;
+
+	enum class EAssetState : uint32
+	{
+		Queued,
+		Loading,
+		/// Bytes are in, decoding or waiting for dependencies
+		Processing,
+		Loaded,
+		Failed,
+		Cancelled
+	};
+
+	/// Where completion callbacks run
+	enum class EAssetCallbackThread : uint32
+	{
+		/// The worker that finished the asset, right away
+		Worker,
+		/// The thread calling AssetStreamer::Update
+		Main
+	};
+
+	struct AssetStreamPriority
+	{
+		/// Distance to the camera, nearer loads first
+		float	Distance = 0.0f;
+		/// Visible assets load before any invisible one
+		bool	Visible = true;
+
+		AssetStreamPriority() {}
+		AssetStreamPriority(float distance, bool visible) : Distance(distance), Visible(visible) {}
+	};
+
+	class AssetStreamRequest;
+	typedef std::shared_ptr<AssetStreamRequest> AssetHandle;
+
+	/// AssetStreamRequest
+	/// One streamed file, shared by every requester of the same path.
+	/// EAssetType::EMesh and ECamera files (cooked chunks) are decoded on a
+	/// worker, other types only carry the bytes, decompressed if the file
+	/// is a compressed bundle chunk.
+	class K3D_API AssetStreamRequest
+	{
+	public:
+		typedef InplaceFunction<void(AssetStreamRequest &), 48> Callback;
+
+		~AssetStreamRequest();
+
+		Name			GetName() const { return m_Name; }
+		kString const &	GetPath() const { return m_Path; }
+		EAssetType		GetType() const { return m_Type; }
+		EAssetState		GetState() const;
+		/// Loaded, failed or cancelled
+		bool			IsDone() const;
+		/// Blocks until IsDone and the Worker callbacks returned,
+		/// does not run Main callbacks
+		void			Wait();
+
+		/// File contents, valid once loaded
+		std::vector<kByte> const &		GetBytes() const { return m_Bytes; }
+		/// Decoded asset, from loaded until the Main callbacks ran: the
+		/// request lets go of it then, so holding the handle does not keep
+		/// a copy alive. Keep the shared_ptr to hold on to it.
+		std::shared_ptr<MeshData> const &	GetMesh() const { return m_Mesh; }
+		std::shared_ptr<CameraData> const &	GetCamera() const { return m_Camera; }
+
+	private:
+		friend class AssetStreamer;
+		friend class AssetStreamerImpl;
+		AssetStreamRequest();
+		AssetStreamRequest(const AssetStreamRequest&) = delete;
+		AssetStreamRequest& operator=(const AssetStreamRequest&) = delete;
+
+		struct PendingCallback
+		{
+			Callback				Fun;
+			EAssetCallbackThread	Thread;
+		};
+
+		Name					m_Name;
+		kString					m_Path;
+		EAssetType				m_Type;
+		AssetStreamPriority		m_Priority;
+		std::atomic<EAssetState>	m_State;
+		bool					m_CancelRequested;
+		bool					m_BytesReady;
+		bool					m_DependencyFailed;
+		/// Set under m_DoneLock once the Worker callbacks ran
+		bool					m_Signaled;
+		/// Dependencies not done yet
+		uint32					m_WaitingDeps;
+		EChunkCompression		m_Compression;
+		uint64					m_RawSize;
+		IORequestId				m_IORequest;
+		/// Issued to AsyncIO and not completed yet, guards m_IORequest
+		bool					m_ReadPending;
+		Os::File				m_File;
+		std::vector<kByte>		m_Bytes;
+		std::shared_ptr<MeshData>	m_Mesh;
+		std::shared_ptr<CameraData>	m_Camera;
+		std::vector<AssetHandle>		m_Dependents;
+		std::vector<PendingCallback>	m_Callbacks;
+		Os::Mutex				m_DoneLock;
+		Os::ConditionVariable	m_DoneCV;
+	};
+
+	/// AssetStreamer
+	/// Streams files on AsyncIO and decodes them on the Dispatcher workers.
+	/// Queued requests start nearest visible first, at most MaxInFlight
+	/// reads at a time so priority changes still matter. Requests of the
+	/// same normalized path are merged. A request completes after its
+	/// dependencies, and fails if one of them fails, is cancelled or
+	/// would wait on the request itself.
+	class K3D_API AssetStreamer
+	{
+	public:
+		/// \param vfs resolves the request paths: loose files and bundle
+		///        chunks are read on AsyncIO, other mounts through Open.
+		///        Without one the paths are native files.
+		explicit AssetStreamer(uint32 maxInFlight = 16, VirtualFS * vfs = nullptr);
+		/// Cancels what is queued and waits for the rest
+		~AssetStreamer();
+
+		/// \param dependencies requests that must complete first
+		AssetHandle	Request(const kchar * path, EAssetType type,
+						AssetStreamPriority const & priority = AssetStreamPriority(),
+						AssetHandle const * dependencies = nullptr, uint32 numDependencies = 0);
+
+		/// Runs at once (on the calling thread for Worker, on the next
+		/// Update for Main) if the request is already done
+		void		OnComplete(AssetHandle const & request, AssetStreamRequest::Callback && callback,
+						EAssetCallbackThread thread = EAssetCallbackThread::Main);
+
+		/// Merged requests take the most urgent priority
+		void		SetPriority(AssetHandle const & request, AssetStreamPriority const & priority);
+
+		/// 0 holds every request in the queue
+		void		SetMaxInFlight(uint32 maxInFlight);
+
+		/// Cancels for every holder of the request, false once it is done
+		bool		Cancel(AssetHandle const & request);
+
+		/// Delivers the Main callbacks, call once a frame. Requests done
+		/// since the last call release their decoded asset afterwards.
+		/// \return callbacks run
+		uint32		Update();
+
+		/// Requests not done yet
+		uint32		GetPendingCount() const;
+
+	private:
+		AssetStreamer(const AssetStreamer&) = delete;
+		AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+		class AssetStreamerImpl * d;
+	};
+}
+
+#endif
@@ -0,0 +1,810 @@
+#include "Kaleido3D.h"
+#include "AsyncIO.h"
+#include "LogUtil.h"
+#include <KTL/HashMap.hpp>
+#include <thread>
+#include <vector>
+
+#if K3DPLATFORM_OS_LINUX && !K3DPLATFORM_OS_ANDROID
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <poll.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define K3D_HAS_IO_URING 1
+#endif
+#endif
+
+K3D_COMMON_NS
+{
+	namespace
+	{
+		const uint32 kNumPriorities = (uint32)EIOPriority::Count;
+
+		struct IORequestImpl
+		{
+			IORequestImpl *			Prev;
+			IORequestImpl *			Next;
+			IORequestId				Id;
+			Os::File *				File;
+			char *					Dest;
+			uint64					Offset;
+			uint64					Size;
+			uint64					BytesRead;
+			EIOPriority				Priority;
+			IOBatch *				Batch;
+			IOReadRequest::Callback	OnComplete;
+#if K3D_HAS_IO_URING
+			struct iovec			Vec;
+#endif
+		};
+
+		struct RequestList
+		{
+			IORequestImpl * Head = nullptr;
+			IORequestImpl * Tail = nullptr;
+
+			void PushBack(IORequestImpl * req)
+			{
+				req->Next = nullptr;
+				req->Prev = Tail;
+				if (Tail)
+					Tail->Next = req;
+				else
+					Head = req;
+				Tail = req;
+			}
+
+			void Remove(IORequestImpl * req)
+			{
+				if (req->Prev)
+					req->Prev->Next = req->Next;
+				else
+					Head = req->Next;
+				if (req->Next)
+					req->Next->Prev = req->Prev;
+				else
+					Tail = req->Prev;
+				req->Prev = req->Next = nullptr;
+			}
+		};
+	}
+
+	class IOBackend
+	{
+	public:
+		virtual ~IOBackend() {}
+		virtual EIOBackend	GetType() const = 0;
+		virtual const char*	GetName() const = 0;
+		/// Requests were queued
+		virtual void		Notify() = 0;
+		/// Return once the requests in flight completed, nothing is queued anymore
+		virtual void		Stop() = 0;
+	};
+
+	class AsyncIOPrivate
+	{
+	public:
+		AsyncIOPrivate() : m_NextId(0), m_Pending(0), m_Stopping(false), m_Backend(nullptr) {}
+		~AsyncIOPrivate();
+
+		bool			Start(EIOBackend backend, uint32 queueDepth, uint32 numThreads);
+		void			Stop();
+
+		void			Submit(IOReadRequest * requests, uint32 count, IOBatch * batch, IORequestId * outIds);
+		bool			Cancel(IORequestId id);
+		uint32			GetPendingCount() const { return m_Pending.load(std::memory_order_relaxed); }
+		IOBackend *		GetBackend() const { return m_Backend; }
+
+		/// Highest priority queued request, nullptr if none
+		IORequestImpl *	Pop();
+		/// Blocks until a request is queued, nullptr once stopping
+		IORequestImpl *	WaitPop();
+		void			Complete(IORequestImpl * req, EIOStatus status);
+
+	private:
+		IORequestImpl *	PopLocked();
+
+		Os::Mutex							m_Lock;
+		Os::ConditionVariable				m_QueueCV;
+		RequestList							m_Queues[kNumPriorities];
+		HashMap<IORequestId, IORequestImpl*> m_Queued;
+		std::vector<IORequestImpl*>			m_FreeRequests;
+		std::atomic<uint64>					m_NextId;
+		std::atomic<uint32>					m_Pending;
+		bool								m_Stopping;
+		IOBackend *							m_Backend;
+	};
+
+	namespace
+	{
+		/// Blocking positional reads on a few threads, queue depth is the thread count
+		class ThreadPoolBackend : public IOBackend
+		{
+		public:
+			ThreadPoolBackend(AsyncIOPrivate * owner, uint32 numThreads)
+				: m_Owner(owner)
+			{
+				for (uint32 i = 0; i < numThreads; i++)
+				{
+					Os::Thread * thread = new Os::Thread([this]() { Run(); }, "AsyncIO#" + std::to_string(i));
+					m_Threads.push_back(thread);
+					thread->Start();
+				}
+			}
+
+			~ThreadPoolBackend() override
+			{
+				Stop();
+			}
+
+			EIOBackend GetType() const override { return EIOBackend::ThreadPool; }
+			const char* GetName() const override { return "ThreadPool"; }
+			// the owner signals its queue condition directly
+			void Notify() override {}
+
+			void Stop() override
+			{
+				for (Os::Thread * thread : m_Threads)
+				{
+					thread->Join();
+					delete thread;
+				}
+				m_Threads.clear();
+			}
+
+		private:
+			void Run()
+			{
+				while (IORequestImpl * req = m_Owner->WaitPop())
+				{
+					size_t read = req->File->ReadAt(req->Dest, (size_t)req->Size, req->Offset);
+					if (read == size_t(-1))
+					{
+						m_Owner->Complete(req, EIOStatus::Failed);
+					}
+					else
+					{
+						req->BytesRead = read;
+						m_Owner->Complete(req, EIOStatus::Done);
+					}
+				}
+			}
+
+			AsyncIOPrivate *			m_Owner;
+			std::vector<Os::Thread*>	m_Threads;
+		};
+
+#if K3D_HAS_IO_URING
+		const uint64 kWakeUpTag = 0;
+
+		/// One thread owns the ring: it fills the submission queue from the
+		/// owner's priority queues, enters the kernel and reaps completions.
+		/// A poll on an eventfd wakes it up when new requests are queued.
+		class IOUringBackend : public IOBackend
+		{
+		public:
+			IOUringBackend(AsyncIOPrivate * owner)
+				: m_Owner(owner), m_RingFd(-1), m_EventFd(-1)
+				, m_SqRing(nullptr), m_CqRing(nullptr), m_Sqes(nullptr)
+				, m_SqRingSize(0), m_CqRingSize(0), m_SqesSize(0)
+				, m_Depth(0), m_InFlight(0), m_ToSubmit(0)
+				, m_Stopping(false), m_Thread(nullptr)
+			{
+			}
+
+			~IOUringBackend() override
+			{
+				Stop();
+				if (m_Sqes)
+					munmap(m_Sqes, m_SqesSize);
+				if (m_CqRing && m_CqRing != m_SqRing)
+					munmap(m_CqRing, m_CqRingSize);
+				if (m_SqRing)
+					munmap(m_SqRing, m_SqRingSize);
+				if (m_RingFd >= 0)
+					close(m_RingFd);
+				if (m_EventFd >= 0)
+					close(m_EventFd);
+			}
+
+			bool Setup(uint32 queueDepth)
+			{
+				io_uring_params params;
+				memset(&params, 0, sizeof(params));
+				// one extra entry for the wake up poll
+				m_RingFd = (int)syscall(__NR_io_uring_setup, queueDepth + 1, &params);
+				if (m_RingFd < 0)
+					return false;
+
+				m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32);
+				m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if (singleMmap)
+					m_SqRingSize = m_CqRingSize = m_SqRingSize > m_CqRingSize ? m_SqRingSize : m_CqRingSize;
+
+				m_SqRing = (char*)mmap(nullptr, m_SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQ_RING);
+				if (m_SqRing == MAP_FAILED)
+				{
+					m_SqRing = nullptr;
+					return false;
+				}
+				if (singleMmap)
+				{
+					m_CqRing = m_SqRing;
+				}
+				else
+				{
+					m_CqRing = (char*)mmap(nullptr, m_CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_CQ_RING);
+					if (m_CqRing == MAP_FAILED)
+					{
+						m_CqRing = nullptr;
+						return false;
+					}
+				}
+				m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+				m_Sqes = (io_uring_sqe*)mmap(nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQES);
+				if (m_Sqes == MAP_FAILED)
+				{
+					m_Sqes = nullptr;
+					return false;
+				}
+
+				m_SqHead = (uint32*)(m_SqRing + params.sq_off.head);
+				m_SqTail = (uint32*)(m_SqRing + params.sq_off.tail);
+				m_SqMask = *(uint32*)(m_SqRing + params.sq_off.ring_mask);
+				m_SqEntries = params.sq_entries;
+				m_SqArray = (uint32*)(m_SqRing + params.sq_off.array);
+				m_CqHead = (uint32*)(m_CqRing + params.cq_off.head);
+				m_CqTail = (uint32*)(m_CqRing + params.cq_off.tail);
+				m_CqMask = *(uint32*)(m_CqRing + params.cq_off.ring_mask);
+				m_Cqes = (io_uring_cqe*)(m_CqRing + params.cq_off.cqes);
+				m_Depth = params.sq_entries - 1 < queueDepth ? params.sq_entries - 1 : queueDepth;
+
+				m_EventFd = eventfd(0, EFD_CLOEXEC);
+				if (m_EventFd < 0)
+					return false;
+
+				m_Thread = new Os::Thread([this]() { Run(); }, "AsyncIO#uring");
+				m_Thread->Start();
+				return true;
+			}
+
+			EIOBackend GetType() const override { return EIOBackend::IOUring; }
+			const char* GetName() const override { return "io_uring"; }
+
+			void Notify() override
+			{
+				uint64 one = 1;
+				ssize_t written = write(m_EventFd, &one, sizeof(one));
+				(void)written;
+			}
+
+			void Stop() override
+			{
+				if (!m_Thread)
+					return;
+				m_Stopping.store(true, std::memory_order_release);
+				Notify();
+				m_Thread->Join();
+				delete m_Thread;
+				m_Thread = nullptr;
+			}
+
+		private:
+			io_uring_sqe * NextSqe()
+			{
+				uint32 tail = *m_SqTail;
+				uint32 index = tail & m_SqMask;
+				io_uring_sqe * sqe = &m_Sqes[index];
+				memset(sqe, 0, sizeof(*sqe));
+				m_SqArray[index] = index;
+				__atomic_store_n(m_SqTail, tail + 1, __ATOMIC_RELEASE);
+				m_ToSubmit++;
+				return sqe;
+			}
+
+			void ArmWakeUp()
+			{
+				io_uring_sqe * sqe = NextSqe();
+				sqe->opcode = IORING_OP_POLL_ADD;
+				sqe->fd = m_EventFd;
+				sqe->poll_events = POLLIN;
+				sqe->user_data = kWakeUpTag;
+			}
+
+			/// Reads the remainder of req, short reads are resubmitted
+			void PrepRead(IORequestImpl * req)
+			{
+				req->Vec.iov_base = req->Dest + req->BytesRead;
+				req->Vec.iov_len = (size_t)(req->Size - req->BytesRead);
+				io_uring_sqe * sqe = NextSqe();
+				sqe->opcode = IORING_OP_READV;
+				sqe->fd = req->File->GetNativeHandle();
+				sqe->addr = (uint64)(uintptr_t)&req->Vec;
+				sqe->len = 1;
+				sqe->off = req->Offset + req->BytesRead;
+				sqe->user_data = (uint64)(uintptr_t)req;
+			}
+
+			void OnCompletion(io_uring_cqe const & cqe)
+			{
+				if (cqe.user_data == kWakeUpTag)
+				{
+					uint64 value = 0;
+					ssize_t got = read(m_EventFd, &value, sizeof(value));
+					(void)got;
+					ArmWakeUp();
+					return;
+				}
+				IORequestImpl * req = (IORequestImpl*)(uintptr_t)cqe.user_data;
+				if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+				{
+					PrepRead(req);
+					return;
+				}
+				if (cqe.res < 0)
+				{
+					m_InFlight--;
+					m_Owner->Complete(req, EIOStatus::Failed);
+					return;
+				}
+				req->BytesRead += (uint64)cqe.res;
+				if (cqe.res > 0 && req->BytesRead < req->Size)
+				{
+					PrepRead(req);
+					return;
+				}
+				m_InFlight--;
+				m_Owner->Complete(req, EIOStatus::Done);
+			}
+
+			void Run()
+			{
+				ArmWakeUp();
+				for (;;)
+				{
+					while (m_InFlight < m_Depth)
+					{
+						IORequestImpl * req = m_Owner->Pop();
+						if (!req)
+							break;
+						PrepRead(req);
+						m_InFlight++;
+					}
+					if (m_Stopping.load(std::memory_order_acquire) && m_InFlight == 0)
+						break;
+
+					int ret = (int)syscall(__NR_io_uring_enter, m_RingFd, m_ToSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+					if (ret < 0)
+					{
+						if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+						{
+							KLOG(Error, AsyncIO, "io_uring_enter failed (errno=%d).", errno);
+						}
+					}
+					else
+					{
+						m_ToSubmit -= (uint32)ret;
+					}
+
+					uint32 head = *m_CqHead;
+					uint32 tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+					while (head != tail)
+					{
+						io_uring_cqe cqe = m_Cqes[head & m_CqMask];
+						__atomic_store_n(m_CqHead, ++head, __ATOMIC_RELEASE);
+						OnCompletion(cqe);
+					}
+				}
+			}
+
+			AsyncIOPrivate *	m_Owner;
+			int					m_RingFd;
+			int					m_EventFd;
+			char *				m_SqRing;
+			char *				m_CqRing;
+			io_uring_sqe *		m_Sqes;
+			size_t				m_SqRingSize;
+			size_t				m_CqRingSize;
+			size_t				m_SqesSize;
+			uint32 *			m_SqHead;
+			uint32 *			m_SqTail;
+			uint32 *			m_SqArray;
+			uint32				m_SqMask;
+			uint32				m_SqEntries;
+			uint32 *			m_CqHead;
+			uint32 *			m_CqTail;
+			uint32				m_CqMask;
+			io_uring_cqe *		m_Cqes;
+			uint32				m_Depth;
+			uint32				m_InFlight;
+			uint32				m_ToSubmit;
+			std::atomic<bool>	m_Stopping;
+			Os::Thread *		m_Thread;
+		};
+#endif
+	}
+
+	AsyncIOPrivate::~AsyncIOPrivate()
+	{
+		for (IORequestImpl * req : m_FreeRequests)
+		{
+			delete req;
+		}
+	}
+
+	bool AsyncIOPrivate::Start(EIOBackend backend, uint32 queueDepth, uint32 numThreads)
+	{
+#if K3D_HAS_IO_URING
+		if (backend != EIOBackend::ThreadPool)
+		{
+			IOUringBackend * uring = new IOUringBackend(this);
+			if (uring->Setup(queueDepth ? queueDepth : 1))
+			{
+				m_Backend = uring;
+				return true;
+			}
+			delete uring;
+			KLOG(Warn, AsyncIO, "io_uring unavailable (errno=%d), using the thread pool.", errno);
+		}
+#endif
+		m_Backend = new ThreadPoolBackend(this, numThreads ? numThreads : 1);
+		return backend != EIOBackend::IOUring;
+	}
+
+	void AsyncIOPrivate::Stop()
+	{
+		RequestList cancelled;
+		m_Lock.Lock();
+		m_Stopping = true;
+		while (IORequestImpl * req = PopLocked())
+		{
+			cancelled.PushBack(req);
+		}
+		m_QueueCV.NotifyAll();
+		m_Lock.UnLock();
+
+		while (IORequestImpl * req = cancelled.Head)
+		{
+			cancelled.Remove(req);
+			Complete(req, EIOStatus::Cancelled);
+		}
+		if (m_Backend)
+		{
+			m_Backend->Stop();
+			delete m_Backend;
+			m_Backend = nullptr;
+		}
+	}
+
+	void AsyncIOPrivate::Submit(IOReadRequest * requests, uint32 count, IOBatch * batch, IORequestId * outIds)
+	{
+		if (count == 0)
+			return;
+		if (batch)
+			batch->Enter(count);
+		m_Pending.fetch_add(count, std::memory_order_relaxed);
+
+		m_Lock.Lock();
+		for (uint32 i = 0; i < count; i++)
+		{
+			IOReadRequest & desc = requests[i];
+			IORequestImpl * req = nullptr;
+			if (m_FreeRequests.empty())
+			{
+				req = new IORequestImpl;
+			}
+			else
+			{
+				req = m_FreeRequests.back();
+				m_FreeRequests.pop_back();
+			}
+			req->Id = m_NextId.fetch_add(1, std::memory_order_relaxed) + 1;
+			req->File = desc.File;
+			req->Dest = (char*)desc.Dest;
+			req->Offset = desc.Offset;
+			req->Size = desc.Size;
+			req->BytesRead = 0;
+			req->Priority = (uint32)desc.Priority < kNumPriorities ? desc.Priority : EIOPriority::Low;
+			req->Batch = batch;
+			req->OnComplete = Move(desc.OnComplete);
+			if (outIds)
+				outIds[i] = req->Id;
+			m_Queues[(uint32)req->Priority].PushBack(req);
+			m_Queued.Insert(req->Id, req);
+		}
+		if (count > 1)
+			m_QueueCV.NotifyAll();
+		else
+			m_QueueCV.Notify();
+		m_Lock.UnLock();
+
+		m_Backend->Notify();
+	}
+
+	bool AsyncIOPrivate::Cancel(IORequestId id)
+	{
+		m_Lock.Lock();
+		IORequestImpl ** found = m_Queued.FindValue(id);
+		IORequestImpl * req = found ? *found : nullptr;
+		if (req)
+		{
+			m_Queues[(uint32)req->Priority].Remove(req);
+			m_Queued.Erase(id);
+		}
+		m_Lock.UnLock();
+		if (!req)
+			return false;
+		Complete(req, EIOStatus::Cancelled);
+		return true;
+	}
+
+	IORequestImpl * AsyncIOPrivate::PopLocked()
+	{
+		for (uint32 p = 0; p < kNumPriorities; p++)
+		{
+			IORequestImpl * req = m_Queues[p].Head;
+			if (req)
+			{
+				m_Queues[p].Remove(req);
+				m_Queued.Erase(req->Id);
+				return req;
+			}
+		}
+		return nullptr;
+	}
+
+	IORequestImpl * AsyncIOPrivate::Pop()
+	{
+		m_Lock.Lock();
+		IORequestImpl * req = PopLocked();
+		m_Lock.UnLock();
+		return req;
+	}
+
+	IORequestImpl * AsyncIOPrivate::WaitPop()
+	{
+		m_Lock.Lock();
+		IORequestImpl * req = PopLocked();
+		while (!req && !m_Stopping)
+		{
+			m_QueueCV.Wait(&m_Lock);
+			req = PopLocked();
+		}
+		m_Lock.UnLock();
+		return req;
+	}
+
+	void AsyncIOPrivate::Complete(IORequestImpl * req, EIOStatus status)
+	{
+		IOResult result = { req->Id, status, req->BytesRead, req->Dest };
+		if (req->OnComplete)
+		{
+			req->OnComplete(result);
+			req->OnComplete = nullptr;
+		}
+		IOBatch * batch = req->Batch;
+
+		m_Lock.Lock();
+		m_FreeRequests.push_back(req);
+		m_Lock.UnLock();
+
+		// the callback has run when the pending count drops, and the count
+		// is already down once a waiter on the batch wakes up
+		m_Pending.fetch_sub(1, std::memory_order_release);
+		if (batch)
+			batch->Leave(result);
+	}
+
+	//--------------------------------------------------------------------------------------------
+
+	IOBatch::IOBatch()
+		: m_Pending(0), m_Failed(0), m_BytesRead(0)
+	{
+	}
+
+	IOBatch::~IOBatch()
+	{
+		Wait();
+	}
+
+	bool IOBatch::IsDone() const
+	{
+		return m_Pending.load(std::memory_order_acquire) == 0;
+	}
+
+	void IOBatch::Wait()
+	{
+		m_Lock.Lock();
+		while (m_Pending.load(std::memory_order_acquire) > 0)
+		{
+			m_DoneCV.Wait(&m_Lock);
+		}
+		m_Lock.UnLock();
+	}
+
+	void IOBatch::Enter(uint32 count)
+	{
+		m_Pending.fetch_add((int32)count, std::memory_order_acq_rel);
+	}
+
+	void IOBatch::Leave(IOResult const & result)
+	{
+		if (result.Status != EIOStatus::Done)
+			m_Failed.fetch_add(1, std::memory_order_relaxed);
+		m_BytesRead.fetch_add(result.BytesRead, std::memory_order_relaxed);
+		// decrement under the lock, a waiter may destroy the batch right after
+		m_Lock.Lock();
+		if (m_Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			m_DoneCV.NotifyAll();
+		m_Lock.UnLock();
+	}
+
+	//--------------------------------------------------------------------------------------------
+
+	namespace
+	{
+		std::atomic<AsyncIOPrivate*> s_AsyncIO(nullptr);
+		/// Calls using the instance, Shutdown waits for them before deleting it
+		std::atomic<uint32> s_Users(0);
+		/// Set by Shutdown, reads fail instead of starting again until Init
+		std::atomic<bool> s_ShutDown(false);
+
+		Os::Mutex & GetInitLock()
+		{
+			static Os::Mutex * s_Lock = new Os::Mutex;
+			return *s_Lock;
+		}
+
+		bool InitAsyncIO(EIOBackend backend, uint32 queueDepth, uint32 numThreads, bool lazy)
+		{
+			Os::Mutex & lock = GetInitLock();
+			lock.Lock();
+			bool ok = true;
+			if (!lazy)
+				s_ShutDown.store(false);
+			if (!s_AsyncIO.load(std::memory_order_acquire) && !s_ShutDown.load())
+			{
+				AsyncIOPrivate * io = new AsyncIOPrivate;
+				ok = io->Start(backend, queueDepth, numThreads);
+				if (ok)
+				{
+					KLOG(Info, AsyncIO, "Started with the %s backend.", io->GetBackend()->GetName());
+					s_AsyncIO.store(io, std::memory_order_release);
+				}
+				else
+				{
+					KLOG(Error, AsyncIO, "Could not start the requested backend.");
+					io->Stop();
+					delete io;
+				}
+			}
+			lock.UnLock();
+			return ok;
+		}
+
+		/// Holds the instance for the scope, starts it with the defaults if
+		/// init is set. Null once Shutdown has begun.
+		struct AsyncIORef
+		{
+			explicit AsyncIORef(bool init) : IO(Acquire())
+			{
+				if (!IO && init)
+				{
+					InitAsyncIO(EIOBackend::Auto, 256, 4, true);
+					IO = Acquire();
+				}
+			}
+			~AsyncIORef()
+			{
+				if (IO)
+					s_Users.fetch_sub(1, std::memory_order_release);
+			}
+
+			static AsyncIOPrivate * Acquire()
+			{
+				// count first, Shutdown clears the instance before it waits
+				s_Users.fetch_add(1);
+				AsyncIOPrivate * io = s_AsyncIO.load();
+				if (!io)
+					s_Users.fetch_sub(1, std::memory_order_release);
+				return io;
+			}
+
+			AsyncIOPrivate * IO;
+		};
+	}
+
+	bool AsyncIO::Init(EIOBackend backend, uint32 queueDepth, uint32 numThreads)
+	{
+		return InitAsyncIO(backend, queueDepth, numThreads, false);
+	}
+
+	void AsyncIO::Shutdown()
+	{
+		Os::Mutex & lock = GetInitLock();
+		lock.Lock();
+		s_ShutDown.store(true);
+		AsyncIOPrivate * io = s_AsyncIO.exchange(nullptr);
+		if (io)
+		{
+			// late calls that got the instance before it was cleared
+			while (s_Users.load() != 0)
+			{
+				std::this_thread::yield();
+			}
+			io->Stop();
+			delete io;
+		}
+		lock.UnLock();
+	}
+
+	EIOBackend AsyncIO::GetBackend()
+	{
+		AsyncIORef io(false);
+		return io.IO ? io.IO->GetBackend()->GetType() : EIOBackend::Auto;
+	}
+
+	const char * AsyncIO::GetBackendName()
+	{
+		AsyncIORef io(false);
+		return io.IO ? io.IO->GetBackend()->GetName() : "None";
+	}
+
+	void AsyncIO::Submit(IOReadRequest * requests, uint32 count, IOBatch * batch, IORequestId * outIds)
+	{
+		AsyncIORef io(true);
+		if (io.IO)
+		{
+			io.IO->Submit(requests, count, batch, outIds);
+			return;
+		}
+		if (count == 0)
+			return;
+		// after Shutdown
+		KLOG_EVERY_MS(Warn, AsyncIO, 1000, "%u reads submitted after shutdown, cancelled.", count);
+		if (batch)
+			batch->Enter(count);
+		for (uint32 i = 0; i < count; i++)
+		{
+			IOReadRequest::Callback onComplete = Move(requests[i].OnComplete);
+			IOResult result = { 0, EIOStatus::Cancelled, 0, requests[i].Dest };
+			if (outIds)
+				outIds[i] = 0;
+			if (onComplete)
+				onComplete(result);
+			if (batch)
+				batch->Leave(result);
+		}
+	}
+
+	IORequestId AsyncIO::Read(Os::File & file, void * dest, uint64 offset, uint64 size,
+		IOReadRequest::Callback && onComplete, EIOPriority priority, IOBatch * batch)
+	{
+		IOReadRequest request;
+		request.File = &file;
+		request.Dest = dest;
+		request.Offset = offset;
+		request.Size = size;
+		request.Priority = priority;
+		request.OnComplete = Move(onComplete);
+		IORequestId id = 0;
+		Submit(&request, 1, batch, &id);
+		return id;
+	}
+
+	bool AsyncIO::Cancel(IORequestId id)
+	{
+		AsyncIORef io(false);
+		return io.IO ? io.IO->Cancel(id) : false;
+	}
+
+	uint32 AsyncIO::GetPendingCount()
+	{
+		AsyncIORef io(false);
+		return io.IO ? io.IO->GetPendingCount() : 0;
+	}
+}
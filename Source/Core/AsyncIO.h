@@ -0,0 +1,131 @@
+#pragma once
+#ifndef __AsyncIO_h__
+#define __AsyncIO_h__
+
+#include "Os.h"
+#include <atomic>
+
+K3D_COMMON_NS
+{
+	enum class EIOPriority : uint32
+	{
+		High,
+		Normal,
+		Low,
+		Count
+	};
+
+	enum class EIOStatus : uint32
+	{
+		Pending,
+		Done,
+		Failed,
+		Cancelled
+	};
+
+	enum class EIOBackend : uint32
+	{
+		Auto,
+		IOUring,
+		ThreadPool
+	};
+
+	typedef uint64 IORequestId;
+
+	struct IOResult
+	{
+		IORequestId	Id;
+		EIOStatus	Status;
+		/// Less than the requested size at end of file
+		uint64		BytesRead;
+		void *		Dest;
+	};
+
+	/// IOBatch
+	/// Completion counter over a set of reads, must outlive them.
+	class K3D_API IOBatch
+	{
+	public:
+		IOBatch();
+		~IOBatch();
+
+		bool	IsDone() const;
+		/// Block until every read of the batch completed, failed or was cancelled
+		void	Wait();
+
+		uint32	GetFailedCount() const { return m_Failed.load(std::memory_order_acquire); }
+		uint64	GetBytesRead() const { return m_BytesRead.load(std::memory_order_acquire); }
+
+	private:
+		friend class AsyncIO;
+		friend class AsyncIOPrivate;
+
+		void	Enter(uint32 count);
+		void	Leave(IOResult const & result);
+
+		IOBatch(const IOBatch&) = delete;
+		IOBatch& operator=(const IOBatch&) = delete;
+
+		std::atomic<int32>		m_Pending;
+		std::atomic<uint32>		m_Failed;
+		std::atomic<uint64>		m_BytesRead;
+		Os::Mutex				m_Lock;
+		Os::ConditionVariable	m_DoneCV;
+	};
+
+	struct IOReadRequest
+	{
+		/// Runs on an I/O thread, keep it short and dispatch heavy work
+		typedef InplaceFunction<void(IOResult const &), 48> Callback;
+
+		/// Must stay open until the read completed
+		Os::File *	File = nullptr;
+		/// Caller owned, at least Size bytes, the data is read straight into it
+		void *		Dest = nullptr;
+		uint64		Offset = 0;
+		uint64		Size = 0;
+		EIOPriority	Priority = EIOPriority::Normal;
+		Callback	OnComplete;
+	};
+
+	class AsyncIOPrivate;
+
+	/// AsyncIO
+	/// Asynchronous positional file reads with priorities and cancellation.
+	/// On Linux requests go through io_uring when the kernel allows it,
+	/// elsewhere (or with EIOBackend::ThreadPool) a few I/O threads issue
+	/// blocking reads. Queued requests are started highest priority first,
+	/// at most QueueDepth of them are in flight at once.
+	class K3D_API AsyncIO
+	{
+	public:
+		/// Optional, the first Submit initializes with the defaults.
+		/// Auto falls back to the thread pool if io_uring is unavailable,
+		/// an unavailable EIOBackend::IOUring fails and starts nothing.
+		static bool			Init(EIOBackend backend = EIOBackend::Auto, uint32 queueDepth = 256, uint32 numThreads = 4);
+		/// Cancels queued reads and waits for the ones in flight. Reads
+		/// submitted afterwards complete as cancelled until the next Init.
+		static void			Shutdown();
+
+		static EIOBackend	GetBackend();
+		static const char*	GetBackendName();
+
+		/// Queue count reads, their callbacks are moved out of requests.
+		/// \param batch optional, counts the reads
+		/// \param outIds optional, count entries receiving the request IDs
+		static void			Submit(IOReadRequest * requests, uint32 count, IOBatch * batch = nullptr, IORequestId * outIds = nullptr);
+
+		static IORequestId	Read(Os::File & file, void * dest, uint64 offset, uint64 size,
+								IOReadRequest::Callback && onComplete,
+								EIOPriority priority = EIOPriority::Normal, IOBatch * batch = nullptr);
+
+		/// Cancel a read that has not been started yet, its callback still
+		/// runs with EIOStatus::Cancelled. False once the read is in flight.
+		static bool			Cancel(IORequestId id);
+
+		/// Reads queued or in flight
+		static uint32		GetPendingCount();
+	};
+}
+
+#endif
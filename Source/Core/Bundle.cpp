@@ -5,145 +5,616 @@
 #include "ImageData.h"
 #include "Os.h"
 #include "LogUtil.h"
-#include "Utils/StringUtils.h"
-#include <list>
+#include "Dispatch/Dispatcher.h"
+#include "Utils/LZ.h"
+#include "Utils/SHA1.h"
+#include "Utils/farmhash.h"
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 using namespace std;
 
 namespace k3d
 {
-	class AssetBundleImpl
+	namespace
+	{
+		/// Archive sink appending to a memory buffer
+		class ChunkWriter : public IIODevice
+		{
+		public:
+			explicit ChunkWriter(vector<kByte> & bytes) : m_Bytes(bytes) {}
+
+			bool	Open(const kchar *, IOFlag) override { return true; }
+			bool	IsEOF() override { return true; }
+			size_t	Read(char *, size_t) override { return 0; }
+			size_t	Write(const void * data, size_t len) override
+			{
+				const kByte * bytes = (const kByte*)data;
+				m_Bytes.insert(m_Bytes.end(), bytes, bytes + len);
+				return len;
+			}
+			bool	Seek(size_t) override { return false; }
+			bool	Skip(size_t) override { return false; }
+			void	Flush() override {}
+			void	Close() override {}
+
+		private:
+			vector<kByte> & m_Bytes;
+		};
+
+		struct Hash128
+		{
+			uint64 Low;
+			uint64 High;
+
+			bool operator==(Hash128 const & rhs) const { return Low == rhs.Low && High == rhs.High; }
+			bool operator!=(Hash128 const & rhs) const { return !(*this == rhs); }
+		};
+
+		Hash128 FingerprintOf(const void * data, size_t size)
+		{
+			util::uint128_t hash = util::Fingerprint128((const char*)data, size);
+			return Hash128{ util::Uint128Low64(hash), util::Uint128High64(hash) };
+		}
+
+		typedef std::shared_ptr< vector<kByte> > SpPayload;
+
+		struct CookedChunk
+		{
+			AssetChunk		Header;
+			/// Serialized asset, then its packed payload once compressed
+			vector<kByte>	Bytes;
+			/// Fingerprint of the serialized asset
+			Hash128			Source;
+			/// Fingerprint of the stored payload
+			Hash128			Content;
+			/// Stored payload: Bytes, a cache entry or the previous bundle
+			const kByte *	Stored = nullptr;
+			SpPayload		Payload;
+		};
+
+		template <class TAsset, class TVersion>
+		void Cook(TAsset const & asset, EAssetType type, TVersion version, CookedChunk & chunk)
+		{
+			ChunkWriter writer(chunk.Bytes);
+			{
+				// the writer sees the asset in a few large appends
+				BufferedArchive archive(&writer, 64 * 1024);
+				archive << version;
+				archive << asset;
+			}
+			memset(&chunk.Header, 0, sizeof(AssetChunk));
+			chunk.Header.Type = type;
+			chunk.Header.Size = (int64)chunk.Bytes.size();
+			chunk.Header.RawSize = chunk.Bytes.size();
+			strncpy(chunk.Header.Name, asset.Name(), 64);
+			chunk.Source = FingerprintOf(chunk.Bytes.data(), chunk.Bytes.size());
+		}
+
+		void Cook(MeshData const & mesh, CookedChunk & chunk)
+		{
+			Cook(mesh, EAssetType::EMesh, EMeshVersion::VERSION_1_1, chunk);
+		}
+
+		void Cook(CameraData const & camera, CookedChunk & chunk)
+		{
+			Cook(camera, EAssetType::ECamera, ECamVersion::VERSION_1_0, chunk);
+		}
+
+		uint64 AlignUp(uint64 offset)
+		{
+			return (offset + BundleAlignment - 1) & ~(BundleAlignment - 1);
+		}
+
+		const uint64 kRawBlockBit = 1ull << 63;
+
+		uint32 BlockCountOf(uint64 rawSize)
+		{
+			return (uint32)((rawSize + ChunkBlockSize - 1) / ChunkBlockSize);
+		}
+
+		struct CompressedBlock
+		{
+			CookedChunk *	Chunk;
+			uint32			Index;
+			vector<kByte>	Bytes;
+			bool			Raw;
+		};
+
+		/// Splits the chunks in blocks, compresses all of them in parallel
+		/// and swaps in the LZ payload of the chunks worth it.
+		void CompressChunks(vector<CookedChunk*> const & chunks)
+		{
+			vector<CompressedBlock> blocks;
+			for (auto chunk : chunks)
+			{
+				uint32 count = BlockCountOf(chunk->Bytes.size());
+				for (uint32 i = 0; i < count; i++)
+					blocks.push_back(CompressedBlock{ chunk, i, {}, false });
+			}
+			CompressedBlock * data = blocks.data();
+			Dispatcher::ParallelFor((uint32)blocks.size(), 4, [data](uint32 i)
+			{
+				CompressedBlock & block = data[i];
+				vector<kByte> const & raw = block.Chunk->Bytes;
+				uint64 begin = block.Index * ChunkBlockSize;
+				size_t rawSize = (size_t)std::min<uint64>(ChunkBlockSize, raw.size() - begin);
+				// only keep blocks that shrink
+				block.Bytes.resize(rawSize - 1);
+				size_t size = LZ::Compress(raw.data() + begin, rawSize, block.Bytes.data(), block.Bytes.size());
+				block.Raw = size == 0;
+				block.Bytes.resize(size);
+			});
+
+			size_t next = 0;
+			for (auto pChunk : chunks)
+			{
+				CookedChunk & chunk = *pChunk;
+				uint32 count = BlockCountOf(chunk.Bytes.size());
+				uint64 packedSize = count * sizeof(uint64);
+				for (uint32 i = 0; i < count; i++)
+				{
+					CompressedBlock const & block = blocks[next + i];
+					packedSize += block.Raw ? std::min<uint64>(ChunkBlockSize, chunk.Bytes.size() - i * ChunkBlockSize) : block.Bytes.size();
+				}
+				// incompressible chunks are served raw, saving the decode
+				if (count == 0 || packedSize > chunk.Bytes.size() - chunk.Bytes.size() / 16)
+				{
+					next += count;
+					continue;
+				}
+				vector<kByte> packed((size_t)packedSize);
+				uint64 * table = (uint64*)packed.data();
+				kByte * dst = packed.data() + count * sizeof(uint64);
+				uint64 end = 0;
+				for (uint32 i = 0; i < count; i++, next++)
+				{
+					CompressedBlock const & block = blocks[next];
+					const kByte * src = block.Raw ? chunk.Bytes.data() + i * ChunkBlockSize : block.Bytes.data();
+					size_t size = block.Raw ? (size_t)std::min<uint64>(ChunkBlockSize, chunk.Bytes.size() - i * ChunkBlockSize) : block.Bytes.size();
+					memcpy(dst + end, src, size);
+					end += size;
+					table[i] = end | (block.Raw ? kRawBlockBit : 0);
+				}
+				chunk.Header.Compression = EChunkCompression::LZ;
+				chunk.Header.RawSize = chunk.Bytes.size();
+				chunk.Header.Size = (int64)packed.size();
+				chunk.Bytes.swap(packed);
+			}
+		}
+	}
+
+	uint32 GetChunkBlockCount(AssetChunkView const & chunk)
+	{
+		return chunk.Compression == EChunkCompression::None ? 1 : BlockCountOf(chunk.RawSize);
+	}
+
+	bool DecompressChunkBlock(AssetChunkView const & chunk, uint32 block, void * dst)
+	{
+		if (chunk.Compression == EChunkCompression::None)
+		{
+			if (block != 0)
+				return false;
+			memcpy(dst, chunk.Data, (size_t)chunk.Size);
+			return true;
+		}
+		uint32 count = BlockCountOf(chunk.RawSize);
+		uint64 tableSize = count * sizeof(uint64);
+		if (block >= count || chunk.Size < tableSize)
+			return false;
+		const uint64 * table = (const uint64*)chunk.Data;
+		const kByte * blocks = (const kByte*)chunk.Data + tableSize;
+		uint64 begin = block ? table[block - 1] & ~kRawBlockBit : 0;
+		uint64 end = table[block] & ~kRawBlockBit;
+		if (begin > end || end > chunk.Size - tableSize)
+			return false;
+		uint64 rawBegin = block * ChunkBlockSize;
+		size_t rawSize = (size_t)std::min<uint64>(ChunkBlockSize, chunk.RawSize - rawBegin);
+		kByte * out = (kByte*)dst + rawBegin;
+		if (table[block] & kRawBlockBit)
+		{
+			if (end - begin != rawSize)
+				return false;
+			memcpy(out, blocks + begin, rawSize);
+			return true;
+		}
+		return LZ::Decompress(blocks + begin, (size_t)(end - begin), out, rawSize) == rawSize;
+	}
+
+	bool DecompressChunk(AssetChunkView const & chunk, void * dst)
+	{
+		uint32 count = GetChunkBlockCount(chunk);
+		std::atomic<bool> ok(true);
+		Dispatcher::ParallelFor(count, 4, [&chunk, dst, &ok](uint32 block)
+		{
+			if (!DecompressChunkBlock(chunk, block, dst))
+				ok.store(false, std::memory_order_relaxed);
+		});
+		return ok.load();
+	}
+
+	namespace
+	{
+		const uint64 kManifestMagic = 0x314B4F4F4344334Bull; // "K3DCOOK1"
+
+		/// One per chunk of a cooked bundle, in the .manifest next to it
+		struct AssetCookRecord
+		{
+			char				Name[64];
+			Hash128				Source;
+			Hash128				Content;
+			EChunkCompression	Compression;
+			/// Bundle setting the payload was cooked for
+			EChunkCompression	Requested;
+		};
+
+		struct AssetCookManifestHeader
+		{
+			uint64		Magic;
+			uint32		Count;
+			/// SHA1 of the records
+			uint32		Digest[5];
+		};
+
+		void DigestOf(vector<AssetCookRecord> const & records, uint32 digest[5])
+		{
+			SHA1 sha;
+			sha.Input((const unsigned char*)records.data(), (unsigned)(records.size() * sizeof(AssetCookRecord)));
+			unsigned result[5] = { 0 };
+			sha.Result(result);
+			for (uint32 i = 0; i < 5; i++)
+				digest[i] = result[i];
+		}
+
+		uint64 NameKey(const char * name)
+		{
+			return Name::HashOf(name, strnlen(name, sizeof(AssetChunk::Name)));
+		}
+	}
+
+	class AssetCookCacheImpl
 	{
 	public:
-		Os::File			BundleFile;
-		Archive				Archv;
+		struct Entry
+		{
+			Hash128				Source;
+			Hash128				Content;
+			EChunkCompression	Compression;
+			uint64				RawSize;
+			SpPayload			Payload;
+		};
+
+		static uint64 KeyOf(Hash128 const & source, EChunkCompression compression)
+		{
+			return source.Low ^ ((uint64)compression * 0x9E3779B97F4A7C15ull);
+		}
+
+		bool Find(Hash128 const & source, EChunkCompression compression, Entry & entry)
+		{
+			Lock.Lock();
+			Entry * found = Entries.FindValue(KeyOf(source, compression));
+			bool hit = found && found->Source == source;
+			if (hit)
+				entry = *found;
+			Lock.UnLock();
+			return hit;
+		}
+
+		void Add(Entry const & entry, EChunkCompression compression)
+		{
+			Lock.Lock();
+			Entries[KeyOf(entry.Source, compression)] = entry;
+			Lock.UnLock();
+		}
+
+		/// keyed by source fingerprint and requested compression
+		HashMap<uint64, Entry>	Entries;
+		mutable Os::Mutex		Lock;
+	};
+
+	AssetCookCache::AssetCookCache()
+		: d(new AssetCookCacheImpl)
+	{
+	}
+
+	AssetCookCache::~AssetCookCache()
+	{
+		delete d;
+	}
+
+	uint32 AssetCookCache::GetCount() const
+	{
+		d->Lock.Lock();
+		uint32 count = (uint32)d->Entries.Count();
+		d->Lock.UnLock();
+		return count;
+	}
 
+	void AssetCookCache::Clear()
+	{
+		d->Lock.Lock();
+		d->Entries.Clear();
+		d->Lock.UnLock();
+	}
+
+	class AssetBundleImpl
+	{
+	public:
 		kString				BundleDir;
 		kString				CacheDir;
 		kString				BundleName;
-		list<MeshData*>		Meshes;
-		list<CameraData*>	Cameras;
-		list<AssetChunk*>	Chunks;
-		bool				Opened;
+		kString				BundlePath;
+		kString				ManifestPath;
+		vector<CookedChunk>	Chunks;
+		EChunkCompression	Compression = EChunkCompression::None;
+		bool				Incremental = false;
+		AssetCookCache *	Cache = nullptr;
+		AssetCookStats		Stats;
 
 		void Initialize()
 		{
 			CacheDir = BundleDir + BundleName;
-			auto bundlePath = BundleDir + BundleName + KT(".bundle");
-			Opened = BundleFile.Open(bundlePath.c_str(), IOWrite);
-			if (Opened)
-			{
-				KLOG(Info, AssetBundleImpl, "Initialize");
-				Archv.SetIODevice(&BundleFile);
-			}
+			BundlePath = BundleDir + BundleName + KT(".bundle");
+			ManifestPath = BundleDir + BundleName + KT(".manifest");
+			KLOG(Info, AssetBundleImpl, "Initialize");
 		}
 
-		void Close()
+		template <class TAsset>
+		void Serialize(TAsset * asset)
 		{
-			if (Opened)
-			{
-				KLOG(Info, AssetBundleImpl, "Close");
-				BundleFile.Close();
-			}
+			if (!asset)
+				return;
+			KLOG(Info, AssetBundleImpl, "Serialize %s: %s", TAsset::ClassName(), asset->Name());
+			Chunks.emplace_back();
+			Cook(*asset, Chunks.back());
 		}
 
-		uint64 GetMergedTableSize()
+		/// Cooks on the dispatch workers, chunks keep the order of assets
+		template <class TAsset>
+		void Serialize(TAsset * const * assets, uint32 count)
 		{
-			return Chunks.size() * sizeof(AssetChunk);
+			vector<TAsset*> valid;
+			valid.reserve(count);
+			for (uint32 i = 0; i < count; i++)
+			{
+				if (assets[i])
+					valid.push_back(assets[i]);
+			}
+			size_t first = Chunks.size();
+			Chunks.resize(first + valid.size());
+			CookedChunk * chunks = Chunks.data() + first;
+			TAsset * const * cooked = valid.data();
+			Dispatcher::ParallelFor((uint32)valid.size(), 1, [cooked, chunks](uint32 i)
+			{
+				Cook(*cooked[i], chunks[i]);
+			});
+			KLOG(Info, AssetBundleImpl, "Serialized %u %s.", (uint32)valid.size(), TAsset::ClassName());
 		}
 
-		void Serialize(MeshData * mesh)
+		/// Records of the previous cook, empty if missing or corrupted
+		bool LoadManifest(vector<AssetCookRecord> & records)
 		{
-			if (!mesh)
-				return;
-#if K3DPLATFORM_OS_WIN
-			wchar_t name[128];
-			StringUtil::CharToWchar(mesh->Name(), name, 128);
-			auto path = CacheDir + KT("/") + name;
-#else
-			auto path = CacheDir + KT("/") + mesh->Name();
-#endif
 			Os::File file;
-			KLOG(Info, AssetBundleImpl, "Serialize Mesh: %s", mesh->Name());
-			file.Open(path.c_str(),IOWrite);
-			Archive archive;
-			archive.SetIODevice(&file);
-			EMeshVersion mVer = EMeshVersion::VERSION_1_1;
-			archive << mVer;
-			archive << *mesh;
-			AssetChunk* chunk = new AssetChunk;
-			memset(chunk, 0, sizeof(AssetChunk));
-			chunk->Type = EAssetType::EMesh;
-			chunk->Size = file.GetSize();
-			strncpy(chunk->Name, mesh->Name(), 64);
-			Chunks.push_back(chunk);
+			if (!file.Open(ManifestPath.c_str(), IORead))
+				return false;
+			AssetCookManifestHeader header;
+			bool valid = file.Read((char*)&header, sizeof(header)) == sizeof(header)
+				&& header.Magic == kManifestMagic
+				&& (uint64)file.GetSize() == sizeof(header) + (uint64)header.Count * sizeof(AssetCookRecord);
+			if (valid)
+			{
+				records.resize(header.Count);
+				size_t size = records.size() * sizeof(AssetCookRecord);
+				valid = file.Read((char*)records.data(), size) == size;
+				uint32 digest[5];
+				DigestOf(records, digest);
+				valid = valid && memcmp(digest, header.Digest, sizeof(digest)) == 0;
+			}
 			file.Close();
+			if (!valid)
+			{
+				KLOG(Warn, AssetBundleImpl, "Cook manifest is corrupted, cooking everything.");
+				records.clear();
+			}
+			return valid;
 		}
 
-		void Serialize(CameraData * camera)
+		bool SaveManifest()
 		{
-			if (!camera)
-				return;
-#if K3DPLATFORM_OS_WIN
-			wchar_t name[128];
-			StringUtil::CharToWchar(camera->Name(), name, 128);
-			auto path = CacheDir + KT("/") + name;
-#else
-			auto path = CacheDir + KT("/") + camera->Name();
-#endif
+			vector<AssetCookRecord> records(Chunks.size());
+			for (size_t i = 0; i < Chunks.size(); i++)
+			{
+				AssetCookRecord & record = records[i];
+				memset(&record, 0, sizeof(record));
+				memcpy(record.Name, Chunks[i].Header.Name, sizeof(record.Name));
+				record.Source = Chunks[i].Source;
+				record.Content = Chunks[i].Content;
+				record.Compression = Chunks[i].Header.Compression;
+				record.Requested = Compression;
+			}
+			AssetCookManifestHeader header = { kManifestMagic, (uint32)records.size(), { 0 } };
+			DigestOf(records, header.Digest);
+
 			Os::File file;
-			KLOG(Info, AssetBundleImpl, "Serialize Camera: %s", camera->Name());
-			file.Open(path.c_str(), IOWrite);
-			Archive archive;
-			archive.SetIODevice(&file);
-			ECamVersion cVer = ECamVersion::VERSION_1_0;
-			archive << cVer;
-			archive << *camera;
-			AssetChunk* chunk = new AssetChunk;
-			memset(chunk, 0, sizeof(AssetChunk));
-			chunk->Type = EAssetType::ECamera;
-			chunk->Size = file.GetSize();
-			strncpy(chunk->Name, camera->Name(), 64);
-			Chunks.push_back(chunk);
+			if (!file.Open(ManifestPath.c_str(), IOWrite))
+				return false;
+			Os::IOVec vecs[] = {
+				{ &header, sizeof(header) },
+				{ records.data(), records.size() * sizeof(AssetCookRecord) }
+			};
+			size_t written = file.WriteV(vecs, 2);
 			file.Close();
+			return written == vecs[0].Size + vecs[1].Size;
+		}
+
+		void SetStored(CookedChunk & chunk, const kByte * data, uint64 size, EChunkCompression compression, uint64 rawSize)
+		{
+			chunk.Stored = data;
+			chunk.Header.Size = (int64)size;
+			chunk.Header.Compression = compression;
+			chunk.Header.RawSize = rawSize;
 		}
 
-		// write chunk table
-		void DumpChunkTable()
+		/// Picks each stored payload from the previous bundle, the cook
+		/// cache or a fresh compression, in that order.
+		void ResolvePayloads(AssetBundleReader & previous, vector<AssetCookRecord> const & records)
 		{
-			Archv << GetMergedTableSize();
-			for (auto Chunk : Chunks)
+			HashMap<uint64, AssetCookRecord const*> recordIndex;
+			for (auto const & record : records)
+				recordIndex.Insert(NameKey(record.Name), &record);
+
+			vector<CookedChunk*> pending;
+			for (auto & chunk : Chunks)
+			{
+				AssetCookRecord const * const * record = recordIndex.FindValue(NameKey(chunk.Header.Name));
+				if (record && (*record)->Source == chunk.Source && (*record)->Requested == Compression)
+				{
+					AssetChunkView view = previous.Find(chunk.Header.Name);
+					if (view && view.Compression == (*record)->Compression && view.RawSize == chunk.Bytes.size())
+					{
+						SetStored(chunk, (const kByte*)view.Data, view.Size, view.Compression, view.RawSize);
+						chunk.Content = (*record)->Content;
+						Stats.Reused++;
+						continue;
+					}
+				}
+				AssetCookCacheImpl::Entry entry;
+				if (Cache && Cache->d->Find(chunk.Source, Compression, entry))
+				{
+					chunk.Payload = entry.Payload;
+					SetStored(chunk, entry.Payload->data(), entry.Payload->size(), entry.Compression, entry.RawSize);
+					chunk.Content = entry.Content;
+					Stats.Cached++;
+					continue;
+				}
+				pending.push_back(&chunk);
+			}
+
+			if (Compression == EChunkCompression::LZ)
+			{
+				CompressChunks(pending);
+			}
+			CookedChunk * const * cooked = pending.data();
+			Dispatcher::ParallelFor((uint32)pending.size(), 4, [cooked](uint32 i)
+			{
+				CookedChunk & chunk = *cooked[i];
+				chunk.Content = FingerprintOf(chunk.Bytes.data(), chunk.Bytes.size());
+			});
+			for (auto chunk : pending)
 			{
-				Archv << *Chunk;
+				chunk->Payload = std::make_shared< vector<kByte> >(std::move(chunk->Bytes));
+				chunk->Stored = chunk->Payload->data();
+				if (Cache)
+				{
+					AssetCookCacheImpl::Entry entry = { chunk->Source, chunk->Content,
+						chunk->Header.Compression, chunk->Header.RawSize, chunk->Payload };
+					Cache->d->Add(entry, Compression);
+				}
 			}
 		}
 
-		void DumpChunk(AssetChunk * chunk)
+		/// Header, chunk table and page aligned payloads in one gathered
+		/// write, chunks of identical content share their payload.
+		bool WriteBundle(AssetBundleReader & previous)
 		{
-			if (!chunk)
-				return;
+			static const kByte s_Padding[BundleAlignment] = { 0 };
+
+			EAssetVersion version = EAssetVersion::E20261018u;
+			uint64 tableSize = Chunks.size() * sizeof(AssetChunk);
+			vector<AssetChunk> table(Chunks.size());
+			vector<bool> unique(Chunks.size(), true);
+			HashMap<uint64, uint32> contentIndex;
+			uint64 offset = AlignUp(sizeof(version) + sizeof(tableSize) + tableSize);
+			for (size_t i = 0; i < Chunks.size(); i++)
+			{
+				CookedChunk const & chunk = Chunks[i];
+				table[i] = chunk.Header;
+				uint32 * same = contentIndex.FindValue(chunk.Content.Low);
+				if (same && Chunks[*same].Content == chunk.Content && table[*same].Size == chunk.Header.Size)
+				{
+					table[i].Offset = table[*same].Offset;
+					unique[i] = false;
+					Stats.Deduplicated++;
+					continue;
+				}
+				contentIndex.Insert(chunk.Content.Low, (uint32)i);
+				table[i].Offset = offset;
+				offset = AlignUp(offset + table[i].Size);
+			}
+
+			// every payload reused in place from the same slot, same layout
+			if (previous.IsOpen() && previous.GetChunkCount() == Chunks.size())
+			{
+				bool same = true;
+				for (uint32 i = 0; i < Chunks.size() && same; i++)
+				{
+					AssetChunkView view = previous.GetChunk(i);
+					same = view.Data == Chunks[i].Stored && view.Size == (uint64)Chunks[i].Header.Size
+						&& strncmp(view.Name, Chunks[i].Header.Name, sizeof(AssetChunk::Name)) == 0
+						&& view.Type == Chunks[i].Header.Type;
+				}
+				if (same)
+				{
+					Stats.UpToDate = true;
+					return true;
+				}
+			}
 
-#if K3DPLATFORM_OS_WIN
-			wchar_t name[128];
-			StringUtil::CharToWchar(chunk->Name, name, 128);
-			auto path = CacheDir + KT("/") + name;
-#else
-			auto path = CacheDir + KT("/")+ chunk->Name;
-#endif
+			vector<Os::IOVec> vecs;
+			vecs.reserve(3 + Chunks.size() * 2);
+			vecs.push_back({ &version, sizeof(version) });
+			vecs.push_back({ &tableSize, sizeof(tableSize) });
+			vecs.push_back({ table.data(), (size_t)tableSize });
+			uint64 position = sizeof(version) + sizeof(tableSize) + tableSize;
+			for (size_t i = 0; i < Chunks.size(); i++)
+			{
+				if (!unique[i])
+					continue;
+				vecs.push_back({ s_Padding, (size_t)(table[i].Offset - position) });
+				vecs.push_back({ Chunks[i].Stored, (size_t)table[i].Size });
+				position = table[i].Offset + table[i].Size;
+			}
+
+			// the previous bundle stays mapped until the new one is complete
+			kString tmpPath = BundlePath + KT(".tmp");
 			Os::File file;
-			bool opened = file.Open(path.c_str(), IORead);
-            if(!opened)
-                return;
-			int64 szFile = file.GetSize();
-			char * data = new char[szFile];
-			file.Read(data, szFile);
-			// Write Chunk header
-			Archv << chunk->Type;
-			Archv.ArrayIn(data, szFile);
-			// Write Chunk tail
-			Archv << EAssetType::EChunkEnd;
+			if (!file.Open(tmpPath.c_str(), IOWrite))
+			{
+				KLOG(Error, AssetBundleImpl, "Cannot create the bundle.");
+				return false;
+			}
+			size_t written = file.WriteV(vecs.data(), (uint32)vecs.size());
 			file.Close();
-			delete[] data;
+			previous.Close();
+			if (written != position || !Os::Rename(tmpPath.c_str(), BundlePath.c_str()))
+			{
+				KLOG(Error, AssetBundleImpl, "Bundle write failed, %llu of %llu bytes written.",
+					(unsigned long long)written, (unsigned long long)position);
+				return false;
+			}
+			return true;
+		}
+
+		bool MergeAndBundle()
+		{
+			Stats = AssetCookStats();
+			Stats.Chunks = (uint32)Chunks.size();
+
+			vector<AssetCookRecord> records;
+			AssetBundleReader previous;
+			if (Incremental && LoadManifest(records) && !previous.Open(BundlePath.c_str()))
+			{
+				records.clear();
+			}
+			ResolvePayloads(previous, records);
+			bool done = WriteBundle(previous);
+			// a stale manifest would let the next cook reuse wrong payloads
+			done = done && (!Incremental || Stats.UpToDate || SaveManifest());
+			KLOG(Info, AssetBundleImpl, "Cooked %u chunks: %u reused, %u cached, %u deduplicated%s.",
+				Stats.Chunks, Stats.Reused, Stats.Cached, Stats.Deduplicated, Stats.UpToDate ? ", up to date" : "");
+			return done;
 		}
 	};
 
@@ -161,23 +632,47 @@ namespace k3d
 	{
 		d->Serialize(camera);
 	}
+
+	void AssetBundle::Serialize(MeshData * const * meshes, uint32 count)
+	{
+		d->Serialize(meshes, count);
+	}
+
+	void AssetBundle::Serialize(CameraData * const * cameras, uint32 count)
+	{
+		d->Serialize(cameras, count);
+	}
 	
+	void AssetBundle::SetCompression(EChunkCompression compression)
+	{
+		d->Compression = compression;
+	}
+
+	void AssetBundle::SetIncremental(bool incremental)
+	{
+		d->Incremental = incremental;
+	}
+
+	void AssetBundle::SetCookCache(AssetCookCache * cache)
+	{
+		d->Cache = cache;
+	}
+
+	AssetCookStats const & AssetBundle::GetCookStats() const
+	{
+		return d->Stats;
+	}
+
 	void AssetBundle::MergeAndBundle(bool deleteCache)
 	{
 		m_IsBundling = true;
-		EAssetVersion bundleVer = EAssetVersion::E20161210u;
-		d->Archv << bundleVer;
-		d->DumpChunkTable();
-		for (auto c : d->Chunks)
-		{
-			d->DumpChunk(c);
-			delete c;
-		}
+		d->MergeAndBundle();
+		d->Chunks.clear();
 		if (deleteCache) 
 		{
+			// left behind by bundlers that cooked through temp files
 			Os::Remove(d->CacheDir.c_str());
 		}
-		d->Close();
 		m_IsBundling = false;
 	}
 
@@ -196,7 +691,6 @@ namespace k3d
 	{
 		if (d)
 		{
-			d->Close();
 			delete d;
 			d = nullptr;
 		}
@@ -204,8 +698,145 @@ namespace k3d
 
 	void AssetBundle::Prepare()
 	{
-		auto bundleTmpCache = d->BundleDir + d->BundleName;
-		Os::MakeDir(bundleTmpCache.c_str());
+		d->Chunks.clear();
 	}
 
+	//--------------------------------------------------------------------------------------------
+
+	class AssetBundleReaderImpl
+	{
+	public:
+		Os::MemMapFile			File;
+		const AssetChunk *		Table = nullptr;
+		uint32					Count = 0;
+		/// name hash -> table index
+		HashMap<uint64, uint32>	Index;
+		bool					Opened = false;
+
+		bool Open(const kchar * bundlePath)
+		{
+			if (!File.Open(bundlePath, IORead))
+			{
+				KLOG(Error, AssetBundleReader, "Cannot open bundle.");
+				return false;
+			}
+			Opened = true;
+			const kByte * base = File.FileData();
+			uint64 size = (uint64)File.GetSize();
+			uint64 tableStart = sizeof(EAssetVersion) + sizeof(uint64);
+			if (size < tableStart || *(const EAssetVersion*)base != EAssetVersion::E20261018u)
+			{
+				KLOG(Error, AssetBundleReader, "Unsupported bundle version, recook it.");
+				return false;
+			}
+			uint64 tableSize = *(const uint64*)(base + sizeof(EAssetVersion));
+			if (tableSize % sizeof(AssetChunk) != 0 || tableStart + tableSize > size)
+			{
+				KLOG(Error, AssetBundleReader, "Corrupted chunk table.");
+				return false;
+			}
+			Table = (const AssetChunk*)(base + tableStart);
+			Count = (uint32)(tableSize / sizeof(AssetChunk));
+			Index.Reserve(Count);
+			for (uint32 i = 0; i < Count; i++)
+			{
+				const AssetChunk & chunk = Table[i];
+				if (chunk.Size < 0 || chunk.Offset > size || (uint64)chunk.Size > size - chunk.Offset)
+				{
+					KLOG(Error, AssetBundleReader, "Chunk %.*s out of bounds.", 64, chunk.Name);
+					Count = 0;
+					Index.Clear();
+					return false;
+				}
+				size_t length = strnlen(chunk.Name, sizeof(chunk.Name));
+				if (!Index.Insert(Name::HashOf(chunk.Name, length), i).second)
+				{
+					KLOG(Warn, AssetBundleReader, "Duplicated chunk %.*s, keeping the first.", (int)length, chunk.Name);
+				}
+			}
+			return true;
+		}
+
+		void Close()
+		{
+			if (Opened)
+			{
+				File.Close();
+				Opened = false;
+			}
+			Table = nullptr;
+			Count = 0;
+			Index.Clear();
+		}
+
+		AssetChunkView View(uint32 index) const
+		{
+			const AssetChunk & chunk = Table[index];
+			AssetChunkView view = { chunk.Type, File.FileData() + chunk.Offset, (uint64)chunk.Size, chunk.Name, chunk.Compression, chunk.RawSize, chunk.Offset };
+			return view;
+		}
+
+		AssetChunkView Find(uint64 id) const
+		{
+			const uint32 * index = Index.FindValue(id);
+			if (!index)
+				return AssetChunkView{ EAssetType::EChunkEnd, nullptr, 0, nullptr, EChunkCompression::None, 0, 0 };
+			return View(*index);
+		}
+	};
+
+	AssetBundleReader::AssetBundleReader()
+		: d(new AssetBundleReaderImpl)
+	{
+	}
+
+	AssetBundleReader::~AssetBundleReader()
+	{
+		d->Close();
+		delete d;
+	}
+
+	bool AssetBundleReader::Open(const kchar * bundlePath)
+	{
+		d->Close();
+		if (d->Open(bundlePath))
+			return true;
+		d->Close();
+		return false;
+	}
+
+	void AssetBundleReader::Close()
+	{
+		d->Close();
+	}
+
+	bool AssetBundleReader::IsOpen() const
+	{
+		return d->Table != nullptr;
+	}
+
+	uint32 AssetBundleReader::GetChunkCount() const
+	{
+		return d->Count;
+	}
+
+	AssetChunkView AssetBundleReader::GetChunk(uint32 index) const
+	{
+		K3D_ASSERT(index < d->Count);
+		return d->View(index);
+	}
+
+	AssetChunkView AssetBundleReader::Find(const char * chunkName) const
+	{
+		size_t length = strnlen(chunkName, sizeof(AssetChunk::Name));
+		AssetChunkView view = d->Find(Name::HashOf(chunkName, length));
+		if (view && strncmp(view.Name, chunkName, sizeof(AssetChunk::Name)) != 0)
+			return AssetChunkView{ EAssetType::EChunkEnd, nullptr, 0, nullptr, EChunkCompression::None, 0, 0 };
+		return view;
+	}
+
+	AssetChunkView AssetBundleReader::Find(Name chunkName) const
+	{
+		return d->Find(chunkName.GetId());
+	}
 }
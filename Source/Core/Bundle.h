@@ -1,12 +1,33 @@
 #pragma once
 
 #include <KTL/Archive.hpp>
+#include <KTL/Name.hpp>
 
 namespace k3d
 {
 	enum class EAssetVersion : uint64
 	{
 		E20161210u,
+		/// Chunk table carries offsets, payloads are BundleAlignment aligned
+		E20261017u,
+		/// Chunks may be LZ compressed
+		E20261018u,
+	};
+
+	/// Payload alignment inside a bundle, mapped chunks start on a page
+	static const uint64 BundleAlignment = 4096;
+
+	/// Raw bytes per block of a compressed chunk
+	static const uint64 ChunkBlockSize = 64 * 1024;
+
+	/// \brief storage of a chunk payload
+	/// An LZ payload starts with one uint64 per block: its end offset past
+	/// the table, with the top bit set when the block is stored raw. The
+	/// blocks follow back to back and decode independently.
+	enum class EChunkCompression : uint32
+	{
+		None,
+		LZ,
 	};
 
 	/// \brief asset type : include shader, mesh, camera, material, image
@@ -36,29 +57,112 @@ namespace k3d
 	/// \class AssetChunk 
 	struct AssetChunk
 	{
-		EAssetType	Type;
-		int64		Size;
-		char		Name[64];
+		EAssetType			Type;
+		EChunkCompression	Compression;
+		/// Stored payload size
+		int64				Size;
+		char				Name[64];
+		/// Payload position from the start of the bundle
+		uint64				Offset;
+		/// Size once decompressed, equals Size for raw chunks
+		uint64				RawSize;
+	};
+
+	/// \brief zero-copy view of a chunk payload, valid while the reader is open
+	struct AssetChunkView
+	{
+		EAssetType			Type;
+		const void *		Data;
+		uint64				Size;
+		const char *		Name;
+		EChunkCompression	Compression;
+		uint64				RawSize;
+		/// Payload position from the start of the bundle
+		uint64				Offset;
+
+		explicit operator bool() const { return Data != nullptr; }
 	};
 
+	/// Blocks of a compressed chunk, 1 for raw chunks
+	K3D_API uint32	GetChunkBlockCount(AssetChunkView const & chunk);
+	/// Decode one block to dst + block * ChunkBlockSize, reads only the
+	/// block table and that block, so blocks can be decoded as they arrive
+	K3D_API bool	DecompressChunkBlock(AssetChunkView const & chunk, uint32 block, void * dst);
+	/// Decode the chunk into RawSize bytes at dst, blocks in parallel
+	K3D_API bool	DecompressChunk(AssetChunkView const & chunk, void * dst);
+
 	class ImageData;
 	class MeshData;
 	class CameraData;
 	class ShaderData;
 
+	/// \brief outcome of the last MergeAndBundle
+	struct AssetCookStats
+	{
+		uint32	Chunks = 0;
+		/// Unchanged since the previous cook, payload taken from the old bundle
+		uint32	Reused = 0;
+		/// Payload taken from the cook cache, cooked by another bundle
+		uint32	Cached = 0;
+		/// Stored once for several chunks of identical content
+		uint32	Deduplicated = 0;
+		/// Nothing changed, the bundle was left untouched
+		bool	UpToDate = false;
+	};
+
+	/// \brief cooked payloads keyed by the fingerprint of their source
+	/// \class AssetCookCache
+	/// Share one between the bundles of a cook so an asset packed into
+	/// several bundles is compressed once. Thread safe.
+	class K3D_API AssetCookCache
+	{
+	public:
+		AssetCookCache();
+		~AssetCookCache();
+
+		uint32	GetCount() const;
+		void	Clear();
+
+	private:
+		AssetCookCache(const AssetCookCache&) = delete;
+		AssetCookCache& operator=(const AssetCookCache&) = delete;
+
+		friend class AssetBundleImpl;
+		class AssetCookCacheImpl * d;
+	};
+
+	/// \brief cooks assets into memory and writes the bundle in one pass
+	/// \class AssetBundle
 	class K3D_API AssetBundle
 	{
 	public:
 		static AssetBundle * CreateBundle(const kchar * bundleName, const kchar * bundleDir);
 		~AssetBundle();
 
+		/// Drops the chunks cooked so far
 		void Prepare();
 
+		/// Cooks right away, the asset may be released afterwards
 		void Serialize(MeshData *);
 		void Serialize(CameraData *);
+		/// Cooks count assets in parallel on the dispatch workers
+		void Serialize(MeshData * const * meshes, uint32 count);
+		void Serialize(CameraData * const * cameras, uint32 count);
+
+		/// LZ compresses the chunks that shrink, the others stay raw
+		void SetCompression(EChunkCompression compression);
 
+		/// Reuse the payloads of the previous bundle for assets whose
+		/// fingerprint did not change, tracked in <bundle>.manifest
+		void SetIncremental(bool incremental);
+		/// Optional, must outlive MergeAndBundle
+		void SetCookCache(AssetCookCache * cache);
+
+		/// Writes the bundle, deleteCache removes a stale cache directory
 		void MergeAndBundle(bool deleteCache);
 
+		AssetCookStats const & GetCookStats() const;
+
 	private:
 		AssetBundle(const kchar * bundleName, const kchar * bundleDir);
 		class AssetBundleImpl * d;
@@ -66,4 +170,32 @@ namespace k3d
 	private:
 		bool m_IsBundling;
 	};
+
+	/// \brief memory maps a bundle and looks chunks up by name
+	/// \class AssetBundleReader
+	/// The chunk table is hashed once at Open, lookups do not touch
+	/// the payloads and views point straight into the mapping.
+	class K3D_API AssetBundleReader
+	{
+	public:
+		AssetBundleReader();
+		~AssetBundleReader();
+
+		bool			Open(const kchar * bundlePath);
+		void			Close();
+		bool			IsOpen() const;
+
+		uint32			GetChunkCount() const;
+		AssetChunkView	GetChunk(uint32 index) const;
+
+		/// Empty view if the bundle has no chunk of that name
+		AssetChunkView	Find(const char * chunkName) const;
+		AssetChunkView	Find(Name chunkName) const;
+
+	private:
+		AssetBundleReader(const AssetBundleReader&) = delete;
+		AssetBundleReader& operator=(const AssetBundleReader&) = delete;
+
+		class AssetBundleReaderImpl * d;
+	};
 }
\ No newline at end of file
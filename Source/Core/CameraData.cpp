@@ -18,7 +18,9 @@ namespace k3d
 
 	Archive& operator << (class Archive & arch, const CameraData & camera)
 	{
-		arch.ArrayIn(CameraData::ClassName(), 64);
+		char className[64] = { 0 };
+		strncpy(className, CameraData::ClassName(), 63);
+		arch.ArrayIn(className, 64);
 		arch.ArrayIn(camera.m_Name, 64);
 
 		arch << camera.m_FOV;
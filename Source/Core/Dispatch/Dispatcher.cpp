@@ -1,5 +1,39 @@
+#include "Kaleido3D.h"
 #include "Dispatcher.h"
 
-void Dispatcher::Dispatch(Queue &, Item &)
+void Dispatcher::Dispatch(Queue & queue, Item & item)
 {
+	queue.Queue(&item);
+}
+
+void Dispatcher::Dispatch(Queue & queue, Group & group)
+{
+	queue.Queue(&group);
+}
+
+namespace
+{
+	struct GlobalQueue : public Dispatcher::Queue
+	{
+		GlobalQueue() : Dispatcher::Queue("Dispatcher", ::Os::ThreadPriority::Normal)
+		{
+			Loop();
+		}
+	};
+}
+
+Dispatcher::Queue & Dispatcher::Global()
+{
+	static GlobalQueue s_GlobalQueue;
+	return s_GlobalQueue;
+}
+
+void Dispatcher::Dispatch(Item * item)
+{
+	Global().Queue(item);
+}
+
+void Dispatcher::Dispatch(Group * group)
+{
+	Global().Queue(group);
 }
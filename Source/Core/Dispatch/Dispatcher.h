@@ -8,7 +8,60 @@ class K3D_API Dispatcher {
 public:
 	using Queue = ::Dispatch::WorkQueue;
 	using Item = ::Dispatch::WorkItem;
+	using Group = ::Dispatch::WorkGroup;
 
 	static void Dispatch(Queue &, Item &);
+	static void Dispatch(Queue &, Group &);
 
-};
\ No newline at end of file
+	/// Process wide queue, one worker per core, started on first use
+	static Queue & Global();
+
+	static void Dispatch(Item *);
+	static void Dispatch(Group *);
+
+	/// Split [0, count) into chunks of grain, run fun(index) on every
+	/// index across the global queue and wait, the caller helps.
+	template <class TFun>
+	static void ParallelFor(uint32 count, uint32 grain, TFun && fun);
+
+private:
+	template <class TFun>
+	class RangeItem : public Item {
+	public:
+		RangeItem() : m_Fun(nullptr), m_Begin(0), m_End(0) {}
+		void OnExec() override {
+			for (uint32 i = m_Begin; i < m_End; i++) {
+				(*m_Fun)(i);
+			}
+		}
+		TFun *	m_Fun;
+		uint32	m_Begin;
+		uint32	m_End;
+	};
+};
+
+template <class TFun>
+void Dispatcher::ParallelFor(uint32 count, uint32 grain, TFun && fun)
+{
+	typedef typename std::remove_reference<TFun>::type FunType;
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+	uint32 numRanges = (count + grain - 1) / grain;
+	if (numRanges == 1) {
+		for (uint32 i = 0; i < count; i++)
+			fun(i);
+		return;
+	}
+	std::vector< RangeItem<FunType> > ranges(numRanges);
+	Group group;
+	for (uint32 r = 0; r < numRanges; r++) {
+		ranges[r].m_Fun = &fun;
+		ranges[r].m_Begin = r * grain;
+		ranges[r].m_End = (r + 1) * grain < count ? (r + 1) * grain : count;
+		group.Add(&ranges[r]);
+	}
+	Global().Queue(&group);
+	group.Wait();
+}
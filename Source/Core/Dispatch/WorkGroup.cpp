@@ -1,22 +1,101 @@
 #include "Kaleido3D.h"
 #include "WorkGroup.h"
 #include "WorkItem.h"
+#include "WorkQueue.h"
 
 namespace Dispatch
 {
 	WorkGroup::WorkGroup()
+		: m_Pending(0)
+		, m_Completed(true)
+		, m_Queue(nullptr)
 	{
 	}
+
 	WorkGroup::~WorkGroup()
 	{
+		for (WorkItem * item : m_ItemContainer) {
+			if (item->m_AutoRelease) {
+				delete item;
+			}
+		}
 	}
+
 	bool WorkGroup::IsEmpty()
 	{
 		return m_ItemContainer.empty();
 	}
+
+	bool WorkGroup::IsDone() const
+	{
+		return m_Completed.load(std::memory_order_acquire);
+	}
+
 	WorkGroup & WorkGroup::Add(WorkItem * item)
 	{
+		item->m_Group = this;
 		m_ItemContainer.push_back(item);
 		return *this;
 	}
-}
\ No newline at end of file
+
+	WorkGroup & WorkGroup::Then(WorkItem * continuation)
+	{
+		bool runNow = false;
+		m_Lock.Lock();
+		if (IsDone() && m_Queue != nullptr) {
+			runNow = true;
+		}
+		else {
+			m_Continuations.push_back(continuation);
+		}
+		m_Lock.UnLock();
+		if (runNow) {
+			m_Queue->Queue(continuation);
+		}
+		return *this;
+	}
+
+	void WorkGroup::Wait()
+	{
+		while (!IsDone()) {
+			if (m_Queue != nullptr && m_Queue->TryExecuteOne()) {
+				continue;
+			}
+			m_Lock.Lock();
+			if (!IsDone()) {
+				m_DoneCV.Wait(&m_Lock, 1);
+			}
+			m_Lock.UnLock();
+		}
+		// Leave() signals under the lock, make sure it has released
+		// the group before the caller is allowed to destroy it.
+		m_Lock.Lock();
+		m_Lock.UnLock();
+	}
+
+	void WorkGroup::Enter(WorkQueue * queue, int32 count)
+	{
+		m_Queue = queue;
+		if (m_Pending.fetch_add(count, std::memory_order_acq_rel) == 0) {
+			m_Completed.store(false, std::memory_order_release);
+		}
+	}
+
+	void WorkGroup::Leave()
+	{
+		if (m_Pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+			return;
+		}
+		vector<WorkItem*> continuations;
+		WorkQueue * queue = m_Queue;
+		m_Lock.Lock();
+		continuations.swap(m_Continuations);
+		m_Completed.store(true, std::memory_order_release);
+		m_DoneCV.NotifyAll();
+		m_Lock.UnLock();
+		// group may be released by a waiter from here on
+		for (WorkItem * item : continuations) {
+			queue->Queue(item);
+		}
+	}
+}
@@ -1,6 +1,8 @@
-#pragma once 
+#pragma once
 
 #include <vector>
+#include <atomic>
+#include "../Os.h"
 
 namespace Dispatch
 {
@@ -9,17 +11,39 @@ namespace Dispatch
 	class WorkItem;
 	class WorkQueue;
 
-	class WorkGroup {
+	/// WorkGroup
+	/// Completion counter over a batch of items, items are queued
+	/// together through WorkQueue::Queue(WorkGroup*).
+	/// Continuations added by Then() are queued once every item finished.
+	/// The group must outlive its items. It owns the auto-release items
+	/// added to it and deletes them when destroyed, so it can be queued
+	/// again once done.
+	class K3D_API WorkGroup {
 	public:
 		WorkGroup();
 		~WorkGroup();
 		bool IsEmpty();
+		bool IsDone() const;
 		WorkGroup& Add(WorkItem* item);
+		WorkGroup& Then(WorkItem* continuation);
+
+		/// Block until all items finished, the calling thread
+		/// executes queued items meanwhile.
+		void Wait();
 
 	private:
 		friend class ::Dispatch::WorkQueue;
 
+		void Enter(WorkQueue * queue, int32 count);
+		void Leave();
+
 		vector<WorkItem*> m_ItemContainer;
-		
+		vector<WorkItem*> m_Continuations;
+
+		std::atomic<int32> m_Pending;
+		std::atomic<bool> m_Completed;
+		WorkQueue *	m_Queue;
+		::Os::Mutex	m_Lock;
+		::Os::ConditionVariable m_DoneCV;
 	};
-}
\ No newline at end of file
+}
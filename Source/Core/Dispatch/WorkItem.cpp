@@ -1,13 +1,139 @@
 #include "Kaleido3D.h"
 #include "WorkItem.h"
 #include "WorkQueue.h"
+#include "../LogUtil.h"
+#include <KTL/Allocator.hpp>
 
-namespace Dispatch 
+namespace Dispatch
 {
+	static_assert(sizeof(PooledWorkItem) <= WorkItemPool::BlockSize, "PooledWorkItem does not fit a pool block");
+
+	namespace
+	{
+		const uint32 kBlocksPerChunk = 64;
+		const uint32 kMaxCachedBlocks = 256;
+
+		struct FreeBlock
+		{
+			FreeBlock * Next;
+		};
+
+		struct SharedFreeList
+		{
+			::Os::Mutex		Lock;
+			FreeBlock *		Head = nullptr;
+			uint32			Count = 0;
+			std::atomic<uint32> Chunks{ 0 };
+		};
+
+		// never destroyed, worker threads may release items during shutdown
+		SharedFreeList & GetShared()
+		{
+			static SharedFreeList * s_Shared = new SharedFreeList;
+			return *s_Shared;
+		}
+
+		/// Moves up to count blocks from the front of head to the shared list
+		void GiveBack(FreeBlock *& head, uint32 & headCount, uint32 count)
+		{
+			if (head == nullptr || count == 0)
+				return;
+			FreeBlock * first = head;
+			FreeBlock * last = head;
+			uint32 moved = 1;
+			while (moved < count && last->Next != nullptr) {
+				last = last->Next;
+				moved++;
+			}
+			head = last->Next;
+			headCount -= moved;
+
+			SharedFreeList & shared = GetShared();
+			shared.Lock.Lock();
+			last->Next = shared.Head;
+			shared.Head = first;
+			shared.Count += moved;
+			shared.Lock.UnLock();
+		}
+
+		struct ThreadFreeList
+		{
+			FreeBlock *	Head = nullptr;
+			uint32		Count = 0;
+
+			~ThreadFreeList()
+			{
+				GiveBack(Head, Count, Count);
+			}
+
+			void Refill()
+			{
+				SharedFreeList & shared = GetShared();
+				shared.Lock.Lock();
+				while (shared.Head != nullptr && Count < kBlocksPerChunk) {
+					FreeBlock * block = shared.Head;
+					shared.Head = block->Next;
+					shared.Count--;
+					block->Next = Head;
+					Head = block;
+					Count++;
+				}
+				shared.Lock.UnLock();
+				if (Head != nullptr)
+					return;
+
+				char * chunk = (char*)__k3d_malloc__(WorkItemPool::BlockSize * kBlocksPerChunk);
+				for (uint32 i = 0; i < kBlocksPerChunk; i++) {
+					FreeBlock * block = (FreeBlock*)(chunk + i * WorkItemPool::BlockSize);
+					block->Next = Head;
+					Head = block;
+				}
+				Count += kBlocksPerChunk;
+				shared.Chunks.fetch_add(1, std::memory_order_relaxed);
+			}
+		};
+
+		thread_local ThreadFreeList t_FreeList;
+	}
+
+	void * WorkItemPool::Allocate(size_t size)
+	{
+		K3D_ASSERT(size <= BlockSize);
+		ThreadFreeList & list = t_FreeList;
+		if (list.Head == nullptr) {
+			list.Refill();
+		}
+		FreeBlock * block = list.Head;
+		list.Head = block->Next;
+		list.Count--;
+		return block;
+	}
+
+	void WorkItemPool::Free(void * p)
+	{
+		if (p == nullptr)
+			return;
+		ThreadFreeList & list = t_FreeList;
+		FreeBlock * block = (FreeBlock*)p;
+		block->Next = list.Head;
+		list.Head = block;
+		if (++list.Count > kMaxCachedBlocks) {
+			GiveBack(list.Head, list.Count, kMaxCachedBlocks / 2);
+		}
+	}
+
+	uint32 WorkItemPool::GetChunkCount()
+	{
+		return GetShared().Chunks.load(std::memory_order_relaxed);
+	}
+
 	WorkItem::WorkItem()
 		: m_Prev(nullptr)
 		, m_Next(nullptr)
 		, m_OwningQueue(nullptr)
+		, m_Group(nullptr)
+		, m_Cancelled(false)
+		, m_AutoRelease(false)
 	{
 	}
 
@@ -25,8 +151,19 @@ namespace Dispatch
 			m_OwningQueue->Remove(this);
 		}
 	}
+
+	bool WorkItem::IsCancelled() const
+	{
+		return m_Cancelled.load(std::memory_order_acquire);
+	}
+
 	WorkQueue * WorkItem::GetOwningQueue()
 	{
 		return m_OwningQueue;
 	}
-}
\ No newline at end of file
+
+	WorkGroup * WorkItem::GetGroup()
+	{
+		return m_Group;
+	}
+}
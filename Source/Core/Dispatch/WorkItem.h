@@ -1,34 +1,50 @@
 #pragma once
 #include <functional>
+#include <atomic>
+#include <KTL/InplaceFunction.hpp>
 
 namespace Dispatch
 {
 	class WorkQueue;
+	class WorkGroup;
 
-	class WorkItem {
+	class K3D_API WorkItem {
 	public:
 		WorkItem();
 		virtual ~WorkItem();
 		virtual void OnExec();
+
+		/// Cancel the item if it has not started yet, it will be skipped by workers
+		/// and has to stay alive until then
 		void RemoveFromQueue();
+		bool IsCancelled() const;
 
 		WorkQueue* GetOwningQueue();
+		WorkGroup* GetGroup();
+
+		/// Items created by Dispatch::Bind are deleted after execution, or by
+		/// their WorkGroup when they were added to one
+		void SetAutoRelease(bool autoRelease) { m_AutoRelease = autoRelease; }
 
 	protected:
 		friend class WorkQueue;
+		friend class WorkGroup;
 
 		WorkItem * m_Prev;
 		WorkItem * m_Next;
 
 		WorkQueue * m_OwningQueue;
+		WorkGroup * m_Group;
+
+		std::atomic<bool> m_Cancelled;
+		bool m_AutoRelease;
 	};
 
 	template <class TFUN>
 	class TWorkItem : public WorkItem {
 	public:
 		template <class U>
-		TWorkItem(U && fun) {
-			m_Fun = fun;
+		TWorkItem(U && fun) : m_Fun(std::forward<U>(fun)) {
 		}
 
 		void OnExec() override {
@@ -39,9 +55,57 @@ namespace Dispatch
 		TFUN m_Fun;
 	};
 
-	template <class BindFunction, class ...Args>
-	WorkItem * Bind(BindFunction && bFun, Args ... args) {
-		return new TWorkItem< std::function<void()> >( std::bind(bFun, args...) );
+	/// WorkItemPool
+	/// Fixed size blocks for short lived work items. Freed blocks go to a
+	/// per-thread free list (per worker, as workers release executed items),
+	/// surplus is exchanged in batches through a shared list. Blocks are
+	/// carved from chunks that are never returned to the heap.
+	class K3D_API WorkItemPool {
+	public:
+		static const size_t BlockSize = 128;
+
+		static void *	Allocate(size_t size);
+		static void		Free(void * block);
+		/// Chunks allocated so far, stays flat once the pool is warm
+		static uint32	GetChunkCount();
+	};
+
+	/// PooledWorkItem
+	/// Work item with inline capture storage, allocated from WorkItemPool.
+	class PooledWorkItem : public WorkItem {
+	public:
+		static const size_t CaptureSize = 64;
+		typedef ::k3d::InplaceFunction<void(), CaptureSize> Function;
+
+		template <class U>
+		PooledWorkItem(U && fun) : m_Fun(std::forward<U>(fun)) {
+		}
+
+		void OnExec() override {
+			m_Fun();
+		}
+
+		static void * operator new(size_t size) { return WorkItemPool::Allocate(size); }
+		static void operator delete(void * block) { WorkItemPool::Free(block); }
+
+	private:
+		Function m_Fun;
+	};
+
+	/// Items created by Bind never touch the heap, the callable (with its bound
+	/// arguments) must fit in PooledWorkItem::CaptureSize bytes.
+	template <class TFun>
+	WorkItem * Bind(TFun && fun) {
+		WorkItem * item = new PooledWorkItem(std::forward<TFun>(fun));
+		item->SetAutoRelease(true);
+		return item;
+	}
+
+	template <class BindFunction, class Arg, class ...Args>
+	WorkItem * Bind(BindFunction && bFun, Arg arg, Args ... args) {
+		WorkItem * item = new PooledWorkItem(std::bind(std::forward<BindFunction>(bFun), arg, args...));
+		item->SetAutoRelease(true);
+		return item;
 	}
 
-}
\ No newline at end of file
+}
@@ -2,145 +2,274 @@
 #include "WorkQueue.h"
 #include "WorkItem.h"
 #include "WorkGroup.h"
+#include "WorkStealDeque.h"
+#include "../Profiler.h"
 
 namespace Dispatch {
-	
-	WorkQueue::WorkQueue(String const & name, ::Os::ThreadPriority priority)
-		: ::Os::Thread(
-			[this]() {
-				while(m_Started) {
-					if(!IsEmpty()) {
-						while (!IsEmpty())
-						{
-							PtrWorkItem front = Front();
-							if(front) {
-								front->OnExec();
-								Pop();
-							}
-						}
-					} else {
-						//Thread::Yield();
-						m_QueueCV.Wait(&m_QueueLock);
-					}
-				}
-				
-			}
-			, name, priority)
-		, m_QueueHead(new WorkItem)
-		, m_CurItem(m_QueueHead)
+
+	static const uint32 kWorkerSpinCount = 64;
+
+	class WorkQueue::Worker : public ::Os::Thread
 	{
+	public:
+		Worker(WorkQueue * queue, uint32 index, String const & name, ::Os::ThreadPriority priority)
+			: ::Os::Thread([this]() { m_Queue->WorkerLoop(this); }, name, priority)
+			, m_Queue(queue)
+			, m_Index(index)
+			, m_Seed(index * 2654435761u + 1)
+		{
+		}
+
+		uint32 NextVictim(uint32 numWorkers)
+		{
+			// xorshift32
+			m_Seed ^= m_Seed << 13;
+			m_Seed ^= m_Seed >> 17;
+			m_Seed ^= m_Seed << 5;
+			return m_Seed % numWorkers;
+		}
+
+		WorkQueue *					m_Queue;
+		uint32						m_Index;
+		uint32						m_Seed;
+		WorkStealDeque<WorkItem>	m_Deque;
+	};
+
+	static thread_local WorkQueue::Worker * t_CurrentWorker = nullptr;
+
+	WorkQueue::WorkQueue(String const & name, ::Os::ThreadPriority priority, uint32 numWorkers)
+		: m_NumWorkers(numWorkers)
+		, m_InjectHead(nullptr)
+		, m_InjectTail(nullptr)
+		, m_NumInjected(0)
+		, m_NumQueued(0)
+		, m_NumSleeping(0)
+		, m_Started(false)
+		, m_Name(name)
+		, m_Priority(priority)
+	{
+		if (m_NumWorkers == 0) {
+			m_NumWorkers = ::Os::GetCpuCoreNum();
+		}
+		if (m_NumWorkers == 0) {
+			m_NumWorkers = 1;
+		}
+	}
+
+	WorkQueue::~WorkQueue()
+	{
+		StopAll();
 	}
 
 	WorkQueue &
 	WorkQueue::Queue(PtrWorkItem item)
 	{
-#if defined(THREAD_SAFE)
-		std::unique_lock<std::mutex> lock(m_QueueLock);
-#endif
-		enqueue(item);
-		m_QueueCV.Notify();
+		if (item != nullptr) {
+			Enqueue(item);
+			WakeUp(1);
+		}
 		return *this;
 	}
 
 	WorkQueue & WorkQueue::Queue(PtrWorkGroup item)
 	{
-#if defined(THREAD_SAFE)
-		std::unique_lock<std::mutex> lock(m_QueueLock);
-#endif
 		if (item != nullptr) {
-			if (!item->m_ItemContainer.empty()) {
-				for (PtrWorkItem &i : item->m_ItemContainer) {
-					enqueue(i);
-				}
-				m_QueueCV.Notify();
+			int32 count = (int32)item->m_ItemContainer.size();
+			// hold one extra reference so the group can't complete while queueing
+			item->Enter(this, count + 1);
+			for (PtrWorkItem &i : item->m_ItemContainer) {
+				Enqueue(i);
 			}
+			WakeUp(count);
+			item->Leave();
 		}
 		return (*this);
 	}
 
 	bool WorkQueue::IsEmpty()
 	{
-		return m_CurItem==m_QueueHead;
+		return m_NumQueued.load() == 0;
+	}
+
+	void WorkQueue::Remove(PtrWorkItem item)
+	{
+		if (item != nullptr) {
+			item->m_Cancelled.store(true, std::memory_order_release);
+		}
 	}
 
-	WorkQueue::PtrWorkItem WorkQueue::Front()
+	bool WorkQueue::TryExecuteOne()
 	{
-		if (m_QueueHead->m_Next != nullptr) {
-			return m_QueueHead->m_Next;
+		Worker * self = t_CurrentWorker;
+		if (self != nullptr && self->m_Queue != this) {
+			self = nullptr;
+		}
+		PtrWorkItem item = Grab(self);
+		if (item == nullptr) {
+			return false;
 		}
-		return nullptr;
+		Execute(item);
+		return true;
+	}
+
+	uint32 WorkQueue::GetWorkerCount() const
+	{
+		return m_NumWorkers;
 	}
 
-	void WorkQueue::Pop()
+	void WorkQueue::Enqueue(PtrWorkItem item)
 	{
-#if defined(THREAD_SAFE)
-		std::unique_lock<std::mutex> lock(m_QueueLock);
-#endif
-		PtrWorkItem next = m_QueueHead->m_Next;
-		if (next != nullptr) {
-			m_QueueHead->m_Next = next->m_Next;
-			if (next->m_Next) {
-				next->m_Next->m_Prev = m_QueueHead;
-			} else {
-				m_CurItem = m_QueueHead;
+		item->m_OwningQueue = this;
+		// a cancel applies to one run of the item
+		item->m_Cancelled.store(false, std::memory_order_relaxed);
+		Worker * self = t_CurrentWorker;
+		if (self == nullptr || self->m_Queue != this || !self->m_Deque.Push(item)) {
+			m_InjectLock.Lock();
+			item->m_Next = nullptr;
+			item->m_Prev = m_InjectTail;
+			if (m_InjectTail != nullptr) {
+				m_InjectTail->m_Next = item;
 			}
+			else {
+				m_InjectHead = item;
+			}
+			m_InjectTail = item;
+			m_NumInjected.fetch_add(1);
+			m_InjectLock.UnLock();
 		}
-		else {
-			m_QueueHead->m_Next = nullptr;
+		m_NumQueued.fetch_add(1);
+	}
+
+	void WorkQueue::WakeUp(int32 count)
+	{
+		// pairs with the sleeper count in WorkerLoop, both sides are seq_cst
+		if (count > 0 && m_NumSleeping.load() > 0) {
+			m_QueueLock.Lock();
+			if (count > 1) {
+				m_QueueCV.NotifyAll();
+			}
+			else {
+				m_QueueCV.Notify();
+			}
+			m_QueueLock.UnLock();
 		}
-#if defined(THREAD_SAFE)
-#endif
 	}
 
-	void WorkQueue::Remove(PtrWorkItem item)
+	WorkQueue::PtrWorkItem WorkQueue::PopInjected()
 	{
-#if defined(THREAD_SAFE)
-		std::unique_lock<std::mutex> lock(m_QueueLock);
-#endif
+		if (m_NumInjected.load() == 0) {
+			return nullptr;
+		}
+		m_InjectLock.Lock();
+		PtrWorkItem item = m_InjectHead;
 		if (item != nullptr) {
-			if (item->m_Prev != nullptr) {
-				PtrWorkItem prev = item->m_Prev;
-				if (item->m_Next != nullptr) {
-					prev->m_Next = item->m_Next;
-					item->m_Next->m_Prev = prev;
-				}
-				else {
-					prev->m_Next = nullptr;
-				}
+			m_InjectHead = item->m_Next;
+			if (m_InjectHead != nullptr) {
+				m_InjectHead->m_Prev = nullptr;
 			}
+			else {
+				m_InjectTail = nullptr;
+			}
+			item->m_Next = nullptr;
+			m_NumInjected.fetch_sub(1);
 		}
-#if defined(THREAD_SAFE)
-#endif
+		m_InjectLock.UnLock();
+		return item;
 	}
 
-	void WorkQueue::enqueue(PtrWorkItem item)
+	WorkQueue::PtrWorkItem WorkQueue::Grab(Worker * self)
 	{
-		/*Initial Queue Head*/
-		if (m_QueueHead->m_Next == nullptr) {
-			m_QueueHead->m_Next = item;
-			item->m_Prev = m_QueueHead;
-			m_CurItem = m_QueueHead;
+		PtrWorkItem item = nullptr;
+		if (self != nullptr) {
+			item = self->m_Deque.Pop();
+		}
+		if (item == nullptr) {
+			item = PopInjected();
+		}
+		if (item == nullptr) {
+			uint32 numWorkers = (uint32)m_Workers.size();
+			uint32 start = (self != nullptr && numWorkers > 0) ? self->NextVictim(numWorkers) : 0;
+			for (uint32 i = 0; i < numWorkers && item == nullptr; i++) {
+				Worker * victim = m_Workers[(start + i) % numWorkers];
+				if (victim != self) {
+					item = victim->m_Deque.Steal();
+				}
+			}
+		}
+		if (item != nullptr) {
+			m_NumQueued.fetch_sub(1);
 		}
+		return item;
+	}
 
-		/*Link the item to the Queue*/
-		if (m_CurItem != nullptr) {
-			m_CurItem->m_Next = item;
-			item->m_Prev = m_CurItem;
-			m_CurItem = item;
+	void WorkQueue::Execute(PtrWorkItem item)
+	{
+		WorkGroup * group = item->m_Group;
+		if (!item->IsCancelled()) {
+			K3D_PROFILE_SCOPE("WorkItem");
+			item->OnExec();
+		}
+		// grouped items stay with their group, which may be queued again
+		if (item->m_AutoRelease && group == nullptr) {
+			delete item;
 		}
+		if (group != nullptr) {
+			group->Leave();
+		}
+	}
 
-		item->m_OwningQueue = this;
+	void WorkQueue::WorkerLoop(Worker * self)
+	{
+		t_CurrentWorker = self;
+		while (m_Started.load()) {
+			PtrWorkItem item = Grab(self);
+			for (uint32 spin = 0; item == nullptr && spin < kWorkerSpinCount; spin++) {
+				std::this_thread::yield();
+				item = Grab(self);
+			}
+			if (item != nullptr) {
+				Execute(item);
+				continue;
+			}
+			m_NumSleeping.fetch_add(1);
+			m_QueueLock.Lock();
+			while (m_Started.load() && m_NumQueued.load() == 0) {
+				m_QueueCV.Wait(&m_QueueLock);
+			}
+			m_QueueLock.UnLock();
+			m_NumSleeping.fetch_sub(1);
+		}
+		t_CurrentWorker = nullptr;
 	}
 
 	void WorkQueue::Loop()
 	{
-		m_Started = true;
-		Start();
+		if (m_Started.exchange(true)) {
+			return;
+		}
+		for (uint32 i = 0; i < m_NumWorkers; i++) {
+			m_Workers.push_back(new Worker(this, i, m_Name + "#" + std::to_string(i), m_Priority));
+		}
+		for (Worker * worker : m_Workers) {
+			worker->Start();
+		}
 	}
 
 	void WorkQueue::StopAll()
 	{
-		m_Started = false;
+		if (!m_Started.exchange(false)) {
+			return;
+		}
+		m_QueueLock.Lock();
+		m_QueueCV.NotifyAll();
+		m_QueueLock.UnLock();
+		for (Worker * worker : m_Workers) {
+			worker->Join();
+		}
+		for (Worker * worker : m_Workers) {
+			delete worker;
+		}
+		m_Workers.clear();
 	}
 
-}
\ No newline at end of file
+}
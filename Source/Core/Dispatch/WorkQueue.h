@@ -1,6 +1,6 @@
-#pragma once 
+#pragma once
 #include <string>
-#include <mutex>
+#include <vector>
 #include <atomic>
 #include "../Os.h"
 
@@ -12,34 +12,63 @@ using AtomicBool= std::atomic_bool;
 class WorkItem;
 class WorkGroup;
 
-class K3D_API WorkQueue : public ::Os::Thread {
+/// WorkQueue
+/// Multi-worker job queue, one worker thread per core by default.
+/// Every worker owns a work-stealing deque, items queued from a worker
+/// go to its own deque, items queued from other threads go to a shared
+/// injection list. Idle workers steal from each other before sleeping.
+class K3D_API WorkQueue {
 public:
 	typedef WorkItem* PtrWorkItem;
 	typedef WorkGroup* PtrWorkGroup;
 
-	WorkQueue(String const & name, ::Os::ThreadPriority priority);
+	/// \param numWorkers 0 means Os::GetCpuCoreNum()
+	WorkQueue(String const & name, ::Os::ThreadPriority priority, uint32 numWorkers = 0);
+	~WorkQueue();
 
 	WorkQueue & Queue(PtrWorkItem item);
 	WorkQueue & Queue(PtrWorkGroup item);
+	/// Start the workers
 	void		Loop();
+	/// Stop and join the workers, items left in the queue are not executed
 	void		StopAll();
 	bool		IsEmpty();
-	PtrWorkItem	Front();
-	void		Pop();
+	/// Cancel an item not yet started. It stays queued until a worker
+	/// skips it and must outlive that, queueing it again clears the cancel.
 	void		Remove(PtrWorkItem item);
 
-protected:
+	/// Run one queued item on the calling thread, used by waiters to help
+	/// \return false if nothing could be grabbed
+	bool		TryExecuteOne();
+
+	uint32		GetWorkerCount() const;
+	String const & GetName() const { return m_Name; }
+
+	class Worker;
 
 private:
-	void		enqueue(PtrWorkItem item);
+	void		Enqueue(PtrWorkItem item);
+	void		WakeUp(int32 count);
+	PtrWorkItem	Grab(Worker * self);
+	PtrWorkItem	PopInjected();
+	void		Execute(PtrWorkItem item);
+	void		WorkerLoop(Worker * self);
+
+	std::vector<Worker*>	m_Workers;
+	uint32		m_NumWorkers;
+
+	WorkItem *	m_InjectHead;
+	WorkItem *	m_InjectTail;
+	std::atomic<int32>		m_NumInjected;
+	std::atomic<int32>		m_NumQueued;
+	std::atomic<int32>		m_NumSleeping;
 
-	WorkItem *	m_QueueHead;
-	WorkItem *	m_CurItem;
-	
 	AtomicBool	m_Started;
 	String		m_Name;
+	::Os::ThreadPriority	m_Priority;
+	::Os::Mutex		m_InjectLock;
 	::Os::Mutex		m_QueueLock;
 	::Os::ConditionVariable m_QueueCV;
 };
 
-}
\ No newline at end of file
+}
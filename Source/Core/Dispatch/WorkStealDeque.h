@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+
+namespace Dispatch
+{
+	/// WorkStealDeque
+	/// Fixed capacity Chase-Lev deque, only the owning worker may Push/Pop
+	/// at the bottom, any thread may Steal from the top.
+	/// Push fails when the deque is full, callers fall back to the shared queue.
+	template <class T, uint32 Capacity = 4096>
+	class WorkStealDeque
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be power of two");
+	public:
+		WorkStealDeque() : m_Top(0), m_Bottom(0)
+		{
+			for (uint32 i = 0; i < Capacity; i++)
+				m_Items[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		bool Push(T * item)
+		{
+			int64 b = m_Bottom.load(std::memory_order_relaxed);
+			int64 t = m_Top.load(std::memory_order_acquire);
+			if (b - t >= (int64)Capacity)
+				return false;
+			m_Items[b & (Capacity - 1)].store(item, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			m_Bottom.store(b + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		T * Pop()
+		{
+			int64 b = m_Bottom.load(std::memory_order_relaxed) - 1;
+			m_Bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64 t = m_Top.load(std::memory_order_relaxed);
+			if (t > b) {
+				m_Bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			T * item = m_Items[b & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (t == b) {
+				// last item, race against stealers
+				if (!m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					item = nullptr;
+				m_Bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return item;
+		}
+
+		T * Steal()
+		{
+			int64 t = m_Top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64 b = m_Bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+			T * item = m_Items[t & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (!m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return nullptr;
+			return item;
+		}
+
+		bool IsEmpty() const
+		{
+			return m_Bottom.load(std::memory_order_acquire) <= m_Top.load(std::memory_order_acquire);
+		}
+
+	private:
+		// keep top and bottom on separate cache lines
+		std::atomic<int64>				m_Top;
+		char							m_PadTop[64 - sizeof(std::atomic<int64>)];
+		std::atomic<int64>				m_Bottom;
+		char							m_PadBottom[64 - sizeof(std::atomic<int64>)];
+		std::atomic<T*>					m_Items[Capacity];
+	};
+}
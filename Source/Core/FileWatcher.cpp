@@ -0,0 +1,403 @@
+#include "Kaleido3D.h"
+#include "FileWatcher.h"
+#include "LogUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+
+#if K3DPLATFORM_OS_LINUX
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#define K3D_HAS_INOTIFY 1
+#endif
+
+#if !K3DPLATFORM_OS_WIN
+#include <dirent.h>
+#endif
+
+namespace k3d
+{
+	namespace
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		kString JoinPath(kString const & directory, kString const & name)
+		{
+			if (directory.empty() || directory.back() == KT('/') || directory.back() == KT('\\'))
+				return directory + name;
+			return directory + KT('/') + name;
+		}
+
+		/// Path and modification time of every file below directory
+		template <class Fun>
+		void ScanDirectory(kString const & directory, bool recursive, Fun && fun)
+		{
+#if K3DPLATFORM_OS_WIN
+			WIN32_FIND_DATAW data;
+			HANDLE find = FindFirstFileW(JoinPath(directory, L"*").c_str(), &data);
+			if (find == INVALID_HANDLE_VALUE)
+				return;
+			do
+			{
+				if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0)
+					continue;
+				kString path = JoinPath(directory, data.cFileName);
+				if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				{
+					if (recursive)
+						ScanDirectory(path, true, fun);
+				}
+				else
+				{
+					fun(path, ((uint64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+				}
+			} while (FindNextFileW(find, &data));
+			FindClose(find);
+#else
+			DIR * dir = opendir(directory.c_str());
+			if (!dir)
+				return;
+			while (dirent * entry = readdir(dir))
+			{
+				if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+					continue;
+				kString path = JoinPath(directory, entry->d_name);
+				struct stat st;
+				if (stat(path.c_str(), &st) != 0)
+					continue;
+				if (S_ISDIR(st.st_mode))
+				{
+					if (recursive)
+						ScanDirectory(path, true, fun);
+				}
+				else
+				{
+					fun(path, Os::LastModified(path.c_str()));
+				}
+			}
+			closedir(dir);
+#endif
+		}
+
+		struct PendingChange
+		{
+			EFileChange			Kind;
+			Clock::time_point	Last;
+		};
+
+		struct WatchRoot
+		{
+			kString		Directory;
+			bool		Recursive;
+		};
+	}
+
+	class FileWatcherImpl
+	{
+	public:
+		FileWatcherImpl(uint32 coalesceMs, bool polling)
+			: Coalesce(std::chrono::milliseconds(coalesceMs))
+			, Polling(polling)
+			, Stopping(false)
+			, Thread(nullptr)
+#if K3D_HAS_INOTIFY
+			, Fd(-1), WakeFd(-1)
+#endif
+		{
+#if K3D_HAS_INOTIFY
+			if (!Polling)
+			{
+				Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+				WakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+				if (Fd < 0 || WakeFd < 0)
+				{
+					KLOG(Warn, FileWatcher, "inotify unavailable (errno=%d), polling.", errno);
+					Polling = true;
+				}
+			}
+#else
+			Polling = true;
+#endif
+			if (Polling)
+				Thread = new Os::Thread([this]() { RunPolling(); }, "FileWatcher#poll");
+#if K3D_HAS_INOTIFY
+			else
+				Thread = new Os::Thread([this]() { RunInotify(); }, "FileWatcher#inotify");
+#endif
+			Thread->Start();
+		}
+
+		~FileWatcherImpl()
+		{
+			Stopping.store(true, std::memory_order_release);
+#if K3D_HAS_INOTIFY
+			if (!Polling)
+			{
+				uint64 one = 1;
+				ssize_t written = write(WakeFd, &one, sizeof(one));
+				(void)written;
+			}
+#endif
+			WakeLock.Lock();
+			WakeCV.NotifyAll();
+			WakeLock.UnLock();
+			Thread->Join();
+			delete Thread;
+#if K3D_HAS_INOTIFY
+			if (Fd >= 0)
+				close(Fd);
+			if (WakeFd >= 0)
+				close(WakeFd);
+#endif
+		}
+
+		/// Merges the events of one file until it settles
+		void Record(kString const & path, EFileChange kind)
+		{
+			Lock.Lock();
+			auto found = Pending.find(path);
+			if (found == Pending.end())
+			{
+				Pending.emplace(path, PendingChange{ kind, Clock::now() });
+			}
+			else
+			{
+				PendingChange & change = found->second;
+				// created then written is still new, removed then back is an edit
+				if (!(change.Kind == EFileChange::Created && kind == EFileChange::Modified))
+					change.Kind = change.Kind == EFileChange::Removed && kind == EFileChange::Created ? EFileChange::Modified : kind;
+				change.Last = Clock::now();
+			}
+			Lock.UnLock();
+		}
+
+		uint32 Poll(std::vector<FileChange> & changes)
+		{
+			uint32 count = 0;
+			Clock::time_point now = Clock::now();
+			Lock.Lock();
+			for (auto iter = Pending.begin(); iter != Pending.end();)
+			{
+				if (now - iter->second.Last < Coalesce)
+				{
+					++iter;
+					continue;
+				}
+				changes.push_back(FileChange{ iter->first, iter->second.Kind });
+				count++;
+				iter = Pending.erase(iter);
+			}
+			Lock.UnLock();
+			return count;
+		}
+
+		bool Watch(const kchar * directory, bool recursive)
+		{
+			if (Polling)
+			{
+				// the baseline, changes are against it
+				std::unordered_map<kString, uint64> files;
+				ScanDirectory(directory, recursive, [&files](kString const & path, uint64 modified)
+				{
+					files[path] = modified;
+				});
+				if (!Os::Exists(directory))
+					return false;
+				WakeLock.Lock();
+				Roots.push_back(WatchRoot{ directory, recursive });
+				Files.insert(files.begin(), files.end());
+				WakeLock.UnLock();
+				return true;
+			}
+#if K3D_HAS_INOTIFY
+			return AddWatch(directory, recursive);
+#else
+			return false;
+#endif
+		}
+
+		void RunPolling()
+		{
+			// coarse enough to stay cheap on big trees
+			uint32 interval = (uint32)std::max<int64>(std::chrono::duration_cast<std::chrono::milliseconds>(Coalesce).count() / 2, 50);
+			WakeLock.Lock();
+			while (!Stopping.load(std::memory_order_acquire))
+			{
+				WakeCV.Wait(&WakeLock, interval);
+				if (Stopping.load(std::memory_order_acquire))
+					break;
+				std::unordered_map<kString, uint64> files;
+				for (auto & root : Roots)
+				{
+					ScanDirectory(root.Directory, root.Recursive, [&files](kString const & path, uint64 modified)
+					{
+						files[path] = modified;
+					});
+				}
+				for (auto & file : files)
+				{
+					auto previous = Files.find(file.first);
+					if (previous == Files.end())
+						Record(file.first, EFileChange::Created);
+					else if (previous->second != file.second)
+						Record(file.first, EFileChange::Modified);
+				}
+				for (auto & file : Files)
+				{
+					if (files.find(file.first) == files.end())
+						Record(file.first, EFileChange::Removed);
+				}
+				Files.swap(files);
+			}
+			WakeLock.UnLock();
+		}
+
+#if K3D_HAS_INOTIFY
+		bool AddWatch(kString const & directory, bool recursive)
+		{
+			const uint32 mask = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+			int wd = inotify_add_watch(Fd, directory.c_str(), mask);
+			if (wd < 0)
+			{
+				KLOG(Error, FileWatcher, "Cannot watch %s (errno=%d).", directory.c_str(), errno);
+				return false;
+			}
+			WakeLock.Lock();
+			Directories[wd] = WatchRoot{ directory, recursive };
+			WakeLock.UnLock();
+			if (!recursive)
+				return true;
+			DIR * dir = opendir(directory.c_str());
+			if (!dir)
+				return true;
+			while (dirent * entry = readdir(dir))
+			{
+				if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+					continue;
+				kString path = JoinPath(directory, entry->d_name);
+				struct stat st;
+				if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+					AddWatch(path, true);
+			}
+			closedir(dir);
+			return true;
+		}
+
+		void RunInotify()
+		{
+			alignas(inotify_event) char buffer[16 * 1024];
+			pollfd fds[2] = { { Fd, POLLIN, 0 }, { WakeFd, POLLIN, 0 } };
+			while (!Stopping.load(std::memory_order_acquire))
+			{
+				if (poll(fds, 2, -1) < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					KLOG(Error, FileWatcher, "poll failed (errno=%d).", errno);
+					break;
+				}
+				if (fds[1].revents)
+					break;
+				ssize_t size;
+				while ((size = read(Fd, buffer, sizeof(buffer))) > 0)
+				{
+					for (char * p = buffer; p < buffer + size;)
+					{
+						inotify_event * event = (inotify_event*)p;
+						p += sizeof(inotify_event) + event->len;
+						OnEvent(*event);
+					}
+				}
+			}
+		}
+
+		void OnEvent(inotify_event const & event)
+		{
+			if (event.mask & IN_Q_OVERFLOW)
+			{
+				KLOG(Warn, FileWatcher, "inotify queue overflow, changes were lost.");
+				return;
+			}
+			WakeLock.Lock();
+			auto found = Directories.find(event.wd);
+			if (found == Directories.end())
+			{
+				WakeLock.UnLock();
+				return;
+			}
+			if (event.mask & IN_IGNORED)
+			{
+				Directories.erase(found);
+				WakeLock.UnLock();
+				return;
+			}
+			WatchRoot directory = found->second;
+			WakeLock.UnLock();
+			if (!event.len)
+				return;
+
+			kString path = JoinPath(directory.Directory, event.name);
+			if (event.mask & IN_ISDIR)
+			{
+				// new directories of a recursive watch are watched too
+				if (directory.Recursive && (event.mask & (IN_CREATE | IN_MOVED_TO)))
+					AddWatch(path, true);
+				return;
+			}
+			if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+				Record(path, EFileChange::Removed);
+			else if (event.mask & (IN_CREATE | IN_MOVED_TO))
+				Record(path, EFileChange::Created);
+			else
+				Record(path, EFileChange::Modified);
+		}
+#endif
+
+		Clock::duration							Coalesce;
+		bool									Polling;
+		std::atomic<bool>						Stopping;
+		Os::Thread *							Thread;
+		/// Guards Pending
+		Os::Mutex								Lock;
+		std::unordered_map<kString, PendingChange>	Pending;
+		/// Guards the watch state, wakes the polling thread
+		Os::Mutex								WakeLock;
+		Os::ConditionVariable					WakeCV;
+		std::vector<WatchRoot>					Roots;
+		/// Last scan of the polling backend
+		std::unordered_map<kString, uint64>		Files;
+#if K3D_HAS_INOTIFY
+		int										Fd;
+		int										WakeFd;
+		std::unordered_map<int, WatchRoot>		Directories;
+#endif
+	};
+
+	FileWatcher::FileWatcher(uint32 coalesceMs, bool polling)
+		: d(new FileWatcherImpl(coalesceMs, polling))
+	{
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+		delete d;
+	}
+
+	bool FileWatcher::Watch(const kchar * directory, bool recursive)
+	{
+		return d->Watch(directory, recursive);
+	}
+
+	uint32 FileWatcher::Poll(std::vector<FileChange> & changes)
+	{
+		return d->Poll(changes);
+	}
+
+	bool FileWatcher::IsPolling() const
+	{
+		return d->Polling;
+	}
+}
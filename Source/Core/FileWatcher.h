@@ -0,0 +1,53 @@
+#ifndef __FileWatcher_h__
+#define __FileWatcher_h__
+#pragma once
+
+#include "Os.h"
+#include <vector>
+
+namespace k3d
+{
+	enum class EFileChange : uint32
+	{
+		Modified,
+		Created,
+		Removed
+	};
+
+	struct FileChange
+	{
+		/// The watched directory joined with the path below it
+		kString			Path;
+		EFileChange		Kind;
+	};
+
+	/// FileWatcher
+	/// Reports the files changed below watched directories, with inotify
+	/// on Linux and by rescanning the directories elsewhere. The bursts
+	/// editors produce for one save (truncate, writes, rename) come out as
+	/// a single change once the file has been quiet for the coalesce delay.
+	class K3D_API FileWatcher
+	{
+	public:
+		/// \param polling rescan even where inotify is available
+		explicit FileWatcher(uint32 coalesceMs = 100, bool polling = false);
+		~FileWatcher();
+
+		/// Changes made after this returns are reported
+		bool		Watch(const kchar * directory, bool recursive = true);
+
+		/// Appends the changes that settled, on the calling thread
+		/// \return changes appended
+		uint32		Poll(std::vector<FileChange> & changes);
+
+		bool		IsPolling() const;
+
+	private:
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		class FileWatcherImpl * d;
+	};
+}
+
+#endif
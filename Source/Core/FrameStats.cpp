@@ -0,0 +1,527 @@
+#include "Kaleido3D.h"
+#include "FrameStats.h"
+#include "LogUtil.h"
+#include <KTL/Histogram.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+
+namespace k3d
+{
+	namespace
+	{
+		const uint32 kNumPhases = (uint32)EFramePhase::Count;
+		const uint32 kMaxHitches = 64;
+		/// Frames the window needs before the median is trusted
+		const uint32 kMinRelativeFrames = 30;
+		/// One minute, in microseconds
+		const uint64 kMaxFrameTime = 60000000;
+
+		const char * s_PhaseNames[kNumPhases] = { "Update", "Cull", "Record", "Submit" };
+
+		std::atomic<uint64> g_PhaseTime[kNumPhases];
+
+		/// Histogram, sum and exact max of one measure
+		struct Series
+		{
+			Series() : Histogram(kMaxFrameTime), Sum(0), Max(0) {}
+
+			void Add(uint64 us)
+			{
+				Histogram.Record(us);
+				Sum += us;
+				Max = us > Max ? us : Max;
+			}
+
+			void Remove(uint64 us)
+			{
+				Histogram.Remove(us);
+				Sum -= us;
+			}
+
+			void Reset()
+			{
+				Histogram.Reset();
+				Sum = 0;
+				Max = 0;
+			}
+
+			void Fill(FrameTimeStats & stats) const
+			{
+				stats.Count = Histogram.GetCount();
+				stats.Mean = stats.Count ? Sum / stats.Count : 0;
+				stats.P50 = Histogram.ValueAtPercentile(50);
+				stats.P95 = Histogram.ValueAtPercentile(95);
+				stats.P99 = Histogram.ValueAtPercentile(99);
+				// the histogram rounds up, the real max bounds them all
+				stats.Max = Max;
+				stats.P50 = stats.P50 < Max ? stats.P50 : Max;
+				stats.P95 = stats.P95 < Max ? stats.P95 : Max;
+				stats.P99 = stats.P99 < Max ? stats.P99 : Max;
+			}
+
+			HdrHistogram	Histogram;
+			uint64			Sum;
+			uint64			Max;
+		};
+
+		struct FrameRecord
+		{
+			uint64	Time;
+			uint64	Phases[kNumPhases];
+		};
+
+		class FrameStatsState
+		{
+		public:
+			static FrameStatsState & Get()
+			{
+				static FrameStatsState * state = new FrameStatsState;
+				return *state;
+			}
+
+			/// The oldest frame leaves the window when it is full
+			void Push(FrameRecord const & frame)
+			{
+				// the histogram cannot tell the max once it is removed,
+				// the window is searched again for it then
+				bool rescan = false;
+				if (Window.size() < WindowSize)
+				{
+					Window.push_back(frame);
+				}
+				else
+				{
+					FrameRecord & oldest = Window[WindowHead];
+					WindowSeries[0].Remove(oldest.Time);
+					rescan = oldest.Time >= WindowSeries[0].Max;
+					for (uint32 p = 0; p < kNumPhases; p++)
+					{
+						if (!oldest.Phases[p])
+							continue;
+						WindowSeries[p + 1].Remove(oldest.Phases[p]);
+						rescan = rescan || oldest.Phases[p] >= WindowSeries[p + 1].Max;
+					}
+					oldest = frame;
+					WindowHead = (WindowHead + 1) % WindowSize;
+				}
+				for (Series * series : { SessionSeries, WindowSeries })
+				{
+					series[0].Add(frame.Time);
+					for (uint32 p = 0; p < kNumPhases; p++)
+					{
+						if (frame.Phases[p])
+							series[p + 1].Add(frame.Phases[p]);
+					}
+				}
+				if (!rescan)
+					return;
+				for (uint32 s = 0; s <= kNumPhases; s++)
+					WindowSeries[s].Max = 0;
+				for (FrameRecord const & record : Window)
+				{
+					WindowSeries[0].Max = record.Time > WindowSeries[0].Max ? record.Time : WindowSeries[0].Max;
+					for (uint32 p = 0; p < kNumPhases; p++)
+					{
+						if (record.Phases[p] > WindowSeries[p + 1].Max)
+							WindowSeries[p + 1].Max = record.Phases[p];
+					}
+				}
+			}
+
+			void Fill(Series const * series, FrameStatsReport & report) const
+			{
+				report.FrameIndex = FrameIndex;
+				report.Hitches = HitchCount;
+				series[0].Fill(report.Frame);
+				for (uint32 p = 0; p < kNumPhases; p++)
+					series[p + 1].Fill(report.Phases[p]);
+				report.WithinBudget = BudgetPercentile <= 0 || report.Frame.Count == 0
+					|| series[0].Histogram.ValueAtPercentile(BudgetPercentile) <= BudgetUs;
+			}
+
+			void Resize(uint32 frames)
+			{
+				WindowSize = frames ? frames : 1;
+				Window.clear();
+				WindowHead = 0;
+				for (uint32 s = 0; s <= kNumPhases; s++)
+					WindowSeries[s].Reset();
+			}
+
+			std::mutex					Lock;
+			uint64						LastEnd;
+			uint64						FrameIndex;
+
+			Series						SessionSeries[kNumPhases + 1];
+			Series						WindowSeries[kNumPhases + 1];
+			std::vector<FrameRecord>	Window;
+			uint32						WindowSize;
+			uint32						WindowHead;
+
+			uint64						HitchAbsolute;
+			float						HitchRelative;
+			uint64						HitchCount;
+			std::vector<FrameHitch>		Hitches;
+			uint32						HitchHead;
+
+			double						BudgetPercentile;
+			uint64						BudgetUs;
+			bool						BudgetMissed;
+
+			uint32						PublishInterval;
+			std::string					DumpPath;
+			bool						DumpRegistered;
+
+		private:
+			FrameStatsState()
+				: LastEnd(0), FrameIndex(0), WindowSize(600), WindowHead(0)
+				, HitchAbsolute(100000), HitchRelative(2.0f), HitchCount(0), HitchHead(0)
+				, BudgetPercentile(0), BudgetUs(0), BudgetMissed(false)
+				, PublishInterval(0), DumpRegistered(false)
+			{
+				Window.reserve(WindowSize);
+			}
+		};
+
+		void FormatStats(std::string & out, const char * name, FrameTimeStats const & stats)
+		{
+			char item[256];
+			snprintf(item, sizeof(item), "{\"Name\":\"%s\",\"Count\":%llu,\"Mean\":%llu,\"P50\":%llu,\"P95\":%llu,\"P99\":%llu,\"Max\":%llu}",
+				name, (unsigned long long)stats.Count, (unsigned long long)stats.Mean, (unsigned long long)stats.P50,
+				(unsigned long long)stats.P95, (unsigned long long)stats.P99, (unsigned long long)stats.Max);
+			out += item;
+		}
+
+		void DumpAtExit()
+		{
+			FrameStatsState & state = FrameStatsState::Get();
+			std::string path;
+			{
+				std::lock_guard<std::mutex> lock(state.Lock);
+				path = state.DumpPath;
+			}
+			if (!path.empty())
+				FrameStats::Dump(path.c_str());
+		}
+	}
+
+	const char * FrameStats::PhaseName(EFramePhase phase)
+	{
+		return (uint32)phase < kNumPhases ? s_PhaseNames[(uint32)phase] : "Unknown";
+	}
+
+	uint64 FrameStats::Now()
+	{
+		return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void FrameStats::AddPhaseTime(EFramePhase phase, uint64 nanoseconds)
+	{
+		if ((uint32)phase < kNumPhases)
+			g_PhaseTime[(uint32)phase].fetch_add(nanoseconds, std::memory_order_relaxed);
+	}
+
+	namespace
+	{
+		/// Ends the frame with timeUs, or with the time since the last end
+		/// when measured
+		void EndFrameWith(bool measured, uint64 timeUs)
+		{
+			FrameStatsState & state = FrameStatsState::Get();
+			uint64 now = FrameStats::Now();
+			FrameRecord frame;
+			for (uint32 p = 0; p < kNumPhases; p++)
+				frame.Phases[p] = g_PhaseTime[p].exchange(0, std::memory_order_relaxed) / 1000;
+
+			bool hitch = false;
+			bool missed = false;
+			bool publish = false;
+			uint64 index = 0;
+			uint64 median = 0;
+			FrameTimeStats window = {};
+			{
+				std::lock_guard<std::mutex> lock(state.Lock);
+				if (measured)
+				{
+					if (state.LastEnd == 0)
+					{
+						state.LastEnd = now;
+						return;
+					}
+					timeUs = (now - state.LastEnd) / 1000;
+				}
+				frame.Time = timeUs;
+				state.LastEnd = now;
+				index = state.FrameIndex++;
+
+				// against the frames before this one
+				Series const & recent = state.WindowSeries[0];
+				median = recent.Histogram.ValueAtPercentile(50);
+				hitch = (state.HitchAbsolute && frame.Time > state.HitchAbsolute)
+					|| (state.HitchRelative > 0 && recent.Histogram.GetCount() >= kMinRelativeFrames
+						&& frame.Time > (uint64)(state.HitchRelative * median));
+				if (hitch)
+				{
+					state.HitchCount++;
+					FrameHitch record = { index, frame.Time, {} };
+					memcpy(record.Phases, frame.Phases, sizeof(record.Phases));
+					if (state.Hitches.size() < kMaxHitches)
+					{
+						state.Hitches.push_back(record);
+					}
+					else
+					{
+						state.Hitches[state.HitchHead] = record;
+						state.HitchHead = (state.HitchHead + 1) % kMaxHitches;
+					}
+				}
+
+				state.Push(frame);
+
+				if (state.BudgetPercentile > 0 && recent.Histogram.GetCount() >= state.WindowSize)
+				{
+					bool over = recent.Histogram.ValueAtPercentile(state.BudgetPercentile) > state.BudgetUs;
+					// once per excursion over the budget
+					missed = over && !state.BudgetMissed;
+					state.BudgetMissed = over;
+					if (missed)
+						recent.Fill(window);
+				}
+				publish = state.PublishInterval && (index + 1) % state.PublishInterval == 0;
+			}
+
+			if (hitch)
+			{
+				// a bad stretch would hitch every frame, the count is in the statistics
+				KLOG_EVERY_MS(Warn, FrameStats, 1000, "Hitch: frame %llu took %.2fms (median %.2fms, update %.2fms, submit %.2fms).",
+					(unsigned long long)index, frame.Time / 1000.0, median / 1000.0,
+					frame.Phases[(uint32)EFramePhase::Update] / 1000.0, frame.Phases[(uint32)EFramePhase::Submit] / 1000.0);
+			}
+			if (missed)
+			{
+				KLOG(Warn, FrameStats, "Frame time over budget: p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms over the last %llu frames.",
+					window.P50 / 1000.0, window.P95 / 1000.0, window.P99 / 1000.0, window.Max / 1000.0, (unsigned long long)window.Count);
+			}
+			if (publish)
+				FrameStats::Publish();
+		}
+	}
+
+	void FrameStats::EndFrame()
+	{
+		EndFrameWith(true, 0);
+	}
+
+	void FrameStats::EndFrame(uint64 microseconds)
+	{
+		EndFrameWith(false, microseconds);
+	}
+
+	void FrameStats::SetWindow(uint32 frames)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.Resize(frames);
+	}
+
+	void FrameStats::SetHitchThresholds(uint64 absoluteUs, float relative)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.HitchAbsolute = absoluteUs;
+		state.HitchRelative = relative;
+	}
+
+	void FrameStats::SetBudget(double percentile, uint64 microseconds)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.BudgetPercentile = percentile;
+		state.BudgetUs = microseconds;
+		state.BudgetMissed = false;
+	}
+
+	void FrameStats::GetWindow(FrameStatsReport & report)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.Fill(state.WindowSeries, report);
+	}
+
+	void FrameStats::GetSession(FrameStatsReport & report)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.Fill(state.SessionSeries, report);
+	}
+
+	void FrameStats::GetHitches(std::vector<FrameHitch> & hitches)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		hitches.clear();
+		for (size_t i = 0; i < state.Hitches.size(); i++)
+			hitches.push_back(state.Hitches[(state.HitchHead + i) % state.Hitches.size()]);
+	}
+
+	void FrameStats::Reset()
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		for (uint32 s = 0; s <= kNumPhases; s++)
+			state.SessionSeries[s].Reset();
+		state.Resize(state.WindowSize);
+		state.Hitches.clear();
+		state.HitchHead = 0;
+		state.HitchCount = 0;
+		state.BudgetMissed = false;
+		state.FrameIndex = 0;
+		state.LastEnd = 0;
+	}
+
+	void FrameStats::Publish()
+	{
+		FrameStatsReport report;
+		FrameStatsState & state = FrameStatsState::Get();
+		double percentile = 0;
+		uint64 budget = 0;
+		{
+			std::lock_guard<std::mutex> lock(state.Lock);
+			state.Fill(state.WindowSeries, report);
+			percentile = state.BudgetPercentile;
+			budget = state.BudgetUs;
+		}
+
+		char item[256];
+		snprintf(item, sizeof(item), "{\"Frame\":%llu,\"Hitches\":%llu,\"Budget\":{\"Percentile\":%.1f,\"Target\":%llu,\"Met\":%s},\"Window\":[",
+			(unsigned long long)report.FrameIndex, (unsigned long long)report.Hitches, percentile,
+			(unsigned long long)budget, report.WithinBudget ? "true" : "false");
+		std::string json = item;
+		FormatStats(json, "Frame", report.Frame);
+		for (uint32 p = 0; p < kNumPhases; p++)
+		{
+			json += ',';
+			FormatStats(json, s_PhaseNames[p], report.Phases[p]);
+		}
+		json += "]}";
+		Log(ELogLevel::Profile, "FrameStats", "%s", json.c_str());
+	}
+
+	void FrameStats::SetPublishInterval(uint32 frames)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.PublishInterval = frames;
+	}
+
+	bool FrameStats::Dump(const char * path)
+	{
+		FrameStatsReport report;
+		std::vector<FrameHitch> hitches;
+		std::vector<uint64> buckets;
+		FrameStatsState & state = FrameStatsState::Get();
+		GetHitches(hitches);
+		{
+			std::lock_guard<std::mutex> lock(state.Lock);
+			state.Fill(state.SessionSeries, report);
+			state.SessionSeries[0].Histogram.ForEachBucket([&buckets](uint64 low, uint64 high, uint64 count)
+			{
+				buckets.push_back(low);
+				buckets.push_back(high);
+				buckets.push_back(count);
+			});
+		}
+
+		std::string out;
+		char item[256];
+		size_t length = strlen(path);
+		bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+		if (json)
+		{
+			snprintf(item, sizeof(item), "{\"Frames\":%llu,\"Hitches\":%llu,\"Session\":[",
+				(unsigned long long)report.FrameIndex, (unsigned long long)report.Hitches);
+			out = item;
+			FormatStats(out, "Frame", report.Frame);
+			for (uint32 p = 0; p < kNumPhases; p++)
+			{
+				out += ",\n";
+				FormatStats(out, s_PhaseNames[p], report.Phases[p]);
+			}
+			out += "],\n\"RecentHitches\":[";
+			for (size_t h = 0; h < hitches.size(); h++)
+			{
+				FrameHitch const & hitch = hitches[h];
+				snprintf(item, sizeof(item), "%s{\"Frame\":%llu,\"Time\":%llu,\"Phases\":[%llu,%llu,%llu,%llu]}", h ? ",\n" : "",
+					(unsigned long long)hitch.FrameIndex, (unsigned long long)hitch.Time,
+					(unsigned long long)hitch.Phases[0], (unsigned long long)hitch.Phases[1],
+					(unsigned long long)hitch.Phases[2], (unsigned long long)hitch.Phases[3]);
+				out += item;
+			}
+			out += "],\n\"FrameHistogram\":[";
+			for (size_t b = 0; b < buckets.size(); b += 3)
+			{
+				snprintf(item, sizeof(item), "%s[%llu,%llu,%llu]", b ? "," : "",
+					(unsigned long long)buckets[b], (unsigned long long)buckets[b + 1], (unsigned long long)buckets[b + 2]);
+				out += item;
+			}
+			out += "]}\n";
+		}
+		else
+		{
+			out = "metric,count,mean_us,p50_us,p95_us,p99_us,max_us\n";
+			for (uint32 s = 0; s <= kNumPhases; s++)
+			{
+				FrameTimeStats const & stats = s ? report.Phases[s - 1] : report.Frame;
+				snprintf(item, sizeof(item), "%s,%llu,%llu,%llu,%llu,%llu,%llu\n", s ? s_PhaseNames[s - 1] : "Frame",
+					(unsigned long long)stats.Count, (unsigned long long)stats.Mean, (unsigned long long)stats.P50,
+					(unsigned long long)stats.P95, (unsigned long long)stats.P99, (unsigned long long)stats.Max);
+				out += item;
+			}
+			snprintf(item, sizeof(item), "\nhitches,%llu\nhitch_frame,time_us,update_us,cull_us,record_us,submit_us\n",
+				(unsigned long long)report.Hitches);
+			out += item;
+			for (FrameHitch const & hitch : hitches)
+			{
+				snprintf(item, sizeof(item), "%llu,%llu,%llu,%llu,%llu,%llu\n",
+					(unsigned long long)hitch.FrameIndex, (unsigned long long)hitch.Time,
+					(unsigned long long)hitch.Phases[0], (unsigned long long)hitch.Phases[1],
+					(unsigned long long)hitch.Phases[2], (unsigned long long)hitch.Phases[3]);
+				out += item;
+			}
+			out += "\nbucket_low_us,bucket_high_us,frames\n";
+			for (size_t b = 0; b < buckets.size(); b += 3)
+			{
+				snprintf(item, sizeof(item), "%llu,%llu,%llu\n",
+					(unsigned long long)buckets[b], (unsigned long long)buckets[b + 1], (unsigned long long)buckets[b + 2]);
+				out += item;
+			}
+		}
+
+		Os::File file;
+		if (!file.Open(path, IOWrite))
+		{
+			KLOG(Error, FrameStats, "Cannot write frame statistics to %s.", path);
+			return false;
+		}
+		bool written = file.Write(out.data(), out.size()) == out.size();
+		file.Close();
+		return written;
+	}
+
+	void FrameStats::SetDumpPath(const char * path)
+	{
+		FrameStatsState & state = FrameStatsState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		state.DumpPath = path ? path : "";
+		if (!state.DumpRegistered && path)
+		{
+			state.DumpRegistered = true;
+			atexit(DumpAtExit);
+		}
+	}
+}
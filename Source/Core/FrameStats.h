@@ -0,0 +1,126 @@
+#pragma once
+#ifndef __FrameStats_h__
+#define __FrameStats_h__
+
+#include "Profiler.h"
+#include <vector>
+
+K3D_COMMON_NS
+{
+	enum class EFramePhase : uint32
+	{
+		Update,
+		Cull,
+		Record,
+		Submit,
+		Count
+	};
+
+	/// Microseconds
+	struct FrameTimeStats
+	{
+		uint64	Count;
+		uint64	Mean;
+		uint64	P50;
+		uint64	P95;
+		uint64	P99;
+		uint64	Max;
+	};
+
+	struct FrameStatsReport
+	{
+		uint64			FrameIndex;
+		uint64			Hitches;
+		FrameTimeStats	Frame;
+		/// Frames without time in a phase do not count for it
+		FrameTimeStats	Phases[(uint32)EFramePhase::Count];
+		/// The budget percentile of Frame is within the budget, true
+		/// without a budget
+		bool			WithinBudget;
+	};
+
+	struct FrameHitch
+	{
+		uint64	FrameIndex;
+		/// Microseconds
+		uint64	Time;
+		uint64	Phases[(uint32)EFramePhase::Count];
+	};
+
+	/// FrameStats
+	/// Frame and phase times in HDR histograms, for the whole session and
+	/// for a rolling window of recent frames, with hitch detection and a
+	/// frame-time budget to hold the window to.
+	class K3D_API FrameStats
+	{
+	public:
+		/// Ends the frame started by the previous call, the first call
+		/// only starts measuring
+		static void			EndFrame();
+		/// Ends the frame with a given time instead of the measured one,
+		/// for replays and tests
+		static void			EndFrame(uint64 microseconds);
+
+		/// Adds to the current frame, phases run by several threads at once
+		/// add up their times
+		static void			AddPhaseTime(EFramePhase phase, uint64 nanoseconds);
+		static const char*	PhaseName(EFramePhase phase);
+		static uint64		Now();
+
+		/// Frames in the rolling window, 600 by default
+		static void			SetWindow(uint32 frames);
+
+		/// A frame is a hitch when it is longer than absoluteUs, or than
+		/// relative times the median of the window. 0 turns a test off.
+		static void			SetHitchThresholds(uint64 absoluteUs, float relative);
+
+		/// Objective for the window, e.g. 99th percentile under 16.6ms.
+		/// Misses are logged, percentile 0 removes the budget.
+		static void			SetBudget(double percentile, uint64 microseconds);
+
+		static void			GetWindow(FrameStatsReport & report);
+		static void			GetSession(FrameStatsReport & report);
+		/// The last 64 hitches, oldest first
+		static void			GetHitches(std::vector<FrameHitch> & hitches);
+		static void			Reset();
+
+		/// Send the window statistics through the WebSocket log channel
+		/// (ELogLevel::Profile, tag "FrameStats")
+		static void			Publish();
+		/// Publish every Nth frame, 0 stops
+		static void			SetPublishInterval(uint32 frames);
+
+		/// Session statistics, recent hitches and the frame time histogram,
+		/// as JSON if path ends in .json, CSV otherwise
+		static bool			Dump(const char * path);
+		/// Dump to path when the process exits, null cancels
+		static void			SetDumpPath(const char * path);
+	};
+
+	/// FramePhaseScope
+	/// Accounts the scope to a phase of the current frame, and shows as a
+	/// zone of the phase name in the profiler.
+	class FramePhaseScope
+	{
+	public:
+		explicit FramePhaseScope(EFramePhase phase)
+			: m_Zone(FrameStats::PhaseName(phase)), m_Phase(phase), m_Begin(FrameStats::Now()) {}
+		~FramePhaseScope()
+		{
+			FrameStats::AddPhaseTime(m_Phase, FrameStats::Now() - m_Begin);
+		}
+
+	private:
+		FramePhaseScope(const FramePhaseScope&) = delete;
+		FramePhaseScope& operator=(const FramePhaseScope&) = delete;
+
+		ProfileScope	m_Zone;
+		EFramePhase		m_Phase;
+		uint64			m_Begin;
+	};
+}
+
+#define K3D_FRAME_PHASE(Phase) \
+	::k3d::FramePhaseScope K3D_PROFILE_CONCAT(_framePhase, __LINE__)(::k3d::EFramePhase::Phase)
+
+#endif
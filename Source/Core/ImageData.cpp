@@ -8,8 +8,12 @@ namespace k3d
 	ImageData::ImageData()
 		: m_ImgWidth(0)
 		, m_ImgHeight(0)
+		, m_ImgDepth(0)
 		, m_ImgLayers(0)
 		, m_MipLev(0)
+		, m_ElementSize(0)
+		, m_IsCubeMap(false)
+		, m_IsCompressed(false)
 	{
 	}
 
@@ -34,6 +38,14 @@ namespace k3d
 		return bw*bh*d*elementSize;
 	}
 
+	uint64 ImageData::GetByteSize() const
+	{
+		uint64 size = 0;
+		for (int32 level = 0; level < m_MipLev; level++)
+			size += GetImageSize((uint32)level);
+		return size * (m_ImgLayers ? m_ImgLayers : 1);
+	}
+
 	const void *ImageData::GetLevel(uint32 level, uint32 face) const
 	{
 		assert(level < (uint32)m_MipLev);
@@ -41,6 +41,8 @@ namespace k3d
 
 		uint32 GetImageSize(uint32 level) const;
 		const void * GetLevel(uint32 level, uint32 face) const;
+		/// Bytes of every level of every layer
+		uint64 GetByteSize() const;
 
 		virtual bool Load(uint8 *dataPtr, uint32 length);
 		virtual bool IsCompressed() const;
@@ -1,67 +1,822 @@
 #include "Kaleido3D.h"
 #include "LogUtil.h"
 #include "Module.h"
+#include "MemoryTracker.h"
 #include <cstdarg>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <Config/OSHeaders.h>
 #include "Log/Public/ILogModule.h"
 #include "../../Data/style.css.h"
 
-namespace k3d 
+namespace k3d
 {
-	void Log(ELogLevel const & Lv, const char * tag, const char * fmt, ...)
+	namespace
 	{
-		static /*thread_local*/ char dbgStr[2048] = { 0 };
-		va_list va;
-		va_start(va, fmt);
-#if K3DPLATFORM_OS_ANDROID
-		::vsprintf(dbgStr, fmt, va);
-#else
-		::vsprintf(dbgStr, fmt, va);
-#endif
-		va_end(va);
+		typedef std::chrono::steady_clock Clock;
+
+		/// Monotonic, cheap enough to stamp every record
+		uint64 Now()
+		{
+			return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+		}
+
+		struct RecordHeader
+		{
+			/// Header, copied tag and arguments, 8 byte aligned. 0 marks the
+			/// unused end of the ring, the next record is at its start.
+			uint32			Size;
+			ELogLevel		Level;
+			uint16			TagLength;
+			uint32			ArgsSize;
+			uint64			Time;
+			/// Null if copied after the header
+			const char *	Tag;
+			const char *	Format;
+		};
+
+		const uint32 MaxTagLength = 63;
+
+		uint32 AlignRecord(size_t size)
+		{
+			return (uint32)((size + 7) & ~(size_t)7);
+		}
 
-		auto logModule = StaticPointerCast<k3d::ILogModule>(GlobalModuleManager.FindModule("KawaLog"));
-		if (logModule)
+		/// Records of one thread, it produces and the log thread consumes
+		class LogRing
 		{
-			int logType = (int)ELoggerType::EConsole;
-			switch (Lv)
+		public:
+			static const uint32 Capacity = 64 * 1024;
+			static const uint32 ArgCapacity = 4096;
+
+			LogRing() : Head(0), Tail(0), Retired(false), Thread(Os::Thread::GetCurrentThreadName()) {}
+
+			/// Rings are the bulk of the log's memory, count them under Log
+			static void * operator new(size_t size) { return MemoryTracker::Allocate(size, EMemoryTag::Log); }
+			static void operator delete(void * ptr) { MemoryTracker::Free(ptr); }
+
+			bool Push(RecordHeader const & header, const char * tag, const kByte * args)
+			{
+				uint32 size = header.Size;
+				uint64 head = Head.load(std::memory_order_relaxed);
+				uint32 offset = (uint32)(head % Capacity);
+				uint32 contiguous = Capacity - offset;
+				uint32 needed = contiguous < size ? contiguous + size : size;
+				if (Capacity - (head - Tail.load(std::memory_order_acquire)) < needed)
+					return false;
+				if (contiguous < size)
+				{
+					((RecordHeader*)(Data + offset))->Size = 0;
+					head += contiguous;
+					offset = 0;
+				}
+				kByte * record = Data + offset;
+				memcpy(record, &header, sizeof(header));
+				if (!header.Tag)
+					memcpy(record + sizeof(header), tag, header.TagLength);
+				if (header.ArgsSize)
+					memcpy(record + sizeof(header) + header.TagLength, args, header.ArgsSize);
+				Head.store(head + size, std::memory_order_release);
+				return true;
+			}
+
+			bool IsEmpty() const
 			{
-			case ELogLevel::Fatal:
-			case ELogLevel::Error:
-			case ELogLevel::Warn:
-			case ELogLevel::Info:
-				logType |= (int)ELoggerType::EWebsocket | (int)ELoggerType::EFile;
-				break;
-			case ELogLevel::Debug:
-				logType |= (int)ELoggerType::EWebsocket;
-				break;
+				return Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_relaxed);
 			}
-			if (logType & int(ELoggerType::EWebsocket))
+
+			alignas(8) kByte			Data[Capacity];
+			std::atomic<uint64>			Head;
+			std::atomic<uint64>			Tail;
+			/// Set once the thread exited, the ring goes away when drained
+			std::atomic<bool>			Retired;
+			std::string					Thread;
+			alignas(8) kByte			Args[ArgCapacity];
+		};
+
+		struct RingHolder
+		{
+			LogRing * Ring = nullptr;
+			~RingHolder()
 			{
-				k3d::ILogger* logger = logModule->GetLogger(ELoggerType::EWebsocket);
-				if (logger)
+				if (Ring)
+					Ring->Retired.store(true, std::memory_order_release);
+				Ring = nullptr;
+			}
+		};
+
+		thread_local RingHolder t_Ring;
+		/// Set on the thread draining, its own records cannot wait for it
+		thread_local bool t_Draining = false;
+
+		void Append(std::string & out, const char * spec, ...)
+		{
+			char buffer[512];
+			va_list va;
+			va_start(va, spec);
+			int length = vsnprintf(buffer, sizeof(buffer), spec, va);
+			va_end(va);
+			if (length < 0)
+				return;
+			if ((size_t)length < sizeof(buffer))
+			{
+				out.append(buffer, (size_t)length);
+				return;
+			}
+			size_t start = out.size();
+			out.resize(start + (size_t)length + 1);
+			va_start(va, spec);
+			vsnprintf(&out[start], (size_t)length + 1, spec, va);
+			va_end(va);
+			out.resize(start + (size_t)length);
+		}
+
+		/// Walks the raw arguments of a record
+		class ArgReader
+		{
+		public:
+			ArgReader(const kByte * args, uint32 size) : m_Cursor(args), m_End(args + size) {}
+
+			bool Next(LogDetail::EArgType & type, uint64 & value, const kByte *& text, uint32 & length)
+			{
+				if (m_Cursor >= m_End)
+					return false;
+				type = (LogDetail::EArgType)*m_Cursor++;
+				if (type == LogDetail::ArgString || type == LogDetail::ArgWString)
 				{
-					logger->Log(Lv, tag, dbgStr);
+					uint16 count;
+					memcpy(&count, m_Cursor, sizeof(count));
+					text = m_Cursor + sizeof(count);
+					length = count;
+					m_Cursor = text + count * (type == LogDetail::ArgString ? 1 : sizeof(wchar_t));
+					return true;
 				}
+				memcpy(&value, m_Cursor, sizeof(value));
+				m_Cursor += sizeof(value);
+				return true;
 			}
-			if (logType & int(ELoggerType::EConsole))
+
+		private:
+			const kByte * m_Cursor;
+			const kByte * m_End;
+		};
+
+		/// printf over the captured arguments, one conversion at a time. The
+		/// argument types were recorded, a conversion that does not match
+		/// its argument prints the argument as what it is.
+		void FormatRecord(const char * format, const kByte * args, uint32 argsSize, std::string & out)
+		{
+			ArgReader reader(args, argsSize);
+			const char * p = format;
+			while (*p)
 			{
-				k3d::ILogger* logger = logModule->GetLogger(ELoggerType::EConsole);
-				if (logger)
+				const char * percent = strchr(p, '%');
+				if (!percent)
+				{
+					out.append(p);
+					break;
+				}
+				out.append(p, percent - p);
+				p = percent + 1;
+				if (*p == '%')
+				{
+					out.push_back('%');
+					p++;
+					continue;
+				}
+				// flags, width and precision are kept, length modifiers follow the argument
+				char spec[32] = "%";
+				size_t specLength = 1;
+				int stars[2] = { 0, 0 };
+				int starCount = 0;
+				while (*p && strchr("-+ #0'", *p) && specLength < 16)
+					spec[specLength++] = *p++;
+				for (int part = 0; part < 2; part++)
+				{
+					if (part == 1)
+					{
+						if (*p != '.')
+							break;
+						spec[specLength++] = *p++;
+					}
+					if (*p == '*')
+					{
+						LogDetail::EArgType type;
+						uint64 value = 0;
+						const kByte * text;
+						uint32 length;
+						stars[starCount++] = reader.Next(type, value, text, length) ? (int)(int64)value : 0;
+						spec[specLength++] = *p++;
+					}
+					while (*p >= '0' && *p <= '9' && specLength < 24)
+						spec[specLength++] = *p++;
+				}
+				while (*p && strchr("hlLqjztI0123456789", *p))
+					p++;
+				char conversion = *p;
+				if (!conversion)
+				{
+					out.append(percent);
+					break;
+				}
+				p++;
+
+				LogDetail::EArgType type;
+				uint64 value = 0;
+				const kByte * text = nullptr;
+				uint32 length = 0;
+				if (!reader.Next(type, value, text, length))
+				{
+					out.append(percent, p - percent);
+					continue;
+				}
+				bool integer = strchr("diouxXc", conversion) != nullptr;
+				if (type == LogDetail::ArgInt32)
 				{
-					logger->Log(Lv, tag, dbgStr);
+					// an int under an unsigned conversion prints its 32 bits, like printf
+					if (strchr("ouxX", conversion))
+						value &= 0xffffffffull;
+					type = LogDetail::ArgInt;
 				}
+				bool real = strchr("fFeEgGaA", conversion) != nullptr;
+				const char * suffix = nullptr;
+				switch (type)
+				{
+				case LogDetail::ArgInt:
+				case LogDetail::ArgUInt:
+				case LogDetail::ArgPointer:
+					if (conversion == 'p' || (type == LogDetail::ArgPointer && !integer))
+					{
+						suffix = "p";
+					}
+					else if (real)
+					{
+						double d = type == LogDetail::ArgInt ? (double)(int64)value : (double)value;
+						memcpy(&value, &d, sizeof(d));
+						type = LogDetail::ArgFloat;
+					}
+					else if (integer && conversion == 'c')
+					{
+						suffix = "c";
+					}
+					else
+					{
+						static const char * const signedSuffix[] = { "lld", "lli" };
+						static const char * const unsignedSuffix[] = { "llo", "llu", "llx", "llX" };
+						const char * convs = "diouxX";
+						size_t index = integer ? strchr(convs, conversion) - convs : (type == LogDetail::ArgInt ? 0 : 3);
+						suffix = index < 2 ? signedSuffix[index] : unsignedSuffix[index - 2];
+					}
+					break;
+				default:
+					break;
+				}
+				if (type == LogDetail::ArgFloat)
+				{
+					char c[2] = { real ? conversion : 'g', 0 };
+					strcpy(spec + specLength, c);
+				}
+				else if (type == LogDetail::ArgString)
+				{
+					strcpy(spec + specLength, "s");
+				}
+				else if (type == LogDetail::ArgWString)
+				{
+					strcpy(spec + specLength, "ls");
+				}
+				else
+				{
+					strcpy(spec + specLength, suffix);
+				}
+
+				double d;
+				std::string narrow;
+				std::wstring wide;
+				switch (type)
+				{
+				case LogDetail::ArgFloat:
+					memcpy(&d, &value, sizeof(d));
+					if (starCount == 2) Append(out, spec, stars[0], stars[1], d);
+					else if (starCount == 1) Append(out, spec, stars[0], d);
+					else Append(out, spec, d);
+					break;
+				case LogDetail::ArgString:
+					narrow.assign((const char*)text, length);
+					if (starCount == 2) Append(out, spec, stars[0], stars[1], narrow.c_str());
+					else if (starCount == 1) Append(out, spec, stars[0], narrow.c_str());
+					else Append(out, spec, narrow.c_str());
+					break;
+				case LogDetail::ArgWString:
+					wide.resize(length);
+					memcpy(&wide[0], text, length * sizeof(wchar_t));
+					if (starCount == 2) Append(out, spec, stars[0], stars[1], wide.c_str());
+					else if (starCount == 1) Append(out, spec, stars[0], wide.c_str());
+					else Append(out, spec, wide.c_str());
+					break;
+				default:
+					if (*suffix == 'p')
+					{
+						void * pointer = (void*)(uintptr_t)value;
+						if (starCount == 2) Append(out, spec, stars[0], stars[1], pointer);
+						else if (starCount == 1) Append(out, spec, stars[0], pointer);
+						else Append(out, spec, pointer);
+					}
+					else if (*suffix == 'c')
+					{
+						if (starCount == 2) Append(out, spec, stars[0], stars[1], (int)value);
+						else if (starCount == 1) Append(out, spec, stars[0], (int)value);
+						else Append(out, spec, (int)value);
+					}
+					else
+					{
+						unsigned long long integerValue = value;
+						if (starCount == 2) Append(out, spec, stars[0], stars[1], integerValue);
+						else if (starCount == 1) Append(out, spec, stars[0], integerValue);
+						else Append(out, spec, integerValue);
+					}
+					break;
+				}
+			}
+		}
+
+		/// A record copied out of its ring
+		struct DrainedRecord
+		{
+			uint64			Time;
+			/// Offset of the RecordHeader in the batch
+			size_t			Offset;
+			const char *	Thread;
+		};
+
+		/// Owns the rings and the log thread. Never destroyed, threads may
+		/// log until the process is gone.
+		class LogService
+		{
+		public:
+			LogService()
+				: State(Idle)
+				, Stopping(false)
+				, Writer(nullptr)
+				, FileLogger(nullptr)
+				, WebsocketLogger(nullptr)
+				, ConsoleLogger(nullptr)
+				, ModuleGeneration(0)
+				, LoggersResolved(false)
+				, Dropped(0)
+			{
+				SteadyBase = Now();
+				WallBase = (uint64)std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+			}
+
+			static LogService & Get()
+			{
+				static LogService * service = new LogService;
+				return *service;
+			}
+
+			LogRing * RingOfThisThread()
+			{
+				if (!t_Ring.Ring)
+				{
+					LogRing * ring = new LogRing;
+					RingsLock.Lock();
+					Rings.push_back(ring);
+					RingsLock.UnLock();
+					t_Ring.Ring = ring;
+				}
+				return t_Ring.Ring;
+			}
+
+			void Push(RecordHeader & header, const char * tag, const kByte * args)
+			{
+				if (State.load(std::memory_order_acquire) == Idle)
+					Start();
+				LogRing * ring = RingOfThisThread();
+				header.Size = AlignRecord(sizeof(RecordHeader) + header.TagLength + header.ArgsSize);
+				header.Time = Now();
+				if (!ring->Push(header, tag, args))
+				{
+					// full, drain here rather than wait for the log thread
+					if (t_Draining)
+					{
+						Dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					// loggers may log on this thread and reuse the argument buffer
+					std::vector<kByte> saved(args, args + header.ArgsSize);
+					Drain(true);
+					if (!ring->Push(header, tag, saved.data()))
+					{
+						Dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+				}
+				if (t_Draining)
+					return;
+				// fatal ones are out before an assert traps, errors go out on the
+				// log thread right away rather than on its next round
+				if (header.Level == ELogLevel::Fatal)
+				{
+					Drain(true);
+				}
+				else if (State.load(std::memory_order_acquire) == Stopped)
+				{
+					Drain(false);
+				}
+				else if (header.Level == ELogLevel::Error ||
+					ring->Head.load(std::memory_order_relaxed) - ring->Tail.load(std::memory_order_relaxed) > LogRing::Capacity / 2)
+				{
+					WakeLock.Lock();
+					WakeCV.NotifyAll();
+					WakeLock.UnLock();
+				}
+			}
+
+			void Start()
+			{
+				int32 idle = Idle;
+				if (!State.compare_exchange_strong(idle, Starting))
+					return;
+				Writer = new Os::Thread([this]() { Run(); }, "LogWriter");
+				Writer->Start();
+				State.store(Running, std::memory_order_release);
+				atexit([]() { Get().Stop(); });
 			}
-			if (logType & int(ELoggerType::EFile))
+
+			void Stop()
+			{
+				if (State.load(std::memory_order_acquire) != Running)
+					return;
+				WakeLock.Lock();
+				Stopping = true;
+				WakeCV.NotifyAll();
+				WakeLock.UnLock();
+				Writer->Join();
+				delete Writer;
+				Writer = nullptr;
+				State.store(Stopped, std::memory_order_release);
+				Drain(true);
+			}
+
+			void Run()
 			{
-				k3d::ILogger* logger = logModule->GetLogger(ELoggerType::EFile);
-				if (logger)
+				WakeLock.Lock();
+				while (!Stopping)
 				{
-					logger->Log(Lv, tag, dbgStr);
+					WakeCV.Wait(&WakeLock, 10);
+					WakeLock.UnLock();
+					Drain(true);
+					WakeLock.Lock();
 				}
+				WakeLock.UnLock();
 			}
+
+			/// Writes out what the rings hold, ordered by time across threads
+			/// \param wait for another thread draining, or return false
+			bool Drain(bool wait)
+			{
+				if (wait)
+					DrainLock.Lock();
+				else if (!DrainLock.TryLock())
+					return false;
+				t_Draining = true;
+				RingsLock.Lock();
+				std::vector<LogRing*> rings = Rings;
+				RingsLock.UnLock();
+
+				Batch.clear();
+				Records.clear();
+				for (auto ring : rings)
+				{
+					uint64 tail = ring->Tail.load(std::memory_order_relaxed);
+					uint64 head = ring->Head.load(std::memory_order_acquire);
+					while (tail != head)
+					{
+						uint32 offset = (uint32)(tail % LogRing::Capacity);
+						RecordHeader const * header = (RecordHeader const*)(ring->Data + offset);
+						if (header->Size == 0)
+						{
+							tail += LogRing::Capacity - offset;
+							continue;
+						}
+						Records.push_back(DrainedRecord{ header->Time, Batch.size(), ring->Thread.c_str() });
+						Batch.insert(Batch.end(), ring->Data + offset, ring->Data + offset + header->Size);
+						tail += header->Size;
+					}
+					ring->Tail.store(tail, std::memory_order_release);
+				}
+				std::stable_sort(Records.begin(), Records.end(), [](DrainedRecord const & a, DrainedRecord const & b)
+				{
+					return a.Time < b.Time;
+				});
+				if (!Records.empty())
+					Dispatch();
+
+				// rings of exited threads, nothing can be pushed to them anymore
+				RingsLock.Lock();
+				for (auto iter = Rings.begin(); iter != Rings.end();)
+				{
+					LogRing * ring = *iter;
+					if (ring->Retired.load(std::memory_order_acquire) && ring->IsEmpty())
+					{
+						delete ring;
+						iter = Rings.erase(iter);
+					}
+					else
+					{
+						++iter;
+					}
+				}
+				RingsLock.UnLock();
+				t_Draining = false;
+				DrainLock.UnLock();
+				return true;
+			}
+
+			/// Under DrainLock, looks the log module up again only once modules
+			/// were loaded or removed since
+			void ResolveLoggers()
+			{
+				if (LoggersResolved && ModuleGeneration == GlobalModuleManager.GetGeneration())
+					return;
+				LogModule = StaticPointerCast<k3d::ILogModule>(GlobalModuleManager.FindModule("KawaLog"));
+				FileLogger = LogModule ? LogModule->GetLogger(ELoggerType::EFile) : nullptr;
+				WebsocketLogger = LogModule ? LogModule->GetLogger(ELoggerType::EWebsocket) : nullptr;
+				ConsoleLogger = LogModule ? LogModule->GetLogger(ELoggerType::EConsole) : nullptr;
+				// after FindModule, which may have loaded it
+				ModuleGeneration = GlobalModuleManager.GetGeneration();
+				LoggersResolved = true;
+			}
+
+			void Dispatch()
+			{
+				ResolveLoggers();
+				ILogger * file = FileLogger;
+				ILogger * websocket = WebsocketLogger;
+				ILogger * console = ConsoleLogger;
+				std::string tag;
+				for (auto const & record : Records)
+				{
+					RecordHeader header;
+					memcpy(&header, Batch.data() + record.Offset, sizeof(header));
+					const kByte * payload = Batch.data() + record.Offset + sizeof(header);
+					if (!header.Tag)
+						tag.assign((const char*)payload, header.TagLength);
+					Message.clear();
+					FormatRecord(header.Format, payload + header.TagLength, header.ArgsSize, Message);
+					LogSource source = { record.Thread, WallBase + (record.Time - SteadyBase) / 1000 };
+					const char * recordTag = header.Tag ? header.Tag : tag.c_str();
+
+					int logType = (int)ELoggerType::EConsole;
+					switch (header.Level)
+					{
+					case ELogLevel::Fatal:
+					case ELogLevel::Error:
+					case ELogLevel::Warn:
+					case ELogLevel::Info:
+						logType |= (int)ELoggerType::EWebsocket | (int)ELoggerType::EFile;
+						break;
+					case ELogLevel::Debug:
+						logType |= (int)ELoggerType::EWebsocket;
+						break;
+					case ELogLevel::Profile:
+						// structured payloads for Tools/WebConsole only
+						logType = (int)ELoggerType::EWebsocket;
+						break;
+					default:
+						break;
+					}
+					if ((logType & int(ELoggerType::EWebsocket)) && websocket)
+						websocket->Log(header.Level, recordTag, Message.c_str(), source);
+					if ((logType & int(ELoggerType::EConsole)) && console)
+						console->Log(header.Level, recordTag, Message.c_str(), source);
+					if ((logType & int(ELoggerType::EFile)) && file)
+						file->Log(header.Level, recordTag, Message.c_str(), source);
+					for (auto logger : Loggers)
+						logger->Log(header.Level, recordTag, Message.c_str(), source);
+				}
+				if (websocket)
+					websocket->Flush();
+				if (console)
+					console->Flush();
+				if (file)
+					file->Flush();
+				for (auto logger : Loggers)
+					logger->Flush();
+			}
+
+			enum { Idle, Starting, Running, Stopped };
+
+			std::atomic<int32>			State;
+			bool						Stopping;
+			Os::Thread *				Writer;
+			Os::Mutex					WakeLock;
+			Os::ConditionVariable		WakeCV;
+
+			/// Guards Rings
+			Os::Mutex					RingsLock;
+			std::vector<LogRing*>		Rings;
+
+			/// One consumer at a time, guards what follows
+			Os::Mutex					DrainLock;
+			std::vector<kByte>			Batch;
+			std::vector<DrainedRecord>	Records;
+			std::string					Message;
+			std::vector<ILogger*>		Loggers;
+			/// KawaLog and its loggers as of ModuleGeneration
+			SharedPtr<ILogModule>		LogModule;
+			ILogger *					FileLogger;
+			ILogger *					WebsocketLogger;
+			ILogger *					ConsoleLogger;
+			uint32						ModuleGeneration;
+			bool						LoggersResolved;
+
+			std::atomic<uint64>			Dropped;
+			uint64						SteadyBase;
+			uint64						WallBase;
+		};
+	}
+
+	namespace LogDetail
+	{
+		kByte * ArgBuffer(uint32 & capacity)
+		{
+			capacity = LogRing::ArgCapacity;
+			return LogService::Get().RingOfThisThread()->Args;
+		}
+
+		void Push(ELogLevel level, const char * tag, const char * format, const kByte * args, uint32 argsSize)
+		{
+			RecordHeader header;
+			header.Level = level;
+			header.TagLength = 0;
+			header.ArgsSize = argsSize;
+			header.Tag = tag;
+			header.Format = format;
+			LogService::Get().Push(header, tag, args);
+		}
+	}
+
+	namespace
+	{
+		void LogV(ELogLevel Lv, const char * tag, const char * fmt, va_list va)
+		{
+			char message[LogDetail::MaxStringArg + 1];
+			::vsnprintf(message, sizeof(message), fmt, va);
+
+			// the tag may not outlive the call either
+			kByte args[LogDetail::MaxStringArg + 16];
+			LogDetail::ArgWriter writer(args, sizeof(args));
+			writer.Write((const char*)message);
+			RecordHeader header;
+			header.Level = Lv;
+			header.TagLength = (uint16)strnlen(tag ? tag : "", MaxTagLength);
+			header.ArgsSize = writer.Size();
+			header.Tag = nullptr;
+			header.Format = "%s";
+			LogService::Get().Push(header, tag ? tag : "", args);
+		}
+
+		/// Channels by name. Set levels stay when the global level changes.
+		class ChannelRegistry
+		{
+		public:
+			static ChannelRegistry & Get()
+			{
+				static ChannelRegistry * registry = new ChannelRegistry;
+				return *registry;
+			}
+
+			LogDetail::Channel & Find(const char * name)
+			{
+				std::lock_guard<std::mutex> lock(m_Lock);
+				return FindLocked(name ? name : "");
+			}
+
+			void SetGlobal(ELogLevel level)
+			{
+				std::lock_guard<std::mutex> lock(m_Lock);
+				m_Level = (uint8)level;
+				for (auto & entry : m_Channels)
+				{
+					if (!entry.second->Explicit)
+						entry.second->Level.store(m_Level, std::memory_order_relaxed);
+				}
+			}
+
+			void Set(const char * name, ELogLevel level, bool explicitLevel)
+			{
+				std::lock_guard<std::mutex> lock(m_Lock);
+				LogDetail::Channel & channel = FindLocked(name ? name : "");
+				channel.Explicit = explicitLevel;
+				channel.Level.store(explicitLevel ? (uint8)level : m_Level, std::memory_order_relaxed);
+			}
+
+		private:
+			ChannelRegistry() : m_Level((uint8)ELogLevel::Default) {}
+
+			LogDetail::Channel & FindLocked(std::string const & name)
+			{
+				auto found = m_Channels.find(name);
+				if (found != m_Channels.end())
+					return *found->second;
+				LogDetail::Channel * channel = new LogDetail::Channel;
+				channel->Level.store(m_Level, std::memory_order_relaxed);
+				channel->Explicit = false;
+				m_Channels.emplace(name, channel);
+				return *channel;
+			}
+
+			std::mutex											m_Lock;
+			uint8												m_Level;
+			std::unordered_map<std::string, LogDetail::Channel*>	m_Channels;
+		};
+	}
+
+	namespace LogDetail
+	{
+		void LogNow(ELogLevel level, const char * tag, const char * fmt, ...)
+		{
+			va_list va;
+			va_start(va, fmt);
+			LogV(level, tag, fmt, va);
+			va_end(va);
 		}
+
+		Channel & GetChannel(const char * name)
+		{
+			return ChannelRegistry::Get().Find(name);
+		}
+
+		bool Site::EveryMs(uint32 ms)
+		{
+			uint64 now = Now() / 1000;
+			uint64 next = m_Next.load(std::memory_order_relaxed);
+			// one thread of those arriving together wins the interval
+			return now >= next && m_Next.compare_exchange_strong(next, now + (uint64)ms * 1000, std::memory_order_relaxed);
+		}
+	}
+
+	void Log(ELogLevel const & Lv, const char * tag, const char * fmt, ...)
+	{
+		if ((uint8)Lv < (uint8)GetLogLevel(tag))
+			return;
+		va_list va;
+		va_start(va, fmt);
+		LogV(Lv, tag, fmt, va);
+		va_end(va);
+	}
+
+	void FlushLog()
+	{
+		if (!t_Draining)
+			LogService::Get().Drain(true);
+	}
+
+	void RegisterLogger(ILogger * logger)
+	{
+		LogService & service = LogService::Get();
+		service.DrainLock.Lock();
+		service.Loggers.push_back(logger);
+		service.DrainLock.UnLock();
+	}
+
+	void UnregisterLogger(ILogger * logger)
+	{
+		LogService & service = LogService::Get();
+		service.DrainLock.Lock();
+		service.Loggers.erase(std::remove(service.Loggers.begin(), service.Loggers.end(), logger), service.Loggers.end());
+		service.DrainLock.UnLock();
+	}
+
+	uint64 GetDroppedLogCount()
+	{
+		return LogService::Get().Dropped.load(std::memory_order_relaxed);
+	}
+
+	void SetLogLevel(ELogLevel level)
+	{
+		ChannelRegistry::Get().SetGlobal(level);
+	}
+
+	void SetLogLevel(const char * channel, ELogLevel level)
+	{
+		ChannelRegistry::Get().Set(channel, level, true);
+	}
+
+	ELogLevel GetLogLevel(const char * channel)
+	{
+		return (ELogLevel)LogDetail::GetChannel(channel).Level.load(std::memory_order_relaxed);
 	}
 
+	void ResetLogLevel(const char * channel)
+	{
+		ChannelRegistry::Get().Set(channel, ELogLevel::Default, false);
+	}
 }
@@ -8,9 +8,233 @@
 
 #include "Os.h"
 
+#include <string.h>
+#include <wchar.h>
+#include <atomic>
+#include <type_traits>
+
+/// Records below this level are compiled out, arguments included:
+/// 1 Debug, 2 Info, 3 Warn, 4 Error, 5 Fatal. The build passes it for
+/// release configurations.
+#ifndef K3D_LOG_MIN_LEVEL
+#if defined(NDEBUG)
+#define K3D_LOG_MIN_LEVEL 2
+#else
+#define K3D_LOG_MIN_LEVEL 0
+#endif
+#endif
+
+#define K3D_LOG_LEVEL_Default	0
+#define K3D_LOG_LEVEL_Debug		1
+#define K3D_LOG_LEVEL_Info		2
+#define K3D_LOG_LEVEL_Warn		3
+#define K3D_LOG_LEVEL_Error		4
+#define K3D_LOG_LEVEL_Fatal		5
+#define K3D_LOG_LEVEL_Profile	6
+
 namespace k3d
 {
+	/// Formats on the calling thread, then goes through the log thread
+	/// like KLOG. For formats that are not string literals.
 	extern K3D_API void Log(ELogLevel const & Lv, const char* tag, const char *fmt, ...);
+
+	/// Writes out every record logged so far, on the calling thread.
+	/// Fatal records flush by themselves, Error ones wake the log thread.
+	extern K3D_API void FlushLog();
+
+	/// Receives every record besides the loggers of the log module, on the
+	/// log thread. The logger must outlive its registration.
+	extern K3D_API void RegisterLogger(ILogger * logger);
+	extern K3D_API void UnregisterLogger(ILogger * logger);
+
+	/// Records dropped because a thread outran the log thread
+	extern K3D_API uint64 GetDroppedLogCount();
+
+	/// Lowest level logged on channels without a level of their own
+	extern K3D_API void SetLogLevel(ELogLevel level);
+
+	/// Lowest level logged on a channel, the tag of KLOG. Records below
+	/// it are discarded before their arguments are evaluated.
+	extern K3D_API void SetLogLevel(const char * channel, ELogLevel level);
+	extern K3D_API ELogLevel GetLogLevel(const char * channel);
+
+	/// Back to the global level
+	extern K3D_API void ResetLogLevel(const char * channel);
+
+	namespace LogDetail
+	{
+		enum EArgType : uint8
+		{
+			ArgInt,
+			/// int and smaller, sign extended
+			ArgInt32,
+			ArgUInt,
+			ArgFloat,
+			ArgPointer,
+			ArgString,
+			ArgWString,
+		};
+
+		/// Longest string argument kept, the rest is cut
+		static const uint32 MaxStringArg = 2048;
+
+		/// Raw arguments of one record, built on the stack of the caller
+		class ArgWriter
+		{
+		public:
+			ArgWriter(kByte * buffer, uint32 capacity) : m_Begin(buffer), m_Cursor(buffer), m_End(buffer + capacity) {}
+
+			template <typename T>
+			typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type Write(T value)
+			{
+				Scalar(!std::is_signed<T>::value ? ArgUInt : sizeof(T) <= sizeof(int32) ? ArgInt32 : ArgInt, (uint64)(int64)value);
+			}
+
+			template <typename T>
+			typename std::enable_if<std::is_floating_point<T>::value>::type Write(T value)
+			{
+				double d = (double)value;
+				uint64 bits;
+				memcpy(&bits, &d, sizeof(bits));
+				Scalar(ArgFloat, bits);
+			}
+
+			template <typename T>
+			typename std::enable_if<std::is_pointer<T>::value &&
+				!std::is_same<typename std::decay<typename std::remove_pointer<T>::type>::type, char>::value &&
+				!std::is_same<typename std::decay<typename std::remove_pointer<T>::type>::type, wchar_t>::value>::type Write(T value)
+			{
+				Scalar(ArgPointer, (uint64)(uintptr_t)value);
+			}
+
+			void Write(std::nullptr_t) { Scalar(ArgPointer, 0); }
+
+			/// What varargs made of small trivial structs, handles mostly
+			template <typename T>
+			typename std::enable_if<std::is_class<T>::value>::type Write(T const & value)
+			{
+				static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(uint64), "KLOG argument cannot be logged, pass c_str() or a scalar");
+				uint64 bits = 0;
+				memcpy(&bits, &value, sizeof(T));
+				Scalar(ArgUInt, bits);
+			}
+
+			void Write(const char * text) { String(ArgString, text ? text : "(null)", text ? strlen(text) : 6, 1); }
+			void Write(const wchar_t * text) { String(ArgWString, text ? text : L"(null)", text ? wcslen(text) : 6, sizeof(wchar_t)); }
+
+			void WriteAll() {}
+			template <typename T, typename... Rest>
+			void WriteAll(T && arg, Rest &&... rest)
+			{
+				Write(static_cast<typename std::decay<T>::type>(arg));
+				WriteAll(static_cast<Rest&&>(rest)...);
+			}
+
+			uint32 Size() const { return (uint32)(m_Cursor - m_Begin); }
+			bool Overflowed() const { return m_Cursor > m_End; }
+
+		private:
+			void Scalar(EArgType type, uint64 value)
+			{
+				if (m_Cursor + 1 + sizeof(value) <= m_End)
+				{
+					*m_Cursor = type;
+					memcpy(m_Cursor + 1, &value, sizeof(value));
+				}
+				m_Cursor += 1 + sizeof(value);
+			}
+
+			void String(EArgType type, const void * text, size_t length, size_t unit)
+			{
+				if (length > MaxStringArg)
+					length = MaxStringArg;
+				uint16 count = (uint16)length;
+				size_t bytes = length * unit;
+				if (m_Cursor + 1 + sizeof(count) + bytes <= m_End)
+				{
+					*m_Cursor = type;
+					memcpy(m_Cursor + 1, &count, sizeof(count));
+					memcpy(m_Cursor + 1 + sizeof(count), text, bytes);
+				}
+				m_Cursor += 1 + sizeof(count) + bytes;
+			}
+
+			kByte * m_Begin;
+			kByte * m_Cursor;
+			kByte * m_End;
+		};
+
+		/// Scratch space of the calling thread for ArgWriter
+		extern K3D_API kByte * ArgBuffer(uint32 & capacity);
+
+		/// Queues a record on the ring of the calling thread
+		/// \param tag, format string literals, the log thread reads them later
+		extern K3D_API void Push(ELogLevel level, const char * tag, const char * format, const kByte * args, uint32 argsSize);
+
+		/// Log without the channel check, the caller did it
+		extern K3D_API void LogNow(ELogLevel level, const char * tag, const char * fmt, ...);
+
+		/// Level of a channel, updated in place by SetLogLevel
+		struct Channel
+		{
+			std::atomic<uint8>	Level;
+			bool				Explicit;
+		};
+
+		/// Created on first use, never freed
+		extern K3D_API Channel & GetChannel(const char * name);
+
+		/// State of one log statement, a function local static
+		class K3D_API Site
+		{
+		public:
+			explicit Site(const char * channel) : m_Channel(GetChannel(channel)), m_Count(0), m_Next(0) {}
+
+			bool Enabled(ELogLevel level) const
+			{
+				return (uint8)level >= m_Channel.Level.load(std::memory_order_relaxed);
+			}
+
+			bool Always() { return true; }
+			bool Once() { return !m_Count.exchange(1, std::memory_order_relaxed); }
+			bool EveryN(uint32 n) { return n <= 1 || m_Count.fetch_add(1, std::memory_order_relaxed) % n == 0; }
+			/// At most once per interval, the first call passes
+			bool EveryMs(uint32 ms);
+
+		private:
+			Site(const Site&) = delete;
+			Site& operator=(const Site&) = delete;
+
+			Channel &				m_Channel;
+			std::atomic<uint64>		m_Count;
+			/// Steady clock, microseconds
+			std::atomic<uint64>		m_Next;
+		};
+	}
+
+	/// Captures the format and the raw arguments, formatting and writing
+	/// happen later on the log thread. tag has to be a string literal.
+	/// \param literal whether format is a string literal, anything else
+	///        (a local char array too) may be gone by the time the log
+	///        thread formats, so it is formatted by the caller
+	template <typename... Args>
+	inline void LogDeferred(ELogLevel level, const char * tag, bool literal, const char * format, Args &&... args)
+	{
+		if (literal)
+		{
+			uint32 capacity = 0;
+			kByte * buffer = LogDetail::ArgBuffer(capacity);
+			LogDetail::ArgWriter writer(buffer, capacity);
+			writer.WriteAll(static_cast<Args&&>(args)...);
+			if (!writer.Overflowed())
+			{
+				LogDetail::Push(level, tag, format, buffer, writer.Size());
+				return;
+			}
+		}
+		// the format may not live long enough or the arguments do not fit
+		LogDetail::LogNow(level, tag, format, args...);
+	}
 }
 
 #ifndef K3DPLATFORM_OS_WIN
@@ -21,15 +245,45 @@ namespace k3d
 #define K3D_STRINGIFY_BUILTIN(x) K3D_STRINGIFY(x)
 #define K3D_ASSERT(isFalse, ...) \
 	if (!(bool)(isFalse)) { \
-		::k3d::Log(::k3d::ELogLevel::Error,"Assert","\nAssertion failed in " K3D_STRINGIFY_BUILTIN( __FILE__ ) " @ " K3D_STRINGIFY_BUILTIN( __LINE__ ) "\n"); \
-		::k3d::Log(::k3d::ELogLevel::Error,"Assert","\'" #isFalse "\' is false"); \
-		::k3d::Log(::k3d::ELogLevel::Error,"Assert", "args is" ##__VA_ARGS__); \
+		::k3d::Log(::k3d::ELogLevel::Fatal,"Assert","\nAssertion failed in " K3D_STRINGIFY_BUILTIN( __FILE__ ) " @ " K3D_STRINGIFY_BUILTIN( __LINE__ ) "\n"); \
+		::k3d::Log(::k3d::ELogLevel::Fatal,"Assert","\'" #isFalse "\' is false"); \
+		::k3d::Log(::k3d::ELogLevel::Fatal,"Assert", "args is" ##__VA_ARGS__); \
 		__debugbreak(); \
     }
 
 
+/// Logs through Func if Level is compiled in, the channel is at or
+/// below Level and the site passes Pass (a LogDetail::Site method).
+/// The arguments are not evaluated otherwise.
+#define K3D_LOG_SITE(Func, Level, Channel, Pass, ...) \
+	do { \
+		if (K3D_LOG_LEVEL_##Level >= K3D_LOG_MIN_LEVEL) { \
+			static ::k3d::LogDetail::Site _logSite(Channel); \
+			if (_logSite.Enabled(::k3d::ELogLevel::Level) && _logSite.Pass) \
+				Func(::k3d::ELogLevel::Level, Channel, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define K3D_STRINGIFY_ARGS(...) #__VA_ARGS__
+
+/// Whether the first argument, macros expanded, is a string literal token.
+/// Known at compile time, "fmt"[0] of the spelling is a quote.
+#define K3D_LOG_IS_LITERAL(...) (K3D_STRINGIFY_ARGS(__VA_ARGS__)[0] == '"')
+
 #define KLOG(Level, TAG, ...) \
-	::k3d::Log(::k3d::ELogLevel::Level, #TAG, __VA_ARGS__);
+	K3D_LOG_SITE(::k3d::LogDeferred, Level, #TAG, Always(), K3D_LOG_IS_LITERAL(__VA_ARGS__), __VA_ARGS__)
+
+/// The first time only
+#define KLOG_ONCE(Level, TAG, ...) \
+	K3D_LOG_SITE(::k3d::LogDeferred, Level, #TAG, Once(), K3D_LOG_IS_LITERAL(__VA_ARGS__), __VA_ARGS__)
+
+/// The first of every N times
+#define KLOG_EVERY_N(Level, TAG, N, ...) \
+	K3D_LOG_SITE(::k3d::LogDeferred, Level, #TAG, EveryN(N), K3D_LOG_IS_LITERAL(__VA_ARGS__), __VA_ARGS__)
+
+/// At most once every Ms milliseconds
+#define KLOG_EVERY_MS(Level, TAG, Ms, ...) \
+	K3D_LOG_SITE(::k3d::LogDeferred, Level, #TAG, EveryMs(Ms), K3D_LOG_IS_LITERAL(__VA_ARGS__), __VA_ARGS__)
 
 
 #define DBG_LINE_WITH_LAST_ERROR(tag, message) \
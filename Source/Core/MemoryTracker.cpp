@@ -0,0 +1,308 @@
+#include "Kaleido3D.h"
+#include "MemoryTracker.h"
+#include "LogUtil.h"
+#include "Os.h"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if K3DPLATFORM_OS_WIN
+#include <Windows.h>
+#elif (K3DPLATFORM_OS_LINUX && !K3DPLATFORM_OS_ANDROID) || K3DPLATFORM_OS_MAC
+#include <execinfo.h>
+#define K3D_HAS_EXECINFO 1
+#endif
+
+K3D_COMMON_NS
+{
+	namespace
+	{
+		const uint32 kNumTags = (uint32)EMemoryTag::Count;
+		const uint32 kMaxSamples = 1024;
+		const uint32 kMaxFrames = 16;
+		const uint32 kMaxPublishedSamples = 16;
+
+		struct BlockHeader
+		{
+			uint64	Size;
+			uint32	Tag;
+			uint32	Sample; // slot + 1, 0 if not sampled
+		};
+		static_assert(sizeof(BlockHeader) == 16, "header must keep 16 byte alignment");
+
+		struct TagCounters
+		{
+			std::atomic<int64>	LiveBytes;
+			std::atomic<int64>	LiveCount;
+			std::atomic<int64>	PeakBytes;
+			std::atomic<uint64>	TotalAllocs;
+			char				Pad[64 - 4 * sizeof(int64)];
+		};
+
+		struct AllocSample
+		{
+			void *	Frames[kMaxFrames];
+			uint32	Depth;
+			uint32	Tag;
+			uint64	Size;
+			bool	Used;
+		};
+
+		const char* s_TagNames[kNumTags] = { "Default", "Assets", "Render", "Log", "Script" };
+
+		TagCounters g_Tags[kNumTags];
+		std::atomic<uint32> g_SamplingRate(0);
+		AllocSample g_Samples[kMaxSamples];
+		uint32 g_SampleHint = 0;
+		Os::Mutex g_SampleLock;
+		Os::Mutex g_PublishLock;
+		MemorySnapshot g_LastPublished = {};
+
+		thread_local EMemoryTag t_CurrentTag = EMemoryTag::Default;
+		thread_local uint32 t_SampleCountdown = 0;
+
+		void Account(uint32 tag, int64 bytes, int64 count)
+		{
+			TagCounters & counters = g_Tags[tag];
+			int64 live = counters.LiveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+			counters.LiveCount.fetch_add(count, std::memory_order_relaxed);
+			if (count > 0)
+				counters.TotalAllocs.fetch_add(count, std::memory_order_relaxed);
+			int64 peak = counters.PeakBytes.load(std::memory_order_relaxed);
+			while (live > peak && !counters.PeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		uint32 CaptureStack(void ** frames, uint32 maxFrames)
+		{
+#if K3DPLATFORM_OS_WIN
+			return CaptureStackBackTrace(2, maxFrames, frames, nullptr);
+#elif K3D_HAS_EXECINFO
+			void * raw[kMaxFrames + 2];
+			int depth = backtrace(raw, maxFrames + 2);
+			if (depth <= 2)
+				return 0;
+			memcpy(frames, raw + 2, (depth - 2) * sizeof(void*));
+			return depth - 2;
+#else
+			return 0;
+#endif
+		}
+
+		uint32 RecordSample(uint32 tag, uint64 size)
+		{
+			void * frames[kMaxFrames];
+			uint32 depth = CaptureStack(frames, kMaxFrames);
+			uint32 slot = 0;
+			g_SampleLock.Lock();
+			for (uint32 i = 0; i < kMaxSamples; i++)
+			{
+				uint32 index = (g_SampleHint + i) % kMaxSamples;
+				AllocSample & sample = g_Samples[index];
+				if (!sample.Used)
+				{
+					memcpy(sample.Frames, frames, depth * sizeof(void*));
+					sample.Depth = depth;
+					sample.Tag = tag;
+					sample.Size = size;
+					sample.Used = true;
+					g_SampleHint = index + 1;
+					slot = index + 1;
+					break;
+				}
+			}
+			g_SampleLock.UnLock();
+			return slot;
+		}
+
+		void ReleaseSample(uint32 slot)
+		{
+			g_SampleLock.Lock();
+			g_Samples[slot - 1].Used = false;
+			g_SampleLock.UnLock();
+		}
+
+		bool ShouldSample()
+		{
+			uint32 rate = g_SamplingRate.load(std::memory_order_relaxed);
+			if (rate == 0)
+				return false;
+			if (t_SampleCountdown == 0 || t_SampleCountdown > rate)
+			{
+				t_SampleCountdown = rate;
+			}
+			return --t_SampleCountdown == 0;
+		}
+	}
+
+	MemoryTagScope::MemoryTagScope(EMemoryTag tag)
+		: m_Previous(t_CurrentTag)
+	{
+		t_CurrentTag = tag;
+	}
+
+	MemoryTagScope::~MemoryTagScope()
+	{
+		t_CurrentTag = m_Previous;
+	}
+
+	void* MemoryTracker::Allocate(size_t size)
+	{
+		return Allocate(size, t_CurrentTag);
+	}
+
+	void* MemoryTracker::Allocate(size_t size, EMemoryTag tag)
+	{
+		BlockHeader * header = (BlockHeader*)__k3d_malloc__(size + sizeof(BlockHeader));
+		if (!header)
+			return nullptr;
+		header->Size = size;
+		header->Tag = (uint32)tag < kNumTags ? (uint32)tag : 0;
+		header->Sample = ShouldSample() ? RecordSample(header->Tag, size) : 0;
+		Account(header->Tag, (int64)size, 1);
+		return header + 1;
+	}
+
+	void MemoryTracker::Free(void * p)
+	{
+		if (!p)
+			return;
+		BlockHeader * header = (BlockHeader*)p - 1;
+		if (header->Sample)
+			ReleaseSample(header->Sample);
+		Account(header->Tag, -(int64)header->Size, -1);
+		__k3d_free__(header, header->Size + sizeof(BlockHeader));
+	}
+
+	void MemoryTracker::Track(EMemoryTag tag, int64 bytes)
+	{
+		if ((uint32)tag < kNumTags)
+			Account((uint32)tag, bytes, bytes > 0 ? 1 : -1);
+	}
+
+	EMemoryTag MemoryTracker::CurrentTag()
+	{
+		return t_CurrentTag;
+	}
+
+	const char* MemoryTracker::TagName(EMemoryTag tag)
+	{
+		return (uint32)tag < kNumTags ? s_TagNames[(uint32)tag] : "Unknown";
+	}
+
+	void MemoryTracker::GetStats(EMemoryTag tag, MemoryTagStats & stats)
+	{
+		TagCounters & counters = g_Tags[(uint32)tag < kNumTags ? (uint32)tag : 0];
+		stats.LiveBytes = counters.LiveBytes.load(std::memory_order_relaxed);
+		stats.LiveCount = counters.LiveCount.load(std::memory_order_relaxed);
+		stats.PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+		stats.TotalAllocs = counters.TotalAllocs.load(std::memory_order_relaxed);
+	}
+
+	void MemoryTracker::TakeSnapshot(MemorySnapshot & snapshot)
+	{
+		snapshot.FrameIndex = FrameArena::FrameIndex();
+		for (uint32 i = 0; i < kNumTags; i++)
+		{
+			GetStats((EMemoryTag)i, snapshot.Tags[i]);
+		}
+	}
+
+	MemorySnapshot MemoryTracker::Diff(MemorySnapshot const & from, MemorySnapshot const & to)
+	{
+		MemorySnapshot diff;
+		diff.FrameIndex = to.FrameIndex - from.FrameIndex;
+		for (uint32 i = 0; i < kNumTags; i++)
+		{
+			diff.Tags[i].LiveBytes = to.Tags[i].LiveBytes - from.Tags[i].LiveBytes;
+			diff.Tags[i].LiveCount = to.Tags[i].LiveCount - from.Tags[i].LiveCount;
+			diff.Tags[i].PeakBytes = to.Tags[i].PeakBytes - from.Tags[i].PeakBytes;
+			diff.Tags[i].TotalAllocs = to.Tags[i].TotalAllocs - from.Tags[i].TotalAllocs;
+		}
+		return diff;
+	}
+
+	void MemoryTracker::SetSamplingRate(uint32 everyNth)
+	{
+		g_SamplingRate.store(everyNth, std::memory_order_relaxed);
+	}
+
+	void MemoryTracker::Publish()
+	{
+		MemorySnapshot snapshot;
+		TakeSnapshot(snapshot);
+
+		g_PublishLock.Lock();
+		MemorySnapshot diff = Diff(g_LastPublished, snapshot);
+		g_LastPublished = snapshot;
+		g_PublishLock.UnLock();
+
+		char item[256];
+		std::string json;
+		snprintf(item, sizeof(item), "{\"Frame\":%llu,\"Tags\":[", (unsigned long long)snapshot.FrameIndex);
+		json += item;
+		for (uint32 i = 0; i < kNumTags; i++)
+		{
+			MemoryTagStats const & s = snapshot.Tags[i];
+			MemoryTagStats const & d = diff.Tags[i];
+			snprintf(item, sizeof(item),
+				"%s{\"Name\":\"%s\",\"LiveBytes\":%lld,\"LiveCount\":%lld,\"PeakBytes\":%lld,\"DeltaBytes\":%lld,\"DeltaCount\":%lld}",
+				i ? "," : "", s_TagNames[i], (long long)s.LiveBytes, (long long)s.LiveCount,
+				(long long)s.PeakBytes, (long long)d.LiveBytes, (long long)d.LiveCount);
+			json += item;
+		}
+		json += "]}";
+		Log(ELogLevel::Profile, "MemSnapshot", "%s", json.c_str());
+
+		// aggregate live samples by call stack, largest first
+		struct StackTotal
+		{
+			AllocSample	Sample;
+			uint64		Bytes;
+			uint32		Count;
+		};
+		std::vector<StackTotal> totals;
+		g_SampleLock.Lock();
+		for (uint32 i = 0; i < kMaxSamples; i++)
+		{
+			AllocSample const & sample = g_Samples[i];
+			if (!sample.Used)
+				continue;
+			auto found = std::find_if(totals.begin(), totals.end(), [&sample](StackTotal const & t) {
+				return t.Sample.Tag == sample.Tag && t.Sample.Depth == sample.Depth
+					&& memcmp(t.Sample.Frames, sample.Frames, sample.Depth * sizeof(void*)) == 0;
+			});
+			if (found != totals.end())
+			{
+				found->Bytes += sample.Size;
+				found->Count++;
+			}
+			else
+			{
+				totals.push_back({ sample, sample.Size, 1 });
+			}
+		}
+		g_SampleLock.UnLock();
+
+		std::sort(totals.begin(), totals.end(), [](StackTotal const & a, StackTotal const & b) {
+			return a.Bytes > b.Bytes;
+		});
+		if (totals.size() > kMaxPublishedSamples)
+			totals.resize(kMaxPublishedSamples);
+		for (StackTotal const & total : totals)
+		{
+			snprintf(item, sizeof(item), "{\"Tag\":\"%s\",\"Bytes\":%llu,\"Count\":%u,\"Stack\":[",
+				s_TagNames[total.Sample.Tag], (unsigned long long)total.Bytes, total.Count);
+			json = item;
+			for (uint32 f = 0; f < total.Sample.Depth; f++)
+			{
+				snprintf(item, sizeof(item), "%s\"%p\"", f ? "," : "", total.Sample.Frames[f]);
+				json += item;
+			}
+			json += "]}";
+			Log(ELogLevel::Profile, "MemSample", "%s", json.c_str());
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+#ifndef __MemoryTracker_h__
+#define __MemoryTracker_h__
+
+#include <KTL/Allocator.hpp>
+
+K3D_COMMON_NS
+{
+	enum class EMemoryTag : uint32
+	{
+		Default,
+		Assets,
+		Render,
+		Log,
+		Script,
+		Count
+	};
+
+	struct MemoryTagStats
+	{
+		int64	LiveBytes;
+		int64	LiveCount;
+		int64	PeakBytes;
+		uint64	TotalAllocs;
+	};
+
+	struct MemorySnapshot
+	{
+		uint64			FrameIndex;
+		MemoryTagStats	Tags[(uint32)EMemoryTag::Count];
+	};
+
+	/// MemoryTagScope
+	/// Tracked allocations made on this thread without an explicit
+	/// tag are accounted to the innermost scope.
+	class K3D_API MemoryTagScope
+	{
+	public:
+		explicit MemoryTagScope(EMemoryTag tag);
+		~MemoryTagScope();
+
+	private:
+		MemoryTagScope(const MemoryTagScope&) = delete;
+		MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+
+		EMemoryTag	m_Previous;
+	};
+
+	/// MemoryTracker
+	/// Tagged allocations on top of __k3d_malloc__. Each block carries a
+	/// 16 byte header with its size and tag, so Free needs neither.
+	/// Every Nth allocation can record its call stack when sampling is on.
+	class K3D_API MemoryTracker
+	{
+	public:
+		static void*		Allocate(size_t size);
+		static void*		Allocate(size_t size, EMemoryTag tag);
+		static void			Free(void * p);
+
+		/// Account memory not allocated through the tracker, e.g. GPU heaps
+		static void			Track(EMemoryTag tag, int64 bytes);
+
+		static EMemoryTag	CurrentTag();
+		static const char*	TagName(EMemoryTag tag);
+		static void			GetStats(EMemoryTag tag, MemoryTagStats & stats);
+
+		static void			TakeSnapshot(MemorySnapshot & snapshot);
+		/// Per tag difference, PeakBytes and TotalAllocs become deltas as well
+		static MemorySnapshot Diff(MemorySnapshot const & from, MemorySnapshot const & to);
+
+		/// Record the call stack of every Nth tracked allocation, 0 disables
+		static void			SetSamplingRate(uint32 everyNth);
+
+		/// Send a snapshot, its diff to the previously published one and the
+		/// live sampled call stacks through the WebSocket log channel
+		/// (ELogLevel::Profile, tags "MemSnapshot" and "MemSample").
+		static void			Publish();
+	};
+
+	/// TaggedAllocator
+	/// kAllocator compatible, accounts container storage to Tag.
+	template <EMemoryTag Tag>
+	class TaggedAllocator
+	{
+	public:
+		TaggedAllocator(const char* = nullptr) {}
+		TaggedAllocator(const TaggedAllocator&) {}
+		TaggedAllocator(const TaggedAllocator&, const char*) {}
+		TaggedAllocator& operator=(const TaggedAllocator&) { return *this; }
+		bool operator==(const TaggedAllocator&) { return true; }
+		bool operator!=(const TaggedAllocator&) { return false; }
+		void* allocate(size_t n, int /*flags = 0*/) { return MemoryTracker::Allocate(n, Tag); }
+		void* allocate(size_t n, size_t /*alignment*/, size_t /*alignmentOffset*/, int /*flags = 0*/)
+		{
+			return MemoryTracker::Allocate(n, Tag);
+		}
+		void deallocate(void* p, size_t) { MemoryTracker::Free(p); }
+		const char* get_name() const { return MemoryTracker::TagName(Tag); }
+		void set_name(const char*) {}
+	};
+}
+
+#endif
@@ -137,7 +137,9 @@ namespace k3d
 
 	Archive & operator <<(Archive &arch, const Mesh &mesh)
 	{
-		arch.ArrayIn(Mesh::ClassName(), 64);
+		char className[64] = { 0 };
+		strncpy(className, Mesh::ClassName(), 63);
+		arch.ArrayIn(className, 64);
 		arch.ArrayIn(mesh.m_MeshName, 96);
 
 		arch << mesh.m_VtxFmt;
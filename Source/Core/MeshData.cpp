@@ -1,5 +1,6 @@
 #include "Kaleido3D.h"
 #include "MeshData.h"
+#include "MemoryTracker.h"
 #include <assert.h>
 #include <cstring>
 
@@ -7,12 +8,19 @@ namespace k3d
 {
 #define SAFERELEASEARRAY(x) \
   if(x) {\
-  delete [] x;\
+  MemoryTracker::Free(x);\
   x=nullptr;\
   }
 
+	template <typename T>
+	static inline T* NewAssetArray(uint32 count)
+	{
+		return static_cast<T*>(MemoryTracker::Allocate(count * sizeof(T), EMemoryTag::Assets));
+	}
+
 	MeshData::MeshData()
 	{
+		m_NameStr = m_Name.CStr();
 		m_IsLoaded = false;
 		m_NumIndices = 0;
 		m_NumVertices = 0;
@@ -23,7 +31,6 @@ namespace k3d
 		m_PrimType = PrimType::TRIANGLES;
 		m_VtxFmt = VtxFormat::PER_INSTANCE;
 
-		memset(m_MeshName, 0, 96);
 	}
 
 	MeshData::~MeshData()
@@ -34,6 +41,7 @@ namespace k3d
 	void MeshData::Release()
 	{
 		SAFERELEASEARRAY(m_IndexData);
+		SAFERELEASEARRAY(m_P3N3T2Buffer);
 		m_IsLoaded = false;
 		m_NumIndices = 0;
 		m_NumVertices = 0;
@@ -48,19 +56,16 @@ namespace k3d
 	void MeshData::SetMeshName(const char *meshName)
 	{
 		assert(meshName && "MeshName cannot be nullptr");
-		const char * ptr = meshName;
-		int pos = 0;
-		while (*ptr != 0 && pos < 96) {
-			m_MeshName[pos] = *ptr;
-			ptr++; pos++;
-		}
+		// serialized into 96 bytes
+		m_Name = ::k3d::Name(meshName, strnlen(meshName, kMeshNameLength - 1));
+		m_NameStr = m_Name.CStr();
 	}
 
 	void MeshData::SetIndexBuffer(std::vector<uint32> &indexBuffer)
 	{
 		m_NumIndices = (uint32)indexBuffer.size();
 		if (m_NumIndices != 0) {
-			m_IndexData = new uint32[m_NumIndices];
+			m_IndexData = NewAssetArray<uint32>(m_NumIndices);
 			std::memcpy(m_IndexData, (uint32*)&std::move(indexBuffer)[0], m_NumIndices*sizeof(uint32));
 		}
 	}
@@ -69,15 +74,15 @@ namespace k3d
 		assert(m_NumVertices!=0);
 		switch (m_VtxFmt) {
 		case VtxFormat::POS3_F32:
-			m_P3Buffer = new Vertex3F[m_NumVertices];
+			m_P3Buffer = NewAssetArray<Vertex3F>(m_NumVertices);
 			std::memcpy(m_P3Buffer, dataPtr, m_NumVertices*sizeof(Vertex3F));
 			break;
 		case VtxFormat::POS3_F32_NOR3_F32:
-			m_P3N3Buffer = new Vertex3F3F[m_NumVertices];
+			m_P3N3Buffer = NewAssetArray<Vertex3F3F>(m_NumVertices);
 			std::memcpy(m_P3N3Buffer, dataPtr, m_NumVertices*sizeof(Vertex3F3F));
 			break;
 		case VtxFormat::POS3_F32_NOR3_F32_UV2_F32:
-			m_P3N3T2Buffer = new Vertex3F3F2F[m_NumVertices];
+			m_P3N3T2Buffer = NewAssetArray<Vertex3F3F2F>(m_NumVertices);
 			std::memcpy(m_P3N3T2Buffer, dataPtr, m_NumVertices*sizeof(Vertex3F3F2F));
 			break;
 		default:
@@ -88,7 +93,10 @@ namespace k3d
 	Archive & operator >> (Archive &arch, MeshData &mesh)
 	{
 		//  arch.ArrayIn(MeshData::ClassName(), 64);
-		arch.ArrayOut(mesh.m_MeshName, 96);
+		char meshName[MeshData::kMeshNameLength] = { 0 };
+		arch.ArrayOut(meshName, MeshData::kMeshNameLength);
+		mesh.m_Name = Name(meshName, strnlen(meshName, MeshData::kMeshNameLength - 1));
+		mesh.m_NameStr = mesh.m_Name.CStr();
 		
 		arch >> mesh.m_VtxFmt;
 		arch >> mesh.m_PrimType;
@@ -102,7 +110,7 @@ namespace k3d
 
 		// IndexBuffer
 		if (mesh.m_NumIndices != 0) {
-			mesh.m_IndexData = new uint32[mesh.m_NumIndices];
+			mesh.m_IndexData = NewAssetArray<uint32>(mesh.m_NumIndices);
 			arch.ArrayOut(mesh.m_IndexData, mesh.m_NumIndices);
 		}
 
@@ -110,19 +118,19 @@ namespace k3d
 		if (mesh.m_NumVertices != 0) {
 			switch (mesh.m_VtxFmt) {
 			case VtxFormat::POS3_F32_NOR3_F32_UV2_F32:
-				mesh.m_P3N3T2Buffer = new Vertex3F3F2F[mesh.m_NumVertices];
+				mesh.m_P3N3T2Buffer = NewAssetArray<Vertex3F3F2F>(mesh.m_NumVertices);
 				arch.ArrayOut<Vertex3F3F2F>(mesh.m_P3N3T2Buffer, mesh.m_NumVertices);
 				break;
 			case VtxFormat::POS3_F32_NOR3_F32:
-				mesh.m_P3N3Buffer = new Vertex3F3F[mesh.m_NumVertices];
+				mesh.m_P3N3Buffer = NewAssetArray<Vertex3F3F>(mesh.m_NumVertices);
 				arch.ArrayOut<Vertex3F3F>(mesh.m_P3N3Buffer, mesh.m_NumVertices);			
 				break;
 			case VtxFormat::POS3_F32:
-				mesh.m_P3Buffer = new Vertex3F[mesh.m_NumVertices];
+				mesh.m_P3Buffer = NewAssetArray<Vertex3F>(mesh.m_NumVertices);
 				arch.ArrayOut<Vertex3F>(mesh.m_P3Buffer, mesh.m_NumVertices);
 				break;
 			case VtxFormat::POS4_F32:
-				mesh.m_P4Buffer = new Vertex4F[mesh.m_NumVertices];
+				mesh.m_P4Buffer = NewAssetArray<Vertex4F>(mesh.m_NumVertices);
 				arch.ArrayOut<Vertex4F>(mesh.m_P4Buffer, mesh.m_NumVertices);
 				break;
 			default:
@@ -135,8 +143,12 @@ namespace k3d
 
 	Archive & operator <<(Archive &arch, const MeshData &mesh)
 	{
-		arch.ArrayIn(MeshData::ClassName(), 64);
-		arch.ArrayIn(mesh.m_MeshName, 96);
+		char className[64] = { 0 };
+		strncpy(className, MeshData::ClassName(), 63);
+		arch.ArrayIn(className, 64);
+		char meshName[MeshData::kMeshNameLength] = { 0 };
+		strncpy(meshName, mesh.Name(), MeshData::kMeshNameLength - 1);
+		arch.ArrayIn(meshName, MeshData::kMeshNameLength);
 
 		arch << mesh.m_VtxFmt;
 		arch << mesh.m_PrimType;
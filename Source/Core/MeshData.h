@@ -5,6 +5,7 @@
 #include <Math/kMath.hpp>
 #include <Math/kGeometry.hpp>
 #include <Interface/IMesh.h>
+#include <KTL/Name.hpp>
 #include <sstream>
 
 #include "Bundle.h"
@@ -73,6 +74,7 @@ namespace k3d
 
 	class K3D_API MeshData : public IMesh {
 	public:
+		static const uint32 kMeshNameLength = 96;
 
 		MeshData();
 		~MeshData();
@@ -86,7 +88,8 @@ namespace k3d
 		}
 		void	SetMaterialID(uint32 matID) { m_MaterialID = matID; }
 
-		const char * Name() const {	return m_MeshName; }
+		const char * Name() const {	return m_NameStr; }
+		::k3d::Name	GetNameId() const { return m_Name; }
 		bool		IsLoaded() const { return m_IsLoaded; }
 
 		kMath::AABB GetBoundingBox() const override{ return kMath::AABB(m_MaxCorner, m_MinCorner); }
@@ -107,6 +110,12 @@ namespace k3d
 		void		SetVertexBuffer(void* dataPtr);
 		void		SetVertexNum(int num) { m_NumVertices = num; }
 
+		/// Bytes held by the vertex and index buffers
+		uint64		GetByteSize() const
+		{
+			return (uint64)GetVertexByteWidth(m_VtxFmt, m_NumVertices) + (uint64)m_NumIndices * sizeof(uint32);
+		}
+
 		std::string DumpMeshInfo() 
 		{
 			std::ostringstream meshInfo;
@@ -186,7 +195,9 @@ namespace k3d
 		MeshData& operator = (const MeshData &) = delete;
 
 		bool                    m_IsLoaded;
-		char                    m_MeshName[96];
+		::k3d::Name             m_Name;
+		/// m_Name.CStr(), interned strings never move
+		const char *            m_NameStr;
 				
 		// IndexBuffer
 		PrimType				m_PrimType;
@@ -6,6 +6,7 @@
 #include <KTL/String.hpp>
 #include <list>
 #include <algorithm>
+#include <atomic>
 #include <utility>
 #include <Config/OSHeaders.h>
 
@@ -22,6 +23,7 @@ namespace k3d
 #endif
 		std::unordered_map<String, ModuleRef> g_ModuleMap;
 		mutable bool g_IsInited = false;
+		std::atomic<uint32> g_Generation{ 0 };
 	};
 
 	ModuleManager GlobalModuleManager;
@@ -53,6 +55,7 @@ namespace k3d
 		if (!p->g_IsInited)
 			return;
 		p->g_ModuleMap[name] = module;
+		p->g_Generation++;
 	}
 
 	void ModuleManager::RemoveModule(const char * name)
@@ -60,6 +63,7 @@ namespace k3d
 		if (!p->g_IsInited)
 			return;
 		p->g_ModuleMap.erase(name);
+		p->g_Generation++;
 	}
 
 	bool ModuleManager::LoadModule(const char * moduleName)
@@ -76,6 +80,7 @@ namespace k3d
 			PFN_GetModule pFn = (PFN_GetModule)::GetProcAddress((HMODULE)hModule, entryFunction.CStr());
 			p->g_Win32ModuleMap[moduleName] = hModule;
 			p->g_ModuleMap[moduleName] = ModuleRef(pFn());
+			p->g_Generation++;
 			return true;
 		}
 #else
@@ -108,6 +113,7 @@ namespace k3d
             auto mod = fn();
 			//g_ModuleMap[moduleName] = mod;
 			p->g_ModuleMap.insert({moduleName, ModuleRef(mod)});
+			p->g_Generation++;
 			return true;
 		}
 #endif
@@ -130,6 +136,11 @@ namespace k3d
 		return nullptr;
 	}
 
+	uint32 ModuleManager::GetGeneration() const
+	{
+		return p->g_Generation.load();
+	}
+
 	ModuleManager::ModuleManager() : p(new ModuleManagerPrivate)
 	{
 		p->g_IsInited = true;
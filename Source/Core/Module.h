@@ -16,6 +16,9 @@ namespace k3d
 		void RemoveModule(const char * name);
 		bool LoadModule(const char * moduleName);
 		ModuleRef FindModule(const char * moduleName);
+		/// Changes whenever a module is added, loaded or removed, to cache
+		/// what FindModule returned
+		uint32 GetGeneration() const;
 
 		ModuleManager();
 
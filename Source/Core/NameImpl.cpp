@@ -0,0 +1,144 @@
+#include "Kaleido3D.h"
+#include <KTL/Name.hpp>
+#include "LogUtil.h"
+#include "Os.h"
+#include <atomic>
+
+K3D_COMMON_NS
+{
+	namespace
+	{
+		const uint32 kNumShards = 16;
+		const size_t kArenaBlockSize = 64 * 1024;
+
+		struct NameEntry
+		{
+			const char *	Str;
+			uint32			Length;
+		};
+
+		/// Sharded by ID to keep concurrent interning off a single lock,
+		/// characters live in append-only arena blocks so CStr() stays valid.
+		class NameTable
+		{
+		public:
+			NameTable() : m_Block(nullptr), m_BlockUsed(0), m_Count(0) {}
+
+			Name::IdType Intern(const char * str, size_t length)
+			{
+				Name::IdType id = Name::HashOf(str, length);
+				Shard & shard = m_Shards[id % kNumShards];
+				shard.Lock.Lock();
+				NameEntry * entry = shard.Names.FindValue(id);
+				if (entry)
+				{
+					if (entry->Length != length || memcmp(entry->Str, str, length) != 0)
+					{
+						KLOG(Error, Name, "Name collision: \"%s\" and \"%.*s\" (id=%llx).", entry->Str, (int)length, str, (unsigned long long)id);
+					}
+				}
+				else
+				{
+					shard.Names.Insert(id, NameEntry{ Store(str, length), (uint32)length });
+					m_Count++;
+				}
+				shard.Lock.UnLock();
+				return id;
+			}
+
+			bool Contains(Name::IdType id)
+			{
+				Shard & shard = m_Shards[id % kNumShards];
+				shard.Lock.Lock();
+				bool found = shard.Names.Contains(id);
+				shard.Lock.UnLock();
+				return found;
+			}
+
+			const char * Lookup(Name::IdType id)
+			{
+				Shard & shard = m_Shards[id % kNumShards];
+				shard.Lock.Lock();
+				NameEntry * entry = shard.Names.FindValue(id);
+				const char * str = entry ? entry->Str : "<unknown>";
+				shard.Lock.UnLock();
+				return str;
+			}
+
+			uint64 Count() const { return m_Count.load(std::memory_order_relaxed); }
+
+		private:
+			const char * Store(const char * str, size_t length)
+			{
+				size_t size = length + 1;
+				char * dst = nullptr;
+				m_ArenaLock.Lock();
+				if (size > kArenaBlockSize / 4)
+				{
+					dst = (char*)malloc(size);
+				}
+				else
+				{
+					if (!m_Block || m_BlockUsed + size > kArenaBlockSize)
+					{
+						m_Block = (char*)malloc(kArenaBlockSize);
+						m_BlockUsed = 0;
+					}
+					dst = m_Block + m_BlockUsed;
+					m_BlockUsed += size;
+				}
+				m_ArenaLock.UnLock();
+				memcpy(dst, str, length);
+				dst[length] = 0;
+				return dst;
+			}
+
+			struct Shard
+			{
+				Os::Mutex						Lock;
+				HashMap<Name::IdType, NameEntry>	Names;
+			};
+
+			Shard				m_Shards[kNumShards];
+			Os::Mutex			m_ArenaLock;
+			char *				m_Block;
+			size_t				m_BlockUsed;
+			std::atomic<uint64>	m_Count;
+		};
+
+		// never destroyed, names may be used by static destructors
+		NameTable & GetNameTable()
+		{
+			static NameTable * s_Table = new NameTable;
+			return *s_Table;
+		}
+	}
+
+	Name::Name(const char * str)
+		: m_Id(str && *str ? GetNameTable().Intern(str, strlen(str)) : 0)
+	{
+	}
+
+	Name::Name(const char * str, size_t length)
+		: m_Id(length ? GetNameTable().Intern(str, length) : 0)
+	{
+	}
+
+	Name Name::Find(const char * str)
+	{
+		if (!str || !*str)
+			return Name();
+		IdType id = HashOf(str, strlen(str));
+		return GetNameTable().Contains(id) ? Name(id, 0) : Name();
+	}
+
+	uint64 Name::Count()
+	{
+		return GetNameTable().Count();
+	}
+
+	const char * Name::CStr() const
+	{
+		return m_Id ? GetNameTable().Lookup(m_Id) : "None";
+	}
+}
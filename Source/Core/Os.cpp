@@ -1,15 +1,19 @@
 #include "Kaleido3D.h"
 #include "Os.h"
+#include "Sampler.h"
 
 #ifdef min
 #undef min
 #endif
 #include <algorithm>
 #include <regex>
+#include <mutex>
 #include "Utils/StringUtils.h"
 
 #if K3DPLATFORM_OS_WIN
 #include <process.h>
+#else
+#include <sys/uio.h>
 #endif
 
 namespace Os
@@ -74,7 +78,7 @@ namespace Os
 			return false;
 #else
 		m_fd = ::open(fileName,
-                      flag == IORead ? O_RDONLY : (O_WRONLY | O_CREAT),
+                      flag == IORead ? O_RDONLY : (O_WRONLY | O_CREAT | O_TRUNC),
                       S_IRWXU);
         if (m_fd < 0)
         {
@@ -170,6 +174,52 @@ namespace Os
 #endif
 	}
 
+	size_t File::ReadAt(void *data, size_t len, uint64 offset)
+	{
+#if K3DPLATFORM_OS_WIN
+		if (m_hFile == NULL || m_hFile == INVALID_HANDLE_VALUE)
+			return size_t(-1);
+		size_t totalRead = 0;
+		while (totalRead < len)
+		{
+			OVERLAPPED overlapped = {};
+			uint64 position = offset + totalRead;
+			overlapped.Offset = (DWORD)position;
+			overlapped.OffsetHigh = (DWORD)(position >> 32);
+			DWORD blockSize = (DWORD)std::min<size_t>(len - totalRead, 32 * (1 << 20));
+			DWORD bytesRead = 0;
+			if (!::ReadFile(m_hFile, (char*)data + totalRead, blockSize, &bytesRead, &overlapped))
+			{
+				if (::GetLastError() == ERROR_HANDLE_EOF)
+					break;
+				return totalRead ? totalRead : size_t(-1);
+			}
+			if (bytesRead == 0)
+				break;
+			totalRead += bytesRead;
+		}
+		return totalRead;
+#else
+		if (m_fd < 0)
+			return size_t(-1);
+		size_t totalRead = 0;
+		while (totalRead < len)
+		{
+			ssize_t bytesRead = ::pread(m_fd, (char*)data + totalRead, len - totalRead, (off_t)(offset + totalRead));
+			if (bytesRead < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return totalRead ? totalRead : size_t(-1);
+			}
+			if (bytesRead == 0)
+				break;
+			totalRead += (size_t)bytesRead;
+		}
+		return totalRead;
+#endif
+	}
+
 	size_t File::Write(const void *data, size_t len)
 	{
 		size_t written = 0;
@@ -183,6 +233,72 @@ namespace Os
 		return written;
 	}
 
+	size_t File::WriteV(const IOVec *vecs, uint32 count)
+	{
+		size_t written = 0;
+#ifdef K3DPLATFORM_OS_WIN
+		for (uint32 i = 0; i < count; i++)
+		{
+			const char * data = (const char*)vecs[i].Data;
+			size_t remain = vecs[i].Size;
+			while (remain > 0)
+			{
+				DWORD blockSize = (DWORD)std::min<size_t>(remain, 32 * (1 << 20));
+				DWORD blockWritten = 0;
+				if (!WriteFile(m_hFile, data, blockSize, &blockWritten, NULL) || blockWritten == 0)
+				{
+					m_CurOffset += written;
+					return written;
+				}
+				data += blockWritten;
+				remain -= blockWritten;
+				written += blockWritten;
+			}
+		}
+#else
+		const uint32 kMaxBatch = 1024; // IOV_MAX on Linux
+		struct iovec iov[kMaxBatch];
+		uint32 next = 0;
+		size_t skip = 0; // already written part of vecs[next]
+		while (next < count)
+		{
+			uint32 n = 0;
+			for (uint32 i = next; i < count && n < kMaxBatch; i++)
+			{
+				size_t start = i == next ? skip : 0;
+				if (vecs[i].Size == start)
+					continue;
+				iov[n].iov_base = (char*)vecs[i].Data + start;
+				iov[n].iov_len = vecs[i].Size - start;
+				n++;
+			}
+			if (n == 0)
+				break;
+			ssize_t result = ::writev(m_fd, iov, (int)n);
+			if (result < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (result == 0)
+				break;
+			written += (size_t)result;
+			// advance past the fully written buffers
+			size_t advance = (size_t)result;
+			while (next < count && advance >= vecs[next].Size - skip)
+			{
+				advance -= vecs[next].Size - skip;
+				skip = 0;
+				next++;
+			}
+			skip += advance;
+		}
+#endif
+		m_CurOffset += written;
+		return written;
+	}
+
 	bool File::Seek(size_t offset)
 	{
 #if K3DPLATFORM_OS_WIN
@@ -215,18 +331,34 @@ namespace Os
 			m_hFile = NULL;
 		}
 #else
-		if (m_fd) ::close(m_fd);
+		if (m_fd >= 0)
+		{
+			::close(m_fd);
+			m_fd = -1;
+		}
 #endif
 	}
 
+#if !K3DPLATFORM_OS_WIN
+	static uint64 ModifiedTime(struct stat const & st)
+	{
+#if K3DPLATFORM_OS_MAC
+		return (uint64)st.st_mtimespec.tv_sec * 1000000000ull + (uint64)st.st_mtimespec.tv_nsec;
+#else
+		return (uint64)st.st_mtim.tv_sec * 1000000000ull + (uint64)st.st_mtim.tv_nsec;
+#endif
+	}
+#endif
+
 	uint64 File::LastModified() const
 	{
 #if K3DPLATFORM_OS_WIN
 		FILETIME FileTime = {};
 		GetFileTime(m_hFile, nullptr, nullptr, &FileTime);
-		return FileTime.dwLowDateTime;
+		return ((uint64)FileTime.dwHighDateTime << 32) | FileTime.dwLowDateTime;
 #else 
-		return uint64();
+		struct stat st;
+		return fstat(m_fd, &st) == 0 ? ModifiedTime(st) : 0;
 #endif
 	}
 
@@ -285,7 +417,11 @@ namespace Os
 		if (st.st_size == 0) return false;
 
 		m_pData = (unsigned char*)mmap(NULL, m_szFile, PROT_READ, MAP_PRIVATE, m_Fd, 0);
-		if (m_pData == MAP_FAILED) return false;
+		if (m_pData == MAP_FAILED)
+		{
+			m_pData = NULL;
+			return false;
+		}
 #endif
 		m_pCur = m_pData;
 		return true;
@@ -363,9 +499,16 @@ namespace Os
 			m_FileMappingHandle = NULL;
 		}
 #else
-		// TODO : need fix
-		munmap(m_pData, m_szFile);
-		close(m_Fd);
+		if (m_pData)
+		{
+			munmap(m_pData, m_szFile);
+			m_pData = NULL;
+		}
+		if (m_Fd >= 0)
+		{
+			close(m_Fd);
+			m_Fd = -1;
+		}
 #endif
 	}
 
@@ -399,7 +542,20 @@ namespace Os
 #if K3DPLATFORM_OS_WIN
 		return TRUE == PathFileExistsW(name);
 #else
-		return false;
+		return access(name, F_OK) == 0;
+#endif
+	}
+
+	uint64 LastModified(const ::k3d::kchar * name)
+	{
+#if K3DPLATFORM_OS_WIN
+		WIN32_FILE_ATTRIBUTE_DATA data = {};
+		if (!GetFileAttributesExW(name, GetFileExInfoStandard, &data))
+			return 0;
+		return ((uint64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+		struct stat st;
+		return stat(name, &st) == 0 ? ModifiedTime(st) : 0;
 #endif
 	}
 
@@ -412,6 +568,15 @@ namespace Os
 #endif
 	}
 
+	bool Rename(const ::k3d::kchar * src, const ::k3d::kchar * target)
+	{
+#if K3DPLATFORM_OS_WIN
+		return TRUE == MoveFileExW(src, target, MOVEFILE_REPLACE_EXISTING);
+#else
+		return rename(src, target) == 0;
+#endif
+	}
+
 	bool Remove(const::k3d::kchar * lpszDir)
 	{
 #if K3DPLATFORM_OS_WIN
@@ -597,6 +762,13 @@ namespace Os
 			EnterCriticalSection(&CS);
 #else
 			pthread_mutex_lock(&mMutex);
+#endif
+		}
+		bool TryLock() {
+#if K3DPLATFORM_OS_WIN
+			return TryEnterCriticalSection(&CS) != FALSE;
+#else
+			return pthread_mutex_trylock(&mMutex) == 0;
 #endif
 		}
 		void UnLock() {
@@ -623,6 +795,11 @@ namespace Os
 		m_Impl->Lock();
 	}
 
+	bool Mutex::TryLock()
+	{
+		return m_Impl->TryLock();
+	}
+
 	void Mutex::UnLock()
 	{
 		m_Impl->UnLock();
@@ -653,7 +830,23 @@ namespace Os
 #if K3DPLATFORM_OS_WIN
 			::SleepConditionVariableCS(&CV, &(mutex->CS), time);
 #else
-			pthread_cond_wait(&mCond, &mutex->mMutex);
+			if (time == 0xffffffff)
+			{
+				pthread_cond_wait(&mCond, &mutex->mMutex);
+			}
+			else
+			{
+				timespec ts;
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += time / 1000;
+				ts.tv_nsec += (time % 1000) * 1000000;
+				if (ts.tv_nsec >= 1000000000)
+				{
+					ts.tv_sec += 1;
+					ts.tv_nsec -= 1000000000;
+				}
+				pthread_cond_timedwait(&mCond, &mutex->mMutex, &ts);
+			}
 #endif
 		}
 		void Notify() {
@@ -705,6 +898,8 @@ namespace Os
 
 #define DEFAULT_THREAD_STACK_SIZE 2048
 	std::map<uint32, Thread*> Thread::s_ThreadMap;
+	/// Threads register themselves while others look their name up
+	static std::mutex s_ThreadMapLock;
 
 	Thread::Thread(std::string const & name, ThreadPriority priority)
 		: m_ThreadName(name)
@@ -755,6 +950,14 @@ namespace Os
 
 	Thread::~Thread()
 	{
+		std::lock_guard<std::mutex> lock(s_ThreadMapLock);
+		for (auto it = s_ThreadMap.begin(); it != s_ThreadMap.end();)
+		{
+			if (it->second == this)
+				it = s_ThreadMap.erase(it);
+			else
+				++it;
+		}
 	}
 
 	void Thread::SetPriority(ThreadPriority prio)
@@ -769,7 +972,7 @@ namespace Os
 		{
 			m_ThreadHandle = ::CreateThread(nullptr, m_StackSize, reinterpret_cast<LPTHREAD_START_ROUTINE>(Run), reinterpret_cast<LPVOID>(/*&std::make_shared<Thread>*/(this)), 0, nullptr);
 			{
-				Mutex::AutoLock lock;
+				std::lock_guard<std::mutex> lock(s_ThreadMapLock);
 				DWORD tid = ::GetThreadId(m_ThreadHandle);
 				s_ThreadMap[tid] = this;
 			}
@@ -785,6 +988,7 @@ namespace Os
 #if K3DPLATFORM_OS_ANDROID
 			pthread_setname_np((pthread_t)m_ThreadHandle, m_ThreadName.c_str());
 #endif
+			std::lock_guard<std::mutex> lock(s_ThreadMapLock);
 			s_ThreadMap[(uint64)m_ThreadHandle] = this;
 		}
 #endif
@@ -824,8 +1028,10 @@ namespace Os
 	std::string  Thread::GetCurrentThreadName() {
 #if K3DPLATFORM_OS_WIN
 		uint32 tid = (uint32)::GetCurrentThreadId();
-		if (s_ThreadMap[tid] != nullptr) {
-			return s_ThreadMap[tid]->GetName();
+		std::lock_guard<std::mutex> lock(s_ThreadMapLock);
+		auto thread = s_ThreadMap.find(tid);
+		if (thread != s_ThreadMap.end() && thread->second != nullptr) {
+			return thread->second->GetName();
 		}
 
 		return "Anonymous Thread";
@@ -835,8 +1041,10 @@ namespace Os
 		return name;
 #else
 		pthread_t tid = pthread_self();
-		if (s_ThreadMap[reinterpret_cast<uint64>(tid)] != nullptr) {
-			return s_ThreadMap[reinterpret_cast<uint64>(tid)]->GetName();
+		std::lock_guard<std::mutex> lock(s_ThreadMapLock);
+		auto thread = s_ThreadMap.find((uint32)reinterpret_cast<uint64>(tid));
+		if (thread != s_ThreadMap.end() && thread->second != nullptr) {
+			return thread->second->GetName();
 		}
 
 		return "Anonymous Thread";
@@ -852,8 +1060,18 @@ namespace Os
 		Thread* thr = reinterpret_cast<Thread*>(data);
 		if (thr != nullptr)
 		{
-			Call call = thr->m_ThreadCallBack;
-			call();
+			{
+				// before Start returns, the thread may ask for its name right away
+				std::lock_guard<std::mutex> lock(s_ThreadMapLock);
+#if K3DPLATFORM_OS_WIN
+				s_ThreadMap[(uint32)::GetCurrentThreadId()] = thr;
+#else
+				s_ThreadMap[(uint32)reinterpret_cast<uint64>(pthread_self())] = thr;
+#endif
+			}
+			::k3d::Sampler::RegisterCurrentThread(thr->m_ThreadName.c_str());
+			thr->m_ThreadCallBack();
+			::k3d::Sampler::UnregisterCurrentThread();
 			thr->m_ThreadStatus = ThreadStatus::Finish;
 #if K3DPLATFORM_OS_WIN
 			::ExitThread(0);
@@ -3,9 +3,11 @@
 
 #include <Interface/IIODevice.h>
 #include <Config/OSHeaders.h>
+#include <KTL/InplaceFunction.hpp>
 
 #include <functional>
 #include <map>
+#include <memory>
 
 /**
  * This module provides facilities on OS like:
@@ -13,6 +15,13 @@
  */
 namespace Os
 {
+	/// One buffer of a gathered write
+	struct IOVec
+	{
+		const void *	Data;
+		size_t			Size;
+	};
+
 	class K3D_API File : public ::IIODevice
 	{
 	public:
@@ -32,6 +41,12 @@ namespace Os
 
 		size_t    Read(char *ptr, size_t len);
 		size_t    Write(const void *ptr, size_t len);
+		/// Positional read, leaves the file pointer alone and may be
+		/// called from several threads at once, returns size_t(-1) on error
+		size_t    ReadAt(void *ptr, size_t len, uint64 offset);
+		/// Gathered write of count buffers at the file pointer, retries
+		/// partial writes, returns the bytes written
+		size_t    WriteV(const IOVec *vecs, uint32 count);
 
 		bool      Seek(size_t offset);
 		bool      Skip(size_t offset);
@@ -39,8 +54,15 @@ namespace Os
 		void      Flush();
 		void      Close();
 
+		/// Platform ticks (100ns on Windows, ns elsewhere), 0 on failure
 		uint64    LastModified() const;
 
+#ifdef K3DPLATFORM_OS_WIN
+		HANDLE    GetNativeHandle() const { return m_hFile; }
+#else
+		int       GetNativeHandle() const { return m_fd; }
+#endif
+
 		static File * CreateIOInterface();
 
 	private:
@@ -80,6 +102,7 @@ namespace Os
 		/// \brief FileData
 		/// \return data const pointer
 		kByte* FileData() { return m_pData; }
+		const kByte* FileData() const { return m_pData; }
 
 		template <class T>
 		/// Convert FileBlocks To Class
@@ -115,8 +138,12 @@ namespace Os
     extern K3D_API int Exec(const ::k3d::kchar * cmd, ::k3d::kchar *const *argv);
 	extern K3D_API bool MakeDir(const ::k3d::kchar * name);
 	extern K3D_API bool Exists(const ::k3d::kchar * name);
+	/// File::LastModified of a path, 0 if missing
+	extern K3D_API uint64 LastModified(const ::k3d::kchar * name);
 	extern K3D_API void Sleep(uint32 ms);
 	extern K3D_API bool Copy(const ::k3d::kchar * src, const ::k3d::kchar * target);
+	/// Replaces target if it exists
+	extern K3D_API bool Rename(const ::k3d::kchar * src, const ::k3d::kchar * target);
 	extern K3D_API bool Remove(const ::k3d::kchar * name);
 	typedef void(*PFN_FileProcessRoutine)(const ::k3d::kchar * path, bool isDir);
 	extern K3D_API bool ListFiles(const ::k3d::kchar * srcPath, PFN_FileProcessRoutine);
@@ -146,6 +173,8 @@ namespace Os
 		~Mutex();
 
 		void Lock();
+		/// \return false if another thread holds it
+		bool TryLock();
 		void UnLock();
 		friend class ConditionVariable;
 
@@ -201,6 +230,9 @@ namespace Os
 		ConditionVariablePrivate * m_Impl;
 	};
 
+	/// Thread
+	/// The thread function is stored inline when it fits in 64 bytes,
+	/// larger callables are moved to the heap once, at construction.
 	class K3D_API Thread {
 	public:
 		// static functions
@@ -210,13 +242,23 @@ namespace Os
 
 	public:
 		typedef void * Handle;
-		typedef std::function<void()> Call;
+		static const size_t kCallCapacity = 64;
+		typedef ::k3d::InplaceFunction<void(), kCallCapacity> Call;
 
 		Thread();
 
 		explicit		Thread(std::string const & name, ThreadPriority priority = ThreadPriority::Normal);
 		explicit		Thread(Call && callback, std::string const & name, ThreadPriority priority = ThreadPriority::Normal);
 
+		template <typename TFun, typename = typename std::enable_if<
+			!std::is_same<typename std::decay<TFun>::type, Call>::value>::type>
+		Thread(TFun && callback, std::string const & name, ThreadPriority priority = ThreadPriority::Normal)
+			: Thread(MakeCall(std::forward<TFun>(callback), std::integral_constant<bool,
+				sizeof(typename std::decay<TFun>::type) <= kCallCapacity &&
+				alignof(typename std::decay<TFun>::type) <= alignof(std::max_align_t)>()), name, priority)
+		{
+		}
+
 		virtual			~Thread();
 
 		void			SetPriority(ThreadPriority prio);
@@ -244,6 +286,19 @@ namespace Os
 		static void* STD_CALL Run(void*);
 		static std::map<uint32, Thread*>	s_ThreadMap;
 
+		template <typename TFun>
+		static Call MakeCall(TFun && callback, std::true_type)
+		{
+			return Call(std::forward<TFun>(callback));
+		}
+
+		template <typename TFun>
+		static Call MakeCall(TFun && callback, std::false_type)
+		{
+			auto boxed = std::make_shared<typename std::decay<TFun>::type>(std::forward<TFun>(callback));
+			return Call([boxed]() { (*boxed)(); });
+		}
+
 	};
 
 	class SockImpl;
@@ -0,0 +1,596 @@
+#include "Kaleido3D.h"
+#include "Profiler.h"
+#include "LogUtil.h"
+#include <KTL/Archive.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define K3D_PROFILER_RDTSC 1
+#if K3DPLATFORM_OS_WIN
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define K3D_PROFILER_RDTSC 0
+#endif
+
+namespace k3d
+{
+	namespace
+	{
+		uint64 SteadyNanoseconds()
+		{
+			return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/// The invariant TSC of current x86 parts runs at a fixed rate and is
+		/// synchronized across cores
+		inline uint64 ReadTicks()
+		{
+#if K3D_PROFILER_RDTSC
+			return __rdtsc();
+#else
+			return SteadyNanoseconds();
+#endif
+		}
+
+		struct ZoneEvent
+		{
+			const char *	Name;
+			uint64			Begin;
+			uint64			End;
+			uint32			Depth;
+		};
+
+		/// Zones closed by one thread, which alone writes Head. The
+		/// collector reads up to Head and moves Tail.
+		struct ZoneRing
+		{
+			static const uint32 Capacity = 8192;
+
+			ZoneEvent			Events[Capacity];
+			std::atomic<uint32>	Head;
+			std::atomic<uint32>	Tail;
+			/// The thread is gone, free once collected
+			std::atomic<bool>	Retired;
+			uint32				Thread;
+		};
+
+		/// Retires the ring of a thread when it exits
+		struct RingHolder
+		{
+			ZoneRing * Ring = nullptr;
+			~RingHolder()
+			{
+				if (Ring)
+					Ring->Retired.store(true, std::memory_order_release);
+			}
+		};
+
+		thread_local RingHolder t_Ring;
+		thread_local uint32 t_Depth = 0;
+
+		/// A capture or the stream is on, apart from the state so that zones
+		/// do not create it
+		std::atomic<bool> g_Recording(false);
+
+		/// A streamed frame stays under the size of a log record
+		const size_t kMaxStreamMessage = 1800;
+
+		void AppendJsonString(std::string & out, const char * text)
+		{
+			out += '"';
+			for (const char * c = text; *c; c++)
+			{
+				if (*c == '"' || *c == '\\')
+					out += '\\';
+				if ((unsigned char)*c >= 0x20)
+					out += *c;
+			}
+			out += '"';
+		}
+
+		class ProfilerState
+		{
+		public:
+			static ProfilerState & Get()
+			{
+				static ProfilerState * state = new ProfilerState;
+				return *state;
+			}
+
+			ZoneRing * CreateRing()
+			{
+				ZoneRing * ring = new ZoneRing;
+				ring->Head.store(0, std::memory_order_relaxed);
+				ring->Tail.store(0, std::memory_order_relaxed);
+				ring->Retired.store(false, std::memory_order_relaxed);
+				std::string name = Os::Thread::GetCurrentThreadName();
+				Lock.Lock();
+				ring->Thread = (uint32)ThreadNames.size();
+				ThreadNames.push_back(name);
+				Rings.push_back(ring);
+				Lock.UnLock();
+				return ring;
+			}
+
+			void UpdateRecording()
+			{
+				g_Recording.store(Capturing || StreamEvery != 0, std::memory_order_relaxed);
+			}
+
+			/// The longer the baseline, the closer the estimate
+			void Recalibrate()
+			{
+#if K3D_PROFILER_RDTSC
+				uint64 ticks = ReadTicks();
+				uint64 ns = SteadyNanoseconds();
+				if (ticks > BaseTicks && ns > BaseNs + 50000000)
+					NsPerTick.store((double)(ns - BaseNs) / (double)(ticks - BaseTicks), std::memory_order_relaxed);
+#endif
+			}
+
+			uint64 ToCapture(uint64 ticks) const
+			{
+				return ticks > CaptureBegin ? Profiler::TicksToNanoseconds(ticks - CaptureBegin) : 0;
+			}
+
+			uint32 NameIndex(const char * name)
+			{
+				auto found = NamesByAddress.find(name);
+				if (found != NamesByAddress.end())
+					return found->second;
+				// the same text at another address, __func__ of an inline function
+				auto text = NamesByText.find(name);
+				uint32 index = 0;
+				if (text != NamesByText.end())
+				{
+					index = text->second;
+				}
+				else
+				{
+					index = (uint32)Current.Names.size();
+					Current.Names.push_back(name);
+					NamesByText.emplace(name, index);
+				}
+				NamesByAddress.emplace(name, index);
+				return index;
+			}
+
+			/// Empties the rings into the capture and the streamed frame
+			void Collect(bool stream)
+			{
+				for (size_t r = 0; r < Rings.size();)
+				{
+					ZoneRing * ring = Rings[r];
+					bool retired = ring->Retired.load(std::memory_order_acquire);
+					uint32 tail = ring->Tail.load(std::memory_order_relaxed);
+					uint32 head = ring->Head.load(std::memory_order_acquire);
+					for (uint32 i = tail; i != head; i++)
+					{
+						ZoneEvent const & event = ring->Events[i % ZoneRing::Capacity];
+						if (Capturing && event.End > CaptureBegin)
+						{
+							uint64 begin = ToCapture(event.Begin);
+							Current.Zones.push_back({ NameIndex(event.Name), ring->Thread, event.Depth,
+								begin, ToCapture(event.End) - begin });
+						}
+						if (stream)
+						{
+							Streamed.push_back(event);
+							StreamedThreads.push_back(ring->Thread);
+						}
+					}
+					ring->Tail.store(head, std::memory_order_release);
+					if (retired && head == ring->Head.load(std::memory_order_acquire))
+					{
+						delete ring;
+						Rings.erase(Rings.begin() + r);
+						continue;
+					}
+					r++;
+				}
+			}
+
+			/// One ProfileFrame message, then ProfileZones per thread in
+			/// pieces small enough for a log record
+			void BuildStream(uint64 frameBegin, uint64 frameEnd, std::vector<std::pair<const char*, std::string>> & messages)
+			{
+				char item[256];
+				std::vector<uint32> threads(StreamedThreads);
+				std::sort(threads.begin(), threads.end());
+				threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+				std::string frame;
+				snprintf(item, sizeof(item), "{\"Frame\":%llu,\"Duration\":%.1f,\"Threads\":[",
+					(unsigned long long)FrameIndex, Profiler::TicksToNanoseconds(frameEnd - frameBegin) / 1000.0);
+				frame += item;
+				for (size_t t = 0; t < threads.size(); t++)
+				{
+					if (t)
+						frame += ',';
+					AppendJsonString(frame, ThreadNames[threads[t]].c_str());
+				}
+				frame += "]}";
+				messages.emplace_back("ProfileFrame", frame);
+
+				for (uint32 thread : threads)
+				{
+					std::string zones;
+					for (size_t i = 0; i < Streamed.size(); i++)
+					{
+						if (StreamedThreads[i] != thread)
+							continue;
+						if (zones.size() > kMaxStreamMessage)
+						{
+							zones += "]}";
+							messages.emplace_back("ProfileZones", zones);
+							zones.clear();
+						}
+						if (zones.empty())
+						{
+							snprintf(item, sizeof(item), "{\"Frame\":%llu,\"Thread\":", (unsigned long long)FrameIndex);
+							zones = item;
+							AppendJsonString(zones, ThreadNames[thread].c_str());
+							zones += ",\"Zones\":[";
+						}
+						else
+						{
+							zones += ',';
+						}
+						ZoneEvent const & event = Streamed[i];
+						// microseconds from the start of the frame, may be negative
+						// for zones that began in an earlier frame
+						zones += '[';
+						AppendJsonString(zones, event.Name);
+						snprintf(item, sizeof(item), ",%.1f,%.1f,%u]",
+							((double)event.Begin - (double)frameBegin) * NsPerTick.load(std::memory_order_relaxed) / 1000.0,
+							Profiler::TicksToNanoseconds(event.End - event.Begin) / 1000.0, event.Depth);
+						zones += item;
+					}
+					if (!zones.empty())
+					{
+						zones += "]}";
+						messages.emplace_back("ProfileZones", zones);
+					}
+				}
+			}
+
+			std::atomic<double>		NsPerTick;
+			std::atomic<uint64>		Dropped;
+			std::atomic<uint64>		FrameIndex;
+
+			/// Guards what follows
+			Os::Mutex				Lock;
+			std::vector<ZoneRing*>	Rings;
+			std::vector<std::string> ThreadNames;
+			uint64					BaseTicks;
+			uint64					BaseNs;
+			uint64					FrameBegin;
+
+			bool					Capturing;
+			uint64					CaptureBegin;
+			uint64					CaptureDropped;
+			ProfileCapture			Current;
+			std::unordered_map<const char*, uint32>	NamesByAddress;
+			std::unordered_map<std::string, uint32>	NamesByText;
+
+			uint32					StreamEvery;
+			std::vector<ZoneEvent>	Streamed;
+			std::vector<uint32>		StreamedThreads;
+
+		private:
+			ProfilerState()
+				: NsPerTick(1.0), Dropped(0), FrameIndex(0)
+				, Capturing(false), CaptureBegin(0), CaptureDropped(0), StreamEvery(0)
+			{
+				BaseTicks = ReadTicks();
+				BaseNs = SteadyNanoseconds();
+				FrameBegin = BaseTicks;
+#if K3D_PROFILER_RDTSC
+				// a first estimate, refined on every frame
+				uint64 ns = BaseNs;
+				while (ns < BaseNs + 2000000)
+					ns = SteadyNanoseconds();
+				NsPerTick.store((double)(ns - BaseNs) / (double)(ReadTicks() - BaseTicks), std::memory_order_relaxed);
+#endif
+			}
+		};
+	}
+
+	uint64 Profiler::Now()
+	{
+		return ReadTicks();
+	}
+
+	uint64 Profiler::TicksToNanoseconds(uint64 ticks)
+	{
+#if K3D_PROFILER_RDTSC
+		return (uint64)((double)ticks * ProfilerState::Get().NsPerTick.load(std::memory_order_relaxed));
+#else
+		return ticks;
+#endif
+	}
+
+	uint64 Profiler::Enter()
+	{
+		if (!g_Recording.load(std::memory_order_relaxed))
+			return 0;
+		t_Depth++;
+		return ReadTicks();
+	}
+
+	void Profiler::Leave(const char * name, uint64 begin)
+	{
+		uint64 end = ReadTicks();
+		uint32 depth = --t_Depth;
+		ZoneRing * ring = t_Ring.Ring;
+		if (!ring)
+			ring = t_Ring.Ring = ProfilerState::Get().CreateRing();
+		uint32 head = ring->Head.load(std::memory_order_relaxed);
+		if (head - ring->Tail.load(std::memory_order_acquire) >= ZoneRing::Capacity)
+		{
+			ProfilerState::Get().Dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		ZoneEvent & event = ring->Events[head % ZoneRing::Capacity];
+		event.Name = name;
+		event.Begin = begin;
+		event.End = end;
+		event.Depth = depth;
+		ring->Head.store(head + 1, std::memory_order_release);
+	}
+
+	void Profiler::MarkFrame()
+	{
+		ProfilerState & state = ProfilerState::Get();
+		uint64 now = ReadTicks();
+		std::vector<std::pair<const char*, std::string>> messages;
+		state.Lock.Lock();
+		state.Recalibrate();
+		uint64 index = state.FrameIndex.load(std::memory_order_relaxed);
+		bool stream = state.StreamEvery != 0 && index % state.StreamEvery == 0;
+		state.Collect(stream);
+		if (state.Capturing)
+		{
+			uint64 begin = state.ToCapture(state.FrameBegin);
+			state.Current.Frames.push_back({ index, begin, state.ToCapture(now) - begin });
+		}
+		if (stream)
+		{
+			state.BuildStream(state.FrameBegin, now, messages);
+			state.Streamed.clear();
+			state.StreamedThreads.clear();
+		}
+		state.FrameBegin = now;
+		state.FrameIndex.store(index + 1, std::memory_order_relaxed);
+		state.Lock.UnLock();
+
+		for (auto const & message : messages)
+			Log(ELogLevel::Profile, message.first, "%s", message.second.c_str());
+	}
+
+	uint64 Profiler::GetFrameIndex()
+	{
+		return ProfilerState::Get().FrameIndex.load(std::memory_order_relaxed);
+	}
+
+	void Profiler::StartCapture()
+	{
+		ProfilerState & state = ProfilerState::Get();
+		state.Lock.Lock();
+		if (!state.Capturing)
+		{
+			// zones closed before the capture are not part of it
+			state.Collect(false);
+			state.Capturing = true;
+			state.CaptureBegin = ReadTicks();
+			state.CaptureDropped = state.Dropped.load(std::memory_order_relaxed);
+			state.Current = ProfileCapture();
+			state.NamesByAddress.clear();
+			state.NamesByText.clear();
+			state.UpdateRecording();
+		}
+		state.Lock.UnLock();
+	}
+
+	void Profiler::StopCapture(ProfileCapture & capture)
+	{
+		ProfilerState & state = ProfilerState::Get();
+		state.Lock.Lock();
+		if (state.Capturing)
+		{
+			state.Collect(false);
+			state.Capturing = false;
+			state.UpdateRecording();
+			state.Current.Threads = state.ThreadNames;
+			state.Current.Dropped = state.Dropped.load(std::memory_order_relaxed) - state.CaptureDropped;
+			capture = std::move(state.Current);
+			state.Current = ProfileCapture();
+		}
+		state.Lock.UnLock();
+	}
+
+	bool Profiler::IsCapturing()
+	{
+		ProfilerState & state = ProfilerState::Get();
+		state.Lock.Lock();
+		bool capturing = state.Capturing;
+		state.Lock.UnLock();
+		return capturing;
+	}
+
+	void Profiler::SetStreaming(uint32 everyNthFrame)
+	{
+		ProfilerState & state = ProfilerState::Get();
+		state.Lock.Lock();
+		state.StreamEvery = everyNthFrame;
+		state.UpdateRecording();
+		state.Lock.UnLock();
+	}
+
+	bool ProfileCapture::SaveChromeTrace(const char * path) const
+	{
+		Os::File file;
+		if (!file.Open(path, IOWrite))
+			return false;
+		bool ok = true;
+		{
+			BufferedArchive ar(&file, 64 * 1024);
+			std::string line;
+			char item[128];
+			auto emit = [&ar, &line, &ok]()
+			{
+				ok = ok && ar.WriteBytes(line.data(), line.size()) == line.size();
+				line.clear();
+			};
+
+			line = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+				"{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"thread_name\",\"args\":{\"name\":\"Frames\"}}";
+			emit();
+			for (size_t t = 0; t < Threads.size(); t++)
+			{
+				snprintf(item, sizeof(item), ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", (uint32)t + 1);
+				line = item;
+				AppendJsonString(line, Threads[t].c_str());
+				line += "}}";
+				emit();
+			}
+			for (Frame const & frame : Frames)
+			{
+				snprintf(item, sizeof(item), ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":0,\"name\":\"Frame %llu\",\"ts\":%.3f,\"dur\":%.3f}",
+					(unsigned long long)frame.Index, frame.Begin / 1000.0, frame.Duration / 1000.0);
+				line = item;
+				emit();
+			}
+			for (Zone const & zone : Zones)
+			{
+				line = ",\n{\"ph\":\"X\",\"pid\":1,\"name\":";
+				AppendJsonString(line, zone.Name < Names.size() ? Names[zone.Name].c_str() : "");
+				snprintf(item, sizeof(item), ",\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					zone.Thread + 1, zone.Begin / 1000.0, zone.Duration / 1000.0);
+				line += item;
+				emit();
+			}
+			line = "\n]}\n";
+			emit();
+			ok = ar.FlushWrites() && ok;
+		}
+		file.Close();
+		return ok;
+	}
+
+	namespace
+	{
+		const uint32 kCaptureMagic = 0x4350334B; // K3PC
+		const uint32 kCaptureVersion = 1;
+
+		bool WriteStrings(Archive & ar, std::vector<std::string> const & strings)
+		{
+			uint32 count = (uint32)strings.size();
+			bool ok = ar.WriteBytes(&count, sizeof(count)) == sizeof(count);
+			for (auto const & text : strings)
+			{
+				uint32 length = (uint32)text.size();
+				ok = ok && ar.WriteBytes(&length, sizeof(length)) == sizeof(length)
+					&& ar.WriteBytes(text.data(), length) == length;
+			}
+			return ok;
+		}
+
+		bool ReadStrings(Archive & ar, std::vector<std::string> & strings)
+		{
+			uint32 count = 0;
+			if (ar.ReadBytes(&count, sizeof(count)) != sizeof(count))
+				return false;
+			strings.clear();
+			for (uint32 i = 0; i < count; i++)
+			{
+				uint32 length = 0;
+				if (ar.ReadBytes(&length, sizeof(length)) != sizeof(length) || length > 65536)
+					return false;
+				std::string text(length, '\0');
+				if (length && ar.ReadBytes(&text[0], length) != length)
+					return false;
+				strings.push_back(std::move(text));
+			}
+			return true;
+		}
+	}
+
+	bool ProfileCapture::Save(const char * path) const
+	{
+		Os::File file;
+		if (!file.Open(path, IOWrite))
+			return false;
+		bool ok = true;
+		{
+			BufferedArchive ar(&file, 64 * 1024);
+			auto write = [&ar](void const * data, size_t size) { return ar.WriteBytes(data, size) == size; };
+			uint32 frames = (uint32)Frames.size();
+			uint32 zones = (uint32)Zones.size();
+			ok = write(&kCaptureMagic, sizeof(kCaptureMagic)) && write(&kCaptureVersion, sizeof(kCaptureVersion))
+				&& write(&Dropped, sizeof(Dropped))
+				&& WriteStrings(ar, Names) && WriteStrings(ar, Threads)
+				&& write(&frames, sizeof(frames));
+			for (Frame const & frame : Frames)
+			{
+				ok = ok && write(&frame.Index, sizeof(frame.Index)) && write(&frame.Begin, sizeof(frame.Begin))
+					&& write(&frame.Duration, sizeof(frame.Duration));
+			}
+			// 28 bytes a zone, no padding
+			ok = ok && write(&zones, sizeof(zones));
+			for (Zone const & zone : Zones)
+			{
+				ok = ok && write(&zone.Name, sizeof(zone.Name)) && write(&zone.Thread, sizeof(zone.Thread))
+					&& write(&zone.Depth, sizeof(zone.Depth)) && write(&zone.Begin, sizeof(zone.Begin))
+					&& write(&zone.Duration, sizeof(zone.Duration));
+			}
+			ok = ar.FlushWrites() && ok;
+		}
+		file.Close();
+		return ok;
+	}
+
+	bool ProfileCapture::Load(const char * path)
+	{
+		Os::File file;
+		if (!file.Open(path, IORead))
+			return false;
+		BufferedArchive ar(&file, 64 * 1024);
+		auto read = [&ar](void * data, size_t size) { return ar.ReadBytes(data, size) == size; };
+		uint32 magic = 0, version = 0, count = 0;
+		bool ok = read(&magic, sizeof(magic)) && read(&version, sizeof(version))
+			&& magic == kCaptureMagic && version == kCaptureVersion
+			&& read(&Dropped, sizeof(Dropped))
+			&& ReadStrings(ar, Names) && ReadStrings(ar, Threads)
+			&& read(&count, sizeof(count));
+		Frames.clear();
+		for (uint32 i = 0; ok && i < count; i++)
+		{
+			Frame frame;
+			ok = read(&frame.Index, sizeof(frame.Index)) && read(&frame.Begin, sizeof(frame.Begin))
+				&& read(&frame.Duration, sizeof(frame.Duration));
+			if (ok)
+				Frames.push_back(frame);
+		}
+		ok = ok && read(&count, sizeof(count));
+		Zones.clear();
+		for (uint32 i = 0; ok && i < count; i++)
+		{
+			Zone zone;
+			ok = read(&zone.Name, sizeof(zone.Name)) && read(&zone.Thread, sizeof(zone.Thread))
+				&& read(&zone.Depth, sizeof(zone.Depth)) && read(&zone.Begin, sizeof(zone.Begin))
+				&& read(&zone.Duration, sizeof(zone.Duration));
+			if (ok)
+				Zones.push_back(zone);
+		}
+		file.Close();
+		return ok;
+	}
+}
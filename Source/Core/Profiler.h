@@ -0,0 +1,119 @@
+#pragma once
+#ifndef __Profiler_h__
+#define __Profiler_h__
+
+#include <string>
+#include <vector>
+
+/// Zones and frame markers compile to nothing when 0
+#ifndef K3D_ENABLE_PROFILER
+#define K3D_ENABLE_PROFILER 1
+#endif
+
+K3D_COMMON_NS
+{
+	/// ProfileCapture
+	/// Zones recorded between Profiler::StartCapture and StopCapture.
+	/// Times are nanoseconds from the start of the capture.
+	class K3D_API ProfileCapture
+	{
+	public:
+		struct Zone
+		{
+			uint32	Name;
+			uint32	Thread;
+			uint32	Depth;
+			uint64	Begin;
+			uint64	Duration;
+		};
+
+		struct Frame
+		{
+			uint64	Index;
+			uint64	Begin;
+			uint64	Duration;
+		};
+
+		std::vector<std::string>	Names;
+		std::vector<std::string>	Threads;
+		std::vector<Zone>			Zones;
+		std::vector<Frame>			Frames;
+		/// Zones lost to full thread buffers
+		uint64						Dropped = 0;
+
+		/// Trace Event Format, loads in chrome://tracing and Perfetto.
+		/// Frames show up as zones of a "Frames" thread.
+		bool SaveChromeTrace(const char * path) const;
+
+		/// Compact binary form, about a third of the JSON
+		bool Save(const char * path) const;
+		bool Load(const char * path);
+	};
+
+	/// Profiler
+	/// Instrumented CPU zones. Every thread writes the zones it closes into
+	/// its own buffer without locking, MarkFrame collects them. Nothing is
+	/// recorded unless a capture or the stream is on. Ticks come from rdtsc
+	/// on x86, calibrated against the steady clock, and from the steady
+	/// clock elsewhere.
+	class K3D_API Profiler
+	{
+	public:
+		static uint64	Now();
+		static uint64	TicksToNanoseconds(uint64 ticks);
+
+		/// \return the begin tick to pass to Leave, 0 if not recording
+		static uint64	Enter();
+		/// \param name string literal, it is read when the zone is collected
+		static void		Leave(const char * name, uint64 begin);
+
+		/// Ends the current frame, collects the zones of all threads and
+		/// publishes the frame if it is streamed
+		static void		MarkFrame();
+		static uint64	GetFrameIndex();
+
+		static void		StartCapture();
+		static void		StopCapture(ProfileCapture & capture);
+		static bool		IsCapturing();
+
+		/// Send every Nth frame through the WebSocket log channel
+		/// (ELogLevel::Profile, tags "ProfileFrame" and "ProfileZones"), 0 stops
+		static void		SetStreaming(uint32 everyNthFrame);
+	};
+
+	/// ProfileScope
+	/// A zone from construction to destruction.
+	class ProfileScope
+	{
+	public:
+		explicit ProfileScope(const char * name) : m_Name(name), m_Begin(Profiler::Enter()) {}
+		~ProfileScope()
+		{
+			if (m_Begin)
+				Profiler::Leave(m_Name, m_Begin);
+		}
+
+	private:
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+
+		const char *	m_Name;
+		uint64			m_Begin;
+	};
+}
+
+#define K3D_PROFILE_CONCAT_(a, b) a##b
+#define K3D_PROFILE_CONCAT(a, b) K3D_PROFILE_CONCAT_(a, b)
+
+#if K3D_ENABLE_PROFILER
+/// name must be a string literal
+#define K3D_PROFILE_SCOPE(name) ::k3d::ProfileScope K3D_PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define K3D_PROFILE_FUNCTION() K3D_PROFILE_SCOPE(__K3D_FUNC__)
+#define K3D_PROFILE_FRAME() ::k3d::Profiler::MarkFrame()
+#else
+#define K3D_PROFILE_SCOPE(name)
+#define K3D_PROFILE_FUNCTION()
+#define K3D_PROFILE_FRAME()
+#endif
+
+#endif
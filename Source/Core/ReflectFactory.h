@@ -1,9 +1,8 @@
 #pragma once
 
 #include <KTL/Singleton.hpp>
+#include <KTL/Name.hpp>
 #include <Interface/IReflectable.h>
-#include <string>
-#include <map>
 
 namespace k3d 
 {
@@ -20,19 +19,19 @@ namespace k3d
 		void Register(const char * className, typename DelegateClassFunction<T>::Type Reflect, T *obj) {
 			//assert(obj);
 			T* refElement = (obj->*Reflect)();
-			m_ReflectMap[className] = refElement;
+			m_ReflectMap[Name(className)] = refElement;
 		}
 		
 		template <typename T, T* (*function)()>
 		void Register(const char * className) {
 			T* refElement = function();
-			m_ReflectMap[className] = refElement;
+			m_ReflectMap[Name(className)] = refElement;
 		}
 
 		void Register(const char * className, IReflectable * refElement)
 		{
 			//assert(className && refElement);
-			m_ReflectMap[className] = refElement;
+			m_ReflectMap[Name(className)] = refElement;
 		}
 		/*
 		template <typename T>
@@ -43,10 +42,17 @@ namespace k3d
 
 		IReflectable * GetClass(const char *className) 
 		{
-			return m_ReflectMap[className];
+			Name name = Name::Find(className);
+			return name.IsNone() ? nullptr : GetClass(name);
+		}
+
+		IReflectable * GetClass(Name className)
+		{
+			IReflectable ** refElement = m_ReflectMap.FindValue(className);
+			return refElement ? *refElement : nullptr;
 		}
 		
-		typedef std::map<std::string, IReflectable*> ReflectMap;
+		typedef HashMap<Name, IReflectable*> ReflectMap;
 	private:
 		ReflectMap m_ReflectMap;
 	};
@@ -0,0 +1,575 @@
+#include "Kaleido3D.h"
+#include "Sampler.h"
+#include "LogUtil.h"
+#include <KTL/Archive.hpp>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <stdlib.h>
+#include <string.h>
+
+#if K3DPLATFORM_OS_LINUX
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <unwind.h>
+#define K3D_HAS_SAMPLER 1
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#else
+#define K3D_HAS_SAMPLER 0
+#endif
+
+#if !K3DPLATFORM_OS_WIN
+#include <cxxabi.h>
+#include <dlfcn.h>
+#endif
+
+namespace k3d
+{
+	namespace
+	{
+		std::string FrameName(uint64 address)
+		{
+			char item[64];
+#if !K3DPLATFORM_OS_WIN
+			Dl_info info;
+			if (dladdr((void*)(uintptr_t)address, &info) && info.dli_fname)
+			{
+				if (info.dli_sname)
+				{
+					int status = 0;
+					char * demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+					std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+					free(demangled);
+					return name;
+				}
+				snprintf(item, sizeof(item), "+0x%llx", (unsigned long long)(address - (uint64)(uintptr_t)info.dli_fbase));
+				return std::string(info.dli_fname) + item;
+			}
+#endif
+			snprintf(item, sizeof(item), "0x%llx", (unsigned long long)address);
+			return item;
+		}
+	}
+
+	bool SampleProfile::SaveFolded(const char * path) const
+	{
+		// stacks apart by address may share all their names
+		std::unordered_map<uint64, std::string> names;
+		std::map<std::string, uint64> folded;
+		std::string line;
+		for (Stack const & stack : Stacks)
+		{
+			line = stack.Thread < Threads.size() ? Threads[stack.Thread] : "Unknown";
+			for (size_t f = stack.Frames.size(); f > 0; f--)
+			{
+				uint64 address = stack.Frames[f - 1];
+				auto name = names.find(address);
+				if (name == names.end())
+					name = names.emplace(address, FrameName(address)).first;
+				line += ';';
+				line += name->second;
+			}
+			folded[line] += stack.Count;
+		}
+
+		Os::File file;
+		if (!file.Open(path, IOWrite))
+			return false;
+		bool ok = true;
+		{
+			BufferedArchive ar(&file, 64 * 1024);
+			char count[32];
+			for (auto const & stack : folded)
+			{
+				snprintf(count, sizeof(count), " %llu\n", (unsigned long long)stack.second);
+				line = stack.first + count;
+				ok = ok && ar.WriteBytes(line.data(), line.size()) == line.size();
+			}
+		}
+		file.Close();
+		return ok;
+	}
+
+#if K3D_HAS_SAMPLER
+	namespace
+	{
+		const uint32 kMaxDepth = 64;
+		/// Power of two, half a second at 1kHz
+		const uint32 kRingSlots = 512;
+		const uint32 kMaxRings = 256;
+		const uint32 kCollectMs = 20;
+
+		/// Written by the signal handler of one thread, read by the collector
+		struct SampleRing
+		{
+			struct Slot
+			{
+				uint32	Depth;
+				/// Periods the sample stands for
+				uint32	Weight;
+				uint64	Frames[kMaxDepth];
+			};
+
+			std::atomic<uint32>	Head;
+			std::atomic<uint32>	Tail;
+			std::atomic<uint64>	Dropped;
+			Slot				Slots[kRingSlots];
+		};
+
+		struct SampledThread
+		{
+			pid_t			Tid;
+			clockid_t		Clock;
+			std::string		Name;
+			uint32			Index;
+			SampleRing *	Ring;
+			timer_t			Timer;
+			bool			Armed;
+			/// The thread calling Start, Stop removes it: it may be gone by
+			/// the next session and its tid reused
+			bool			Starter;
+		};
+
+		std::atomic<bool> g_Sampling(false);
+		/// Rings are reused but never freed, a signal still queued for a
+		/// thread that went away cannot write to freed memory
+		std::atomic<SampleRing*> g_Rings[kMaxRings];
+		std::atomic<uint32> g_RingCount(0);
+		struct sigaction g_PreviousAction;
+
+		struct UnwindState
+		{
+			uint64 *	Frames;
+			uint32		Depth;
+			uint32		Max;
+			int32		Interrupted;
+		};
+
+		_Unwind_Reason_Code UnwindFrame(struct _Unwind_Context * context, void * arg)
+		{
+			UnwindState & state = *reinterpret_cast<UnwindState*>(arg);
+			int beforeInstruction = 0;
+			uint64 ip = (uint64)_Unwind_GetIPInfo(context, &beforeInstruction);
+			if (ip == 0)
+				return _URC_END_OF_STACK;
+			// the frame the signal interrupted holds the exact pc, callers
+			// hold return addresses which may already be in the next line
+			if (beforeInstruction && state.Interrupted < 0)
+				state.Interrupted = (int32)state.Depth;
+			state.Frames[state.Depth++] = beforeInstruction ? ip : ip - 1;
+			return state.Depth < state.Max ? _URC_NO_REASON : _URC_END_OF_STACK;
+		}
+
+		uint32 Unwind(uint64 * frames, uint32 max)
+		{
+			UnwindState state = { frames, 0, max, -1 };
+			_Unwind_Backtrace(UnwindFrame, &state);
+			// drop the frames of the handler
+			if (state.Interrupted > 0)
+			{
+				memmove(frames, frames + state.Interrupted, (state.Depth - state.Interrupted) * sizeof(uint64));
+				state.Depth -= state.Interrupted;
+			}
+			return state.Depth;
+		}
+
+		/// No allocation and no lock of its own. The unwinder finds the
+		/// unwind tables with dl_iterate_phdr though, which takes the loader
+		/// lock: a sample landing while another thread runs dlopen or
+		/// dlclose waits for it, one landing inside the loader re-enters it.
+		void OnProfileSignal(int signal, siginfo_t * info, void * context)
+		{
+			SampleRing * ring = info->si_code == SI_TIMER ? reinterpret_cast<SampleRing*>(info->si_value.sival_ptr) : nullptr;
+			uint32 count = g_RingCount.load(std::memory_order_acquire);
+			uint32 r = 0;
+			while (r < count && g_Rings[r].load(std::memory_order_relaxed) != ring)
+				r++;
+			if (r == count || !ring)
+			{
+				// someone else's SIGPROF
+				if (g_PreviousAction.sa_flags & SA_SIGINFO)
+				{
+					if (g_PreviousAction.sa_sigaction)
+						g_PreviousAction.sa_sigaction(signal, info, context);
+				}
+				else if (g_PreviousAction.sa_handler != SIG_DFL && g_PreviousAction.sa_handler != SIG_IGN)
+				{
+					g_PreviousAction.sa_handler(signal);
+				}
+				return;
+			}
+			if (!g_Sampling.load(std::memory_order_relaxed))
+				return;
+
+			int savedErrno = errno;
+			uint32 head = ring->Head.load(std::memory_order_relaxed);
+			if (head - ring->Tail.load(std::memory_order_acquire) >= kRingSlots)
+			{
+				ring->Dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				SampleRing::Slot & slot = ring->Slots[head % kRingSlots];
+				slot.Depth = Unwind(slot.Frames, kMaxDepth);
+				// CPU clock timers may only fire on the scheduler tick, the
+				// periods they skipped still belong to this stack
+				slot.Weight = 1 + (info->si_overrun > 0 ? (uint32)info->si_overrun : 0);
+				ring->Head.store(head + 1, std::memory_order_release);
+			}
+			errno = savedErrno;
+		}
+
+		class SamplerState
+		{
+		public:
+			static SamplerState & Get()
+			{
+				static SamplerState * state = new SamplerState;
+				return *state;
+			}
+
+			SampledThread * Find(pid_t tid)
+			{
+				for (SampledThread & thread : Threads)
+				{
+					if (thread.Tid == tid)
+						return &thread;
+				}
+				return nullptr;
+			}
+
+			bool Arm(SampledThread & thread)
+			{
+				if (!thread.Ring)
+				{
+					if (!FreeRings.empty())
+					{
+						thread.Ring = FreeRings.back();
+						FreeRings.pop_back();
+					}
+					else if (g_RingCount.load(std::memory_order_relaxed) < kMaxRings)
+					{
+						thread.Ring = new SampleRing;
+						thread.Ring->Head.store(0);
+						thread.Ring->Tail.store(0);
+						thread.Ring->Dropped.store(0);
+						uint32 count = g_RingCount.load(std::memory_order_relaxed);
+						g_Rings[count].store(thread.Ring, std::memory_order_relaxed);
+						g_RingCount.store(count + 1, std::memory_order_release);
+					}
+					else
+					{
+						KLOG(Warn, Sampler, "Thread %s is not sampled, more than %u threads.", thread.Name.c_str(), kMaxRings);
+						return false;
+					}
+				}
+				// forget samples a late signal left behind
+				thread.Ring->Tail.store(thread.Ring->Head.load(std::memory_order_acquire), std::memory_order_release);
+				thread.Ring->Dropped.store(0, std::memory_order_relaxed);
+				thread.Index = (uint32)SessionThreads.size();
+				SessionThreads.push_back(thread.Name);
+
+				struct sigevent event;
+				memset(&event, 0, sizeof(event));
+				event.sigev_notify = SIGEV_THREAD_ID;
+				event.sigev_signo = SIGPROF;
+				event.sigev_value.sival_ptr = thread.Ring;
+				event.sigev_notify_thread_id = thread.Tid;
+				if (timer_create(thread.Clock, &event, &thread.Timer) != 0)
+				{
+					KLOG(Error, Sampler, "Cannot create the sampling timer of %s (errno %d).", thread.Name.c_str(), errno);
+					return false;
+				}
+				uint64 interval = 1000000000ull / Hz;
+				struct itimerspec spec;
+				spec.it_interval.tv_sec = (time_t)(interval / 1000000000ull);
+				spec.it_interval.tv_nsec = (long)(interval % 1000000000ull);
+				spec.it_value = spec.it_interval;
+				timer_settime(thread.Timer, 0, &spec, nullptr);
+				thread.Armed = true;
+				return true;
+			}
+
+			void Disarm(SampledThread & thread)
+			{
+				if (thread.Armed)
+				{
+					timer_delete(thread.Timer);
+					thread.Armed = false;
+				}
+			}
+
+			void Drain(SampledThread & thread)
+			{
+				SampleRing & ring = *thread.Ring;
+				uint32 tail = ring.Tail.load(std::memory_order_relaxed);
+				uint32 head = ring.Head.load(std::memory_order_acquire);
+				for (; tail != head; tail++)
+				{
+					SampleRing::Slot const & slot = ring.Slots[tail % kRingSlots];
+					Key.assign(1, thread.Index);
+					Key.insert(Key.end(), slot.Frames, slot.Frames + slot.Depth);
+					Counts[Key] += slot.Weight;
+					Samples += slot.Weight;
+				}
+				ring.Tail.store(tail, std::memory_order_release);
+				Dropped += ring.Dropped.exchange(0, std::memory_order_relaxed);
+			}
+
+			std::mutex							Lock;
+			std::vector<SampledThread>			Threads;
+			std::vector<SampleRing*>			FreeRings;
+
+			std::vector<std::string>			SessionThreads;
+			/// Session thread index followed by the frames
+			std::map<std::vector<uint64>, uint64>	Counts;
+			std::vector<uint64>					Key;
+			uint64								Samples;
+			uint64								Dropped;
+
+			uint32								Hz;
+			bool								Active;
+			bool								HandlerInstalled;
+			/// Not an Os::Thread: it is not sampled itself, and Start may run
+			/// from a static constructor before the thread map exists
+			pthread_t							Collector;
+			std::atomic<bool>					Collecting;
+
+		private:
+			SamplerState()
+				: Samples(0), Dropped(0), Hz(1000), Active(false), HandlerInstalled(false)
+				, Collecting(false)
+			{
+			}
+		};
+
+		void * Collect(void *)
+		{
+			SamplerState & state = SamplerState::Get();
+			while (state.Collecting.load())
+			{
+				Os::Sleep(kCollectMs);
+				std::lock_guard<std::mutex> lock(state.Lock);
+				for (SampledThread & thread : state.Threads)
+				{
+					if (thread.Ring)
+						state.Drain(thread);
+				}
+			}
+			return nullptr;
+		}
+
+		/// K3D_SAMPLER_OUTPUT
+		char s_AutoOutput[512];
+
+		void FinishAutoSampling()
+		{
+			SampleProfile profile;
+			Sampler::Stop(profile);
+			profile.SaveFolded(s_AutoOutput);
+		}
+
+		struct AutoSampler
+		{
+			AutoSampler()
+			{
+				const char * path = getenv("K3D_SAMPLER_OUTPUT");
+				if (!path || !*path || strlen(path) >= sizeof(s_AutoOutput))
+					return;
+				strcpy(s_AutoOutput, path);
+				const char * hz = getenv("K3D_SAMPLER_HZ");
+				if (Sampler::Start(hz ? (uint32)atoi(hz) : 1000))
+					atexit(FinishAutoSampling);
+			}
+		} s_AutoSampler;
+	}
+
+	bool Sampler::Start(uint32 hz)
+	{
+		SamplerState & state = SamplerState::Get();
+		{
+			std::lock_guard<std::mutex> lock(state.Lock);
+			if (state.Active)
+				return false;
+			if (!state.HandlerInstalled)
+			{
+				// the unwinder loads and initializes on first use, not in the handler
+				uint64 frames[4];
+				Unwind(frames, 4);
+
+				struct sigaction action;
+				memset(&action, 0, sizeof(action));
+				action.sa_sigaction = OnProfileSignal;
+				action.sa_flags = SA_SIGINFO | SA_RESTART;
+				sigemptyset(&action.sa_mask);
+				// kept once installed, a signal still queued after Stop must
+				// not reach the default action, which ends the process
+				if (sigaction(SIGPROF, &action, &g_PreviousAction) != 0)
+				{
+					KLOG(Error, Sampler, "Cannot install the SIGPROF handler (errno %d).", errno);
+					return false;
+				}
+				state.HandlerInstalled = true;
+			}
+			state.Hz = hz < 1 ? 1 : hz > 10000 ? 10000 : hz;
+			state.Active = true;
+			state.Samples = 0;
+			state.Dropped = 0;
+			state.Counts.clear();
+			state.SessionThreads.clear();
+			g_Sampling.store(true);
+
+			pid_t self = (pid_t)syscall(SYS_gettid);
+			if (!state.Find(self))
+			{
+				SampledThread thread = {};
+				thread.Tid = self;
+				thread.Name = "Main";
+				thread.Starter = true;
+				if (pthread_getcpuclockid(pthread_self(), &thread.Clock) == 0)
+					state.Threads.push_back(thread);
+			}
+			for (SampledThread & thread : state.Threads)
+				state.Arm(thread);
+		}
+
+		state.Collecting.store(true);
+		int error = pthread_create(&state.Collector, nullptr, Collect, nullptr);
+		if (error == 0)
+			return true;
+
+		KLOG(Error, Sampler, "Cannot start the collector thread (error %d).", error);
+		std::lock_guard<std::mutex> lock(state.Lock);
+		g_Sampling.store(false);
+		for (SampledThread & thread : state.Threads)
+		{
+			state.Disarm(thread);
+			if (thread.Starter && thread.Ring)
+				state.FreeRings.push_back(thread.Ring);
+		}
+		state.Threads.erase(std::remove_if(state.Threads.begin(), state.Threads.end(), [](SampledThread const & thread)
+		{
+			return thread.Starter;
+		}), state.Threads.end());
+		state.Active = false;
+		state.Collecting.store(false);
+		return false;
+	}
+
+	void Sampler::Stop(SampleProfile & profile)
+	{
+		profile = SampleProfile();
+		SamplerState & state = SamplerState::Get();
+		pthread_t collector;
+		{
+			std::lock_guard<std::mutex> lock(state.Lock);
+			if (!state.Active)
+				return;
+			g_Sampling.store(false);
+			for (SampledThread & thread : state.Threads)
+				state.Disarm(thread);
+			state.Active = false;
+			state.Collecting.store(false);
+			collector = state.Collector;
+		}
+		pthread_join(collector, nullptr);
+
+		std::lock_guard<std::mutex> lock(state.Lock);
+		for (SampledThread & thread : state.Threads)
+		{
+			if (thread.Ring)
+				state.Drain(thread);
+			if (thread.Starter && thread.Ring)
+				state.FreeRings.push_back(thread.Ring);
+		}
+		state.Threads.erase(std::remove_if(state.Threads.begin(), state.Threads.end(), [](SampledThread const & thread)
+		{
+			return thread.Starter;
+		}), state.Threads.end());
+		profile.Threads = state.SessionThreads;
+		profile.Stacks.reserve(state.Counts.size());
+		for (auto const & count : state.Counts)
+		{
+			SampleProfile::Stack stack;
+			stack.Thread = (uint32)count.first[0];
+			stack.Count = count.second;
+			stack.Frames.assign(count.first.begin() + 1, count.first.end());
+			profile.Stacks.push_back(std::move(stack));
+		}
+		profile.Samples = state.Samples;
+		profile.Dropped = state.Dropped;
+		state.Counts.clear();
+	}
+
+	bool Sampler::IsSampling()
+	{
+		return g_Sampling.load(std::memory_order_relaxed);
+	}
+
+	void Sampler::RegisterCurrentThread(const char * name)
+	{
+		SampledThread thread = {};
+		thread.Tid = (pid_t)syscall(SYS_gettid);
+		thread.Name = name ? name : "";
+		if (pthread_getcpuclockid(pthread_self(), &thread.Clock) != 0)
+			return;
+		SamplerState & state = SamplerState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		if (state.Find(thread.Tid))
+			return;
+		state.Threads.push_back(thread);
+		if (state.Active)
+			state.Arm(state.Threads.back());
+	}
+
+	void Sampler::UnregisterCurrentThread()
+	{
+		pid_t tid = (pid_t)syscall(SYS_gettid);
+		SamplerState & state = SamplerState::Get();
+		std::lock_guard<std::mutex> lock(state.Lock);
+		SampledThread * thread = state.Find(tid);
+		if (!thread)
+			return;
+		// a signal queued for this thread is handled before timer_delete returns
+		state.Disarm(*thread);
+		if (thread->Ring)
+		{
+			state.Drain(*thread);
+			state.FreeRings.push_back(thread->Ring);
+		}
+		state.Threads.erase(state.Threads.begin() + (thread - state.Threads.data()));
+	}
+#else
+	bool Sampler::Start(uint32 hz)
+	{
+		KLOG(Warn, Sampler, "Sampling is not supported on this platform.");
+		return false;
+	}
+
+	void Sampler::Stop(SampleProfile & profile)
+	{
+		profile = SampleProfile();
+	}
+
+	bool Sampler::IsSampling()
+	{
+		return false;
+	}
+
+	void Sampler::RegisterCurrentThread(const char * name)
+	{
+	}
+
+	void Sampler::UnregisterCurrentThread()
+	{
+	}
+#endif
+}
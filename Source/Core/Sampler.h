@@ -0,0 +1,65 @@
+#pragma once
+#ifndef __Sampler_h__
+#define __Sampler_h__
+
+#include <string>
+#include <vector>
+
+K3D_COMMON_NS
+{
+	/// SampleProfile
+	/// Call stacks sampled between Sampler::Start and Stop, with the
+	/// number of times each was seen.
+	class K3D_API SampleProfile
+	{
+	public:
+		struct Stack
+		{
+			uint32				Thread;
+			/// Sampling periods spent in the stack
+			uint64				Count;
+			/// Return addresses, innermost first
+			std::vector<uint64>	Frames;
+		};
+
+		std::vector<std::string>	Threads;
+		std::vector<Stack>			Stacks;
+		/// Sampling periods, a timer signal delivered late counts for the
+		/// ones it skipped
+		uint64						Samples = 0;
+		/// Samples lost to full thread buffers
+		uint64						Dropped = 0;
+
+		/// Folded stacks, "thread;outer;...;inner count" per line, as read by
+		/// flamegraph.pl and speedscope. Frames are named with dladdr, the
+		/// ones without a dynamic symbol are written as module+0xoffset for
+		/// Tools/FlameGraph/symbolize.py to resolve with addr2line.
+		bool SaveFolded(const char * path) const;
+	};
+
+	/// Sampler
+	/// Statistical CPU profiler. Every Os::Thread, and the thread calling
+	/// Start until Stop, gets a timer on its own CPU clock that raises
+	/// SIGPROF on it; the handler unwinds the stack into the thread's ring
+	/// buffer and a collector thread counts the stacks. The handler takes
+	/// no lock but the loader's, which the unwinder needs to find unwind
+	/// tables. Linux and Android only, Start fails elsewhere.
+	///
+	/// Setting K3D_SAMPLER_OUTPUT=path (and K3D_SAMPLER_HZ) samples the whole
+	/// run of an unmodified binary and writes folded stacks at exit.
+	class K3D_API Sampler
+	{
+	public:
+		/// \param hz samples per second of CPU time, per thread
+		static bool		Start(uint32 hz = 1000);
+		static void		Stop(SampleProfile & profile);
+		static bool		IsSampling();
+
+		/// Os::Thread calls these around the thread function, other threads
+		/// may call them to be sampled too
+		static void		RegisterCurrentThread(const char * name);
+		static void		UnregisterCurrentThread();
+	};
+}
+
+#endif
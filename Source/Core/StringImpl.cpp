@@ -3,6 +3,7 @@
 #include <KTL/String.hpp>
 #include <string.h>
 #include "Utils/MD5.h"
+#include "Utils/farmhash.h"
 
 K3D_COMMON_NS
 {
@@ -11,6 +12,11 @@ K3D_API int Vsnprintf(char*dest, int n, const char* fmt, va_list list)
     return ::vsnprintf(dest, n, fmt, list);
 }
 
+K3D_API uint64 HashBytes(const char * data, size_t len)
+{
+    return util::Hash64(data, len);
+}
+
 // -------------------------------------------------------------------------------------------------------------
 //                                                    Base64
 //--------------------------------------------------------------------------------------------------------------
@@ -25,7 +31,7 @@ K3D_API K3D_API String Base64Encode(String const & in)
 	auto bytes_to_encode = in.CStr();
 	int reckon_len = ((4 * in_len / 3) + 3) & ~3;
 	String ret;
-	ret.Resize(reckon_len);
+	ret.Reserve(reckon_len);
 	int i = 0;
 	int j = 0;
 	unsigned char char_array_3[3];
@@ -87,7 +93,7 @@ K3D_API String Base64Decode(String const& encoded_string)
 	int in_ = 0;
 	unsigned char char_array_4[4], char_array_3[3];
 	String ret;
-	ret.Resize(encoded_string.Length());
+	ret.Reserve(encoded_string.Length() / 4 * 3 + 3);
 
 	while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
 		char_array_4[i++] = encoded_string[in_]; in_++;
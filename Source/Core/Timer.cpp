@@ -5,27 +5,8 @@
 
 #ifdef K3DPLATFORM_OS_WIN
 #include <Windows.h>
-#include <intrin.h>
-#elif defined(K3DPLATFORM_OS_LINUX) && !defined(K3DPLATFORM_OS_ANDROID)
+#else
 #include <time.h>
-///
-/// \brief rdtsc for x64 machine
-/// \return
-///
-static __inline__ unsigned long long __rdtsc(void)
-{
-  unsigned hi, lo;
-  __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
-  return ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
-}
-
-static int64 Lfrequency = 0;
-static int64 QueryFrequency()
-{
-    timespec sp;
-    Lfrequency = ::clock_getres(CLOCK_MONOTONIC,&sp);
-}
-
 #endif
 
 static int64 gFrequency = 0;
@@ -61,6 +42,22 @@ static inline int64 GetPerformanceCounter()
   else
     return 0;
 }
+
+#else
+
+/// CLOCK_MONOTONIC counts nanoseconds
+static int64 GetPerformanceFrequency()
+{
+  return 1000000000;
+}
+
+static inline int64 GetPerformanceCounter()
+{
+  timespec now;
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
 #endif
 
 static inline int64 ticksToNanoseconds( int64 ticks )
@@ -82,15 +79,14 @@ namespace k3d {
 	Timer::Timer(Precision precision)
 		: m_Precision(precision)
 		, m_BaseTime(0)
+		, m_LastTime(0)
+		, m_OffSetTime(0)
 		, m_CurrentTime(0)
 		, m_FrameRate(0)
 		, m_Enabled(false)
 	{
-#ifdef K3DPLATFORM_OS_WIN
 		gFrequency = GetPerformanceFrequency();
-#elif defined(K3DPLATFORM_OS_LINUX) && !defined(K3DPLATFORM_OS_ANDROID)
-		frequency = QueryFrequency();
-#endif
+		m_CurrentTime = GetPerformanceCounter();
 	}
 
 
@@ -100,32 +96,25 @@ namespace k3d {
 
 	void Timer::ResetTimer()
 	{
-#ifdef K3DPLATFORM_OS_WIN
 		m_CurrentTime = GetPerformanceCounter();
-#endif
 	}
 
 	int64 Timer::MicrosecElapsed()
 	{
-#ifdef K3DPLATFORM_OS_WIN
 		m_LastTime = m_CurrentTime;
 		m_CurrentTime = GetPerformanceCounter();
-#endif
-		return ticksToNanoseconds(m_CurrentTime - m_LastTime) / 1000000;
+		return ticksToNanoseconds(m_CurrentTime - m_LastTime) / 1000;
 	}
 
+	/// Counter ticks rather than cycles, Update divides by the counter frequency
 	void Timer::BeginTimer()
 	{
-#if defined(K3DPLATFORM_OS_WIN)
-		m_BaseTime = __rdtsc();
-#endif
+		m_BaseTime = GetPerformanceCounter();
 	}
 
 	int64 Timer::EndTimer()
 	{
-#if defined(K3DPLATFORM_OS_WIN)
-		m_OffSetTime = __rdtsc() - m_BaseTime;
-#endif
+		m_OffSetTime = GetPerformanceCounter() - m_BaseTime;
 		return m_OffSetTime;
 	}
 
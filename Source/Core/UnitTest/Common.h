@@ -7,9 +7,15 @@
 #include <KTL/Archive.hpp>
 #include <Core/WebSocket.h>
 #include <Core/LogUtil.h>
+#include <Core/MemoryTracker.h>
+#include <Core/AsyncIO.h>
+#include <Core/Dispatch/Dispatcher.h>
 
 #include <KTL/SharedPtr.hpp>
 #include <KTL/DynArray.hpp>
+#include <KTL/LockFreeQueue.hpp>
+#include <KTL/HashMap.hpp>
+#include <KTL/Name.hpp>
 
 #include <Tools/ShaderGen/Public/ShaderCompiler.h>
 
@@ -0,0 +1,83 @@
+#include "Common.h"
+#include <atomic>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestSizeClasses()
+{
+	uint32 numClasses = PoolAllocator::GetSizeClassCount();
+	SizeClassStats stats;
+	uint32 lastSize = 0;
+	for (uint32 i = 0; i < numClasses; i++)
+	{
+		K3D_ASSERT(PoolAllocator::GetStats(i, stats));
+		K3D_ASSERT(stats.ObjectSize > lastSize && stats.ObjectSize % 16 == 0);
+		lastSize = stats.ObjectSize;
+	}
+	K3D_ASSERT(lastSize == PoolAllocator::MaxSmallSize);
+	K3D_ASSERT(!PoolAllocator::GetStats(numClasses, stats));
+
+	// every size fits its block, sized and unsized frees are both accepted
+	for (size_t size = 1; size <= PoolAllocator::MaxSmallSize; size += 7)
+	{
+		char* p = (char*)__k3d_malloc__(size);
+		K3D_ASSERT(((uintptr_t)p & 15) == 0);
+		memset(p, 0xab, size);
+		__k3d_free__(p, (size & 1) ? size : 0);
+	}
+
+	uint64 largeFrees = PoolAllocator::GetLargeFreeCount();
+	void* large = __k3d_malloc__(PoolAllocator::MaxSmallSize + 1);
+	__k3d_free__(large, 0);
+	K3D_ASSERT(PoolAllocator::GetLargeFreeCount() == largeFrees + 1);
+}
+
+void TestCrossThreadFree()
+{
+	const int kCount = 20000;
+	MPMCQueue<void*> handoff(1024);
+	std::atomic<int> freed(0);
+
+	thread consumer([&]() {
+		void* p = nullptr;
+		while (freed.load() < kCount)
+		{
+			if (handoff.Dequeue(p, 10))
+			{
+				K3D_ASSERT(*(uint64*)p == (uint64)(uintptr_t)p);
+				__k3d_free__(p, 48);
+				freed++;
+			}
+		}
+		PoolAllocator::FlushThreadCache();
+	});
+	thread producer([&]() {
+		for (int i = 0; i < kCount; i++)
+		{
+			void* p = __k3d_malloc__(48);
+			*(uint64*)p = (uint64)(uintptr_t)p;
+			handoff.Enqueue(p);
+		}
+		PoolAllocator::FlushThreadCache();
+	});
+	producer.join();
+	consumer.join();
+
+	SizeClassStats stats;
+	PoolAllocator::GetStats(2, stats);
+	K3D_ASSERT(stats.ObjectSize == 48);
+	K3D_ASSERT(stats.Allocs >= (uint64)kCount && stats.Frees >= (uint64)kCount);
+	K3D_ASSERT(stats.DepotObjects * stats.ObjectSize <= stats.SpanBytes);
+}
+
+int main(int argc, char**argv)
+{
+	TestSizeClasses();
+	TestCrossThreadFree();
+	return 0;
+}
@@ -0,0 +1,147 @@
+#include "Common.h"
+#include <Core/AssetManager.h>
+#include <Core/CameraData.h>
+
+#include <fstream>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+/// A cooked camera chunk, as the bundle cook writes it
+void WriteCamera(const char * path, float fov)
+{
+	AssetBundle * bundle = AssetBundle::CreateBundle(KT("amcam.bundle"), KT("./"));
+	CameraData camera;
+	camera.SetName("LevelCamera");
+	camera.SetFOV(fov);
+	bundle->Serialize(&camera);
+	bundle->MergeAndBundle(false);
+	delete bundle;
+	{
+		AssetBundleReader reader;
+		K3D_ASSERT(reader.Open(KT("./amcam.bundle")));
+		AssetChunkView chunk = reader.GetChunk(0);
+		Os::File file;
+		K3D_ASSERT(file.Open(path, IOWrite));
+		file.Write(chunk.Data, (size_t)chunk.Size);
+		file.Close();
+	}
+	remove("./amcam.bundle");
+}
+
+void WriteText(const char * path, const char * text)
+{
+	ofstream file(path, ios::trunc);
+	file << text;
+}
+
+void TestAppendedMesh()
+{
+	AssetManager & manager = AssetManager::Get();
+	SpMesh mesh = std::make_shared<MeshData>();
+	mesh->SetMeshName("AppendedMesh");
+	vector<uint32> indices(1000, 1);
+	mesh->SetIndexBuffer(indices);
+	manager.AppendMesh(mesh);
+	mesh = nullptr;
+
+	// no path to stream it back from, so it stays over budget
+	manager.GetResidency().SetBudget(EAssetType::EMesh, 1);
+	SpMesh found = manager.FindMesh("AppendedMesh");
+	K3D_ASSERT(found && found->GetIndexNum() == 1000);
+	K3D_ASSERT(manager.GetResidency().GetStats(EAssetType::EMesh).Evictions == 0);
+	manager.GetResidency().SetBudget(EAssetType::EMesh, 0);
+}
+
+void TestOpenAsset()
+{
+	AssetManager & manager = AssetManager::Get();
+	VirtualFS::MountId memory = manager.GetVFS().MountMemory("Generated/");
+	K3D_ASSERT(manager.GetVFS().WriteMemory(memory, "note.txt", "in memory", 9));
+
+	char text[16] = { 0 };
+	AssetManager::SpIODevice device = AssetManager::OpenAsset(KT("asset://Generated/note.txt"));
+	K3D_ASSERT(device && device->Read(text, sizeof(text)) == 9 && string(text) == "in memory");
+	manager.GetVFS().Unmount(memory);
+}
+
+void TestHotReload()
+{
+	AssetManager & manager = AssetManager::Get();
+	Os::MakeDir(KT("am.reload"));
+	WriteText("am.reload/level.camsrc", "30");
+	WriteCamera("am.reload/level.cam", 30.0f);
+	manager.AddSearchPath(KT("am.reload"));
+
+	Name name("LevelCamera");
+	std::shared_ptr<CameraData> original = std::make_shared<CameraData>();
+	original->SetFOV(30.0f);
+	manager.GetResidency().Insert(name, EAssetType::ECamera, original, sizeof(CameraData), KT("level.cam"));
+
+	// the source is text, its cook writes the chunk the runtime loads
+	std::atomic<uint32> cooks(0);
+	manager.RegisterCooker(KT(".camsrc"), [&cooks](kString const & source)
+	{
+		float fov = 0;
+		ifstream(source.c_str()) >> fov;
+		kString cooked = source.substr(0, source.size() - 3);
+		WriteCamera(cooked.c_str(), fov);
+		cooks++;
+		return cooked;
+	});
+	vector<kString> reloaded;
+	manager.AddReloadListener([&reloaded, name](kString const & path, Name asset)
+	{
+		K3D_ASSERT(asset == name);
+		reloaded.push_back(path);
+	});
+	K3D_ASSERT(manager.EnableHotReload(20));
+
+	WriteText("am.reload/level.camsrc", "60");
+	for (int i = 0; i < 500 && reloaded.empty(); i++)
+	{
+		manager.UpdateStreaming();
+		Os::Sleep(10);
+	}
+	K3D_ASSERT(reloaded.size() == 1 && reloaded[0] == KT("level.cam") && cooks == 1);
+	std::shared_ptr<CameraData> swapped = manager.GetResidency().Find<CameraData>(name);
+	K3D_ASSERT(swapped && swapped != original && swapped->GetFOV() == 60.0f);
+
+	// the watcher reporting the cooked file does not reload it again
+	for (int i = 0; i < 30; i++)
+	{
+		manager.UpdateStreaming();
+		Os::Sleep(10);
+	}
+	K3D_ASSERT(reloaded.size() == 1 && cooks == 1);
+
+	// a later edit of the cooked file itself is a change again
+	WriteCamera("am.reload/level.cam", 90.0f);
+	for (int i = 0; i < 500 && reloaded.size() < 2; i++)
+	{
+		manager.UpdateStreaming();
+		Os::Sleep(10);
+	}
+	K3D_ASSERT(reloaded.size() == 2 && cooks == 1);
+	swapped = manager.GetResidency().Find<CameraData>(name);
+	K3D_ASSERT(swapped && swapped->GetFOV() == 90.0f);
+
+	manager.DisableHotReload();
+	manager.GetResidency().Remove(name);
+	remove("am.reload/level.camsrc");
+	remove("am.reload/level.cam");
+	Os::Remove(KT("am.reload"));
+}
+
+int main(int argc, char**argv)
+{
+	TestAppendedMesh();
+	TestOpenAsset();
+	TestHotReload();
+	AssetManager::Get().Shutdown();
+	return 0;
+}
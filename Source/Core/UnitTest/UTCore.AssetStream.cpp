@@ -0,0 +1,348 @@
+#include "Common.h"
+#include <Core/AssetStream.h>
+#include <Core/AssetResidency.h>
+#include <Core/CameraData.h>
+#include <Core/MeshData.h>
+#include <Core/VirtualFS.h>
+#include <atomic>
+#include <vector>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+/// A cooked camera chunk, as the bundle cook writes it
+void WriteCamera(const char * path, const char * name, float fov)
+{
+	AssetBundle * bundle = AssetBundle::CreateBundle(KT("streamcam.bundle"), KT("./"));
+	CameraData camera;
+	camera.SetName(name);
+	camera.SetFOV(fov);
+	bundle->Serialize(&camera);
+	bundle->MergeAndBundle(false);
+	delete bundle;
+	{
+		AssetBundleReader reader;
+		K3D_ASSERT(reader.Open(KT("./streamcam.bundle")));
+		AssetChunkView chunk = reader.GetChunk(0);
+		Os::File file;
+		K3D_ASSERT(file.Open(path, IOWrite));
+		file.Write(chunk.Data, (size_t)chunk.Size);
+		file.Close();
+	}
+	remove("./streamcam.bundle");
+}
+
+void WriteBytes(const char * path, uint32 size)
+{
+	vector<kByte> bytes(size);
+	for (uint32 i = 0; i < size; i++)
+		bytes[i] = (kByte)i;
+	Os::File file;
+	K3D_ASSERT(file.Open(path, IOWrite));
+	file.Write(bytes.data(), bytes.size());
+	file.Close();
+}
+
+/// A camera and an LZ compressed mesh, as the cook writes them
+void WriteBundle(const kchar * name)
+{
+	AssetBundle * bundle = AssetBundle::CreateBundle(name, KT("./"));
+	bundle->SetCompression(EChunkCompression::LZ);
+	CameraData camera;
+	camera.SetName("BundleCamera");
+	camera.SetFOV(45.0f);
+	bundle->Serialize(&camera);
+	MeshData mesh;
+	mesh.SetMeshName("BundleGrid");
+	vector<uint32> indices(100000);
+	for (uint32 i = 0; i < indices.size(); i++)
+		indices[i] = i / 3;
+	mesh.SetIndexBuffer(indices);
+	bundle->Serialize(&mesh);
+	bundle->MergeAndBundle(false);
+	delete bundle;
+}
+
+void TestStreaming()
+{
+	AssetStreamer streamer(2);
+	AssetHandle camera = streamer.Request(KT("stream.cam"), EAssetType::ECamera);
+	// same file, same request
+	K3D_ASSERT(streamer.Request(KT("stream.cam"), EAssetType::ECamera, AssetStreamPriority(1.0f, false)) == camera);
+	K3D_ASSERT(streamer.Request(KT("./stream.cam"), EAssetType::ECamera) == camera);
+	K3D_ASSERT(streamer.Request(KT("dir/.././/stream.cam"), EAssetType::ECamera) == camera);
+
+	AssetHandle raw = streamer.Request(KT("stream.raw"), EAssetType::EImage, AssetStreamPriority(10.0f, true), &camera, 1);
+	std::atomic<uint32> workerCalls(0);
+	uint32 mainCalls = 0;
+	streamer.OnComplete(raw, [&workerCalls](AssetStreamRequest & request)
+	{
+		workerCalls++;
+	}, EAssetCallbackThread::Worker);
+	streamer.OnComplete(raw, [&mainCalls, camera](AssetStreamRequest & request)
+	{
+		// dependencies complete first
+		K3D_ASSERT(camera->GetState() == EAssetState::Loaded);
+		mainCalls++;
+	});
+
+	raw->Wait();
+	K3D_ASSERT(raw->GetState() == EAssetState::Loaded && workerCalls == 1);
+	K3D_ASSERT(raw->GetBytes().size() == 100000 && raw->GetBytes()[999] == (kByte)999);
+	K3D_ASSERT(camera->GetCamera() && camera->GetCamera()->GetFOV() == 60.0f);
+	K3D_ASSERT(strcmp(camera->GetCamera()->Name(), "StreamCamera") == 0);
+	K3D_ASSERT(mainCalls == 0);
+	K3D_ASSERT(streamer.Update() == 1 && mainCalls == 1);
+	// done already, runs on the next Update
+	streamer.OnComplete(raw, [&mainCalls](AssetStreamRequest &) { mainCalls++; });
+	K3D_ASSERT(streamer.Update() == 1 && mainCalls == 2);
+	K3D_ASSERT(!streamer.Cancel(raw));
+	K3D_ASSERT(streamer.GetPendingCount() == 0);
+}
+
+void TestFailureAndCancel()
+{
+	AssetStreamer streamer(1);
+	AssetHandle missing = streamer.Request(KT("stream.missing"), EAssetType::EImage);
+	AssetHandle dependent = streamer.Request(KT("stream.raw"), EAssetType::EImage, AssetStreamPriority(), &missing, 1);
+	dependent->Wait();
+	K3D_ASSERT(missing->GetState() == EAssetState::Failed);
+	K3D_ASSERT(dependent->GetState() == EAssetState::Failed);
+
+	// a long queue of missing files fails one read after another, each
+	// opened on a worker rather than where the last one completed
+	uint32 requester = Os::Thread::GetId();
+	std::atomic<uint32> failedOnRequester(0);
+	vector<AssetHandle> missingFiles;
+	streamer.SetMaxInFlight(0);
+	for (int i = 0; i < 2000; i++)
+	{
+		kString path = KT("stream.missing.");
+		for (int n = i; ; n /= 10)
+		{
+			path += (kchar)(KT('0') + n % 10);
+			if (n < 10)
+				break;
+		}
+		missingFiles.push_back(streamer.Request(path.c_str(), EAssetType::EImage));
+		streamer.OnComplete(missingFiles.back(), [requester, &failedOnRequester](AssetStreamRequest &)
+		{
+			if (Os::Thread::GetId() == requester)
+				failedOnRequester++;
+		}, EAssetCallbackThread::Worker);
+	}
+	streamer.SetMaxInFlight(1);
+	for (auto & request : missingFiles)
+	{
+		request->Wait();
+		K3D_ASSERT(request->GetState() == EAssetState::Failed);
+	}
+	K3D_ASSERT(failedOnRequester == 0);
+
+	// held in the queue, cancelled before any read
+	streamer.SetMaxInFlight(0);
+	vector<AssetHandle> queued;
+	const kchar * paths[] = { KT("stream.raw"), KT("stream2.raw"), KT("stream3.raw") };
+	for (auto path : paths)
+		queued.push_back(streamer.Request(path, EAssetType::EImage, AssetStreamPriority(100.0f, false)));
+	AssetHandle blocked = streamer.Request(KT("stream.cam"), EAssetType::ECamera, AssetStreamPriority(), &queued[0], 1);
+	K3D_ASSERT(streamer.Cancel(queued[0]) && !streamer.Cancel(queued[0]));
+	K3D_ASSERT(queued[0]->GetState() == EAssetState::Cancelled);
+	K3D_ASSERT(blocked->GetState() == EAssetState::Failed);
+	K3D_ASSERT(streamer.Cancel(queued[1]));
+
+	// in flight, cancelled or already through
+	streamer.SetMaxInFlight(1);
+	streamer.Cancel(queued[2]);
+	queued[2]->Wait();
+	K3D_ASSERT(queued[2]->GetState() == EAssetState::Cancelled || queued[2]->GetState() == EAssetState::Loaded);
+	K3D_ASSERT(streamer.GetPendingCount() == 0);
+}
+
+void TestPriority()
+{
+	AssetStreamer streamer(0);
+	AssetHandle far = streamer.Request(KT("stream.raw"), EAssetType::EImage, AssetStreamPriority(50.0f, true));
+	AssetHandle hidden = streamer.Request(KT("stream2.raw"), EAssetType::EImage, AssetStreamPriority(1.0f, false));
+	AssetHandle near = streamer.Request(KT("stream3.raw"), EAssetType::EImage, AssetStreamPriority(5.0f, false));
+	K3D_ASSERT(near->GetState() == EAssetState::Queued && streamer.GetPendingCount() == 3);
+	streamer.SetPriority(near, AssetStreamPriority(5.0f, true));
+
+	Os::Mutex lock;
+	vector<AssetStreamRequest*> order;
+	for (auto request : { hidden, far, near })
+	{
+		streamer.OnComplete(request, [&lock, &order](AssetStreamRequest & r)
+		{
+			lock.Lock();
+			order.push_back(&r);
+			lock.UnLock();
+		}, EAssetCallbackThread::Worker);
+	}
+	// one read at a time: nearest visible first, invisible last
+	streamer.SetMaxInFlight(1);
+	hidden->Wait();
+	far->Wait();
+	near->Wait();
+	K3D_ASSERT(order.size() == 3);
+	K3D_ASSERT(order[0] == near.get() && order[1] == far.get() && order[2] == hidden.get());
+}
+
+void TestDependencyCycle()
+{
+	AssetStreamer streamer(0);
+	AssetHandle first = streamer.Request(KT("stream.raw"), EAssetType::EImage);
+	AssetHandle second = streamer.Request(KT("stream2.raw"), EAssetType::EImage, AssetStreamPriority(), &first, 1);
+	// merged into first, which second already waits on
+	K3D_ASSERT(streamer.Request(KT("./stream.raw"), EAssetType::EImage, AssetStreamPriority(), &second, 1) == first);
+	streamer.SetMaxInFlight(2);
+	first->Wait();
+	second->Wait();
+	K3D_ASSERT(first->GetState() == EAssetState::Failed && second->GetState() == EAssetState::Failed);
+	K3D_ASSERT(streamer.GetPendingCount() == 0);
+}
+
+void StreamFromVFS()
+{
+	VirtualFS vfs;
+	K3D_ASSERT(vfs.MountBundle("bundle/", KT("./stream.bundle")));
+	K3D_ASSERT(vfs.MountDirectory("disk/", KT("./")));
+	VirtualFS::MountId memory = vfs.MountMemory("memory/");
+	const char blob[] = "in memory only";
+	K3D_ASSERT(vfs.WriteMemory(memory, "blob", blob, sizeof(blob)));
+	VFSLocation location;
+	K3D_ASSERT(vfs.Locate("bundle/BundleGrid", location) && location.Compression == EChunkCompression::LZ);
+
+	AssetStreamer streamer(4, &vfs);
+	// compressed chunk, read from its range of the bundle
+	AssetHandle mesh = streamer.Request(KT("asset://bundle/BundleGrid"), EAssetType::EMesh);
+	AssetHandle camera = streamer.Request(KT("bundle/BundleCamera"), EAssetType::ECamera);
+	AssetHandle loose = streamer.Request(KT("disk/./stream.cam"), EAssetType::ECamera);
+	AssetHandle bytes = streamer.Request(KT("memory/blob"), EAssetType::EImage);
+	AssetHandle missing = streamer.Request(KT("bundle/Missing"), EAssetType::EMesh);
+	for (auto request : { mesh, camera, loose, bytes, missing })
+		request->Wait();
+
+	K3D_ASSERT(mesh->GetState() == EAssetState::Loaded && mesh->GetMesh());
+	K3D_ASSERT(strcmp(mesh->GetMesh()->Name(), "BundleGrid") == 0);
+	K3D_ASSERT(mesh->GetMesh()->GetIndexNum() == 100000 && mesh->GetMesh()->GetIndexBuffer()[99999] == 33333);
+	K3D_ASSERT(camera->GetState() == EAssetState::Loaded && camera->GetCamera()->GetFOV() == 45.0f);
+	K3D_ASSERT(loose->GetState() == EAssetState::Loaded && loose->GetCamera()->GetFOV() == 60.0f);
+	K3D_ASSERT(bytes->GetState() == EAssetState::Loaded && bytes->GetBytes().size() == sizeof(blob));
+	K3D_ASSERT(memcmp(bytes->GetBytes().data(), blob, sizeof(blob)) == 0);
+	K3D_ASSERT(missing->GetState() == EAssetState::Failed);
+}
+
+void TestVirtualFS()
+{
+	WriteBundle(KT("stream.bundle"));
+	// unmapped before the bundle is removed
+	StreamFromVFS();
+	remove("stream.bundle");
+}
+
+AssetResidency::Resource MakeBlob(uint32 size)
+{
+	return std::make_shared<vector<kByte>>(size);
+}
+
+void TestResidency()
+{
+	// cameras with a path can stream back in, so they are evicted
+	AssetResidency sweep;
+	sweep.SetBudget(EAssetType::ECamera, 250);
+	sweep.Insert(Name("A"), EAssetType::ECamera, MakeBlob(100), 100, KT("a.cam"));
+	sweep.Insert(Name("B"), EAssetType::ECamera, MakeBlob(100), 100, KT("b.cam"));
+	K3D_ASSERT(sweep.Find(Name("B")));
+	// A was not found since, it goes first
+	sweep.Insert(Name("C"), EAssetType::ECamera, MakeBlob(100), 100, KT("c.cam"));
+	K3D_ASSERT(!sweep.Find(Name("A")) && sweep.Find(Name("B")) && sweep.Find(Name("C")));
+	AssetResidencyStats stats = sweep.GetStats(EAssetType::ECamera);
+	K3D_ASSERT(stats.Evictions == 1 && stats.BytesResident == 200 && stats.Resident == 2);
+	K3D_ASSERT(stats.Hits == 3 && stats.Misses == 1 && stats.HitRate() == 0.75f);
+	// no streamer to reload with
+	K3D_ASSERT(!sweep.Reload(Name("A")));
+
+	// pinned or held assets stay over budget until released
+	sweep.Pin(Name("B"));
+	AssetResidency::Resource held = sweep.Find(Name("C"));
+	sweep.Insert(Name("D"), EAssetType::ECamera, MakeBlob(100), 100, KT("d.cam"));
+	K3D_ASSERT(sweep.GetStats(EAssetType::ECamera).BytesResident == 300);
+	K3D_ASSERT(sweep.Trim(EAssetType::ECamera) == 1 && !sweep.Find(Name("D")));
+	held = nullptr;
+	sweep.SetBudget(EAssetType::ECamera, 100);
+	stats = sweep.GetStats(EAssetType::ECamera);
+	K3D_ASSERT(stats.Resident == 1 && stats.Pinned == 1 && sweep.Find(Name("B")));
+
+	// nothing could bring these back, evicting them would lose them
+	sweep.SetBudget(EAssetType::EMesh, 1);
+	sweep.Insert(Name("Appended"), EAssetType::EMesh, std::make_shared<MeshData>(), 100);
+	sweep.SetBudget(EAssetType::EShaderBytes, 1);
+	sweep.Insert(Name("Shader"), EAssetType::EShaderBytes, MakeBlob(100), 100, KT("shader.spv"));
+	K3D_ASSERT(sweep.Find(Name("Appended")) && sweep.Find(Name("Shader")));
+	K3D_ASSERT(sweep.GetStats(EAssetType::EMesh).Evictions == 0 && sweep.GetStats(EAssetType::EShaderBytes).Evictions == 0);
+
+	// evicted cameras stream back in from their path
+	AssetStreamer streamer;
+	AssetResidency residency(&streamer);
+	Name name("StreamCamera");
+	residency.Insert(name, EAssetType::ECamera, std::make_shared<CameraData>(), sizeof(CameraData), KT("stream.cam"));
+	residency.SetBudget(EAssetType::ECamera, 1);
+	K3D_ASSERT(residency.GetStats(EAssetType::ECamera).Evictions == 1);
+	residency.SetBudget(EAssetType::ECamera, 0);
+	AssetHandle reload = residency.Reload(name);
+	K3D_ASSERT(reload);
+	reload->Wait();
+	std::shared_ptr<CameraData> reloaded = residency.Find<CameraData>(name);
+	K3D_ASSERT(reloaded && reloaded->GetFOV() == 60.0f);
+	K3D_ASSERT(residency.GetStats(EAssetType::ECamera).Reloads == 1);
+
+	// what hot reload swaps when stream.cam changes
+	std::vector<AssetSource> sources;
+	K3D_ASSERT(residency.FindByPath(KT("stream.cam"), sources) == 1);
+	K3D_ASSERT(sources[0].Asset == name && sources[0].Type == EAssetType::ECamera);
+	K3D_ASSERT(!residency.FindByPath(KT("stream.raw"), sources));
+
+	// the request lets go of a streamed asset once delivered, holding
+	// the handle does not keep it resident
+	AssetHandle streamed = streamer.Request(KT("./stream.cam"), EAssetType::ECamera);
+	streamer.OnComplete(streamed, [&residency](AssetStreamRequest & loaded)
+	{
+		residency.Insert(Name("Streamed"), EAssetType::ECamera, loaded.GetCamera(), sizeof(CameraData), loaded.GetPath().c_str());
+	}, EAssetCallbackThread::Worker);
+	streamed->Wait();
+	K3D_ASSERT(streamed->GetCamera());
+	streamer.Update();
+	K3D_ASSERT(!streamed->GetCamera());
+	residency.SetBudget(EAssetType::ECamera, 1);
+	// reloaded is still held
+	K3D_ASSERT(residency.GetStats(EAssetType::ECamera).Evictions == 2);
+	residency.SetBudget(EAssetType::ECamera, 0);
+
+	K3D_ASSERT(residency.Remove(name) && !residency.Find(name));
+	residency.Clear();
+	K3D_ASSERT(residency.GetStats(EAssetType::ECamera).Resident == 0);
+}
+
+int main(int argc, char**argv)
+{
+	WriteCamera("stream.cam", "StreamCamera", 60.0f);
+	WriteBytes("stream.raw", 100000);
+	WriteBytes("stream2.raw", 1000);
+	WriteBytes("stream3.raw", 1000);
+	TestStreaming();
+	TestFailureAndCancel();
+	TestPriority();
+	TestDependencyCycle();
+	TestVirtualFS();
+	TestResidency();
+	remove("stream.cam");
+	remove("stream.raw");
+	remove("stream2.raw");
+	remove("stream3.raw");
+	return 0;
+}
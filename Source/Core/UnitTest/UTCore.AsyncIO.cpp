@@ -0,0 +1,165 @@
+#include "Common.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+static const char * kTestFile = "AsyncIO.test.bin";
+static const uint32 kBlockSize = 4096;
+static const uint32 kNumBlocks = 1024;
+
+void WriteTestFile()
+{
+	vector<uint32> data(kBlockSize * kNumBlocks / sizeof(uint32));
+	for (uint32 i = 0; i < data.size(); i++)
+		data[i] = i;
+	Os::File file;
+	K3D_ASSERT(file.Open(kTestFile, IOWrite));
+	file.Write(data.data(), data.size() * sizeof(uint32));
+	file.Close();
+}
+
+void TestBatchedReads()
+{
+	Os::File file;
+	K3D_ASSERT(file.Open(kTestFile, IORead));
+	vector<uint32> dest(kBlockSize * kNumBlocks / sizeof(uint32), 0xffffffff);
+	vector<IOReadRequest> requests(kNumBlocks);
+	std::atomic<uint32> callbacks(0);
+	for (uint32 i = 0; i < kNumBlocks; i++)
+	{
+		// reverse order, mixed priorities
+		uint32 block = kNumBlocks - 1 - i;
+		requests[i].File = &file;
+		requests[i].Dest = (char*)dest.data() + block * kBlockSize;
+		requests[i].Offset = block * kBlockSize;
+		requests[i].Size = kBlockSize;
+		requests[i].Priority = (EIOPriority)(i % 3);
+		requests[i].OnComplete = [&callbacks](IOResult const & result) {
+			K3D_ASSERT(result.Status == EIOStatus::Done && result.BytesRead == kBlockSize);
+			callbacks++;
+		};
+	}
+	IOBatch batch;
+	AsyncIO::Submit(requests.data(), kNumBlocks, &batch);
+	batch.Wait();
+	K3D_ASSERT(callbacks == kNumBlocks && batch.GetFailedCount() == 0);
+	K3D_ASSERT(batch.GetBytesRead() == (uint64)kBlockSize * kNumBlocks);
+	for (uint32 i = 0; i < dest.size(); i++)
+	{
+		K3D_ASSERT(dest[i] == i);
+	}
+
+	// short read at the end of the file
+	uint32 tail[4] = {};
+	IOBatch eof;
+	AsyncIO::Read(file, tail, kBlockSize * kNumBlocks - 8, sizeof(tail), nullptr, EIOPriority::High, &eof);
+	eof.Wait();
+	K3D_ASSERT(eof.GetBytesRead() == 8 && tail[1] == kBlockSize * kNumBlocks / 4 - 1);
+	file.Close();
+}
+
+void TestCancel()
+{
+	Os::File file;
+	K3D_ASSERT(file.Open(kTestFile, IORead));
+	vector<char> dest(kBlockSize * kNumBlocks);
+	vector<IOReadRequest> requests(kNumBlocks);
+	vector<IORequestId> ids(kNumBlocks);
+	vector<int> statuses(kNumBlocks, -1);
+	for (uint32 i = 0; i < kNumBlocks; i++)
+	{
+		requests[i].File = &file;
+		requests[i].Dest = dest.data() + i * kBlockSize;
+		requests[i].Offset = i * kBlockSize;
+		requests[i].Size = kBlockSize;
+		requests[i].Priority = EIOPriority::Low;
+		int * status = &statuses[i];
+		requests[i].OnComplete = [status](IOResult const & result) { *status = (int)result.Status; };
+	}
+	IOBatch batch;
+	AsyncIO::Submit(requests.data(), kNumBlocks, &batch, ids.data());
+	uint32 numCancelled = 0;
+	vector<bool> cancelled(kNumBlocks, false);
+	for (uint32 i = kNumBlocks; i-- > kNumBlocks / 2;)
+	{
+		cancelled[i] = AsyncIO::Cancel(ids[i]);
+		numCancelled += cancelled[i] ? 1 : 0;
+	}
+	batch.Wait();
+	K3D_ASSERT(batch.GetFailedCount() == numCancelled);
+	for (uint32 i = 0; i < kNumBlocks; i++)
+	{
+		K3D_ASSERT(statuses[i] == (int)(cancelled[i] ? EIOStatus::Cancelled : EIOStatus::Done));
+	}
+	// already completed
+	K3D_ASSERT(!AsyncIO::Cancel(ids[0]));
+	K3D_ASSERT(AsyncIO::GetPendingCount() == 0);
+	file.Close();
+}
+
+void TestShutdown()
+{
+	Os::File file;
+	K3D_ASSERT(file.Open(kTestFile, IORead));
+	AsyncIO::Init(EIOBackend::ThreadPool, 64, 4);
+
+	// submissions racing the shutdown all complete, the late ones cancelled
+	std::atomic<bool> stop(false);
+	std::atomic<uint32> submitted(0), completed(0);
+	std::thread submitter([&]()
+	{
+		char dest[64];
+		while (!stop)
+		{
+			IOBatch batch;
+			AsyncIO::Read(file, dest, 0, sizeof(dest), [&completed](IOResult const &) { completed++; },
+				EIOPriority::Normal, &batch);
+			submitted++;
+			batch.Wait();
+		}
+	});
+	while (submitted < 100)
+		std::this_thread::yield();
+	AsyncIO::Shutdown();
+	while (submitted < 200)
+		std::this_thread::yield();
+	stop = true;
+	submitter.join();
+	K3D_ASSERT(completed == submitted);
+
+	// no restart until Init
+	uint32 status = (uint32)EIOStatus::Pending;
+	IOBatch late;
+	IORequestId id = AsyncIO::Read(file, &status, 0, 4,
+		[&status](IOResult const & result) { status = (uint32)result.Status; }, EIOPriority::Normal, &late);
+	late.Wait();
+	K3D_ASSERT(id == 0 && status == (uint32)EIOStatus::Cancelled && late.GetFailedCount() == 1);
+	K3D_ASSERT(string(AsyncIO::GetBackendName()) == "None");
+	file.Close();
+}
+
+int main(int argc, char**argv)
+{
+	WriteTestFile();
+	AsyncIO::Init();
+	cout << "backend:" << AsyncIO::GetBackendName() << endl;
+	TestBatchedReads();
+	TestCancel();
+	AsyncIO::Shutdown();
+
+	AsyncIO::Init(EIOBackend::ThreadPool, 64, 4);
+	K3D_ASSERT(AsyncIO::GetBackend() == EIOBackend::ThreadPool);
+	TestBatchedReads();
+	TestCancel();
+	AsyncIO::Shutdown();
+	TestShutdown();
+	cout << "async io test passed" << endl;
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include "Common.h"
 #include <Core/MeshData.h>
 #include <Core/CameraData.h>
+#include <Core/Utils/LZ.h>
 
 #if K3DPLATFORM_OS_WIN
 #pragma comment(linker,"/subsystem:console")
@@ -9,54 +10,200 @@
 using namespace k3d;
 using namespace std;
 
+AssetCookStats WriteTestBundle(const kchar * name, EChunkCompression compression,
+	bool incremental = false, AssetCookCache * cache = nullptr, float mainFov = 30.0f)
+{
+	AssetBundle * bundle = AssetBundle::CreateBundle(name, KT("./"));
+	bundle->SetCompression(compression);
+	bundle->SetIncremental(incremental);
+	bundle->SetCookCache(cache);
+	bundle->Prepare();
+	const char * names[] = { "MainCamera", "ShadowCamera", "DebugCamera" };
+	CameraData cameras[3];
+	for (uint32 i = 0; i < 3; i++)
+	{
+		cameras[i].SetName(names[i]);
+		cameras[i].SetFOV(30.0f + i);
+	}
+	cameras[0].SetFOV(mainFov);
+	bundle->Serialize(&cameras[0]);
+	// cooked in parallel, the order is kept
+	CameraData * batch[] = { &cameras[1], nullptr, &cameras[2] };
+	bundle->Serialize(batch, 3);
+
+	// a few blocks of fairly regular data
+	MeshData mesh;
+	mesh.SetMeshName("Grid");
+	vector<uint32> indices(200000);
+	for (uint32 i = 0; i < indices.size(); i++)
+		indices[i] = (i / 6) * 4 + "\0\1\2\2\1\3"[i % 6];
+	mesh.SetIndexBuffer(indices);
+	bundle->Serialize(&mesh);
+	bundle->MergeAndBundle(true);
+	AssetCookStats stats = bundle->GetCookStats();
+	delete bundle;
+	return stats;
+}
+
 void TestBundle()
 {
-		Os::File file("../../Data/Test/test.bundle");
-		file.Open(IORead);
-		Archive arch;
-		arch.SetIODevice(&file);
-		EAssetVersion bundleVer;
-		arch >> bundleVer;
-		int64 szTable;
-		arch >> szTable;
-		uint64 chunkCnt = szTable / sizeof(AssetChunk);
-		vector<AssetChunk> chunks(chunkCnt);
-		for (uint32 i = 0; i < chunkCnt; i++)
-		{
-			arch >> chunks[i];
-		}
-
-		for (uint32 i = 0; i < chunkCnt; i++)
-		{
-			EAssetType type;
-			arch >> type;
-			K3D_ASSERT(type == chunks[i].Type);
-			MeshData meshData;
-			CameraData camData;
-			switch (type)
-			{
-			case EAssetType::EMesh:
-				EMeshVersion meshVer;
-				arch >> meshVer;
-				file.Skip( 64);//class name
-				arch >> meshData;
-				break;
-			case EAssetType::ECamera:
-				ECamVersion camVer;
-				arch >> camVer;
-				file.Skip( 64);//class name
-				arch >> camData;
-				break;
-			}
-			arch >> type;
-			K3D_ASSERT(type == EAssetType::EChunkEnd);
-		}
-
-		file.Close();
+	AssetBundleReader reader;
+	K3D_ASSERT(reader.Open(KT("./test.bundle")));
+	K3D_ASSERT(reader.GetChunkCount() == 4);
+
+	AssetChunkView view = reader.Find("ShadowCamera");
+	K3D_ASSERT(view && view.Type == EAssetType::ECamera);
+	K3D_ASSERT(strcmp(view.Name, "ShadowCamera") == 0);
+	K3D_ASSERT(K3D_NAME_ID("DebugCamera") == Name("DebugCamera").GetId());
+	K3D_ASSERT(reader.Find(Name("DebugCamera")).Data == reader.GetChunk(2).Data);
+	K3D_ASSERT(!reader.Find("MissingCamera"));
+
+	for (uint32 i = 0; i < 3; i++)
+	{
+		AssetChunkView chunk = reader.GetChunk(i);
+		// payloads are page aligned inside the mapping
+		K3D_ASSERT(((uintptr_t)chunk.Data & (BundleAlignment - 1)) == 0);
+
+		// version, class name, camera name then the fields, read in place
+		const kByte * data = (const kByte*)chunk.Data;
+		K3D_ASSERT(*(const ECamVersion*)data == ECamVersion::VERSION_1_0);
+		K3D_ASSERT(strcmp((const char*)data + 8 + 64, chunk.Name) == 0);
+		float fov = 0;
+		memcpy(&fov, data + 8 + 128, sizeof(float));
+		K3D_ASSERT(fov == 30.0f + i);
+	}
+	reader.Close();
+	K3D_ASSERT(!reader.IsOpen());
+}
+
+void TestLZ()
+{
+	vector<kByte> text(100000);
+	for (size_t i = 0; i < text.size(); i++)
+		text[i] = "kaleido3d bundle "[i % 17] + (kByte)(i / 5000);
+	vector<kByte> packed(LZ::CompressBound(text.size()));
+	size_t size = LZ::Compress(text.data(), text.size(), packed.data(), packed.size());
+	K3D_ASSERT(size > 0 && size < text.size() / 4);
+	vector<kByte> unpacked(text.size());
+	K3D_ASSERT(LZ::Decompress(packed.data(), size, unpacked.data(), unpacked.size()) == text.size());
+	K3D_ASSERT(unpacked == text);
+	// truncated input or a short output never overruns
+	K3D_ASSERT(LZ::Decompress(packed.data(), size, unpacked.data(), unpacked.size() / 2) == size_t(-1));
+	size_t truncated = LZ::Decompress(packed.data(), size / 2, unpacked.data(), unpacked.size());
+	K3D_ASSERT(truncated == size_t(-1) || truncated < text.size());
+
+	// noise does not shrink
+	vector<kByte> noise(10000);
+	uint32 seed = 12345;
+	for (auto & b : noise)
+	{
+		seed = seed * 1103515245 + 12345;
+		b = (kByte)(seed >> 16);
+	}
+	K3D_ASSERT(LZ::Compress(noise.data(), noise.size(), packed.data(), noise.size() - 1) == 0);
+}
+
+void TestCompressedBundle()
+{
+	AssetBundleReader raw, lz;
+	K3D_ASSERT(raw.Open(KT("./test.bundle")));
+	K3D_ASSERT(lz.Open(KT("./testlz.bundle")));
+	K3D_ASSERT(lz.GetChunkCount() == raw.GetChunkCount());
+
+	AssetChunkView grid = lz.Find("Grid");
+	K3D_ASSERT(grid.Compression == EChunkCompression::LZ);
+	K3D_ASSERT(grid.Size < grid.RawSize);
+	K3D_ASSERT(GetChunkBlockCount(grid) == (grid.RawSize + ChunkBlockSize - 1) / ChunkBlockSize);
+
+	for (uint32 i = 0; i < lz.GetChunkCount(); i++)
+	{
+		AssetChunkView expected = raw.GetChunk(i);
+		AssetChunkView chunk = lz.GetChunk(i);
+		K3D_ASSERT(expected.Compression == EChunkCompression::None);
+		K3D_ASSERT(chunk.RawSize == expected.Size);
+		vector<kByte> bytes((size_t)chunk.RawSize);
+		K3D_ASSERT(DecompressChunk(chunk, bytes.data()));
+		K3D_ASSERT(memcmp(bytes.data(), expected.Data, bytes.size()) == 0);
+	}
+
+	// blocks decode on their own, in any order
+	vector<kByte> bytes((size_t)grid.RawSize);
+	for (uint32 b = GetChunkBlockCount(grid); b-- > 0;)
+		K3D_ASSERT(DecompressChunkBlock(grid, b, bytes.data()));
+	K3D_ASSERT(memcmp(bytes.data(), raw.Find("Grid").Data, bytes.size()) == 0);
+}
+
+void TestIncrementalCook()
+{
+	AssetCookStats stats = WriteTestBundle(KT("testinc.bundle"), EChunkCompression::LZ, true);
+	K3D_ASSERT(stats.Chunks == 4 && stats.Reused == 0 && !stats.UpToDate);
+
+	stats = WriteTestBundle(KT("testinc.bundle"), EChunkCompression::LZ, true);
+	K3D_ASSERT(stats.Reused == 4 && stats.UpToDate);
+
+	// one edit, the rest comes from the previous bundle
+	stats = WriteTestBundle(KT("testinc.bundle"), EChunkCompression::LZ, true, nullptr, 45.0f);
+	K3D_ASSERT(stats.Reused == 3 && !stats.UpToDate);
+	{
+		AssetBundleReader reader;
+		K3D_ASSERT(reader.Open(KT("./testinc.bundle")));
+		AssetChunkView main = reader.Find("MainCamera");
+		vector<kByte> bytes((size_t)main.RawSize);
+		K3D_ASSERT(DecompressChunk(main, bytes.data()));
+		float fov = 0;
+		memcpy(&fov, bytes.data() + 8 + 128, sizeof(float));
+		K3D_ASSERT(fov == 45.0f);
+		AssetChunkView grid = reader.Find("Grid");
+		vector<kByte> raw((size_t)grid.RawSize);
+		K3D_ASSERT(DecompressChunk(grid, raw.data()));
+	}
+
+	// a changed compression setting recooks
+	stats = WriteTestBundle(KT("testinc.bundle"), EChunkCompression::None, true, nullptr, 45.0f);
+	K3D_ASSERT(stats.Reused == 0);
+
+	// bundles of one cook share the compressed payloads
+	AssetCookCache cache;
+	stats = WriteTestBundle(KT("testa.bundle"), EChunkCompression::LZ, false, &cache);
+	K3D_ASSERT(stats.Cached == 0 && cache.GetCount() == 4);
+	stats = WriteTestBundle(KT("testb.bundle"), EChunkCompression::LZ, false, &cache, 50.0f);
+	K3D_ASSERT(stats.Cached == 3);
+	{
+		AssetBundleReader a, b;
+		K3D_ASSERT(a.Open(KT("./testa.bundle")) && b.Open(KT("./testb.bundle")));
+		AssetChunkView ga = a.Find("Grid"), gb = b.Find("Grid");
+		K3D_ASSERT(ga.Size == gb.Size && memcmp(ga.Data, gb.Data, (size_t)ga.Size) == 0);
+	}
+
+	// identical chunks are stored once
+	AssetBundle * bundle = AssetBundle::CreateBundle(KT("testdup.bundle"), KT("./"));
+	CameraData camera;
+	camera.SetName("Twin");
+	bundle->Serialize(&camera);
+	bundle->Serialize(&camera);
+	bundle->MergeAndBundle(false);
+	K3D_ASSERT(bundle->GetCookStats().Deduplicated == 1);
+	delete bundle;
+	{
+		AssetBundleReader reader;
+		K3D_ASSERT(reader.Open(KT("./testdup.bundle")));
+		K3D_ASSERT(reader.GetChunk(0).Data == reader.GetChunk(1).Data);
+	}
+
+	const char * files[] = { "./testinc.bundle", "./testinc.manifest", "./testa.bundle", "./testb.bundle", "./testdup.bundle" };
+	for (auto file : files)
+		remove(file);
 }
 
 int main(int argc, char**argv)
 {
+	WriteTestBundle(KT("test.bundle"), EChunkCompression::None);
+	WriteTestBundle(KT("testlz.bundle"), EChunkCompression::LZ);
 	TestBundle();
+	TestLZ();
+	TestCompressedBundle();
+	TestIncrementalCook();
+	remove("./test.bundle");
+	remove("./testlz.bundle");
 	return 0;
-}
\ No newline at end of file
+}
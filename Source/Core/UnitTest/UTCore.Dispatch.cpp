@@ -0,0 +1,170 @@
+#include "Common.h"
+#include <atomic>
+#include <memory>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestWorkGroup()
+{
+	Dispatch::WorkQueue queue("TestQueue", Os::ThreadPriority::Normal);
+	queue.Loop();
+	cout << "workers:" << queue.GetWorkerCount() << endl;
+
+	std::atomic<int> counter(0);
+	std::atomic<bool> continued(false);
+	Dispatch::WorkGroup group;
+	for (int i = 0; i < 1000; i++)
+	{
+		group.Add(Dispatch::Bind([&counter]() { counter++; }));
+	}
+	group.Then(Dispatch::Bind([&continued]() { continued = true; }));
+	queue.Queue(&group);
+	group.Wait();
+	K3D_ASSERT(counter == 1000);
+	while (!continued)
+	{
+		Os::Sleep(1);
+	}
+	queue.StopAll();
+}
+
+void TestRequeueGroup()
+{
+	Dispatch::WorkQueue queue("RequeueQueue", Os::ThreadPriority::Normal, 4);
+	queue.Loop();
+	std::atomic<int> counter(0);
+	Dispatch::WorkGroup group;
+	for (int i = 0; i < 256; i++)
+	{
+		group.Add(Dispatch::Bind([&counter]() { counter++; }));
+	}
+	// the group keeps its items, the second run executes them again
+	queue.Queue(&group);
+	group.Wait();
+	queue.Queue(&group);
+	group.Wait();
+	K3D_ASSERT(counter == 2 * 256);
+	queue.StopAll();
+
+	// an item cancelled in one run still executes in the next
+	Dispatch::WorkQueue stopped("CancelQueue", Os::ThreadPriority::Normal, 4);
+	std::atomic<int> cancelled(0);
+	Dispatch::WorkGroup once;
+	Dispatch::WorkItem * item = Dispatch::Bind([&cancelled]() { cancelled++; });
+	once.Add(item);
+	stopped.Queue(&once);
+	item->RemoveFromQueue();
+	stopped.Loop();
+	once.Wait();
+	K3D_ASSERT(cancelled == 0);
+	stopped.Queue(&once);
+	once.Wait();
+	K3D_ASSERT(cancelled == 1);
+	stopped.StopAll();
+}
+
+void TestNestedSpawn()
+{
+	Dispatch::WorkQueue queue("NestedQueue", Os::ThreadPriority::Normal);
+	queue.Loop();
+	std::atomic<int> counter(0);
+	Dispatch::WorkGroup outer;
+	for (int i = 0; i < 64; i++)
+	{
+		outer.Add(Dispatch::Bind([&queue, &counter]() {
+			// spawn from a worker, pushed onto its own deque and stolen by others
+			Dispatch::WorkGroup inner;
+			for (int j = 0; j < 64; j++)
+			{
+				inner.Add(Dispatch::Bind([&counter]() { counter++; }));
+			}
+			queue.Queue(&inner);
+			inner.Wait();
+		}));
+	}
+	queue.Queue(&outer);
+	outer.Wait();
+	K3D_ASSERT(counter == 64 * 64);
+	queue.StopAll();
+}
+
+void TestParallelFor()
+{
+	vector<uint32> data(100000);
+	Dispatcher::ParallelFor((uint32)data.size(), 1024, [&data](uint32 i) {
+		data[i] = i * 2;
+	});
+	for (uint32 i = 0; i < data.size(); i++)
+	{
+		K3D_ASSERT(data[i] == i * 2);
+	}
+}
+
+void TestInplaceFunction()
+{
+	int calls = 0;
+	InplaceFunction<int(int)> add = [&calls](int v) { calls++; return v + 1; };
+	K3D_ASSERT(add(1) == 2);
+	InplaceFunction<int(int)> copy = add;
+	InplaceFunction<int(int)> moved = Move(add);
+	K3D_ASSERT(!add && copy(2) == 3 && moved(3) == 4 && calls == 3);
+
+	// move-only capture
+	std::unique_ptr<int> owned(new int(7));
+	InplaceFunction<int()> unique = [p = std::move(owned)]() { return *p; };
+	InplaceFunction<int()> target;
+	target = Move(unique);
+	K3D_ASSERT(target() == 7);
+	target = nullptr;
+	K3D_ASSERT(!target);
+
+	// a thread function larger than Os::Thread::Call goes to the heap
+	char big[Os::Thread::kCallCapacity * 2] = {};
+	big[sizeof(big) - 1] = 5;
+	int seen = 0;
+	Os::Thread thread([big, &seen]() { seen = big[sizeof(big) - 1]; }, "BigCapture");
+	thread.Start();
+	thread.Join();
+	K3D_ASSERT(seen == 5);
+}
+
+void TestPooledItems()
+{
+	Dispatch::WorkQueue queue("PoolQueue", Os::ThreadPriority::Normal, 4);
+	queue.Loop();
+	std::atomic<int> counter(0);
+	uint32 chunks = 0;
+	for (int round = 0; round < 8; round++)
+	{
+		Dispatch::WorkGroup group;
+		for (int i = 0; i < 512; i++)
+		{
+			group.Add(Dispatch::Bind([&counter](int v) { counter += v; }, 1));
+		}
+		queue.Queue(&group);
+		group.Wait();
+		if (round == 1)
+			chunks = Dispatch::WorkItemPool::GetChunkCount();
+	}
+	K3D_ASSERT(counter == 8 * 512);
+	// blocks released by workers flow back to the submitting thread
+	K3D_ASSERT(Dispatch::WorkItemPool::GetChunkCount() <= chunks + queue.GetWorkerCount() * 4);
+	queue.StopAll();
+}
+
+int main(int argc, char**argv)
+{
+	TestInplaceFunction();
+	TestPooledItems();
+	TestWorkGroup();
+	TestRequeueGroup();
+	TestNestedSpawn();
+	TestParallelFor();
+	cout << "dispatch test passed" << endl;
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include "Common.h"
+#include <Core/FileWatcher.h>
+#include <string.h>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void WriteText(const char * path, const char * text)
+{
+	Os::File file;
+	K3D_ASSERT(file.Open(path, IOWrite));
+	file.Write(text, strlen(text));
+	file.Close();
+}
+
+/// Polls until count changes settled or a few seconds went by
+vector<FileChange> WaitChanges(FileWatcher & watcher, uint32 count)
+{
+	vector<FileChange> changes;
+	for (int i = 0; i < 300 && changes.size() < count; i++)
+	{
+		watcher.Poll(changes);
+		Os::Sleep(10);
+	}
+	// nothing else trickles in
+	Os::Sleep(300);
+	watcher.Poll(changes);
+	return changes;
+}
+
+void TestWatcher(bool polling)
+{
+	Os::MakeDir(KT("fw.root"));
+	WriteText("fw.root/a.txt", "a");
+
+	FileWatcher watcher(200, polling);
+	K3D_ASSERT(watcher.Watch(KT("fw.root")));
+	K3D_ASSERT(!watcher.Watch(KT("fw.missing")));
+
+	// a burst of writes is one change
+	for (int i = 0; i < 3; i++)
+	{
+		WriteText("fw.root/a.txt", i % 2 ? "edit" : "edited");
+		Os::Sleep(5);
+	}
+	vector<FileChange> changes = WaitChanges(watcher, 1);
+	K3D_ASSERT(changes.size() == 1);
+	K3D_ASSERT(changes[0].Path == KT("fw.root/a.txt") && changes[0].Kind == EFileChange::Modified);
+
+	WriteText("fw.root/b.txt", "b");
+	remove("fw.root/a.txt");
+	changes = WaitChanges(watcher, 2);
+	K3D_ASSERT(changes.size() == 2);
+	for (auto & change : changes)
+	{
+		bool created = change.Path == KT("fw.root/b.txt");
+		K3D_ASSERT(created || change.Path == KT("fw.root/a.txt"));
+		K3D_ASSERT(change.Kind == (created ? EFileChange::Created : EFileChange::Removed));
+	}
+
+	// directories made after Watch are watched too
+	Os::MakeDir(KT("fw.root/sub"));
+	Os::Sleep(100);
+	WriteText("fw.root/sub/c.txt", "c");
+	changes = WaitChanges(watcher, 1);
+	K3D_ASSERT(changes.size() == 1 && changes[0].Path == KT("fw.root/sub/c.txt"));
+
+	remove("fw.root/sub/c.txt");
+	remove("fw.root/b.txt");
+	Os::Remove(KT("fw.root/sub"));
+	Os::Remove(KT("fw.root"));
+}
+
+int main(int argc, char**argv)
+{
+	TestWatcher(true);
+	TestWatcher(false);
+	return 0;
+}
@@ -0,0 +1,202 @@
+#include "Common.h"
+#include <Core/FrameStats.h>
+#include <KTL/Histogram.hpp>
+
+#include <fstream>
+#include <sstream>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+class StatsLogger : public ILogger
+{
+public:
+	void Log(ELogLevel const & lv, const char * tag, const char * msg) override
+	{
+		if (lv == ELogLevel::Profile && string(tag) == "FrameStats")
+			Published.push_back(msg);
+		else if (lv == ELogLevel::Warn && string(tag) == "FrameStats")
+			Warnings.push_back(msg);
+	}
+
+	vector<string> Published;
+	vector<string> Warnings;
+};
+
+string ReadAll(const char * path)
+{
+	ifstream file(path);
+	stringstream text;
+	text << file.rdbuf();
+	return text.str();
+}
+
+void TestHistogram()
+{
+	HdrHistogram histogram(1000000);
+	for (uint64 v = 1; v <= 10000; v++)
+		histogram.Record(v);
+	K3D_ASSERT(histogram.GetCount() == 10000);
+	// within 1.6% above the exact value
+	uint64 p50 = histogram.ValueAtPercentile(50);
+	uint64 p99 = histogram.ValueAtPercentile(99);
+	K3D_ASSERT(p50 >= 5000 && p50 <= 5080);
+	K3D_ASSERT(p99 >= 9900 && p99 <= 10060);
+	K3D_ASSERT(histogram.ValueAtPercentile(100) >= 10000 && histogram.GetMax() >= 10000);
+
+	// small values are exact
+	HdrHistogram small;
+	small.Record(3, 99);
+	small.Record(100);
+	K3D_ASSERT(small.ValueAtPercentile(50) == 3 && small.ValueAtPercentile(100) == 100);
+	small.Remove(100);
+	K3D_ASSERT(small.GetCount() == 99 && small.GetMax() == 3);
+
+	// out of range values count as the max
+	small.Record(1000000000);
+	K3D_ASSERT(small.GetMax() == 60000000);
+
+	uint64 buckets = 0, total = 0;
+	histogram.ForEachBucket([&](uint64 low, uint64 high, uint64 count)
+	{
+		K3D_ASSERT(low <= high);
+		buckets++;
+		total += count;
+	});
+	K3D_ASSERT(total == 10000 && buckets < 10000);
+}
+
+/// Frames of timeUs, all spent in Update
+void RunFrames(uint32 count, uint64 timeUs)
+{
+	for (uint32 i = 0; i < count; i++)
+	{
+		FrameStats::AddPhaseTime(EFramePhase::Update, timeUs * 1000);
+		FrameStats::EndFrame(timeUs);
+	}
+}
+
+void TestWindow()
+{
+	FrameStats::Reset();
+	FrameStats::SetWindow(8);
+	FrameStats::SetHitchThresholds(0, 0);
+	RunFrames(8, 10000);
+	RunFrames(8, 1000);
+
+	FrameStatsReport window, session;
+	FrameStats::GetWindow(window);
+	FrameStats::GetSession(session);
+	K3D_ASSERT(window.FrameIndex == 16 && session.FrameIndex == 16);
+	K3D_ASSERT(window.Frame.Count == 8 && session.Frame.Count == 16);
+	// the slow frames rolled out of the window
+	K3D_ASSERT(window.Frame.Max < 1100 && session.Frame.Max >= 10000);
+	K3D_ASSERT(window.Frame.P50 <= window.Frame.P99 && window.Frame.P99 <= window.Frame.Max);
+	FrameTimeStats const & update = window.Phases[(uint32)EFramePhase::Update];
+	K3D_ASSERT(update.Count == 8 && update.Max <= window.Frame.Max);
+	K3D_ASSERT(window.Phases[(uint32)EFramePhase::Submit].Count == 0);
+	K3D_ASSERT(window.Hitches == 0);
+
+	// measured frames, the first call only starts the clock
+	FrameStats::Reset();
+	FrameStats::EndFrame();
+	FrameStats::GetSession(session);
+	K3D_ASSERT(session.FrameIndex == 0 && session.Frame.Count == 0);
+	FrameStats::EndFrame();
+	FrameStats::GetSession(session);
+	K3D_ASSERT(session.FrameIndex == 1 && session.Frame.Count == 1);
+}
+
+void TestHitches(StatsLogger & logger)
+{
+	FrameStats::Reset();
+	FrameStats::SetWindow(600);
+	FrameStats::SetHitchThresholds(60000, 0);
+	RunFrames(3, 1000);
+	RunFrames(1, 80000);
+	RunFrames(3, 1000);
+	FlushLog();
+
+	vector<FrameHitch> hitches;
+	FrameStats::GetHitches(hitches);
+	K3D_ASSERT(hitches.size() == 1 && hitches[0].FrameIndex == 3);
+	K3D_ASSERT(hitches[0].Time == 80000 && hitches[0].Phases[(uint32)EFramePhase::Update] == 80000);
+	K3D_ASSERT(logger.Warnings.size() == 1 && logger.Warnings[0].find("Hitch: frame 3") == 0);
+
+	// against the median of the window, only once it has enough frames
+	FrameStats::Reset();
+	FrameStats::SetHitchThresholds(0, 5.0f);
+	RunFrames(1, 40000);
+	RunFrames(30, 2000);
+	RunFrames(1, 60000);
+	FrameStats::GetHitches(hitches);
+	K3D_ASSERT(hitches.size() == 1 && hitches[0].FrameIndex == 31);
+}
+
+void TestBudget(StatsLogger & logger)
+{
+	FrameStats::Reset();
+	FrameStats::SetWindow(10);
+	FrameStats::SetHitchThresholds(0, 0);
+	FrameStats::SetBudget(90, 5000);
+	RunFrames(10, 1000);
+	FrameStatsReport report;
+	FrameStats::GetWindow(report);
+	K3D_ASSERT(report.WithinBudget);
+
+	logger.Warnings.clear();
+	RunFrames(10, 10000);
+	FlushLog();
+	FrameStats::GetWindow(report);
+	K3D_ASSERT(!report.WithinBudget);
+	// logged once for the whole excursion
+	K3D_ASSERT(logger.Warnings.size() == 1 && logger.Warnings[0].find("Frame time over budget") == 0);
+	FrameStats::SetBudget(0, 0);
+}
+
+void TestOutput(StatsLogger & logger)
+{
+	FrameStats::Reset();
+	FrameStats::SetHitchThresholds(8000, 0);
+	FrameStats::SetPublishInterval(4);
+	RunFrames(3, 1000);
+	RunFrames(1, 10000);
+	RunFrames(4, 1000);
+	FrameStats::SetPublishInterval(0);
+	FlushLog();
+
+	K3D_ASSERT(logger.Published.size() == 2);
+	K3D_ASSERT(logger.Published[0].find("{\"Frame\":4,\"Hitches\":1,") == 0);
+	K3D_ASSERT(logger.Published[1].find("{\"Name\":\"Submit\",\"Count\":0,") != string::npos);
+
+	K3D_ASSERT(FrameStats::Dump("framestats.csv"));
+	string csv = ReadAll("framestats.csv");
+	K3D_ASSERT(csv.find("metric,count,mean_us,p50_us,p95_us,p99_us,max_us\nFrame,8,") == 0);
+	K3D_ASSERT(csv.find("\nhitches,1\n") != string::npos && csv.find("\n3,") != string::npos);
+	K3D_ASSERT(csv.find("bucket_low_us,bucket_high_us,frames\n") != string::npos);
+	remove("framestats.csv");
+
+	K3D_ASSERT(FrameStats::Dump("framestats.json"));
+	string json = ReadAll("framestats.json");
+	K3D_ASSERT(json.find("{\"Frames\":8,\"Hitches\":1,\"Session\":[{\"Name\":\"Frame\",\"Count\":8,") == 0);
+	K3D_ASSERT(json.find("\"RecentHitches\":[{\"Frame\":3,") != string::npos);
+	K3D_ASSERT(json.find("\"FrameHistogram\":[[") != string::npos);
+	remove("framestats.json");
+}
+
+int main(int argc, char**argv)
+{
+	StatsLogger logger;
+	RegisterLogger(&logger);
+	TestHistogram();
+	TestWindow();
+	TestHitches(logger);
+	TestBudget(logger);
+	TestOutput(logger);
+	UnregisterLogger(&logger);
+	return 0;
+}
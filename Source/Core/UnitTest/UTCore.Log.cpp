@@ -0,0 +1,223 @@
+#include "Common.h"
+#include <Core/LogUtil.h>
+
+#include <mutex>
+#include <stdio.h>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+/// Keeps what the log thread hands over
+class CaptureLogger : public ILogger
+{
+public:
+	struct Line
+	{
+		string		Tag;
+		string		Message;
+		string		Thread;
+		uint64		Time;
+		uint32		Batch;
+		/// The thread that wrote the record out
+		string		Writer;
+	};
+
+	void Log(ELogLevel const &, const char * tag, const char * msg) override
+	{
+		Lines.push_back(Line{ tag, msg, string(), 0, Batches, Os::Thread::GetCurrentThreadName() });
+		Written++;
+	}
+
+	void Log(ELogLevel const &, const char * tag, const char * msg, LogSource const & source) override
+	{
+		Lines.push_back(Line{ tag, msg, source.Thread, source.Time, Batches, Os::Thread::GetCurrentThreadName() });
+		Written++;
+	}
+
+	void Flush() override { Batches++; }
+
+	vector<Line>	Lines;
+	uint32			Batches = 0;
+	std::atomic<uint32>	Written{ 0 };
+};
+
+template <typename... Args>
+string Printf(const char * format, Args... args)
+{
+	char buffer[1024];
+	snprintf(buffer, sizeof(buffer), format, args...);
+	return buffer;
+}
+
+#if K3DPLATFORM_OS_WIN
+#define UT_NOINLINE __declspec(noinline)
+#else
+#define UT_NOINLINE __attribute__((noinline))
+#endif
+
+/// The format lives in this frame only
+UT_NOINLINE void LogLocalFormat(int value)
+{
+	const char format[] = "local %d";
+	KLOG(Info, UTLog, format, value);
+}
+
+UT_NOINLINE void ClobberStack()
+{
+	volatile char junk[512];
+	for (size_t i = 0; i < sizeof(junk); i++)
+		junk[i] = 'x';
+}
+
+void TestFormatting(CaptureLogger & capture)
+{
+	enum class EColor : uint32 { Red = 3 };
+	int local = 0;
+	const char * name = "mesh";
+	char scratch[16] = "scratch %d";
+
+	KLOG(Info, UTLog, "plain");
+	KLOG(Info, UTLog, "%d %u %x %05.2f %s %c %%", -42, 7u, 255, 3.14159, name, 'k');
+	KLOG(Info, UTLog, "%lld %llu %-6s| %*d %.*s", (int64)-1, (uint64)1 << 40, "ab", 5, 12, 3, "abcdef");
+	KLOG(Info, UTLog, "%x %d %p", -1, EColor::Red, (void*)&local);
+	KLOG(Info, UTLog, "%d %s", 1.5, 9);
+	KLOG(Info, UTLog, scratch, 11);
+	k3d::Log(ELogLevel::Info, string("Dyn").append("Tag").c_str(), "%s=%d", "compat", 5);
+	FlushLog();
+
+	K3D_ASSERT(capture.Lines.size() == 7);
+	K3D_ASSERT(capture.Lines[0].Tag == "UTLog" && capture.Lines[0].Message == "plain");
+	K3D_ASSERT(capture.Lines[1].Message == Printf("%d %u %x %05.2f %s %c %%", -42, 7u, 255, 3.14159, name, 'k'));
+	K3D_ASSERT(capture.Lines[2].Message == Printf("%lld %llu %-6s| %*d %.*s", (long long)-1, 1ull << 40, "ab", 5, 12, 3, "abcdef"));
+	K3D_ASSERT(capture.Lines[3].Message == Printf("%x %d %p", -1, 3, (void*)&local));
+	// mismatched conversions print the argument as what it is
+	K3D_ASSERT(capture.Lines[4].Message == "1.5 9");
+	K3D_ASSERT(capture.Lines[5].Message == "scratch 11");
+	K3D_ASSERT(capture.Lines[6].Tag == "DynTag" && capture.Lines[6].Message == "compat=5");
+	K3D_ASSERT(capture.Lines[0].Thread == Os::Thread::GetCurrentThreadName());
+	K3D_ASSERT(capture.Lines[0].Time > 0 && capture.Lines[0].Time <= capture.Lines[6].Time);
+	capture.Lines.clear();
+
+	// fatal records are out before the call returns
+	KLOG(Fatal, UTLog, "failed %d", 1);
+	K3D_ASSERT(capture.Lines.size() == 1 && capture.Lines[0].Message == "failed 1");
+	capture.Lines.clear();
+
+	// errors wake the log thread, which writes them
+	uint32 written = capture.Written;
+	KLOG(Error, UTLog, "error %d", 2);
+	for (int i = 0; i < 1000 && capture.Written == written; i++)
+		Os::Sleep(1);
+	K3D_ASSERT(capture.Lines.size() == 1 && capture.Lines[0].Message == "error 2");
+	K3D_ASSERT(capture.Lines[0].Writer == "LogWriter");
+	capture.Lines.clear();
+
+	// only literals are read later on the log thread
+	static_assert(K3D_LOG_IS_LITERAL("%d", 1) && !K3D_LOG_IS_LITERAL(scratch, 1), "");
+	LogLocalFormat(42);
+	ClobberStack();
+	FlushLog();
+	K3D_ASSERT(capture.Lines.size() == 1 && capture.Lines[0].Message == "local 42");
+	capture.Lines.clear();
+}
+
+void TestThreads(CaptureLogger & capture)
+{
+	const int kThreads = 4;
+	const int kRecords = 20000;
+	vector<Os::Thread*> threads;
+	for (int t = 0; t < kThreads; t++)
+	{
+		threads.push_back(new Os::Thread([t]()
+		{
+			for (int i = 0; i < kRecords; i++)
+				KLOG(Debug, UTLog, "%d %d %s", t, i, "payload");
+		}, "LogProducer"));
+	}
+	for (auto thread : threads)
+		thread->Start();
+	for (auto thread : threads)
+	{
+		thread->Join();
+		delete thread;
+	}
+	FlushLog();
+
+	K3D_ASSERT(GetDroppedLogCount() == 0);
+	K3D_ASSERT(capture.Lines.size() == kThreads * kRecords);
+	// in order per thread, by time across the threads of a batch
+	int next[kThreads] = { 0 };
+	uint64 time = 0;
+	uint32 batch = 0;
+	for (auto & line : capture.Lines)
+	{
+		int t = -1, i = -1;
+		K3D_ASSERT(sscanf(line.Message.c_str(), "%d %d", &t, &i) == 2);
+		K3D_ASSERT(t >= 0 && t < kThreads && i == next[t]);
+		next[t]++;
+		K3D_ASSERT(line.Batch != batch || line.Time >= time);
+		time = line.Time;
+		batch = line.Batch;
+	}
+	capture.Lines.clear();
+}
+
+static int s_Evaluated = 0;
+
+int Evaluate()
+{
+	return ++s_Evaluated;
+}
+
+void TestFiltering(CaptureLogger & capture)
+{
+	// filtered records do not evaluate their arguments
+	SetLogLevel("UTFilter", ELogLevel::Warn);
+	KLOG(Info, UTFilter, "%d", Evaluate());
+	k3d::Log(ELogLevel::Info, "UTFilter", "%d", 0);
+	KLOG(Warn, UTFilter, "%d", Evaluate());
+	FlushLog();
+	K3D_ASSERT(s_Evaluated == 1 && capture.Lines.size() == 1);
+
+	// the global level reaches channels without their own
+	SetLogLevel(ELogLevel::Error);
+	KLOG(Warn, UTLog, "hidden");
+	KLOG(Warn, UTFilter, "shown");
+	ResetLogLevel("UTFilter");
+	K3D_ASSERT(GetLogLevel("UTFilter") == ELogLevel::Error);
+	SetLogLevel(ELogLevel::Default);
+	KLOG(Info, UTFilter, "back");
+	FlushLog();
+	K3D_ASSERT(capture.Lines.size() == 3 && capture.Lines[1].Message == "shown" && capture.Lines[2].Message == "back");
+	capture.Lines.clear();
+
+	for (int i = 0; i < 7; i++)
+	{
+		KLOG_ONCE(Info, UTLog, "once %d", i);
+		KLOG_EVERY_N(Info, UTLog, 3, "every %d", i);
+		KLOG_EVERY_MS(Info, UTLog, 60000, "timed %d", i);
+	}
+	FlushLog();
+	K3D_ASSERT(capture.Lines.size() == 5);
+	K3D_ASSERT(capture.Lines[0].Message == "once 0" && capture.Lines[1].Message == "every 0" && capture.Lines[2].Message == "timed 0");
+	K3D_ASSERT(capture.Lines[3].Message == "every 3" && capture.Lines[4].Message == "every 6");
+	capture.Lines.clear();
+}
+
+int main(int argc, char**argv)
+{
+	CaptureLogger capture;
+	RegisterLogger(&capture);
+	TestFormatting(capture);
+	TestThreads(capture);
+	TestFiltering(capture);
+	UnregisterLogger(&capture);
+	KLOG(Info, UTLog, "not captured");
+	FlushLog();
+	K3D_ASSERT(capture.Lines.empty() && capture.Batches > 0);
+	return 0;
+}
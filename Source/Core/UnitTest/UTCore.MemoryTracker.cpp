@@ -0,0 +1,94 @@
+#include "Common.h"
+#include <Core/MeshData.h>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestTaggedAllocation()
+{
+	MemorySnapshot before;
+	MemoryTracker::TakeSnapshot(before);
+
+	void* mesh = MemoryTracker::Allocate(1000, EMemoryTag::Assets);
+	void* cmd = nullptr;
+	{
+		MemoryTagScope scope(EMemoryTag::Render);
+		K3D_ASSERT(MemoryTracker::CurrentTag() == EMemoryTag::Render);
+		cmd = MemoryTracker::Allocate(64);
+	}
+	K3D_ASSERT(MemoryTracker::CurrentTag() == EMemoryTag::Default);
+	K3D_ASSERT(((uintptr_t)mesh & 15) == 0);
+
+	MemorySnapshot during;
+	MemoryTracker::TakeSnapshot(during);
+	MemorySnapshot diff = MemoryTracker::Diff(before, during);
+	K3D_ASSERT(diff.Tags[(uint32)EMemoryTag::Assets].LiveBytes == 1000);
+	K3D_ASSERT(diff.Tags[(uint32)EMemoryTag::Render].LiveBytes == 64);
+	K3D_ASSERT(diff.Tags[(uint32)EMemoryTag::Render].LiveCount == 1);
+
+	MemoryTracker::Free(mesh);
+	MemoryTracker::Free(cmd);
+	MemorySnapshot after;
+	MemoryTracker::TakeSnapshot(after);
+	diff = MemoryTracker::Diff(before, after);
+	K3D_ASSERT(diff.Tags[(uint32)EMemoryTag::Assets].LiveBytes == 0);
+	K3D_ASSERT(after.Tags[(uint32)EMemoryTag::Assets].PeakBytes >= 1000);
+	K3D_ASSERT(diff.Tags[(uint32)EMemoryTag::Assets].TotalAllocs == 1);
+}
+
+void TestTaggedContainer()
+{
+	MemoryTagStats stats;
+	{
+		DynArray<int, TaggedAllocator<EMemoryTag::Script>> values;
+		for (int i = 0; i < 100; i++)
+			values.Append(i);
+		MemoryTracker::GetStats(EMemoryTag::Script, stats);
+		K3D_ASSERT(stats.LiveBytes >= (int64)(100 * sizeof(int)));
+	}
+	MemoryTracker::GetStats(EMemoryTag::Script, stats);
+	K3D_ASSERT(stats.LiveBytes == 0 && stats.LiveCount == 0);
+}
+
+void TestMeshRelease()
+{
+	MemoryTagStats before, loaded, released;
+	MemoryTracker::GetStats(EMemoryTag::Assets, before);
+	{
+		MeshData mesh;
+		float positions[3 * 4] = {};
+		mesh.SetVertexFormat(VtxFormat::POS3_F32);
+		mesh.SetVertexNum(4);
+		mesh.SetVertexBuffer(positions);
+		MemoryTracker::GetStats(EMemoryTag::Assets, loaded);
+		K3D_ASSERT(loaded.LiveBytes - before.LiveBytes == (int64)sizeof(positions));
+	}
+	MemoryTracker::GetStats(EMemoryTag::Assets, released);
+	K3D_ASSERT(released.LiveBytes == before.LiveBytes && released.LiveCount == before.LiveCount);
+}
+
+void TestSampling()
+{
+	MemoryTracker::SetSamplingRate(1);
+	void* blocks[8];
+	for (int i = 0; i < 8; i++)
+		blocks[i] = MemoryTracker::Allocate(128, EMemoryTag::Log);
+	MemoryTracker::Publish();
+	for (int i = 0; i < 8; i++)
+		MemoryTracker::Free(blocks[i]);
+	MemoryTracker::SetSamplingRate(0);
+	MemoryTracker::Publish();
+}
+
+int main(int argc, char**argv)
+{
+	TestTaggedAllocation();
+	TestTaggedContainer();
+	TestMeshRelease();
+	TestSampling();
+	return 0;
+}
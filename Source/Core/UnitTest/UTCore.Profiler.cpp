@@ -0,0 +1,166 @@
+#include "Common.h"
+#include <Core/Profiler.h>
+
+#include <fstream>
+#include <sstream>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+/// Keeps the streamed frames
+class StreamLogger : public ILogger
+{
+public:
+	void Log(ELogLevel const & lv, const char * tag, const char * msg) override
+	{
+		if (lv == ELogLevel::Profile)
+			Messages.push_back(string(tag) + msg);
+	}
+
+	vector<string> Messages;
+};
+
+uint32 CountZones(ProfileCapture const & capture, const char * name)
+{
+	uint32 count = 0;
+	for (auto const & zone : capture.Zones)
+		count += capture.Names[zone.Name] == name;
+	return count;
+}
+
+void TestCapture(ProfileCapture & capture)
+{
+	// nothing is kept outside of a capture
+	{
+		K3D_PROFILE_SCOPE("Before");
+	}
+	Profiler::StartCapture();
+	K3D_ASSERT(Profiler::IsCapturing());
+	for (int frame = 0; frame < 3; frame++)
+	{
+		{
+			K3D_PROFILE_SCOPE("Outer");
+			K3D_PROFILE_SCOPE("Inner");
+		}
+		K3D_PROFILE_FRAME();
+	}
+
+	vector<Os::Thread*> threads;
+	for (int t = 0; t < 2; t++)
+	{
+		threads.push_back(new Os::Thread([]()
+		{
+			for (int i = 0; i < 100; i++)
+			{
+				K3D_PROFILE_SCOPE("Job");
+			}
+		}, "ProfileWorker"));
+	}
+	for (auto thread : threads)
+		thread->Start();
+	for (auto thread : threads)
+	{
+		thread->Join();
+		delete thread;
+	}
+	{
+		K3D_PROFILE_SCOPE("Sleep");
+		Os::Sleep(20);
+	}
+	K3D_PROFILE_FRAME();
+	Profiler::StopCapture(capture);
+	K3D_ASSERT(!Profiler::IsCapturing());
+
+	K3D_ASSERT(capture.Frames.size() == 4 && capture.Dropped == 0);
+	K3D_ASSERT(capture.Frames[1].Index == capture.Frames[0].Index + 1);
+	K3D_ASSERT(CountZones(capture, "Before") == 0);
+	K3D_ASSERT(CountZones(capture, "Outer") == 3 && CountZones(capture, "Inner") == 3);
+	K3D_ASSERT(CountZones(capture, "Job") == 200);
+
+	uint32 workers = 0;
+	for (auto const & zone : capture.Zones)
+	{
+		string const & name = capture.Names[zone.Name];
+		if (name == "Inner")
+			K3D_ASSERT(zone.Depth == 1);
+		if (name == "Outer")
+			K3D_ASSERT(zone.Depth == 0);
+		if (name == "Job")
+			workers |= 1u << zone.Thread;
+		// calibrated ticks, Sleep took about 20ms
+		if (name == "Sleep")
+			K3D_ASSERT(zone.Duration > 15000000 && zone.Duration < 1000000000);
+	}
+	uint32 workerCount = 0;
+	for (uint32 t = 0; t < capture.Threads.size(); t++)
+	{
+		if (workers & (1u << t))
+		{
+			K3D_ASSERT(capture.Threads[t] == "ProfileWorker");
+			workerCount++;
+		}
+	}
+	K3D_ASSERT(workerCount == 2);
+}
+
+void TestExport(ProfileCapture const & capture)
+{
+	K3D_ASSERT(capture.SaveChromeTrace("profile.json"));
+	ifstream json("profile.json");
+	stringstream text;
+	text << json.rdbuf();
+	json.close();
+	K3D_ASSERT(text.str().find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+	K3D_ASSERT(text.str().find("\"name\":\"Inner\"") != string::npos);
+	K3D_ASSERT(text.str().find("\"args\":{\"name\":\"ProfileWorker\"}") != string::npos);
+	remove("profile.json");
+
+	K3D_ASSERT(capture.Save("profile.bin"));
+	ProfileCapture loaded;
+	K3D_ASSERT(loaded.Load("profile.bin"));
+	K3D_ASSERT(loaded.Names == capture.Names && loaded.Threads == capture.Threads);
+	K3D_ASSERT(loaded.Frames.size() == capture.Frames.size() && loaded.Zones.size() == capture.Zones.size());
+	for (size_t i = 0; i < capture.Zones.size(); i++)
+	{
+		K3D_ASSERT(loaded.Zones[i].Name == capture.Zones[i].Name && loaded.Zones[i].Thread == capture.Zones[i].Thread);
+		K3D_ASSERT(loaded.Zones[i].Begin == capture.Zones[i].Begin && loaded.Zones[i].Duration == capture.Zones[i].Duration);
+	}
+	remove("profile.bin");
+	K3D_ASSERT(!loaded.Load("profile.bin"));
+
+#if K3DPLATFORM_OS_LINUX
+	// every write fails with ENOSPC
+	K3D_ASSERT(!capture.Save("/dev/full") && !capture.SaveChromeTrace("/dev/full"));
+#endif
+}
+
+void TestStreaming()
+{
+	StreamLogger logger;
+	RegisterLogger(&logger);
+	Profiler::SetStreaming(1);
+	{
+		K3D_PROFILE_SCOPE("Streamed");
+	}
+	K3D_PROFILE_FRAME();
+	Profiler::SetStreaming(0);
+	FlushLog();
+	UnregisterLogger(&logger);
+
+	K3D_ASSERT(logger.Messages.size() == 2);
+	K3D_ASSERT(logger.Messages[0].find("ProfileFrame{\"Frame\":") == 0);
+	K3D_ASSERT(logger.Messages[1].find("ProfileZones{") == 0 && logger.Messages[1].find("[\"Streamed\",") != string::npos);
+}
+
+int main(int argc, char**argv)
+{
+	ProfileCapture capture;
+	TestCapture(capture);
+	TestExport(capture);
+	TestStreaming();
+	return 0;
+}
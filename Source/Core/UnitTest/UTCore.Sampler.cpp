@@ -0,0 +1,118 @@
+#include "Common.h"
+#include <Core/Sampler.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+/// Keeps the CPU busy for about ms milliseconds
+uint64 Spin(uint32 ms)
+{
+	volatile uint64 sum = 0;
+	auto end = chrono::steady_clock::now() + chrono::milliseconds(ms);
+	while (chrono::steady_clock::now() < end)
+	{
+		for (int i = 0; i < 1000; i++)
+			sum = sum + i;
+	}
+	return sum;
+}
+
+uint64 CountThread(SampleProfile const & profile, const char * name)
+{
+	uint64 count = 0;
+	for (auto const & stack : profile.Stacks)
+	{
+		if (profile.Threads[stack.Thread] == name)
+			count += stack.Count;
+	}
+	return count;
+}
+
+void TestSampling()
+{
+	K3D_ASSERT(Sampler::Start(1000));
+	K3D_ASSERT(Sampler::IsSampling());
+	K3D_ASSERT(!Sampler::Start(1000));
+
+	// started while sampling, gone before Stop
+	Os::Thread worker([]() { Spin(200); }, "SampleWorker");
+	worker.Start();
+	Spin(200);
+	worker.Join();
+	// an idle thread is not on the CPU clock
+	Os::Thread idle([]() { Os::Sleep(100); }, "SampleIdle");
+	idle.Start();
+	idle.Join();
+
+	SampleProfile profile;
+	Sampler::Stop(profile);
+	K3D_ASSERT(!Sampler::IsSampling());
+
+	// the timers count CPU time, a loaded machine still gives some
+	uint64 main = CountThread(profile, "Main");
+	uint64 spun = CountThread(profile, "SampleWorker");
+	K3D_ASSERT(main > 20 && main < 400);
+	K3D_ASSERT(spun > 20 && spun < 400);
+	K3D_ASSERT(CountThread(profile, "SampleIdle") < 5);
+
+	uint64 total = 0;
+	for (auto const & stack : profile.Stacks)
+	{
+		K3D_ASSERT(!stack.Frames.empty() && stack.Count > 0);
+		total += stack.Count;
+	}
+	K3D_ASSERT(total == profile.Samples && profile.Dropped == 0);
+
+	K3D_ASSERT(profile.SaveFolded("sampler.folded"));
+	ifstream folded("sampler.folded");
+	string line;
+	uint64 lines = 0, counted = 0;
+	while (getline(folded, line))
+	{
+		size_t space = line.rfind(' ');
+		K3D_ASSERT(space != string::npos && line.find(';') < space);
+		counted += strtoull(line.c_str() + space + 1, nullptr, 10);
+		lines++;
+	}
+	folded.close();
+	K3D_ASSERT(lines > 0 && lines <= profile.Stacks.size() && counted == profile.Samples);
+	remove("sampler.folded");
+
+	// nothing is sampled any more, a second session starts clean
+	Spin(50);
+	K3D_ASSERT(Sampler::Start(100));
+	Sampler::Stop(profile);
+	K3D_ASSERT(profile.Samples < 10);
+
+	// a thread that ran a session and exited is not sampled by the next one
+	std::thread starter([]()
+	{
+		SampleProfile own;
+		K3D_ASSERT(Sampler::Start(1000));
+		Spin(20);
+		Sampler::Stop(own);
+		K3D_ASSERT(own.Threads.size() == 1 && own.Threads[0] == "Main");
+	});
+	starter.join();
+	K3D_ASSERT(Sampler::Start(1000));
+	Spin(50);
+	Sampler::Stop(profile);
+	K3D_ASSERT(profile.Threads.size() == 1 && CountThread(profile, "Main") > 0);
+}
+
+int main(int argc, char**argv)
+{
+#if K3DPLATFORM_OS_LINUX
+	TestSampling();
+#endif
+	return 0;
+}
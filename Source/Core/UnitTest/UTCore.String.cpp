@@ -48,8 +48,48 @@ void TestString()
 
 }
 
+void TestSmallString()
+{
+	String small("vs_main");
+	K3D_ASSERT(small.Capacity() == String::InlineCapacity);
+	String exact("0123456789abcdefghijklm");
+	K3D_ASSERT(exact.Length() == 23 && exact.Capacity() == String::InlineCapacity);
+	exact += 'n';
+	K3D_ASSERT(exact.Length() == 24 && exact.Capacity() > String::InlineCapacity);
+	K3D_ASSERT(exact == String("0123456789abcdefghijklmn"));
+
+	// moving and swapping inline and heap strings
+	String heap(Move(exact));
+	K3D_ASSERT(exact.Length() == 0 && exact.CStr()[0] == 0);
+	heap.Swap(small);
+	K3D_ASSERT(small.Length() == 24 && heap == String("vs_main"));
+	String inlineMoved(Move(heap));
+	K3D_ASSERT(inlineMoved == String("vs_main") && heap.Length() == 0);
+
+	// self append and in place formatting
+	small += small;
+	K3D_ASSERT(small.Length() == 48 && small.CStr()[24] == '0');
+	String fmt;
+	fmt.AppendSprintf("%d", 42);
+	K3D_ASSERT(fmt == String("42") && fmt.Capacity() == String::InlineCapacity);
+	fmt.AppendSprintf("-%s-%d", "a long enough argument to spill", 7);
+	K3D_ASSERT(fmt == String("42-a long enough argument to spill-7"));
+
+	String reserved;
+	reserved.Reserve(100);
+	uint64 capacity = reserved.Capacity();
+	for (int i = 0; i < 100; i++)
+		reserved += 'x';
+	K3D_ASSERT(reserved.Capacity() == capacity && reserved.Length() == 100);
+	reserved.Clear();
+	K3D_ASSERT(reserved.Length() == 0 && reserved.Capacity() == capacity);
+
+	K3D_ASSERT(Base64Decode(Base64Encode(String("Love you later."))) == String("Love you later."));
+}
+
 int main(int argc, char**argv)
 {
 	TestString();
+	TestSmallString();
 	return 0;
 }
\ No newline at end of file
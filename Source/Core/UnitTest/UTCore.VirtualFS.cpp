@@ -0,0 +1,134 @@
+#include "Common.h"
+#include <Core/VirtualFS.h>
+#include <Core/CameraData.h>
+#include <string.h>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void WriteText(const char * path, const char * text)
+{
+	Os::File file;
+	K3D_ASSERT(file.Open(path, IOWrite));
+	file.Write(text, strlen(text));
+	file.Close();
+}
+
+string ReadText(VirtualFS & vfs, const char * path)
+{
+	IAsset * asset = vfs.Open(path);
+	if (!asset)
+		return string();
+	string text((size_t)asset->GetLength(), '\0');
+	asset->Read(&text[0], text.size());
+	delete asset;
+	return text;
+}
+
+void TestMounts()
+{
+	Os::MakeDir(KT("vfs.low"));
+	Os::MakeDir(KT("vfs.high"));
+	WriteText("vfs.low/a.txt", "low a");
+	WriteText("vfs.low/b.txt", "low b");
+	WriteText("vfs.high/a.txt", "high a");
+
+	VirtualFS vfs;
+	vfs.MountDirectory("", KT("vfs.low"));
+	VirtualFS::MountId high = vfs.MountDirectory("", KT("vfs.high/"), 1);
+	K3D_ASSERT(ReadText(vfs, "a.txt") == "high a");
+	K3D_ASSERT(ReadText(vfs, "asset://b.txt") == "low b");
+	K3D_ASSERT(vfs.NativePath("a.txt") == KT("vfs.high/a.txt"));
+	K3D_ASSERT(!vfs.Open("c.txt") && vfs.NativePath("c.txt").empty());
+
+	// hits are cached until the mounts change, a miss is looked up again
+	uint32 cached = vfs.GetCachedCount();
+	K3D_ASSERT(vfs.Exists("a.txt") && vfs.GetCachedCount() == cached);
+	WriteText("vfs.low/c.txt", "low c");
+	K3D_ASSERT(vfs.Exists("c.txt") && vfs.GetCachedCount() == cached + 1);
+	// a cached hit shadowed by a new file needs an invalidation
+	WriteText("vfs.high/c.txt", "high c");
+	K3D_ASSERT(ReadText(vfs, "c.txt") == "low c");
+	vfs.InvalidateCache();
+	K3D_ASSERT(ReadText(vfs, "c.txt") == "high c");
+	remove("vfs.high/c.txt");
+	vfs.InvalidateCache();
+
+	const char * paths[] = { "a.txt", "b.txt", "d.txt", "asset://c.txt" };
+	bool exists[4];
+	K3D_ASSERT(vfs.Exists(paths, 4, exists) == 3);
+	K3D_ASSERT(exists[0] && exists[1] && !exists[2] && exists[3]);
+
+	// the memory overlay shadows the directories
+	VirtualFS::MountId memory = vfs.MountMemory("");
+	K3D_ASSERT(vfs.WriteMemory(memory, "a.txt", "memory a", 8));
+	K3D_ASSERT(!vfs.WriteMemory(high, "a.txt", "x", 1));
+	K3D_ASSERT(ReadText(vfs, "a.txt") == "memory a");
+	K3D_ASSERT(vfs.NativePath("a.txt").empty());
+	// memory files through IIODevice too, loose ones are opened natively
+	{
+		char text[16] = { 0 };
+		std::shared_ptr<IIODevice> device = vfs.OpenDevice("a.txt");
+		K3D_ASSERT(device && device->Seek(7) && device->Read(text, sizeof(text)) == 1);
+		K3D_ASSERT(text[0] == 'a' && device->IsEOF() && device->Write("x", 1) == 0);
+		device = vfs.OpenDevice("b.txt", true);
+		K3D_ASSERT(device && device->Read(text, 5) == 5 && strncmp(text, "low b", 5) == 0);
+		K3D_ASSERT(!vfs.OpenDevice("d.txt"));
+	}
+	K3D_ASSERT(vfs.Unmount(memory) && !vfs.Unmount(memory));
+	K3D_ASSERT(vfs.Unmount(high));
+	K3D_ASSERT(ReadText(vfs, "a.txt") == "low a");
+
+	// below a mount point only
+	vfs.MountMemory("Test/");
+	vfs.MountDirectory("Data/", KT("vfs.high"));
+	K3D_ASSERT(ReadText(vfs, "asset://Data/a.txt") == "high a");
+	K3D_ASSERT(!vfs.Exists("Data/b.txt") && !vfs.Exists("Test/a.txt"));
+
+	const char * files[] = { "vfs.low/a.txt", "vfs.low/b.txt", "vfs.low/c.txt", "vfs.high/a.txt" };
+	for (auto file : files)
+		remove(file);
+	Os::Remove(KT("vfs.low"));
+	Os::Remove(KT("vfs.high"));
+}
+
+void TestBundleMount()
+{
+	AssetBundle * bundle = AssetBundle::CreateBundle(KT("vfs.bundle"), KT("./"));
+	bundle->SetCompression(EChunkCompression::LZ);
+	CameraData camera;
+	camera.SetName("MainCamera");
+	camera.SetFOV(42.0f);
+	bundle->Serialize(&camera);
+	bundle->MergeAndBundle(false);
+	delete bundle;
+
+	{
+		VirtualFS vfs;
+		K3D_ASSERT(!vfs.MountBundle("", KT("./missing.bundle")));
+		K3D_ASSERT(vfs.MountBundle("Cameras/", KT("./vfs.bundle")));
+		IAsset * asset = vfs.Open("asset://Cameras/MainCamera");
+		K3D_ASSERT(asset && !vfs.Exists("Cameras/ShadowCamera"));
+		float fov = 0;
+		K3D_ASSERT(asset->Seek(8 + 128) && asset->Read(&fov, sizeof(fov)) == sizeof(fov));
+		K3D_ASSERT(fov == 42.0f);
+		delete asset;
+
+		std::shared_ptr<IIODevice> device = vfs.OpenDevice("Cameras/MainCamera");
+		fov = 0;
+		K3D_ASSERT(device && device->Seek(8) && device->Skip(128));
+		K3D_ASSERT(device->Read((char*)&fov, sizeof(fov)) == sizeof(fov) && fov == 42.0f);
+	}
+	remove("./vfs.bundle");
+}
+
+int main(int argc, char**argv)
+{
+	TestMounts();
+	TestBundleMount();
+	return 0;
+}
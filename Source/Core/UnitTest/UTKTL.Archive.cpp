@@ -0,0 +1,124 @@
+#include "Common.h"
+#include <Core/CameraData.h>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+/// Os::File counting the calls reaching it
+class CountingFile : public Os::File
+{
+public:
+	size_t Read(char * data, size_t len) override { Reads++; return Os::File::Read(data, len); }
+	size_t Write(const void * data, size_t len) override { Writes++; return Os::File::Write(data, len); }
+
+	uint32 Reads = 0;
+	uint32 Writes = 0;
+};
+
+void TestBufferedArchive()
+{
+	vector<uint32> big(100000);
+	for (uint32 i = 0; i < big.size(); i++)
+		big[i] = i * 7;
+
+	CountingFile out;
+	K3D_ASSERT(out.Open(KT("archive.bin"), IOWrite));
+	{
+		BufferedArchive ar(&out, 4096);
+		for (uint32 i = 0; i < 1000; i++)
+			ar << i;
+		// bigger than the buffer, written in place
+		ar.ArrayIn(big.data(), big.size());
+		ar << 42.0f;
+	}
+	out.Close();
+	// 4000 bytes of fields, the array, the trailing float
+	K3D_ASSERT(out.Writes == 3);
+
+	CountingFile in;
+	K3D_ASSERT(in.Open(KT("archive.bin"), IORead));
+	{
+		BufferedArchive ar(&in, 4096);
+		for (uint32 i = 0; i < 1000; i++)
+		{
+			uint32 value = 0;
+			ar >> value;
+			K3D_ASSERT(value == i);
+		}
+		vector<uint32> read(big.size());
+		ar.ArrayOut(read.data(), read.size());
+		K3D_ASSERT(read == big);
+		float last = 0;
+		ar >> last;
+		K3D_ASSERT(last == 42.0f);
+		K3D_ASSERT(ar.ReadBytes(&last, sizeof(last)) == 0);
+	}
+	in.Close();
+	K3D_ASSERT(in.Reads < 10);
+}
+
+void TestViewArchive()
+{
+	Os::MemMapFile file;
+	K3D_ASSERT(file.Open(KT("archive.bin"), IORead));
+	ViewArchive ar(file.FileData(), (size_t)file.GetSize());
+
+	// fields are copied, arrays stay in the mapping
+	uint32 first = 1;
+	ar >> first;
+	K3D_ASSERT(first == 0);
+	K3D_ASSERT(ar.Skip(999 * sizeof(uint32)));
+	const uint32 * big = ar.View<uint32>(100000);
+	K3D_ASSERT((const kByte*)big == file.FileData() + 4000);
+	K3D_ASSERT(big[99999] == 99999 * 7);
+	K3D_ASSERT(ar.Remaining() == sizeof(float));
+
+	K3D_ASSERT(!ar.View<float>(2) && !ar.Skip(5));
+	float values[2] = { 0, 0 };
+	K3D_ASSERT(ar.ReadBytes(values, sizeof(values)) == sizeof(float));
+	K3D_ASSERT(values[0] == 42.0f && ar.Remaining() == 0);
+
+	// no views at an offset T cannot live at
+	ViewArchive misaligned(file.FileData() + 1, 16);
+	K3D_ASSERT(!misaligned.View<uint32>(1) && misaligned.View<char>(4));
+	file.Close();
+	remove("archive.bin");
+}
+
+void TestCameraRoundTrip()
+{
+	CameraData camera;
+	camera.SetName("ArchiveCamera");
+	camera.SetFOV(75.0f);
+	{
+		Os::File out;
+		K3D_ASSERT(out.Open(KT("camera.bin"), IOWrite));
+		BufferedArchive ar(&out);
+		ar << camera;
+		ar.FlushCurrentCache();
+		out.Close();
+	}
+	Os::MemMapFile in;
+	K3D_ASSERT(in.Open(KT("camera.bin"), IORead));
+	ViewArchive ar(in.FileData(), (size_t)in.GetSize());
+	// the class name is written, not read
+	K3D_ASSERT(ar.Skip(64));
+	CameraData read;
+	ar >> read;
+	K3D_ASSERT(ar.Remaining() == 0);
+	K3D_ASSERT(strcmp(read.Name(), "ArchiveCamera") == 0 && read.GetFOV() == 75.0f);
+	in.Close();
+	remove("camera.bin");
+}
+
+int main(int argc, char**argv)
+{
+	TestBufferedArchive();
+	TestViewArchive();
+	TestCameraRoundTrip();
+	return 0;
+}
@@ -68,8 +68,80 @@ void TestDynArrray()
     }
 }
 
+struct Counted
+{
+	static int Alive;
+	Counted() : Value(0) { Alive++; }
+	Counted(int v) : Value(v) { Alive++; }
+	Counted(Counted const& rhs) : Value(rhs.Value) { Alive++; }
+	Counted(Counted && rhs) : Value(rhs.Value) { rhs.Value = -1; Alive++; }
+	~Counted() { Alive--; }
+	int Value;
+};
+int Counted::Alive = 0;
+
+void TestDynArrayStorage()
+{
+	{
+		DynArray<Counted> counted(8);
+		K3D_ASSERT(counted.Capacity() == 8 && Counted::Alive == 0);
+		for (int i = 0; i < 100; i++)
+			counted.Emplace(i);
+		K3D_ASSERT(counted.Count() == 100 && Counted::Alive == 100);
+		// the argument lives in the buffer being reallocated
+		counted.Shrink();
+		counted.Append(counted[0]);
+		K3D_ASSERT(counted[100].Value == 0 && counted[99].Value == 99);
+		counted.AddAll(counted);
+		K3D_ASSERT(counted.Count() == 202 && counted[201].Value == 0 && counted[150].Value == 49);
+		counted.Resize(10);
+		K3D_ASSERT(Counted::Alive == 10);
+		counted.Resize(12);
+		K3D_ASSERT(counted[11].Value == 0 && Counted::Alive == 12);
+
+		DynArray<Counted> moved(Move(counted));
+		K3D_ASSERT(counted.Count() == 0 && counted.Data() == nullptr && moved.Count() == 12);
+		counted = moved;
+		K3D_ASSERT(Counted::Alive == 24);
+		counted.Clear();
+		K3D_ASSERT(Counted::Alive == 12 && counted.Capacity() >= 12);
+	}
+	K3D_ASSERT(Counted::Alive == 0);
+
+	// String keeps a pointer into itself, relocation must move it
+	DynArray<String> strings;
+	for (int i = 0; i < 20; i++)
+		strings.Append(String("short"));
+	K3D_ASSERT(strings[19] == String("short") && strings[0].CStr()[0] == 's');
+
+	{
+		SmallDynArray<Counted, 4> small;
+		Counted const* inlineData = small.Data();
+		for (int i = 0; i < 4; i++)
+			small.Emplace(i);
+		K3D_ASSERT(small.Data() == inlineData && small.Capacity() == 4);
+		SmallDynArray<Counted, 4> copy(small);
+		SmallDynArray<Counted, 4> moved(Move(small));
+		K3D_ASSERT(moved.Data() != inlineData && moved[3].Value == 3 && small.Count() == 0);
+		for (int i = 0; i < 5; i++)
+			small.Emplace(i);
+		K3D_ASSERT(small.Data() != inlineData && small.Capacity() > 4);
+		small.Clear();
+		small.Shrink();
+		K3D_ASSERT(small.Data() == inlineData);
+		small.Emplace(5);
+		small.Swap(copy);
+		K3D_ASSERT(small.Count() == 4 && copy.Count() == 1 && copy[0].Value == 5);
+		DynArray<Counted> & base = small;
+		base.AddAll(moved);
+		K3D_ASSERT(small.Count() == 8 && small[7].Value == 3);
+	}
+	K3D_ASSERT(Counted::Alive == 0);
+}
+
 int main(int argc, char**argv)
 {
 	TestDynArrray();
+	TestDynArrayStorage();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "Common.h"
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestFrameArena()
+{
+	uint64 frame = FrameArena::FrameIndex();
+	void* a = FrameArena::Allocate(100);
+	void* b = FrameArena::Allocate(24, 64);
+	K3D_ASSERT(a != b);
+	K3D_ASSERT(((uintptr_t)b & 63) == 0);
+	K3D_ASSERT(FrameArena::BytesUsed() == 124);
+
+	// oversized request gets its own block
+	void* big = FrameArena::Allocate(4 << 20);
+	K3D_ASSERT(big != nullptr);
+	memset(big, 0xcd, 4 << 20);
+	uint64 reserved = FrameArena::BytesReserved();
+
+	// the buffer of this frame is rewound and reused FramesInFlight frames later
+	for (uint32 i = 0; i < FrameArena::FramesInFlight; i++)
+	{
+		FrameArena::EndFrame();
+	}
+	K3D_ASSERT(FrameArena::FrameIndex() == frame + FrameArena::FramesInFlight);
+	K3D_ASSERT(FrameArena::BytesUsed() == 0);
+	void* again = FrameArena::Allocate(100);
+	K3D_ASSERT(again == a);
+	K3D_ASSERT(FrameArena::BytesReserved() == reserved);
+}
+
+void TestFrameAllocator()
+{
+	DynArray<int, FrameAllocator> ints;
+	for (int i = 0; i < 1000; i++)
+	{
+		ints.Append(i);
+	}
+	K3D_ASSERT(ints.Count() == 1000);
+	K3D_ASSERT(ints[999] == 999);
+	FrameArena::EndFrame();
+}
+
+int main(int argc, char**argv)
+{
+	TestFrameArena();
+	TestFrameAllocator();
+	return 0;
+}
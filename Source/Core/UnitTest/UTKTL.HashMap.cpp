@@ -0,0 +1,85 @@
+#include "Common.h"
+#include <unordered_map>
+#include <random>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestStringKeys()
+{
+	HashMap<std::string, int> map;
+	K3D_ASSERT(map.Find("missing") == map.end());
+	map["mesh"] = 1;
+	map.Insert("image", 2);
+	K3D_ASSERT(!map.Insert("image", 3).second);
+	K3D_ASSERT(map.Count() == 2);
+
+	// heterogeneous lookup, no std::string is built
+	const char* name = "mesh";
+	auto iter = map.Find(name);
+	K3D_ASSERT(iter != map.end() && iter->second == 1);
+	K3D_ASSERT(*map.FindValue(String("image")) == 2);
+	K3D_ASSERT(map.Contains(std::string("image")));
+
+	K3D_ASSERT(map.Erase("mesh"));
+	K3D_ASSERT(!map.Erase("mesh"));
+	K3D_ASSERT(map.FindValue("mesh") == nullptr);
+
+	HashSet<String> set;
+	set.Insert(String("a"));
+	set.Insert("b");
+	K3D_ASSERT(set.Contains("a") && set.Contains("b") && !set.Contains("c"));
+}
+
+void TestAgainstStd()
+{
+	HashMap<uint32, uint64> map;
+	std::unordered_map<uint32, uint64> ref;
+	std::mt19937 rng(42);
+	for (int i = 0; i < 200000; i++)
+	{
+		uint32 key = rng() % 5000;
+		switch (rng() % 3)
+		{
+		case 0:
+			map[key] = i;
+			ref[key] = i;
+			break;
+		case 1:
+			K3D_ASSERT(map.Erase(key) == (ref.erase(key) == 1));
+			break;
+		default:
+		{
+			auto found = map.FindValue(key);
+			auto expect = ref.find(key);
+			K3D_ASSERT((found != nullptr) == (expect != ref.end()));
+			K3D_ASSERT(!found || *found == expect->second);
+		}
+		}
+	}
+	K3D_ASSERT(map.Count() == ref.size());
+	uint64 visited = 0;
+	for (auto & kv : map)
+	{
+		K3D_ASSERT(ref[kv.first] == kv.second);
+		visited++;
+	}
+	K3D_ASSERT(visited == ref.size());
+
+	HashMap<uint32, uint64> copy(map);
+	HashMap<uint32, uint64> moved(std::move(map));
+	K3D_ASSERT(copy.Count() == ref.size() && moved.Count() == ref.size() && map.Count() == 0);
+	copy.Clear();
+	K3D_ASSERT(copy.IsEmpty() && copy.begin() == copy.end());
+}
+
+int main(int argc, char**argv)
+{
+	TestStringKeys();
+	TestAgainstStd();
+	return 0;
+}
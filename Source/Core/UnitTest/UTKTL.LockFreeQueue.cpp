@@ -0,0 +1,96 @@
+#include "Common.h"
+#include <atomic>
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestMPMCQueue()
+{
+	const int kProducers = 4;
+	const int kItemsPerProducer = 100000;
+	MPMCQueue<uint64> queue(256);
+	std::atomic<uint64> sum(0);
+	std::atomic<int> consumed(0);
+
+	vector<thread> threads;
+	for (int p = 0; p < kProducers; p++)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 1; i <= kItemsPerProducer; i++)
+			{
+				queue.Enqueue((uint64)i);
+			}
+		});
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		threads.emplace_back([&]() {
+			uint64 value = 0;
+			while (consumed.load() < kProducers * kItemsPerProducer)
+			{
+				if (queue.Dequeue(value, 10))
+				{
+					sum += value;
+					consumed++;
+				}
+			}
+		});
+	}
+	for (auto & t : threads)
+	{
+		t.join();
+	}
+	uint64 expected = (uint64)kProducers * kItemsPerProducer * (kItemsPerProducer + 1) / 2;
+	K3D_ASSERT(sum == expected);
+	K3D_ASSERT(queue.IsEmpty());
+}
+
+void TestMPMCQueueBounds()
+{
+	MPMCQueue<String> queue(4);
+	K3D_ASSERT(queue.Capacity() == 4);
+	K3D_ASSERT(queue.TryEnqueue(String("a")));
+	K3D_ASSERT(queue.TryEnqueue(String("b")));
+	K3D_ASSERT(queue.TryEnqueue(String("c")));
+	K3D_ASSERT(queue.TryEnqueue(String("d")));
+	K3D_ASSERT(!queue.TryEnqueue(String("e")));
+	String front;
+	K3D_ASSERT(queue.TryDequeue(front));
+	K3D_ASSERT(front == String("a"));
+	K3D_ASSERT(queue.Count() == 3);
+}
+
+void TestSPSCQueue()
+{
+	const uint64 kCount = 1000000;
+	SPSCQueue<uint64> queue(1024);
+	thread producer([&queue]() {
+		for (uint64 i = 0; i < kCount; i++)
+		{
+			queue.Enqueue(i);
+		}
+	});
+	uint64 expect = 0;
+	while (expect < kCount)
+	{
+		uint64 value;
+		queue.Dequeue(value);
+		K3D_ASSERT(value == expect);
+		expect++;
+	}
+	producer.join();
+	K3D_ASSERT(queue.IsEmpty());
+}
+
+int main(int argc, char**argv)
+{
+	TestMPMCQueue();
+	TestMPMCQueueBounds();
+	TestSPSCQueue();
+	cout << "lock free queue test passed" << endl;
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "Common.h"
+
+#if K3DPLATFORM_OS_WIN
+#pragma comment(linker,"/subsystem:console")
+#endif
+
+using namespace std;
+using namespace k3d;
+
+void TestName()
+{
+	Name none;
+	K3D_ASSERT(none.IsNone() && strcmp(none.CStr(), "None") == 0);
+
+	Name mesh("Mesh/Cube");
+	K3D_ASSERT(mesh == Name(std::string("Mesh/Cube")));
+	K3D_ASSERT(mesh == Name(String("Mesh/Cube")));
+	K3D_ASSERT(strcmp(mesh.CStr(), "Mesh/Cube") == 0);
+	K3D_ASSERT(mesh != Name("Mesh/Sphere"));
+
+	// literal IDs are known at compile time and agree with the table
+	static_assert(K3D_NAME_ID("Mesh/Cube") != 0, "compile time hash");
+	switch (mesh.GetId())
+	{
+	case K3D_NAME_ID("Mesh/Cube"):
+		break;
+	default:
+		K3D_ASSERT(false);
+	}
+	K3D_ASSERT(Name::FromId(K3D_NAME_ID("Mesh/Cube")) == mesh);
+	K3D_ASSERT(K3D_NAME("Mesh/Cube") == mesh);
+
+	K3D_ASSERT(Name::Find("Never/Interned").IsNone());
+	K3D_ASSERT(strcmp(Name::FromId(K3D_NAME_ID("Never/Interned")).CStr(), "<unknown>") == 0);
+	K3D_ASSERT(Name::Find("Mesh/Cube") == mesh);
+}
+
+void TestNameMap()
+{
+	HashMap<Name, int> materials;
+	materials[Name("Diffuse")] = 1;
+	materials[Name("Specular")] = 2;
+	K3D_ASSERT(*materials.FindValue(K3D_NAME("Specular")) == 2);
+	K3D_ASSERT(materials.FindValue(Name::Find("Emissive")) == nullptr);
+}
+
+void TestConcurrentIntern()
+{
+	uint64 before = Name::Count();
+	vector<thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([]() {
+			char buffer[32];
+			for (int i = 0; i < 1000; i++)
+			{
+				snprintf(buffer, sizeof(buffer), "Shader/%d", i);
+				Name name(buffer);
+				K3D_ASSERT(strcmp(name.CStr(), buffer) == 0);
+			}
+		});
+	}
+	for (auto & t : threads)
+		t.join();
+	K3D_ASSERT(Name::Count() == before + 1000);
+}
+
+int main(int argc, char**argv)
+{
+	TestName();
+	TestNameMap();
+	TestConcurrentIntern();
+	return 0;
+}
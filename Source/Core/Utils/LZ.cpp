@@ -0,0 +1,200 @@
+#include "Kaleido3D.h"
+#include "LZ.h"
+#include <string.h>
+
+namespace LZ
+{
+	namespace
+	{
+		typedef unsigned char	u8;
+		typedef unsigned int	u32;
+
+		const u32		kHashLog = 12;
+		const size_t	kMinMatch = 4;
+		const size_t	kMaxOffset = 65535;
+		/// Matches start this far from the end, the tail stays literal
+		const size_t	kMatchStartLimit = 12;
+		const size_t	kLastLiterals = 5;
+
+		inline u32 Read32(const u8 * p)
+		{
+			u32 v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		inline u32 HashOf(u32 sequence)
+		{
+			return (sequence * 2654435761u) >> (32 - kHashLog);
+		}
+
+		/// 255-continued length bytes after a saturated nibble
+		inline u8 * WriteLength(u8 * op, size_t length)
+		{
+			while (length >= 255)
+			{
+				*op++ = 255;
+				length -= 255;
+			}
+			*op++ = (u8)length;
+			return op;
+		}
+
+		inline size_t LengthBytes(size_t length)
+		{
+			return length >= 15 ? (length - 15) / 255 + 1 : 0;
+		}
+	}
+
+	size_t CompressBound(size_t srcSize)
+	{
+		return srcSize + srcSize / 255 + 16;
+	}
+
+	size_t Compress(const void * src, size_t srcSize, void * dst, size_t dstCapacity)
+	{
+		const u8 * const base = (const u8*)src;
+		const u8 * const iend = base + srcSize;
+		const u8 * ip = base;
+		const u8 * anchor = base;
+		u8 * op = (u8*)dst;
+		u8 * const oend = op + dstCapacity;
+
+		if (srcSize > kMatchStartLimit)
+		{
+			const u8 * const mflimit = iend - kMatchStartLimit;
+			const u8 * const matchlimit = iend - kLastLiterals;
+			u32 table[1 << kHashLog];
+			memset(table, 0, sizeof(table));
+
+			while (ip < mflimit)
+			{
+				u32 sequence = Read32(ip);
+				u32 h = HashOf(sequence);
+				const u8 * ref = base + table[h];
+				table[h] = (u32)(ip - base);
+				if (ref >= ip || (size_t)(ip - ref) > kMaxOffset || Read32(ref) != sequence)
+				{
+					// skip faster through data that does not match
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+				while (ip > anchor && ref > base && ip[-1] == ref[-1])
+				{
+					ip--;
+					ref--;
+				}
+				const u8 * mp = ip + kMinMatch;
+				const u8 * rp = ref + kMinMatch;
+				while (mp < matchlimit && *mp == *rp)
+				{
+					mp++;
+					rp++;
+				}
+
+				size_t literals = (size_t)(ip - anchor);
+				size_t matchLength = (size_t)(mp - ip) - kMinMatch;
+				size_t needed = 1 + LengthBytes(literals) + literals + 2 + LengthBytes(matchLength);
+				if ((size_t)(oend - op) < needed)
+					return 0;
+
+				u8 * token = op++;
+				*token = (u8)((literals >= 15 ? 15 : literals) << 4);
+				if (literals >= 15)
+					op = WriteLength(op, literals - 15);
+				memcpy(op, anchor, literals);
+				op += literals;
+				size_t offset = (size_t)(ip - ref);
+				*op++ = (u8)offset;
+				*op++ = (u8)(offset >> 8);
+				*token |= (u8)(matchLength >= 15 ? 15 : matchLength);
+				if (matchLength >= 15)
+					op = WriteLength(op, matchLength - 15);
+
+				ip = mp;
+				anchor = ip;
+				if (ip - 2 > base && ip < mflimit)
+					table[HashOf(Read32(ip - 2))] = (u32)(ip - 2 - base);
+			}
+		}
+
+		// the last sequence carries only literals
+		size_t literals = (size_t)(iend - anchor);
+		if ((size_t)(oend - op) < 1 + LengthBytes(literals) + literals)
+			return 0;
+		*op++ = (u8)((literals >= 15 ? 15 : literals) << 4);
+		if (literals >= 15)
+			op = WriteLength(op, literals - 15);
+		memcpy(op, anchor, literals);
+		op += literals;
+		return (size_t)(op - (u8*)dst);
+	}
+
+	size_t Decompress(const void * src, size_t srcSize, void * dst, size_t dstCapacity)
+	{
+		const u8 * ip = (const u8*)src;
+		const u8 * const iend = ip + srcSize;
+		u8 * op = (u8*)dst;
+		u8 * const ostart = op;
+		u8 * const oend = op + dstCapacity;
+
+		while (ip < iend)
+		{
+			u32 token = *ip++;
+			size_t literals = token >> 4;
+			if (literals == 15)
+			{
+				u8 b;
+				do
+				{
+					if (ip >= iend)
+						return size_t(-1);
+					b = *ip++;
+					literals += b;
+				} while (b == 255);
+			}
+			if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op))
+				return size_t(-1);
+			memcpy(op, ip, literals);
+			ip += literals;
+			op += literals;
+			if (ip == iend)
+				break;
+
+			if (iend - ip < 2)
+				return size_t(-1);
+			size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > (size_t)(op - ostart))
+				return size_t(-1);
+			size_t matchLength = token & 15;
+			if (matchLength == 15)
+			{
+				u8 b;
+				do
+				{
+					if (ip >= iend)
+						return size_t(-1);
+					b = *ip++;
+					matchLength += b;
+				} while (b == 255);
+			}
+			matchLength += kMinMatch;
+			if (matchLength > (size_t)(oend - op))
+				return size_t(-1);
+			const u8 * match = op - offset;
+			if (offset >= matchLength)
+			{
+				memcpy(op, match, matchLength);
+				op += matchLength;
+			}
+			else
+			{
+				// overlapping copy repeats the last offset bytes
+				for (size_t i = 0; i < matchLength; i++)
+					*op++ = *match++;
+			}
+		}
+		return (size_t)(op - ostart);
+	}
+}
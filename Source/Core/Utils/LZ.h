@@ -0,0 +1,21 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+#include <stddef.h>
+
+/// Byte oriented LZ77 codec (LZ4 block layout): a token of literal and
+/// match length nibbles, the literals, a 16 bit little endian offset and
+/// 255-continued length bytes. Favors decode speed over ratio.
+namespace LZ
+{
+	/// Worst case size of compressing srcSize bytes
+	size_t K3D_API CompressBound(size_t srcSize);
+
+	/// \return compressed size, 0 if the result does not fit dstCapacity
+	size_t K3D_API Compress(const void * src, size_t srcSize, void * dst, size_t dstCapacity);
+
+	/// Bounds checked, malformed input never writes past dst + dstCapacity
+	/// \return decompressed size, size_t(-1) on malformed input
+	size_t K3D_API Decompress(const void * src, size_t srcSize, void * dst, size_t dstCapacity);
+}
+
+#endif
@@ -356,7 +356,7 @@ string MD5::toString() {
 k3d::String MD5::Str()
 {
 	k3d::String str;
-	str.Resize(32);
+	str.Reserve(32);
 	for (size_t i = 0; i < 16; ++i) {
 		int t = digest()[i];
 		int a = t / 16;
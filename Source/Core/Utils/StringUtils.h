@@ -2,6 +2,7 @@
 
 #include "Config/Config.h"
 #include <string>
+#include <vector>
 
 namespace k3d
 {
@@ -13,6 +14,62 @@ namespace k3d
 		static void	WCharToChar(const wchar_t *wchr, char *wchar, int size);
 #endif
 		static std::string GenerateMD5(std::string const & source);
+
+		/// Separators become '/', "." and "name/.." segments fold away, a
+		/// "scheme://" prefix is kept. Leading ".." of relative paths stay.
+		template <class TString>
+		static TString NormalizePath(TString const & path)
+		{
+			typedef typename TString::value_type TChar;
+			TString normalized;
+			size_t pos = 0;
+			size_t colon = path.find(TChar(':'));
+			if (colon != TString::npos && colon + 2 < path.size() && path[colon + 1] == TChar('/')
+				&& path[colon + 2] == TChar('/') && path.find(TChar('/')) > colon)
+			{
+				normalized = path.substr(0, colon + 3);
+				pos = colon + 3;
+			}
+			bool absolute = pos < path.size() && (path[pos] == TChar('/') || path[pos] == TChar('\\'));
+			std::vector<TString> segments;
+			size_t kept = 0;
+			while (pos <= path.size())
+			{
+				size_t end = pos;
+				while (end < path.size() && path[end] != TChar('/') && path[end] != TChar('\\'))
+					end++;
+				TString segment = path.substr(pos, end - pos);
+				bool dot = segment.size() == 1 && segment[0] == TChar('.');
+				bool dotDot = segment.size() == 2 && segment[0] == TChar('.') && segment[1] == TChar('.');
+				if (dotDot && segments.size() > kept)
+				{
+					segments.pop_back();
+				}
+				else if (dotDot)
+				{
+					// above the root is the root
+					if (!absolute)
+					{
+						segments.push_back(segment);
+						kept++;
+					}
+				}
+				else if (!segment.empty() && !dot)
+				{
+					segments.push_back(segment);
+				}
+				pos = end + 1;
+			}
+			if (absolute)
+				normalized += TChar('/');
+			for (size_t i = 0; i < segments.size(); i++)
+			{
+				if (i)
+					normalized += TChar('/');
+				normalized += segments[i];
+			}
+			return normalized;
+		}
 	};
 
 #if K3DPLATFORM_OS_WIN
@@ -95,7 +95,7 @@ uint32_t Hash32WithSeed(const char* s, size_t len, uint32_t seed);
 // Hash function for a byte array.
 // May change from time to time, may differ on different platforms, may differ
 // depending on NDEBUG.
-uint64_t Hash64(const char* s, size_t len);
+uint64_t K3D_API Hash64(const char* s, size_t len);
 
 // Hash function for a byte array.  For convenience, a 64-bit seed is also
 // hashed into the result.
@@ -0,0 +1,566 @@
+#include "Kaleido3D.h"
+#include "VirtualFS.h"
+#include "Bundle.h"
+#include "LogUtil.h"
+#include "Utils/StringUtils.h"
+#include <KTL/HashMap.hpp>
+
+#if K3DPLATFORM_OS_ANDROID
+#include "App.h"
+#include <android/asset_manager.h>
+#endif
+
+#include <algorithm>
+
+namespace k3d
+{
+	namespace
+	{
+		const char		kAssetScheme[] = "asset://";
+		const size_t	kAssetSchemeLength = sizeof(kAssetScheme) - 1;
+
+		const char * StripScheme(const char * path)
+		{
+			return strncmp(path, kAssetScheme, kAssetSchemeLength) == 0 ? path + kAssetSchemeLength : path;
+		}
+
+		kString ToNative(const char * path)
+		{
+#if K3DPLATFORM_OS_WIN
+			wchar_t buffer[2048] = { 0 };
+			StringUtil::CharToWchar(path, buffer, sizeof(buffer));
+			return buffer;
+#else
+			return path;
+#endif
+		}
+
+		class MemmapedAsset : public IAsset
+		{
+		public:
+			/// Check IsOpen, a missing file leaves the mapping empty
+			explicit MemmapedAsset(kString const & path) { m_Opened = m_File.Open(path.c_str(), IORead); }
+			~MemmapedAsset() override {}
+
+			bool IsOpen() const { return m_Opened; }
+
+			uint64 GetLength() override
+			{	return m_File.GetSize();	}
+
+			const void * GetBuffer() override
+			{	return m_File.FileData(); }
+
+			uint64 Read(void *data, uint64 size) override { return m_File.Read((char*)data, (size_t)size); }
+			bool Seek(uint64 offset) override { return m_File.Seek((size_t)offset); }
+
+		private:
+			Os::MemMapFile	m_File;
+			bool			m_Opened;
+		};
+
+		/// Bytes kept alive by their owner
+		class BufferAsset : public IAsset
+		{
+		public:
+			BufferAsset(const kByte * data, uint64 size, std::shared_ptr<void> const & owner)
+				: m_Data(data), m_Size(size), m_Position(0), m_Owner(owner) {}
+
+			uint64 GetLength() override { return m_Size; }
+			const void * GetBuffer() override { return m_Data; }
+			uint64 Read(void *data, uint64 size) override
+			{
+				size = std::min(size, m_Size - m_Position);
+				memcpy(data, m_Data + m_Position, (size_t)size);
+				m_Position += size;
+				return size;
+			}
+			bool Seek(uint64 offset) override
+			{
+				if (offset > m_Size)
+					return false;
+				m_Position = offset;
+				return true;
+			}
+
+		private:
+			const kByte *			m_Data;
+			uint64					m_Size;
+			uint64					m_Position;
+			std::shared_ptr<void>	m_Owner;
+		};
+
+		/// Read-only IIODevice over the bytes of a bundle chunk, memory file
+		/// or Android asset
+		class AssetDevice : public ::IIODevice
+		{
+		public:
+			explicit AssetDevice(IAsset * asset) : m_Asset(asset), m_Position(0) {}
+
+			bool Open(const kchar *, IOFlag) override { return false; }
+			bool IsEOF() override { return !m_Asset || m_Position >= m_Asset->GetLength(); }
+			size_t Read(char * data, size_t len) override
+			{
+				if (!m_Asset)
+					return 0;
+				size_t read = (size_t)m_Asset->Read(data, len);
+				m_Position += read;
+				return read;
+			}
+			size_t Write(const void *, size_t) override { return 0; }
+			bool Seek(size_t offset) override
+			{
+				if (!m_Asset || !m_Asset->Seek(offset))
+					return false;
+				m_Position = offset;
+				return true;
+			}
+			bool Skip(size_t offset) override { return Seek((size_t)m_Position + offset); }
+			void Flush() override {}
+			void Close() override { m_Asset.reset(); }
+
+		private:
+			std::unique_ptr<IAsset>	m_Asset;
+			uint64					m_Position;
+		};
+
+		class DirectoryMount : public IMount
+		{
+		public:
+			explicit DirectoryMount(const kchar * directory) : m_Directory(directory)
+			{
+				if (!m_Directory.empty() && m_Directory.back() != KT('/') && m_Directory.back() != KT('\\'))
+					m_Directory += KT('/');
+			}
+
+			bool Exists(const char * path) override
+			{
+				return Os::Exists(NativePath(path).c_str());
+			}
+
+			IAsset * Open(const char * path) override
+			{
+				MemmapedAsset * asset = new MemmapedAsset(NativePath(path));
+				if (asset->IsOpen())
+					return asset;
+				delete asset;
+				return nullptr;
+			}
+
+			kString NativePath(const char * path) override
+			{
+				return m_Directory + ToNative(path);
+			}
+
+		private:
+			kString		m_Directory;
+		};
+
+		class BundleMount : public IMount
+		{
+		public:
+			BundleMount() : m_Reader(std::make_shared<AssetBundleReader>()) {}
+
+			bool Load(const kchar * bundlePath)
+			{
+				m_Path = bundlePath;
+				return m_Reader->Open(bundlePath);
+			}
+
+			bool Exists(const char * path) override
+			{
+				return (bool)m_Reader->Find(path);
+			}
+
+			IAsset * Open(const char * path) override
+			{
+				AssetChunkView chunk = m_Reader->Find(path);
+				if (!chunk)
+					return nullptr;
+				if (chunk.Compression == EChunkCompression::None)
+					return new BufferAsset((const kByte*)chunk.Data, chunk.Size, m_Reader);
+				auto bytes = std::make_shared<std::vector<kByte>>((size_t)chunk.RawSize);
+				if (!DecompressChunk(chunk, bytes->data()))
+				{
+					KLOG(Error, VirtualFS, "Corrupt chunk %s.", path);
+					return nullptr;
+				}
+				return new BufferAsset(bytes->data(), bytes->size(), bytes);
+			}
+
+			bool Locate(const char * path, VFSLocation & location) override
+			{
+				AssetChunkView chunk = m_Reader->Find(path);
+				if (!chunk)
+					return false;
+				location.NativePath = m_Path;
+				location.Offset = chunk.Offset;
+				location.Size = (int64)chunk.Size;
+				location.Compression = chunk.Compression;
+				location.RawSize = chunk.RawSize;
+				return true;
+			}
+
+		private:
+			kString								m_Path;
+			/// Shared with the open assets, they point into its mapping
+			std::shared_ptr<AssetBundleReader>	m_Reader;
+		};
+
+		class MemoryMount : public IMount
+		{
+		public:
+			typedef std::shared_ptr<std::vector<kByte>> Bytes;
+
+			void Write(const char * path, const void * data, uint64 size)
+			{
+				Bytes bytes = std::make_shared<std::vector<kByte>>((const kByte*)data, (const kByte*)data + size);
+				m_Lock.Lock();
+				m_Files[path] = bytes;
+				m_Lock.UnLock();
+			}
+
+			bool Exists(const char * path) override
+			{
+				m_Lock.Lock();
+				bool exists = m_Files.Contains(path);
+				m_Lock.UnLock();
+				return exists;
+			}
+
+			IAsset * Open(const char * path) override
+			{
+				m_Lock.Lock();
+				Bytes * found = m_Files.FindValue(path);
+				Bytes bytes = found ? *found : nullptr;
+				m_Lock.UnLock();
+				// a rewrite leaves the open asset on the old bytes
+				return bytes ? new BufferAsset(bytes->data(), bytes->size(), bytes) : nullptr;
+			}
+
+		private:
+			Os::Mutex						m_Lock;
+			HashMap<std::string, Bytes>		m_Files;
+		};
+
+#if K3DPLATFORM_OS_ANDROID
+		class AndroidAsset : public IAsset
+		{
+		public:
+			AndroidAsset(AAsset * asset) : m_Asset(asset) {}
+			~AndroidAsset() override { if(m_Asset) AAsset_close(m_Asset); }
+
+			uint64 		GetLength() override { return (uint64)AAsset_getLength64(m_Asset); }
+			const void* GetBuffer() override { return AAsset_isAllocated(m_Asset) ? AAsset_getBuffer(m_Asset) : nullptr; }
+
+			uint64 Read(void *data, uint64 size) override { return (uint64)AAsset_read(m_Asset, data, (size_t)size); }
+			bool Seek(uint64 offset) override { return AAsset_seek64(m_Asset, offset, SEEK_SET)!=-1; }
+
+		private:
+			AAsset	* m_Asset;
+		};
+
+		/// Asks the environment for the asset manager on use, mounting may
+		/// happen before the activity is up
+		class AndroidAssetMount : public IMount
+		{
+		public:
+			bool Exists(const char * path) override
+			{
+				AAsset * asset = AAssetManager_open(GetEnv()->GetAssets(), path, AASSET_MODE_UNKNOWN);
+				if (asset)
+					AAsset_close(asset);
+				return asset != nullptr;
+			}
+
+			IAsset * Open(const char * path) override
+			{
+				AAsset * asset = AAssetManager_open(GetEnv()->GetAssets(), path, AASSET_MODE_STREAMING);
+				return asset ? new AndroidAsset(asset) : nullptr;
+			}
+		};
+#endif
+
+		struct MountEntry
+		{
+			VirtualFS::MountId			Id;
+			std::string					Point;
+			int32						Priority;
+			std::shared_ptr<IMount>		Mount;
+		};
+	}
+
+	class VirtualFSImpl
+	{
+	public:
+		VirtualFSImpl() : NextId(1), Generation(0) {}
+
+		/// The mount a path resolves to and the length of its mount point
+		struct Resolution
+		{
+			std::shared_ptr<IMount>	Mount;
+			size_t					PointLength = 0;
+		};
+
+		/// Hits come from the cache, misses ask the mounts outside Lock
+		/// and are not cached, a file created later is found next time
+		/// \param paths normalized
+		void Resolve(std::string const * paths, uint32 count, Resolution * found)
+		{
+			std::vector<uint32> misses;
+			Lock.Lock();
+			for (uint32 i = 0; i < count; i++)
+			{
+				VirtualFS::MountId * cached = Resolved.FindValue(paths[i]);
+				MountEntry * entry = cached ? FindMount(*cached) : nullptr;
+				if (entry)
+					found[i] = { entry->Mount, entry->Point.size() };
+				else
+					misses.push_back(i);
+			}
+			if (misses.empty())
+			{
+				Lock.UnLock();
+				return;
+			}
+			std::vector<MountEntry> mounts = Mounts;
+			uint32 generation = Generation;
+			Lock.UnLock();
+
+			std::vector<VirtualFS::MountId> ids(misses.size(), 0);
+			for (size_t m = 0; m < misses.size(); m++)
+			{
+				std::string const & path = paths[misses[m]];
+				for (auto & entry : mounts)
+				{
+					if (path.compare(0, entry.Point.size(), entry.Point) == 0
+						&& entry.Mount->Exists(path.c_str() + entry.Point.size()))
+					{
+						found[misses[m]] = { entry.Mount, entry.Point.size() };
+						ids[m] = entry.Id;
+						break;
+					}
+				}
+			}
+
+			Lock.Lock();
+			// stale if the mounts changed meanwhile, this lookup still answers
+			if (generation == Generation)
+			{
+				for (size_t m = 0; m < misses.size(); m++)
+				{
+					if (ids[m])
+						Resolved.Insert(paths[misses[m]], ids[m]);
+				}
+			}
+			Lock.UnLock();
+		}
+
+		/// Under Lock
+		MountEntry * FindMount(VirtualFS::MountId id)
+		{
+			for (auto & entry : Mounts)
+			{
+				if (entry.Id == id)
+					return &entry;
+			}
+			return nullptr;
+		}
+
+		/// Under Lock, after the mounts or their files changed
+		void Invalidate()
+		{
+			Resolved.Clear();
+			Generation++;
+		}
+
+		/// Resolves path to its mount and the path inside it
+		std::shared_ptr<IMount> Lookup(const char * path, std::string & inner)
+		{
+			std::string normalized = VirtualFS::Normalize(path);
+			Resolution found;
+			Resolve(&normalized, 1, &found);
+			if (found.Mount)
+				inner = normalized.substr(found.PointLength);
+			return found.Mount;
+		}
+
+		VirtualFS::MountId					NextId;
+		/// Highest priority first
+		std::vector<MountEntry>				Mounts;
+		/// Existing files only
+		HashMap<std::string, VirtualFS::MountId>	Resolved;
+		/// Bumped by every invalidation
+		uint32								Generation;
+		mutable Os::Mutex					Lock;
+	};
+
+	VirtualFS::VirtualFS() : d(new VirtualFSImpl)
+	{
+	}
+
+	VirtualFS::~VirtualFS()
+	{
+		delete d;
+	}
+
+	VirtualFS::MountId VirtualFS::Mount(const char * mountPoint, std::shared_ptr<IMount> const & mount, int32 priority)
+	{
+		if (!mount)
+			return 0;
+		d->Lock.Lock();
+		MountEntry entry = { d->NextId++, StripScheme(mountPoint ? mountPoint : ""), priority, mount };
+		// before the first lower one, the latest of equals wins
+		auto pos = std::find_if(d->Mounts.begin(), d->Mounts.end(), [priority](MountEntry const & e)
+		{
+			return e.Priority <= priority;
+		});
+		d->Mounts.insert(pos, entry);
+		d->Invalidate();
+		d->Lock.UnLock();
+		return entry.Id;
+	}
+
+	VirtualFS::MountId VirtualFS::MountDirectory(const char * mountPoint, const kchar * directory, int32 priority)
+	{
+		return Mount(mountPoint, std::make_shared<DirectoryMount>(directory), priority);
+	}
+
+	VirtualFS::MountId VirtualFS::MountBundle(const char * mountPoint, const kchar * bundlePath, int32 priority)
+	{
+		auto bundle = std::make_shared<BundleMount>();
+		if (!bundle->Load(bundlePath))
+			return 0;
+		return Mount(mountPoint, bundle, priority);
+	}
+
+#if K3DPLATFORM_OS_ANDROID
+	VirtualFS::MountId VirtualFS::MountAndroidAssets(const char * mountPoint, int32 priority)
+	{
+		return Mount(mountPoint, std::make_shared<AndroidAssetMount>(), priority);
+	}
+#endif
+
+	VirtualFS::MountId VirtualFS::MountMemory(const char * mountPoint, int32 priority)
+	{
+		return Mount(mountPoint, std::make_shared<MemoryMount>(), priority);
+	}
+
+	bool VirtualFS::WriteMemory(MountId memoryMount, const char * path, const void * data, uint64 size)
+	{
+		d->Lock.Lock();
+		MountEntry * entry = d->FindMount(memoryMount);
+		MemoryMount * memory = entry ? dynamic_cast<MemoryMount*>(entry->Mount.get()) : nullptr;
+		if (memory)
+		{
+			memory->Write(Normalize(path).c_str(), data, size);
+			// may shadow a lower mount
+			d->Invalidate();
+		}
+		d->Lock.UnLock();
+		return memory != nullptr;
+	}
+
+	bool VirtualFS::Unmount(MountId mount)
+	{
+		std::shared_ptr<IMount> removed;
+		d->Lock.Lock();
+		auto entry = std::find_if(d->Mounts.begin(), d->Mounts.end(), [mount](MountEntry const & e)
+		{
+			return e.Id == mount;
+		});
+		if (entry != d->Mounts.end())
+		{
+			removed = Move(entry->Mount);
+			d->Mounts.erase(entry);
+			d->Invalidate();
+		}
+		d->Lock.UnLock();
+		return removed != nullptr;
+	}
+
+	IAsset * VirtualFS::Open(const char * path)
+	{
+		std::string inner;
+		std::shared_ptr<IMount> mount = d->Lookup(path, inner);
+		return mount ? mount->Open(inner.c_str()) : nullptr;
+	}
+
+	std::shared_ptr<IIODevice> VirtualFS::OpenDevice(const char * path, bool memoryMapped)
+	{
+		std::string inner;
+		std::shared_ptr<IMount> mount = d->Lookup(path, inner);
+		if (!mount)
+			return nullptr;
+		kString native = mount->NativePath(inner.c_str());
+		if (native.empty())
+		{
+			IAsset * asset = mount->Open(inner.c_str());
+			return asset ? std::make_shared<AssetDevice>(asset) : nullptr;
+		}
+		if (memoryMapped)
+		{
+			auto file = std::make_shared<Os::MemMapFile>();
+			return file->Open(native.c_str(), IORead) ? file : nullptr;
+		}
+		auto file = std::make_shared<Os::File>();
+		return file->Open(native.c_str(), IORead) ? file : nullptr;
+	}
+
+	bool VirtualFS::Exists(const char * path)
+	{
+		std::string normalized = Normalize(path);
+		VirtualFSImpl::Resolution found;
+		d->Resolve(&normalized, 1, &found);
+		return found.Mount != nullptr;
+	}
+
+	uint32 VirtualFS::Exists(const char * const * paths, uint32 count, bool * exists)
+	{
+		std::vector<std::string> normalized(count);
+		for (uint32 i = 0; i < count; i++)
+			normalized[i] = Normalize(paths[i]);
+		std::vector<VirtualFSImpl::Resolution> found(count);
+		d->Resolve(normalized.data(), count, found.data());
+		uint32 existing = 0;
+		for (uint32 i = 0; i < count; i++)
+		{
+			exists[i] = found[i].Mount != nullptr;
+			existing += exists[i] ? 1 : 0;
+		}
+		return existing;
+	}
+
+	kString VirtualFS::NativePath(const char * path)
+	{
+		std::string inner;
+		std::shared_ptr<IMount> mount = d->Lookup(path, inner);
+		return mount ? mount->NativePath(inner.c_str()) : kString();
+	}
+
+	bool VirtualFS::Locate(const char * path, VFSLocation & location)
+	{
+		std::string inner;
+		std::shared_ptr<IMount> mount = d->Lookup(path, inner);
+		return mount && mount->Locate(inner.c_str(), location);
+	}
+
+	std::string VirtualFS::Normalize(const char * path)
+	{
+		return StringUtil::NormalizePath(std::string(StripScheme(path)));
+	}
+
+	uint32 VirtualFS::GetCachedCount() const
+	{
+		d->Lock.Lock();
+		uint32 count = (uint32)d->Resolved.Count();
+		d->Lock.UnLock();
+		return count;
+	}
+
+	void VirtualFS::InvalidateCache()
+	{
+		d->Lock.Lock();
+		d->Invalidate();
+		d->Lock.UnLock();
+	}
+}
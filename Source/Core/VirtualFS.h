@@ -0,0 +1,117 @@
+#ifndef __VirtualFS_h__
+#define __VirtualFS_h__
+#pragma once
+
+#include "Os.h"
+#include "Bundle.h"
+#include <memory>
+
+namespace k3d
+{
+	struct IAsset
+	{
+		virtual ~IAsset() {}
+		virtual uint64	GetLength() = 0;
+		virtual const void*	GetBuffer() = 0;
+		virtual uint64 Read(void *data, uint64 size) = 0;
+		virtual bool Seek(uint64 offset) = 0;
+	};
+
+	/// VFSLocation
+	/// Where the stored bytes of a file are on disk, for reading them with
+	/// AsyncIO instead of through IAsset.
+	struct VFSLocation
+	{
+		/// The file holding the bytes, a loose file or a bundle
+		kString				NativePath;
+		uint64				Offset = 0;
+		/// Stored bytes from Offset, -1 to the end of the file
+		int64				Size = -1;
+		/// Decompress like a bundle chunk unless None
+		EChunkCompression	Compression = EChunkCompression::None;
+		uint64				RawSize = 0;
+	};
+
+	/// IMount
+	/// One source of read-only files, paths are relative to its mount point.
+	struct K3D_API IMount
+	{
+		virtual ~IMount() {}
+		virtual bool	Exists(const char * path) = 0;
+		/// \return null if missing, the caller deletes the asset
+		virtual IAsset*	Open(const char * path) = 0;
+		/// File path for Os::File and AsyncIO, empty if the file is not on disk
+		virtual kString	NativePath(const char *) { return kString(); }
+		/// False if the bytes are not in a file on disk, Open them instead
+		virtual bool	Locate(const char * path, VFSLocation & location)
+		{
+			location = VFSLocation();
+			location.NativePath = NativePath(path);
+			return !location.NativePath.empty();
+		}
+	};
+
+	/// VirtualFS
+	/// Overlays mounts (directories, bundles, Android assets, memory) at
+	/// priorities: a path resolves to the highest priority mount that has
+	/// it, the latest of equal ones. Found files are cached until the
+	/// mounts change or InvalidateCache, so repeated lookups never reach the
+	/// OS; misses ask the mounts again. Paths may carry the "asset://"
+	/// scheme and are normalized, so "./a/b" and "a//b" are the same file.
+	class K3D_API VirtualFS
+	{
+	public:
+		typedef uint32 MountId;
+
+		VirtualFS();
+		~VirtualFS();
+
+		/// \param mountPoint prefix the files appear under, "" for the root,
+		///        otherwise ending with '/'
+		/// \return 0 if mount is null
+		MountId		Mount(const char * mountPoint, std::shared_ptr<IMount> const & mount, int32 priority = 0);
+		MountId		MountDirectory(const char * mountPoint, const kchar * directory, int32 priority = 0);
+		/// Chunks by name, compressed ones are decompressed on open
+		/// \return 0 if the bundle cannot be opened
+		MountId		MountBundle(const char * mountPoint, const kchar * bundlePath, int32 priority = 0);
+#if K3DPLATFORM_OS_ANDROID
+		/// The APK assets of the running application
+		MountId		MountAndroidAssets(const char * mountPoint, int32 priority = 0);
+#endif
+		/// Files written with WriteMemory, shadowing the other mounts by default
+		MountId		MountMemory(const char * mountPoint, int32 priority = 1000);
+		bool		WriteMemory(MountId memoryMount, const char * path, const void * data, uint64 size);
+		bool		Unmount(MountId mount);
+
+		/// \return null if no mount has path, the caller deletes the asset
+		IAsset *	Open(const char * path);
+		/// Read-only, the file itself for directory mounts (memory mapped
+		/// if asked), the bytes Open returns for the others
+		/// \return null if no mount has path
+		std::shared_ptr<IIODevice>	OpenDevice(const char * path, bool memoryMapped = false);
+		bool		Exists(const char * path);
+		/// Resolves count paths with one pass over the cache
+		/// \return how many exist
+		uint32		Exists(const char * const * paths, uint32 count, bool * exists);
+		/// Empty if missing or not on disk
+		kString		NativePath(const char * path);
+		/// The loose file or bundle range holding path
+		/// \return false if missing or only readable through Open
+		bool		Locate(const char * path, VFSLocation & location);
+		/// The path every lookup uses, scheme stripped
+		static std::string	Normalize(const char * path);
+
+		uint32		GetCachedCount() const;
+		/// Call when files were removed or created below a mount, a cached
+		/// hit may be gone or shadowed
+		void		InvalidateCache();
+
+	private:
+		VirtualFS(const VirtualFS&) = delete;
+		VirtualFS& operator=(const VirtualFS&) = delete;
+
+		class VirtualFSImpl * d;
+	};
+}
+
+#endif
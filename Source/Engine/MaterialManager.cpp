@@ -20,17 +20,18 @@ namespace k3d
 
 	std::shared_ptr<Material> MaterialManager::FindMaterialByName(const char *name)
 	{
-		std::string matName(name);
-		return FindMaterialByName(matName);
+		Name id = Name::Find(name);
+		return id.IsNone() ? nullptr : FindMaterial(id);
 	}
 
 	std::shared_ptr<Material> MaterialManager::FindMaterialByName(const std::string & name)
 	{
-		MaterialMap::const_iterator iter = m_Materials.find(name);
-		if (iter != m_Materials.end()) {
-			return m_Materials[name];
-		}
-		else
-			return nullptr;
+		return FindMaterialByName(name.c_str());
+	}
+
+	std::shared_ptr<Material> MaterialManager::FindMaterial(Name name)
+	{
+		std::shared_ptr<Material> * material = m_Materials.FindValue(name);
+		return material ? *material : nullptr;
 	}
 }
@@ -1,8 +1,8 @@
 #pragma once
 #include "Material.h"
 #include <KTL/Singleton.hpp>
+#include <KTL/Name.hpp>
 #include <memory>
-#include <map>
 
 namespace k3d
 {
@@ -12,7 +12,7 @@ namespace k3d
 	/// \brief The k3dMaterialManager class manages material loading, finding
 	///
 	class MaterialManager : public Singleton<MaterialManager> {
-		typedef std::map<std::string, std::shared_ptr<Material> >  MaterialMap;
+		typedef HashMap<Name, std::shared_ptr<Material> >  MaterialMap;
 	public:
 		MaterialManager();
 		~MaterialManager();
@@ -39,6 +39,9 @@ namespace k3d
 		std::shared_ptr<Material>
 			FindMaterialByName(const std::string & name);
 
+		std::shared_ptr<Material>
+			FindMaterial(Name name);
+
 	private:
 		MaterialMap     m_Materials;
 	};
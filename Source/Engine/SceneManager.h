@@ -1,5 +1,6 @@
 #pragma once
 #include <KTL/Singleton.hpp>
+#include <KTL/HashMap.hpp>
 #include "SceneObject.h"
 
 namespace k3d 
@@ -13,7 +14,7 @@ namespace k3d
 
 		/// \brief VMarkMap
 		/// visible marks map
-		typedef std::unordered_map<uint32, std::shared_ptr<std::vector<char> > > VMarkMap;
+		typedef HashMap<uint32, std::shared_ptr<std::vector<char> > > VMarkMap;
 
 		SceneManager();
 		~SceneManager();
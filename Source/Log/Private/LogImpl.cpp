@@ -30,6 +30,16 @@ namespace k3d
 		return time_info;
 	}
 
+	/// hh:mm:ss.mmm of a LogSource time, on the log thread
+	static inline const char* GetLocalTime(uint64 microseconds) {
+		time_t t = (time_t)(microseconds / 1000000);
+		struct tm *tm = localtime(&t);
+		static char time_info[128] = { 0 };
+		::snprintf(time_info, 128, "%02d:%02d:%02d.%03d", tm->tm_hour, tm->tm_min, tm->tm_sec, (int)(microseconds / 1000 % 1000));
+		return time_info;
+	}
+
+	/// Lines gather in memory, each batch of the log thread is one write
 	class FileLogger : public ILogger
 	{
 	public:
@@ -37,50 +47,45 @@ namespace k3d
 		{
 			kString name = GetEnv()->GetEnvValue(Environment::ENV_KEY_LOG_DIR) + KT("/") + GetEnv()->GetEnvValue(Environment::ENV_KEY_APP_NAME) + KT(".log");
 			m_LogFile.Open(name.c_str(), IOWrite);
-			m_Thread = new Os::Thread([this]()->void {
-				while (true)
-				{
-					if (m_Logs.empty())
-					{
-						unique_lock<std::mutex> uSignal(m_Signal);
-						m_CV.wait(uSignal);
-					}
-					else
-					{
-						lock_guard<mutex> scopeLock(m_LogMutex);
-						while (!m_Logs.empty())
-						{
-							std::string log = m_Logs.front();
-							m_LogFile.Write(log.data(), log.size());
-							m_Logs.pop();
-						}
-					}
-				}
-			}, "FileLogger");
-			m_Thread->Start();
 		}
 
 		~FileLogger() override
 		{
+			Flush();
 			m_LogFile.Close();
 		}
 
 		void Log(ELogLevel const & logLv, const char * tag, const char * msg) override
+		{
+			Append(GetLocalTime(), Os::Thread::GetCurrentThreadName().c_str(), msg);
+			Flush();
+		}
+
+		void Log(ELogLevel const & logLv, const char * tag, const char * msg, LogSource const & source) override
+		{
+			Append(GetLocalTime(source.Time), source.Thread, msg);
+		}
+
+		void Flush() override
 		{
 			lock_guard<mutex> scopeLock(m_LogMutex);
-			static char sCurBuffer[4096] = { 0 }; // 4K buffer less than websocket buffer size
-			snprintf(sCurBuffer, 4096, "[%s]@[%s]:%s\n", GetLocalTime(), Os::Thread::GetCurrentThreadName().c_str(), msg);
-			m_Logs.push(sCurBuffer);
-			m_CV.notify_one();
+			if (!m_Pending.empty())
+			{
+				m_LogFile.Write(m_Pending.data(), m_Pending.size());
+				m_Pending.clear();
+			}
 		}
 
 	private:
+		void Append(const char * time, const char * thread, const char * msg)
+		{
+			lock_guard<mutex> scopeLock(m_LogMutex);
+			m_Pending.append("[").append(time).append("]@[").append(thread).append("]:").append(msg).append("\n");
+		}
+
 		Os::File				m_LogFile;
-		std::queue<std::string> m_Logs;
-		Os::Thread*				m_Thread;
+		std::string				m_Pending;
 		mutex					m_LogMutex;
-		mutex					m_Signal;
-		condition_variable		m_CV;
 	};
 
 
@@ -147,17 +152,35 @@ namespace k3d
 		}
 
 		void Log(ELogLevel const & lv, const char * tag, const char * logLine) override
+		{
+			Push(lv, tag, logLine, GetLocalTime(), Os::Thread::GetCurrentThreadName().c_str());
+		}
+
+		void Log(ELogLevel const & lv, const char * tag, const char * logLine, LogSource const & source) override
+		{
+			Push(lv, tag, logLine, GetLocalTime(source.Time), source.Thread);
+		}
+
+	protected:
+		void Push(ELogLevel const & lv, const char * tag, const char * logLine, const char * time, const char * thread)
 		{
 			{
 				lock_guard<mutex> scopeLock(m_LogMutex);
-				static char sCurBuffer[4096] = { 0 }; // 4K buffer less than websocket buffer size
-				snprintf(sCurBuffer, 4096, "[%s]@[%s]:%s", GetLocalTime(), Os::Thread::GetCurrentThreadName().c_str(), logLine);
-				m_Logs.push({ sCurBuffer, tag, lv });
+				if (lv == ELogLevel::Profile)
+				{
+					// JSON payload, keep it parseable
+					m_Logs.push({ logLine, tag, lv });
+				}
+				else
+				{
+					static char sCurBuffer[4096] = { 0 }; // 4K buffer less than websocket buffer size
+					snprintf(sCurBuffer, 4096, "[%s]@[%s]:%s", time, thread, logLine);
+					m_Logs.push({ sCurBuffer, tag, lv });
+				}
 			}
 			m_CV.notify_one();
 		}
 
-	protected:
 		struct LogItem
 		{
 			LogItem(string const &log, string const &tag, ELogLevel const& lv)
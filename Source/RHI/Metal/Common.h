@@ -9,7 +9,7 @@
 #include <Core/LogUtil.h>
 
 #define MTLLOG(Level, ...) \
-::k3d::Log(::k3d::ELogLevel::Level, "kaleido3d::MetalRHI", __VA_ARGS__);
+K3D_LOG_SITE(::k3d::LogDetail::LogNow, Level, "kaleido3d::MetalRHI", Always(), __VA_ARGS__);
 
 #define MTLLOGI(...) MTLLOG(Info, __VA_ARGS__);
 #define MTLLOGE(...) MTLLOG(Error, __VA_ARGS__);
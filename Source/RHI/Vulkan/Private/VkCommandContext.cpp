@@ -2,9 +2,8 @@
 #include "VkRHI.h"
 #include "VkUtils.h"
 #include "VkEnums.h"
+#include <Core/FrameStats.h>
 
-#include <sstream>
-#include <iomanip>
 
 K3D_VK_BEGIN
 
@@ -42,6 +41,7 @@ void CommandQueue::Submit(
 VkResult CommandQueue::Submit(const std::vector<VkSubmitInfo>& submits, VkFence fence)
 {
 	VKRHI_METHOD_TRACE
+	K3D_FRAME_PHASE(Submit);
 	K3D_ASSERT(!submits.empty());
 	uint32_t submitCount = static_cast<uint32_t>(submits.size());
 	const VkSubmitInfo* pSubmits = submits.data();
@@ -97,21 +97,24 @@ rhi::CommandContextRef CommandContextPool::RequestContext(rhi::ECommandType type
 	auto context = rhi::CommandContextRef(new CommandContext(GetDevice(), cmdBuffer, pAllocator->GetCommandPool(), type));
 	//uint32 tid = Thread::GetId();
 	//m_ContextList[tid].push_back(context);
-	VKLOG(Info, "CommandContextPool::RequestContext() called in thread [%s], (cmdBuf=0x%x, type=%d).", Thread::GetCurrentThreadName().c_str(), cmdBuffer, type);
+	VKLOG(Debug, "CommandContextPool::RequestContext() called in thread [%s], (cmdBuf=0x%x, type=%d).", Thread::GetCurrentThreadName().c_str(), cmdBuffer, type);
 	return context;
 }
 
 PtrCmdAlloc CommandContextPool::RequestCommandAllocator()
 {
 	uint32 tid = Thread::GetId();
-	if (m_AllocatorPool.find(tid) == m_AllocatorPool.end())
+	// the table may rehash while another thread inserts, look up under the lock too
+	Mutex::AutoLock lock(&m_PoolMutex);
+	PtrCmdAlloc * pAllocator = m_AllocatorPool.FindValue(tid);
+	if (pAllocator)
 	{
-		Mutex::AutoLock lock(&m_PoolMutex);
-		auto pAllocator = GetDevice()->NewCommandAllocator(false);
-		m_AllocatorPool.insert({ tid, pAllocator });
-		VKLOG(Info, "CommandContextPool, new vkcommandpool created. thread=%s", Thread::GetCurrentThreadName().c_str());
+		return *pAllocator;
 	}
-	return m_AllocatorPool.at(tid);
+	auto newAllocator = GetDevice()->NewCommandAllocator(false);
+	m_AllocatorPool.Insert(tid, newAllocator);
+	VKLOG(Info, "CommandContextPool, new vkcommandpool created. thread=%s", Thread::GetCurrentThreadName().c_str());
+	return newAllocator;
 }
 
 
@@ -148,8 +151,9 @@ void CommandContext::CopyTexture(const rhi::TextureCopyLocation & Dest, const rh
 	K3D_ASSERT(Dest.pResource && Src.pResource);
 	if (Src.pResource->GetDesc().Type == rhi::EGT_Buffer && Dest.pResource->GetDesc().Type != rhi::EGT_Buffer)
 	{
-		DynArray<VkBufferImageCopy> Copies;
-		for (auto footprint : Src.SubResourceFootPrints)
+		SmallDynArray<VkBufferImageCopy, 16> Copies;
+		Copies.Reserve(Src.SubResourceFootPrints.Count());
+		for (auto const& footprint : Src.SubResourceFootPrints)
 		{
 			VkBufferImageCopy bImgCpy = {};
 			bImgCpy.bufferOffset = footprint.BufferOffSet;
@@ -222,12 +226,7 @@ void CommandContext::SubmitAndWait(PtrSemaphore wait, PtrSemaphore signal, PtrFe
 	submitInfo.pCommandBuffers = &m_CommandBuffer;
 	submitInfo.signalSemaphoreCount = signal? 1:0 ;
 	submitInfo.pSignalSemaphores = &signalSemaphore;
-#if _DEBUG
-	std::stringstream strream;
-	strream << "submit ----- wait " << std::hex << std::setfill('0') << waitSemaphore << ", signal " << std::hex
-		<< std::setfill('0') << signalSemaphore;
-	VKLOG(Info, strream.str().c_str());
-#endif
+	VKLOG(Debug, "submit ----- wait %llx, signal %llx", (unsigned long long)waitSemaphore, (unsigned long long)signalSemaphore);
 	SpCmdQueue q;
 	switch (m_CmdType)
 	{
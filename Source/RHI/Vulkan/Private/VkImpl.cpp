@@ -4,8 +4,6 @@
 #include "VkUtils.h"
 #include <set>
 #include <map>
-#include <sstream>
-#include <iomanip>
 #include <cstdarg>
 #include <Core/Os.h>
 #include <Core/Module.h>
@@ -1268,17 +1266,13 @@ void RenderViewport::PrepareNextFrame()
 {
   VKRHI_METHOD_TRACE
     m_CurFrameId = m_pSwapChain->AcquireNextImage(m_PresentSemaphore, nullptr);
-  std::stringstream stream;
-  stream << "Current Frame Id = " << m_CurFrameId << " acquiring " << std::hex << std::setfill('0') << m_PresentSemaphore->GetNativeHandle();
-  VKLOG(Info, stream.str().c_str());
+  VKLOG(Debug, "Current Frame Id = %u acquiring %llx", m_CurFrameId, (unsigned long long)m_PresentSemaphore->GetNativeHandle());
 }
 
 bool RenderViewport::Present(bool vSync)
 {
   VKRHI_METHOD_TRACE
-    std::stringstream stream;
-  stream << "present ----- renderSemaphore " << std::hex << std::setfill('0') << m_RenderSemaphore->GetNativeHandle();
-  VKLOG(Info, stream.str().c_str());
+  VKLOG(Debug, "present ----- renderSemaphore %llx", (unsigned long long)m_RenderSemaphore->GetNativeHandle());
   VkResult result = m_pSwapChain->Present(m_CurFrameId, m_RenderSemaphore);
   return result == VK_SUCCESS;
 }
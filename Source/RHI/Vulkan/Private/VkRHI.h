@@ -3,6 +3,8 @@
 #pragma once
 #include "VkObjects.h"
 #include <Core/Os.h>
+#include <Core/MemoryTracker.h>
+#include <KTL/HashMap.hpp>
 #include <list>
 #include <tuple>
 
@@ -445,6 +447,7 @@ public:
 		{
 			VKLOG(Info, "TResource Freeing Memory. -- 0x%0x, tid:%d", m_DeviceMem, Os::Thread::GetId());
 			vkFreeMemory(NativeDevice(), m_DeviceMem, nullptr);
+			MemoryTracker::Track(EMemoryTag::Render, -(int64)m_MemAllocInfo.allocationSize);
 			m_DeviceMem = VK_NULL_HANDLE;
 		}
 	}
@@ -492,7 +495,7 @@ protected:
 		m_MemAllocInfo.allocationSize = m_MemReq.size;
 		m_Device->FindMemoryType(m_MemReq.memoryTypeBits, m_MemoryBits, &m_MemAllocInfo.memoryTypeIndex);
 		K3D_VK_VERIFY(vkAllocateMemory(NativeDevice(), &m_MemAllocInfo, nullptr, &m_DeviceMem));
-		m_MemAllocInfo.allocationSize;
+		MemoryTracker::Track(EMemoryTag::Render, (int64)m_MemAllocInfo.allocationSize);
 
 		/*K3D_VK_VERIFY(vkBindBufferMemory(NativeDevice(), m_Buffer, m_DeviceMem, m_AllocationOffset));*/
 	}
@@ -664,7 +667,7 @@ private:
 	using Mutex = Os::Mutex;
 	Mutex m_PoolMutex;
 	Mutex m_ContextMutex;
-	std::unordered_map<uint32, PtrCmdAlloc> m_AllocatorPool;
+	k3d::HashMap<uint32, PtrCmdAlloc> m_AllocatorPool;
 	std::unordered_map<uint32, std::list<CommandContext*> > m_ContextList;
 };
 /**
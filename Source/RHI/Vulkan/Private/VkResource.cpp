@@ -319,6 +319,7 @@ ResourceManager::Pool<VkObject>::Create(VkDevice device, const VkDeviceSize pool
 	VkDeviceMemory memory = VK_NULL_HANDLE;
 	VkResult res = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
 	if (VK_SUCCESS == res) {
+		MemoryTracker::Track(EMemoryTag::Render, (int64)poolSize);
 		result = std::unique_ptr< ResourceManager::Pool<VkObject> >(new ResourceManager::Pool<VkObject>(memoryTypeIndex, memory, poolSize));
 	}
 	return result;
@@ -355,6 +356,7 @@ void ResourceManager::PoolManager<VkObjectT>::Destroy()
 	::Os::Mutex::AutoLock lock(&m_Mutex);
 	for (auto& pool : m_Pools) {
 		vkFreeMemory(GetRawDevice(), pool->m_Memory, nullptr);
+		MemoryTracker::Track(EMemoryTag::Render, -(int64)pool->m_Size);
 	}
 	m_Pools.clear();
 }
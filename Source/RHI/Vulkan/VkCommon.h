@@ -21,9 +21,10 @@ typedef void (*PFN_vklogCallBack)(k3d::ELogLevel const&, const char * tag, const
 extern void VkLog(k3d::ELogLevel const&, const char * tag, const char * fmt, ...);
 extern void SetVkLogCallback(PFN_vklogCallBack func);
 
-#define VKLOG(level, ...) VkLog(::k3d::ELogLevel::level, "kaleido3d::VulkanRHI", __VA_ARGS__)
+#define VKLOG(level, ...) K3D_LOG_SITE(VkLog, level, "kaleido3d::VulkanRHI", Always(), __VA_ARGS__)
 
-#define VKRHI_METHOD_TRACE VKLOG(Info, __K3D_FUNC__);
+/// Debug, compiled out of release builds
+#define VKRHI_METHOD_TRACE VKLOG(Debug, __K3D_FUNC__);
 
 #define K3D_VK_VERIFY(expr) \
 	do { \
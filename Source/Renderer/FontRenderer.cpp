@@ -52,7 +52,7 @@ namespace render
 
 	unsigned int* GlyphTexture(const FT_Bitmap& bitmap, const unsigned int& color)
 	{
-		unsigned int* buffer = new unsigned int[bitmap.width * bitmap.rows * 4];
+		unsigned int* buffer = (unsigned int*)::k3d::FrameArena::Allocate(bitmap.width * bitmap.rows * 4 * sizeof(unsigned int));
 		for (int y = 0; y< bitmap.rows; y++)
 		{
 			for (int x = 0; x < bitmap.width; x++)
@@ -72,6 +72,7 @@ namespace render
 			return TextQuads();
 		FT_Face face = (FT_Face)m_pFontFace;
 		TextQuads quadlist;
+		quadlist.Reserve((uint32)text.Length());
 		for (unsigned int i = 0; i < text.Length(); i++) 
 		{
 			FT_Load_Char(face, text[i], FT_LOAD_RENDER | FT_LOAD_NO_HINTING);
@@ -192,7 +193,7 @@ namespace render
 	void FontRenderer::DrawText2D(rhi::CommandContextRef const & cmd, const::k3d::String & text, float x, float y)
 	{
 		auto quads = m_FontManager.AcquireText(text);
-		for (auto quad : quads)
+		for (auto const& quad : quads)
 		{
 			CharTexture * tex = new CharTexture(m_Device, quad);
 		}
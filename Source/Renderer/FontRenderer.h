@@ -1,10 +1,9 @@
 #pragma once
 #include <KTL/DynArray.hpp>
 #include <KTL/String.hpp>
+#include <KTL/HashMap.hpp>
 #include <Interface/IRHI.h>
 
-#include <unordered_map>
-
 namespace render
 {
 	class TextQuad
@@ -18,7 +17,9 @@ namespace render
 		unsigned int* Pixels;
 	};
 
-	typedef ::k3d::DynArray<TextQuad> TextQuads;
+	/// Quads and their pixels live in the frame arena, consume them
+	/// (e.g. upload to CharTexture) within FramesInFlight frames.
+	typedef ::k3d::DynArray<TextQuad, ::k3d::FrameAllocator> TextQuads;
 
 	class K3D_API FontManager
 	{
@@ -80,6 +81,6 @@ namespace render
 		rhi::DeviceRef							m_Device;
 		rhi::PipelineStateObjectRef				m_TextRenderPSO;
 		FontManager								m_FontManager;
-		std::unordered_map<char, CharTexture>	m_TexCache;
+		::k3d::HashMap<char, CharTexture>		m_TexCache;
 	};
 }
\ No newline at end of file
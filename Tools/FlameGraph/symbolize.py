@@ -0,0 +1,51 @@
+import re
+import subprocess
+import sys
+
+# Names the module+0xoffset frames of Sampler folded stacks with addr2line,
+# for functions dladdr cannot see (static, hidden or in the executable).
+#   python symbolize.py profile.folded > named.folded
+#   flamegraph.pl named.folded > profile.svg
+
+FRAME = re.compile(r'^(.+)\+0x([0-9a-fA-F]+)$')
+
+def resolve(module, offsets):
+	try:
+		out = subprocess.check_output(['addr2line', '-f', '-C', '-e', module] + offsets)
+	except (OSError, subprocess.CalledProcessError):
+		return {}
+	lines = out.decode('utf-8', 'replace').splitlines()
+	names = {}
+	for index in range(0, len(offsets)):
+		name = lines[index * 2] if index * 2 < len(lines) else '??'
+		if name != '??':
+			names[module + '+' + offsets[index]] = name
+	return names
+
+def symbolize(src_file):
+	stacks = []
+	modules = {}
+	with open(src_file, 'r') as source:
+		for line in source:
+			stack, _, count = line.rstrip('\n').rpartition(' ')
+			frames = stack.split(';')
+			for frame in frames:
+				match = FRAME.match(frame)
+				if match:
+					modules.setdefault(match.group(1), set()).add('0x' + match.group(2))
+			stacks.append((frames, int(count)))
+	names = {}
+	for module in modules:
+		names.update(resolve(module, sorted(modules[module])))
+	folded = {}
+	for frames, count in stacks:
+		stack = ';'.join([names.get(frame, frame) for frame in frames])
+		folded[stack] = folded.get(stack, 0) + count
+	for stack in sorted(folded):
+		sys.stdout.write('%s %d\n' % (stack, folded[stack]))
+
+if __name__ == '__main__':
+	if len(sys.argv) != 2:
+		sys.stderr.write('usage: symbolize.py profile.folded\n')
+		sys.exit(1)
+	symbolize(sys.argv[1])
@@ -80,6 +80,148 @@ $(function () {
         }
     });
 
+    var formatBytes = function (bytes) {
+        var sign = bytes < 0 ? '-' : '';
+        bytes = Math.abs(bytes);
+        if (bytes >= 1048576) return sign + (bytes / 1048576).toFixed(2) + ' MB';
+        if (bytes >= 1024) return sign + (bytes / 1024).toFixed(1) + ' KB';
+        return sign + bytes + ' B';
+    };
+
+    // MemoryTracker::Publish sends one MemSnapshot followed by its MemSamples
+    var onProfile = function (tag, payload) {
+        var memory = $("#memory");
+        if (tag == "MemSnapshot") {
+            var rows = '<table><tr><th>Tag</th><th>Live</th><th>Count</th><th>Peak</th><th>Delta</th></tr>';
+            payload.Tags.forEach(function (t) {
+                rows += '<tr><td>' + t.Name + '</td><td>' + formatBytes(t.LiveBytes) + '</td><td>' + t.LiveCount +
+                    '</td><td>' + formatBytes(t.PeakBytes) + '</td><td>' + formatBytes(t.DeltaBytes) + '</td></tr>';
+            });
+            rows += '</table>';
+            memory.html('<p>Frame ' + payload.Frame + '</p>' + rows + '<div id="memsamples"></div>');
+        } else if (tag == "MemSample") {
+            $("#memsamples").append('<p><span style="color:orange;">' + payload.Tag + ' ' + formatBytes(payload.Bytes) +
+                ' in ' + payload.Count + ' blocks</span><br/>' + payload.Stack.join('<br/>') + '</p>');
+        } else if (tag == "ProfileFrame") {
+            drawTimeline();
+            timeline = { Frame: payload.Frame, Duration: payload.Duration, Threads: payload.Threads, Zones: {} };
+        } else if (tag == "ProfileZones") {
+            if (timeline && timeline.Frame == payload.Frame) {
+                timeline.Zones[payload.Thread] = (timeline.Zones[payload.Thread] || []).concat(payload.Zones);
+            }
+        } else if (tag == "FrameStats") {
+            var ms = function (us) { return (us / 1000).toFixed(2); };
+            var stats = '<table><tr><th></th><th>Count</th><th>Mean</th><th>P50</th><th>P95</th><th>P99</th><th>Max</th></tr>';
+            payload.Window.forEach(function (s) {
+                stats += '<tr><td>' + s.Name + '</td><td>' + s.Count + '</td><td>' + ms(s.Mean) + '</td><td>' + ms(s.P50) +
+                    '</td><td>' + ms(s.P95) + '</td><td>' + ms(s.P99) + '</td><td>' + ms(s.Max) + '</td></tr>';
+            });
+            stats += '</table>';
+            var budget = '';
+            if (payload.Budget.Percentile > 0) {
+                budget = ' <span style="color:' + (payload.Budget.Met ? 'lime' : 'red') + ';">P' + payload.Budget.Percentile +
+                    ' budget ' + ms(payload.Budget.Target) + ' ms</span>';
+            }
+            $("#framestats").html('<p>Frame ' + payload.Frame + ', ' + payload.Hitches + ' hitches' + budget + '</p>' + stats);
+        }
+    };
+
+    // Profiler::SetStreaming sends a ProfileFrame, then the ProfileZones of
+    // every thread ([name, begin us, duration us, depth]). A frame is drawn
+    // once the next one starts.
+    var timeline = null;
+    var drawTimeline = function () {
+        var canvas = document.getElementById("timeline");
+        if (!timeline || !canvas) {
+            return;
+        }
+        var rowHeight = 14, depthHeight = 12, labelWidth = 90;
+        var rows = timeline.Threads.map(function (thread) {
+            var zones = timeline.Zones[thread] || [];
+            var depth = zones.reduce(function (d, z) { return Math.max(d, z[3] + 1); }, 1);
+            return { Thread: thread, Zones: zones, Height: depth * depthHeight + 4 };
+        });
+        canvas.width = canvas.parentNode.clientWidth;
+        canvas.height = rows.reduce(function (h, r) { return h + r.Height; }, rowHeight + 4);
+        var ctx = canvas.getContext("2d");
+        var scale = (canvas.width - labelWidth) / Math.max(timeline.Duration, 1);
+        ctx.font = "10px monospace";
+        ctx.fillStyle = "#aaa";
+        ctx.fillText("Frame " + timeline.Frame + "  " + (timeline.Duration / 1000).toFixed(2) + " ms", 2, 10);
+        var y = rowHeight + 4;
+        rows.forEach(function (row) {
+            ctx.fillStyle = "#aaa";
+            ctx.fillText(row.Thread.substr(0, 14), 2, y + 10);
+            row.Zones.forEach(function (z) {
+                var x = labelWidth + Math.max(z[1], 0) * scale;
+                var w = Math.max((z[2] + Math.min(z[1], 0)) * scale, 1);
+                ctx.fillStyle = "hsl(" + (z[0].length * 37 % 360) + ",60%,45%)";
+                ctx.fillRect(x, y + z[3] * depthHeight, w, depthHeight - 1);
+                if (w > 40) {
+                    ctx.fillStyle = "#fff";
+                    ctx.fillText(z[0].substr(0, Math.floor(w / 6)), x + 2, y + z[3] * depthHeight + 9);
+                }
+            });
+            y += row.Height;
+        });
+    };
+
+    $.jsPanel({
+        headerTitle: "Memory",
+        theme: "green",
+        headerControls: {
+            close: 'remove'
+        },
+        position: {
+            right:  10,
+            top:    10
+        },
+        content: "",
+        callback: function () {
+            this.content.attr("id", "memory");
+            this.content.css("color", "#aaa");
+            this.content.css("background-color", "#000");
+            this.content.css("overflow", "auto");
+        }
+    });
+
+    $.jsPanel({
+        headerTitle: "Profiler",
+        theme: "orange",
+        headerControls: {
+            close: 'remove'
+        },
+        position: {
+            right:  10,
+            bottom: 10
+        },
+        content: '<canvas id="timeline"></canvas>',
+        callback: function () {
+            this.content.css("background-color", "#000");
+            this.content.css("overflow", "auto");
+        }
+    });
+
+    // FrameStats::Publish, times of the rolling window in ms
+    $.jsPanel({
+        headerTitle: "Frame Stats",
+        theme: "yellow",
+        headerControls: {
+            close: 'remove'
+        },
+        position: {
+            left:   10,
+            top:    10
+        },
+        content: "",
+        callback: function () {
+            this.content.attr("id", "framestats");
+            this.content.css("color", "#aaa");
+            this.content.css("background-color", "#000");
+            this.content.css("overflow", "auto");
+        }
+    });
+
     $.jsPanel({
         headerTitle: "Logcat",
         theme: "blue",
@@ -128,10 +270,15 @@ $(function () {
           var ELogWarn = 3;
           var ELogError = 4;
           var ELogFatal = 5;
+          var ELogProfile = 6;
           // most important part - incoming messages
           connection.onmessage = function (message) {
             try {
               logitem = JSON.parse(message.data);
+              if (logitem.LogLevel == ELogProfile) {
+                onProfile(logitem.Tag, JSON.parse(logitem.Log));
+                return;
+              }
               var color = 'white';
               switch (logitem.LogLevel) {
                 case ELogFatal: